@@ -0,0 +1,625 @@
+/*
+ * jimbench - Benchmarks for the Jim interpreter
+ *
+ * Micro benchmarks time a single operation on a hot path of the core
+ * (command dispatch, expressions, variables, lists, dicts, glob matching,
+ * regexp, format and aio gets), driven through the C API. Macro benchmarks
+ * are the scripts in the macro directory: each one defines a proc [bench]
+ * that is timed as a whole, and may define [cleanup].
+ *
+ * Every benchmark is warmed up, then timed over a number of repetitions.
+ * A summary is printed, and with --json the samples and statistics are
+ * written out so that builds can be compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "jim.h"
+
+using namespace Jim;
+
+struct BenchOptions {
+    int reps = 10;               /* Timed repetitions of each benchmark */
+    int warmup = 1;              /* Untimed repetitions before those */
+    double minTimeMs = 20;       /* Micro benchmarks repeat the operation for at least this long */ // #MagicNum
+    const char *filter = NULL;   /* Only run benchmarks whose name contains this */
+    const char *jsonFile = NULL; /* Where to write the results, "-" for stdout */
+    const char *scriptDir = "macro";
+    bool list = false;
+};
+
+struct BenchResult {
+    std::string name;
+    const char *kind;
+    long iterations;             /* Operations per sample */
+    std::vector<double> samples; /* Nanoseconds per operation */
+    double min, max, median, mean, stddev;
+};
+
+/* Objects a micro benchmark works on, released by the runner */
+enum { BENCH_MAX_OBJS = 6 }; // #MagicNum
+
+struct BenchCtx {
+    Jim_InterpPtr interp;
+    Jim_ObjPtr obj[BENCH_MAX_OBJS];
+};
+
+struct MicroBench {
+    const char *name;
+    const char *setupScript;    /* Evaluated in the new interpreter first. May be NULL */
+    const char *cleanupScript;  /* Evaluated once the benchmark is done. May be NULL */
+    void (*setup)(BenchCtx *ctx);
+    Retval (*op)(BenchCtx *ctx, long i);
+};
+
+static double BenchNow(void)
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Jim_ObjPtr BenchKeep(BenchCtx *ctx, int slot, Jim_ObjPtr objPtr)
+{
+    Jim_IncrRefCount(objPtr);
+    ctx->obj[slot] = objPtr;
+    return objPtr;
+}
+
+static Jim_ObjPtr BenchKeepStr(BenchCtx *ctx, int slot, const char *str)
+{
+    return BenchKeep(ctx, slot, Jim_NewStringObj(ctx->interp, str, -1));
+}
+
+/* ---------------------------------------------------------------------------
+ * Micro benchmarks
+ * -------------------------------------------------------------------------*/
+
+static void SetupDispatch(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "incr");
+    BenchKeepStr(ctx, 1, "x");
+}
+
+static void SetupDispatchProc(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "nop");
+    BenchKeep(ctx, 1, Jim_NewIntObj(ctx->interp, 1));
+}
+
+static Retval OpDispatch(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_EvalObjVector(ctx->interp, 2, ctx->obj);
+}
+
+static void SetupExpr(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "$x * 2 + $y < 1000 && $x != 3");
+}
+
+static Retval OpExpr(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_EvalExpression(ctx->interp, ctx->obj[0]);
+}
+
+static void SetupVar(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "x");
+    BenchKeep(ctx, 1, Jim_NewIntObj(ctx->interp, 42)); // #MagicNum
+}
+
+static Retval OpVarGet(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_GetVariable(ctx->interp, ctx->obj[0], JIM_ERRMSG) ? JIM_OK : JIM_ERR;
+}
+
+static Retval OpVarSet(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_SetVariable(ctx->interp, ctx->obj[0], ctx->obj[1]);
+}
+
+enum { BENCH_COLLECTION_SIZE = 1000 }; // #MagicNum
+
+static void SetupList(BenchCtx *ctx)
+{
+    Jim_ObjPtr listObj = BenchKeep(ctx, 0, Jim_NewListObj(ctx->interp, NULL, 0));
+    int i;
+
+    for (i = 0; i < BENCH_COLLECTION_SIZE; i++) {
+        Jim_ListAppendElement(ctx->interp, listObj, Jim_NewIntObj(ctx->interp, i));
+    }
+    BenchKeep(ctx, 1, Jim_NewIntObj(ctx->interp, 1));
+}
+
+static Retval OpListIndex(BenchCtx *ctx, long i)
+{
+    Jim_ObjPtr objPtr;
+
+    return Jim_ListIndex(ctx->interp, ctx->obj[0], CAST(int)(i % BENCH_COLLECTION_SIZE), &objPtr, JIM_ERRMSG);
+}
+
+/* One operation builds a list of BENCH_COLLECTION_SIZE elements */
+static Retval OpListAppend(BenchCtx *ctx, long i)
+{
+    Jim_ObjPtr listObj = Jim_NewListObj(ctx->interp, NULL, 0);
+    int j;
+
+    JIM_NOTUSED(i);
+    Jim_IncrRefCount(listObj);
+    for (j = 0; j < BENCH_COLLECTION_SIZE; j++) {
+        Jim_ListAppendElement(ctx->interp, listObj, ctx->obj[1]);
+    }
+    Jim_DecrRefCount(ctx->interp, listObj);
+    return JIM_OK;
+}
+
+static void SetupDict(BenchCtx *ctx)
+{
+    Jim_ObjPtr dictObj = BenchKeep(ctx, 0, Jim_NewDictObj(ctx->interp, NULL, 0));
+    Jim_ObjPtr keysObj = BenchKeep(ctx, 1, Jim_NewListObj(ctx->interp, NULL, 0));
+    int i;
+
+    for (i = 0; i < BENCH_COLLECTION_SIZE; i++) {
+        char buf[32]; // #MagicNum
+        Jim_ObjPtr keyObj;
+
+        snprintf(buf, sizeof(buf), "key%d", i);
+        keyObj = Jim_NewStringObj(ctx->interp, buf, -1);
+        Jim_ListAppendElement(ctx->interp, keysObj, keyObj);
+        IGNORERET Jim_DictAddElement(ctx->interp, dictObj, keyObj, Jim_NewIntObj(ctx->interp, i));
+    }
+    BenchKeep(ctx, 2, Jim_NewIntObj(ctx->interp, 1));
+}
+
+static Retval OpDictGet(BenchCtx *ctx, long i)
+{
+    Jim_ObjPtr objPtr;
+    Jim_ObjPtr keyObj = Jim_ListGetIndex(ctx->interp, ctx->obj[1], CAST(int)(i % BENCH_COLLECTION_SIZE));
+
+    return Jim_DictKey(ctx->interp, ctx->obj[0], keyObj, &objPtr, JIM_ERRMSG);
+}
+
+static Retval OpDictSet(BenchCtx *ctx, long i)
+{
+    Jim_ObjPtr keyObj = Jim_ListGetIndex(ctx->interp, ctx->obj[1], CAST(int)(i % BENCH_COLLECTION_SIZE));
+
+    return Jim_DictAddElement(ctx->interp, ctx->obj[0], keyObj, ctx->obj[2]);
+}
+
+static void SetupGlob(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "*foo*b?r*[0-9]");
+    BenchKeepStr(ctx, 1, "some/long/prefix/with/foo/in/it/and/a/bar/after/it/version7");
+}
+
+static Retval OpGlob(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_StringMatchObj(ctx->interp, ctx->obj[0], ctx->obj[1], 0) ? JIM_OK : JIM_ERR;
+}
+
+static void SetupRegexp(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "regexp");
+    BenchKeepStr(ctx, 1, "^([a-z]+)=([0-9]+)(;.*)?$");
+    BenchKeepStr(ctx, 2, "timeout=12345;retry=3");
+}
+
+static Retval OpRegexp(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_EvalObjVector(ctx->interp, 3, ctx->obj);
+}
+
+static void SetupFormat(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "%s=%d (%.2f) %-10s|%x");
+    BenchKeepStr(ctx, 1, "name");
+    BenchKeep(ctx, 2, Jim_NewIntObj(ctx->interp, 42)); // #MagicNum
+    BenchKeep(ctx, 3, Jim_NewDoubleObj(ctx->interp, 3.14159)); // #MagicNum
+    BenchKeepStr(ctx, 4, "padded");
+    BenchKeep(ctx, 5, Jim_NewIntObj(ctx->interp, 0xbeef)); // #MagicNum
+}
+
+static Retval OpFormat(BenchCtx *ctx, long i)
+{
+    Jim_ObjPtr objPtr = Jim_FormatString(ctx->interp, ctx->obj[0], 5, ctx->obj + 1); // #MagicNum
+
+    JIM_NOTUSED(i);
+    if (objPtr == NULL)
+        return JIM_ERR;
+    Jim_IncrRefCount(objPtr);
+    Jim_DecrRefCount(ctx->interp, objPtr);
+    return JIM_OK;
+}
+
+static void SetupGets(BenchCtx *ctx)
+{
+    BenchKeepStr(ctx, 0, "if {[gets $f line] < 0} {seek $f 0}");
+}
+
+static Retval OpEval(BenchCtx *ctx, long i)
+{
+    JIM_NOTUSED(i);
+    return Jim_EvalObj(ctx->interp, ctx->obj[0]);
+}
+
+static const MicroBench g_microBenchs[] = {
+    { "dispatch", "set x 0", NULL, SetupDispatch, OpDispatch },
+    { "dispatch-proc", "proc nop {a} {return $a}", NULL, SetupDispatchProc, OpDispatch },
+    { "expr", "set x 5; set y 7", NULL, SetupExpr, OpExpr },
+    { "var-get", "set x 1", NULL, SetupVar, OpVarGet },
+    { "var-set", NULL, NULL, SetupVar, OpVarSet },
+    { "list-index", NULL, NULL, SetupList, OpListIndex },
+    { "list-append-1k", NULL, NULL, SetupList, OpListAppend },
+    { "dict-get", NULL, NULL, SetupDict, OpDictGet },
+    { "dict-set", NULL, NULL, SetupDict, OpDictSet },
+    { "glob-match", NULL, NULL, SetupGlob, OpGlob },
+    { "regexp", NULL, NULL, SetupRegexp, OpRegexp },
+    { "format", NULL, NULL, SetupFormat, OpFormat },
+    { "aio-gets",
+        "set name [file tempfile]\n"
+        "set f [open $name w]\n"
+        "for {set i 0} {$i < 10000} {incr i} {puts $f \"line $i of the benchmark input\"}\n"
+        "close $f\n"
+        "set f [open $name]",
+        "close $f; file delete $name",
+        SetupGets, OpEval },
+};
+
+/* ---------------------------------------------------------------------------
+ * Runner
+ * -------------------------------------------------------------------------*/
+
+static Jim_InterpPtr BenchNewInterp(void)
+{
+    Jim_InterpPtr interp = Jim_CreateInterp();
+
+    Jim_RegisterCoreCommands(interp);
+    IGNORERET Jim_InitStaticExtensions(interp);
+    return interp;
+}
+
+static void BenchError(Jim_InterpPtr interp, const char *name)
+{
+    Jim_MakeErrorMessage(interp);
+    fprintf(stderr, "%s: %s\n", name, Jim_String(Jim_GetResult(interp)));
+}
+
+static bool BenchSelected(const BenchOptions &opts, const std::string &name)
+{
+    return opts.filter == NULL || strstr(name.c_str(), opts.filter) != NULL;
+}
+
+static void BenchSummarize(BenchResult &res)
+{
+    std::vector<double> sorted = res.samples;
+    size_t n = sorted.size();
+    double sum = 0, sq = 0;
+
+    std::sort(sorted.begin(), sorted.end());
+    res.min = sorted[0];
+    res.max = sorted[n - 1];
+    res.median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    for (double s : sorted) {
+        sum += s;
+    }
+    res.mean = sum / n;
+    for (double s : sorted) {
+        sq += (s - res.mean) * (s - res.mean);
+    }
+    res.stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+}
+
+/* Times 'iterations' calls of the operation. Returns ns per call, or -1 on error. */
+static double BenchMicroSample(const MicroBench &bench, BenchCtx *ctx, long iterations)
+{
+    double start = BenchNow();
+    long i;
+
+    for (i = 0; i < iterations; i++) {
+        if (bench.op(ctx, i) != JIM_OK)
+            return -1;
+    }
+    return (BenchNow() - start) / iterations;
+}
+
+static bool BenchRunMicro(const BenchOptions &opts, const MicroBench &bench, BenchResult &res)
+{
+    BenchCtx ctx;
+    bool ok = false;
+    long iterations = 1;
+    double ns;
+    int i;
+
+    ctx.interp = BenchNewInterp();
+    for (i = 0; i < BENCH_MAX_OBJS; i++) {
+        ctx.obj[i] = NULL;
+    }
+    res.name = bench.name;
+    res.kind = "micro";
+
+    if (bench.setupScript && Jim_Eval(ctx.interp, bench.setupScript) != JIM_OK) {
+        BenchError(ctx.interp, bench.name);
+        goto done;
+    }
+    bench.setup(&ctx);
+
+    /* Find how many operations take minTimeMs. This warms up too. */
+    while ((ns = BenchMicroSample(bench, &ctx, iterations)) >= 0 &&
+        ns * iterations < opts.minTimeMs * 1e6) { // #MagicNum
+        iterations *= 2;
+    }
+    for (i = 0; ns >= 0 && i < opts.warmup; i++) {
+        ns = BenchMicroSample(bench, &ctx, iterations);
+    }
+    for (i = 0; ns >= 0 && i < opts.reps; i++) {
+        ns = BenchMicroSample(bench, &ctx, iterations);
+        res.samples.push_back(ns);
+    }
+    if (ns < 0) {
+        BenchError(ctx.interp, bench.name);
+        goto done;
+    }
+    res.iterations = iterations;
+    ok = true;
+
+  done:
+    for (i = 0; i < BENCH_MAX_OBJS; i++) {
+        if (ctx.obj[i]) {
+            Jim_DecrRefCount(ctx.interp, ctx.obj[i]);
+        }
+    }
+    if (bench.cleanupScript && Jim_Eval(ctx.interp, bench.cleanupScript) != JIM_OK) {
+        BenchError(ctx.interp, bench.name);
+    }
+    Jim_FreeInterp(ctx.interp);
+    return ok;
+}
+
+static bool BenchRunMacro(const BenchOptions &opts, const char *script, const std::string &name, BenchResult &res)
+{
+    Jim_InterpPtr interp = BenchNewInterp();
+    Jim_ObjPtr benchObj = Jim_NewStringObj(interp, "bench", -1);
+    bool ok = false;
+    int i;
+
+    Jim_IncrRefCount(benchObj);
+    res.name = name;
+    res.kind = "macro";
+    res.iterations = 1;
+
+    if (Jim_EvalFile(interp, script) != JIM_OK) {
+        goto done;
+    }
+    for (i = 0; i < opts.warmup; i++) {
+        if (Jim_EvalObjVector(interp, 1, &benchObj) != JIM_OK)
+            goto done;
+    }
+    for (i = 0; i < opts.reps; i++) {
+        double start = BenchNow();
+
+        if (Jim_EvalObjVector(interp, 1, &benchObj) != JIM_OK)
+            goto done;
+        res.samples.push_back(BenchNow() - start);
+    }
+    ok = true;
+
+  done:
+    if (!ok) {
+        BenchError(interp, name.c_str());
+    }
+    if (Jim_Eval(interp, "if {[info procs cleanup] ne {}} cleanup") != JIM_OK) {
+        BenchError(interp, name.c_str());
+    }
+    Jim_DecrRefCount(interp, benchObj);
+    Jim_FreeInterp(interp);
+    return ok;
+}
+
+/* Returns the sorted paths of the macro benchmark scripts */
+static std::vector<std::string> BenchScripts(const char *dir)
+{
+    std::vector<std::string> scripts;
+    Jim_InterpPtr interp = BenchNewInterp();
+    Jim_ObjPtr dirObj = Jim_NewStringObj(interp, dir, -1);
+
+    if (Jim_SetVariableStr(interp, "dir", dirObj) == JIM_OK &&
+        Jim_Eval(interp, "lsort [glob -nocomplain -directory $dir *.tcl]") == JIM_OK) {
+        Jim_ObjPtr listObj = Jim_GetResult(interp);
+        int i;
+
+        for (i = 0; i < Jim_ListLength(interp, listObj); i++) {
+            scripts.push_back(Jim_String(Jim_ListGetIndex(interp, listObj, i)));
+        }
+    }
+    Jim_FreeInterp(interp);
+    return scripts;
+}
+
+static std::string BenchScriptName(const std::string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    return "script-" + name.substr(0, name.rfind(".tcl"));
+}
+
+static void BenchPrint(FILE *fp, const BenchResult &res)
+{
+    /* Macro benchmarks are shown in ms, micro ones in ns per operation */
+    bool macro = strcmp(res.kind, "macro") == 0;
+    double scale = macro ? 1e-6 : 1; // #MagicNum
+
+    fprintf(fp, "%-24s %12.3f %12.3f %12.3f %7.1f%% %10ld %s\n", res.name.c_str(),
+        res.median * scale, res.min * scale, res.max * scale,
+        res.mean > 0 ? 100 * res.stddev / res.mean : 0, // #MagicNum
+        res.iterations, macro ? "ms" : "ns/op");
+}
+
+static void BenchWriteJson(const BenchOptions &opts, const std::vector<BenchResult> &results, FILE *fp)
+{
+    Jim_InterpPtr interp = BenchNewInterp();
+    char stamp[32]; // #MagicNum
+    time_t now = time(NULL);
+    size_t r, i;
+
+    IGNORERET Jim_Eval(interp, "info patchlevel");
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", Jim_String(Jim_GetResult(interp)));
+#ifdef NDEBUG // #optionalCode
+    fprintf(fp, "  \"build\": \"release\",\n");
+#else
+    fprintf(fp, "  \"build\": \"debug\",\n");
+#endif
+    fprintf(fp, "  \"timestamp\": \"%s\",\n", stamp);
+    fprintf(fp, "  \"reps\": %d,\n  \"warmup\": %d,\n  \"min_time_ms\": %g,\n",
+        opts.reps, opts.warmup, opts.minTimeMs);
+    fprintf(fp, "  \"benchmarks\": [\n");
+    for (r = 0; r < results.size(); r++) {
+        const BenchResult &res = results[r];
+
+        /* Benchmark names are plain identifiers, no escaping needed */
+        fprintf(fp, "    {\"name\": \"%s\", \"kind\": \"%s\", \"unit\": \"ns\", \"iterations\": %ld,\n",
+            res.name.c_str(), res.kind, res.iterations);
+        fprintf(fp, "     \"min\": %.3f, \"max\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f,\n",
+            res.min, res.max, res.median, res.mean, res.stddev);
+        fprintf(fp, "     \"samples\": [");
+        for (i = 0; i < res.samples.size(); i++) {
+            fprintf(fp, "%s%.3f", i ? ", " : "", res.samples[i]);
+        }
+        fprintf(fp, "]}%s\n", r + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    Jim_FreeInterp(interp);
+}
+
+static void BenchUsage(const char *executable_name)
+{
+    printf("Usage: %s [options]\n", executable_name);
+    printf("\n");
+    printf("Options:\n");
+    printf("      --reps N        : timed repetitions of each benchmark (default 10)\n");
+    printf("      --warmup N      : untimed repetitions first (default 1)\n");
+    printf("      --min-time MS   : minimum time of one micro benchmark sample (default 20)\n");
+    printf("      --filter TEXT   : only run the benchmarks whose name contains TEXT\n");
+    printf("      --scripts DIR   : directory of the macro benchmark scripts (default macro)\n");
+    printf("      --json FILE     : write the results as JSON to FILE, or stdout if \"-\"\n");
+    printf("      --list          : list the benchmarks and exit\n");
+    printf("      --help          : prints this text\n");
+}
+
+int main(int argc, char *const argv[])
+{
+    BenchOptions opts;
+    std::vector<BenchResult> results;
+    std::vector<std::string> scripts;
+    FILE *out;
+    int failed = 0;
+    int i;
+    size_t s;
+
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--list") == 0) {
+            opts.list = true;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || value == NULL) {
+            BenchUsage(argv[0]);
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+        if (strcmp(arg, "--reps") == 0)
+            opts.reps = std::max(1, atoi(value));
+        else if (strcmp(arg, "--warmup") == 0)
+            opts.warmup = std::max(0, atoi(value));
+        else if (strcmp(arg, "--min-time") == 0)
+            opts.minTimeMs = std::max(0.0, atof(value));
+        else if (strcmp(arg, "--filter") == 0)
+            opts.filter = value;
+        else if (strcmp(arg, "--scripts") == 0)
+            opts.scriptDir = value;
+        else if (strcmp(arg, "--json") == 0)
+            opts.jsonFile = value;
+        else {
+            BenchUsage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    scripts = BenchScripts(opts.scriptDir);
+    if (opts.list) {
+        for (const MicroBench &bench : g_microBenchs) {
+            if (BenchSelected(opts, bench.name))
+                printf("%s\n", bench.name);
+        }
+        for (s = 0; s < scripts.size(); s++) {
+            if (BenchSelected(opts, BenchScriptName(scripts[s])))
+                printf("%s\n", BenchScriptName(scripts[s]).c_str());
+        }
+        return 0;
+    }
+
+    /* The summary goes to stderr when the JSON goes to stdout */
+    out = opts.jsonFile && strcmp(opts.jsonFile, "-") == 0 ? stderr : stdout;
+    fprintf(out, "%-24s %12s %12s %12s %8s %10s\n", "benchmark", "median", "min", "max", "stddev", "iters");
+    for (const MicroBench &bench : g_microBenchs) {
+        BenchResult res;
+
+        if (!BenchSelected(opts, bench.name))
+            continue;
+        if (BenchRunMicro(opts, bench, res)) {
+            BenchSummarize(res);
+            BenchPrint(out, res);
+            results.push_back(res);
+        }
+        else {
+            failed++;
+        }
+    }
+    for (s = 0; s < scripts.size(); s++) {
+        BenchResult res;
+        std::string name = BenchScriptName(scripts[s]);
+
+        if (!BenchSelected(opts, name))
+            continue;
+        if (BenchRunMacro(opts, scripts[s].c_str(), name, res)) {
+            BenchSummarize(res);
+            BenchPrint(out, res);
+            results.push_back(res);
+        }
+        else {
+            failed++;
+        }
+    }
+
+    if (opts.jsonFile) {
+        FILE *fp = strcmp(opts.jsonFile, "-") == 0 ? stdout : fopen(opts.jsonFile, "w");
+
+        if (fp == NULL) {
+            fprintf(stderr, "Can't write %s\n", opts.jsonFile);
+            return 1;
+        }
+        BenchWriteJson(opts, results, fp);
+        if (fp != stdout) {
+            fclose(fp);
+        }
+    }
+    return failed ? 1 : 0;
+}
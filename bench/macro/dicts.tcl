@@ -0,0 +1,19 @@
+# Dicts and arrays: set, get, incr and iteration
+
+proc bench {} {
+	set d {}
+	for {set i 0} {$i < 20000} {incr i} {
+		dict set d key$i $i
+		set a(key$i) $i
+	}
+	set sum 0
+	for {set i 0} {$i < 20000} {incr i} {
+		incr sum [dict get $d key$i]
+		incr sum $a(key$i)
+		dict incr d key$i
+	}
+	dict for {k v} $d {
+		incr sum $v
+	}
+	return $sum
+}
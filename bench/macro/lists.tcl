@@ -0,0 +1,15 @@
+# List building, sorting, searching and slicing
+
+proc bench {} {
+	set l {}
+	for {set i 0} {$i < 50000} {incr i} {
+		lappend l [expr {($i * 7919) % 50000}]
+	}
+	set sorted [lsort -integer $l]
+	set squares [lmap x [lrange $sorted 0 9999] {expr {$x * $x}}]
+	set found 0
+	foreach x {17 4242 49999 123} {
+		incr found [expr {[lsearch -exact $sorted $x] >= 0}]
+	}
+	list [llength $squares] $found [llength [lrange $l 100 end-100]]
+}
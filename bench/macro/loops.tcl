@@ -0,0 +1,17 @@
+# Loops, incr and expr on locals: the compiled-script and expr paths
+
+proc bench {} {
+	set total 0
+	for {set i 0} {$i < 100000} {incr i} {
+		if {$i % 3 == 0} {
+			incr total $i
+		} else {
+			set total [expr {$total - 1}]
+		}
+	}
+	set j 0
+	while {$j < 100000} {
+		incr j
+	}
+	return $total
+}
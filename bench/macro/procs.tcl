@@ -0,0 +1,12 @@
+# Proc calls: argument binding, call frames and return
+
+proc fib {n} {
+	if {$n < 2} {
+		return $n
+	}
+	expr {[fib [expr {$n - 1}]] + [fib [expr {$n - 2}]]}
+}
+
+proc bench {} {
+	fib 20
+}
@@ -0,0 +1,26 @@
+# Reading a tab separated file line by line and splitting it,
+# as tests/perf.test does
+
+set file [file tempfile]
+set f [open $file w]
+for {set i 0} {$i < 20000} {incr i} {
+	puts $f "a\tb\tc\te\tf\tg\th\ti\tj\t$i"
+}
+close $f
+
+proc bench {} {
+	set f [open $::file]
+	set n 0
+	while {[gets $f buf] >= 0} {
+		foreach {chan datetime duration title subtitle_genre desc rating} [split $buf \t] break
+		set info(chan) $chan
+		set info(title) $title
+		incr n
+	}
+	close $f
+	return $n
+}
+
+proc cleanup {} {
+	file delete $::file
+}
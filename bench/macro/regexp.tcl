@@ -0,0 +1,13 @@
+# regexp and regsub over generated log lines
+
+proc bench {} {
+	set n 0
+	for {set i 0} {$i < 20000} {incr i} {
+		set line "2024-01-[expr {$i % 28 + 1}] host$i GET /path/$i?q=$i 200 [expr {$i * 13 % 9000}]"
+		if {[regexp {^(\S+) (\S+) (GET|POST) (\S+) ([0-9]+) ([0-9]+)$} $line -> date host method path code size]} {
+			incr n
+		}
+		regsub -all {[0-9]+} $path N path
+	}
+	return $n
+}
@@ -0,0 +1,16 @@
+# Building a report: append, format, string map and searching
+
+proc bench {} {
+	set out {}
+	for {set i 0} {$i < 5000} {incr i} {
+		append out [format "%6d %-12s %8.2f\n" $i item$i [expr {$i * 1.5}]]
+	}
+	set out [string map {item ITEM} $out]
+	set n 0
+	set pos 0
+	while {[set pos [string first ITEM1 $out $pos]] >= 0} {
+		incr n
+		incr pos
+	}
+	return $n
+}
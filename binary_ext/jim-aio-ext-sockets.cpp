@@ -208,7 +208,7 @@ static Retval aio_cmd_recvfrom(Jim_InterpPtr  interp_, int argc, Jim_ObjConstArr
 
     buf = new_CharArray(len_ + 1); // #AllocF 
 
-    rlen = prj_recvfrom(prj_fileno(af->fp), buf, len_, 0, &sa.sa, &salen); // #NonPortFuncFix
+    rlen = prj_recvfrom(af->fd, buf, len_, 0, &sa.sa, &salen); // #NonPortFuncFix
     if (rlen < 0) {
         Jim_TFree<char>(buf,"buf"); // #FreeF
         JimAioSetError(interp_, NULL);
@@ -245,7 +245,7 @@ static Retval aio_cmd_sendto(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray
     wdata = Jim_GetString(argv[0], &wlen);
 
     /* Note that we don't validate the socket tokenType_. Rely on sendto() failing if appropriate */
-    len_ = prj_sendto(prj_fileno(af->fp), wdata, wlen, 0, &sa.sa, salen); // #NonPortFuncFix #SockFunc
+    len_ = prj_sendto(af->fd, wdata, wlen, 0, &sa.sa, salen); // #NonPortFuncFix #SockFunc
     if (len_ < 0) {
         JimAioSetError(interp_, NULL);
         return JIM_ERR;
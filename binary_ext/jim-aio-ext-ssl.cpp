@@ -121,7 +121,7 @@ static Retval aio_cmd_ssl(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray arg
 
     SSL_set_cipher_list(ssl, "ALL"); // #MagicStr
 
-    if (SSL_set_fd(ssl, prj_fileno(af->fp)) == 0) {
+    if (SSL_set_fd(ssl, af->fd) == 0) {
         goto out;
     }
 
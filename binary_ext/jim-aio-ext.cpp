@@ -57,6 +57,33 @@
 
 #ifdef HAVE_UNISTD_H
 #  include <fcntl.h>
+#  include <unistd.h> // #NonPortHeader
+#endif
+
+#ifdef jim_ext_eventloop // #optionalCode #WinOff
+#  include <poll.h> // #NonPortHeader
+#endif
+
+#if defined(PRJ_OS_LINUX) // #optionalCode
+#  include <sys/stat.h>
+#  include <sys/sendfile.h> // #NonPortHeader
+#  define JIM_AIO_KERNEL_COPY
+#endif
+
+#if defined(PRJ_OS_LINUX) || defined(PRJ_OS_MACOS) // #optionalCode
+#  include <sys/stat.h>
+#  include <sys/mman.h> // #NonPortHeader
+#  include <sys/uio.h> // #NonPortHeader
+#  define JIM_AIO_MMAP
+#  define JIM_AIO_WRITEV
+#endif
+
+#if defined(PRJ_OS_LINUX) && defined(jim_ext_eventloop) // #optionalCode
+#  include <sys/syscall.h> // #NonPortHeader
+#  ifdef __NR_io_uring_setup
+#    include <linux/io_uring.h> // #NonPortHeader
+#    define JIM_AIO_URING
+#  endif
 #endif
 
 #ifdef JIM_WIDE_4BYTE
@@ -72,11 +99,17 @@ BEGIN_JIM_NAMESPACE
 
 enum {
     AIO_CMD_LEN = 32,      /* e.g. aio.handleXXXXXX */
-    AIO_BUF_LEN = 256     /* Can keep this small and rely on stdio buffering */
+    AIO_BUF_SIZE = 65536,  /* Default size of the channel read and write buffers #MagicNum */
+    AIO_BUF_MAX = 1 << 30, /* Largest [$f buffersize] #MagicNum */
+    AIO_COPY_MAX = 1 << 30,  /* Most bytes asked of one kernel copy call #MagicNum */
+    AIO_COPY_STEP = 1 << 20, /* Most bytes a background copy moves per event #MagicNum */
+    AIO_IOV_MAX = 64         /* Most pieces gathered by one writev() #MagicNum */
 };
 
 enum { AIO_KEEPOPEN = 1 };
 
+enum { AIO_BUFFER_NONE, AIO_BUFFER_LINE, AIO_BUFFER_FULL };
+
 #if defined(JIM_IPV6) // #optionalCode #WinOff
 #define IPV6 1
 #else
@@ -162,285 +195,2071 @@ static const JimAioFopsType g_stdio_fops = {
     NULL
 };
 
+/* Channels that own their descriptor read and write it directly. Buffering is done by the
+ * channel itself (see JimAioFill() and JimAioWrite()), so each call here is one system call.
+ */
+static int fd_writer(struct AioFile *af, const char *buf, int len)
+{
+    int ret;
+
+    do {
+        ret = CAST(int)prj_write(af->fd, buf, len); // #output
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        af->err = errno;
+        af->errWrite = 1;
+    }
+    return ret;
+}
 
-static int JimAioSubCmdProc(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
-static AioFile *JimMakeChannel(Jim_InterpPtr interp, FILE *fh, int fd, Jim_ObjPtr filename,
-    const char *hdlfmt, int family, const char *mode);
-
+static int fd_reader(struct AioFile *af, char *buf, int len)
+{
+    int ret;
+
+    do {
+        ret = CAST(int)prj_read(af->fd, buf, len); // #input
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        af->err = errno;
+        af->errWrite = 0;
+    }
+    return ret;
+}
 
-static const char *JimAioErrorString(AioFile *af)
+static int fd_error(const AioFile *af)
 {
-    if (af && af->fops)
-        return af->fops->strerror(af);
+    if (af->err == 0) {
+        return JIM_OK;
+    }
+    /* A non-blocking channel with nothing to read or no room to write is not an error */
+    if (af->err == EAGAIN || af->err == EINTR) {
+        return JIM_OK;
+    }
+#ifdef EWOULDBLOCK // #optionalCode
+    if (af->err == EWOULDBLOCK) {
+        return JIM_OK;
+    }
+#endif
+    /* A reset connection reads as end of file, but output to it can never be written */
+    if (af->errWrite) {
+        return JIM_ERR;
+    }
+#ifdef ECONNRESET // #optionalCode
+    if (af->err == ECONNRESET) {
+        return JIM_OK;
+    }
+#endif
+#ifdef ECONNABORTED // #optionalCode
+    if (af->err == ECONNABORTED) {
+        return JIM_OK;
+    }
+#endif
+    return JIM_ERR;
+}
 
-    return strerror(errno);
+static const char *fd_strerror(struct AioFile *af)
+{
+    return strerror(af->err ? af->err : errno);
 }
 
-static void JimAioSetError(Jim_InterpPtr interp, Jim_ObjPtr name)
+static const JimAioFopsType g_fd_fops = {
+    fd_writer,
+    fd_reader,
+    NULL,       /* lines are split out of the read buffer */
+    fd_error,
+    fd_strerror,
+    NULL
+};
+
+static int JimAioIsStdio(const AioFile *af)
 {
-    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    return af->fops == &g_stdio_fops;
+}
 
-    if (name) {
-        Jim_SetResultFormatted(interp, "%#s: %s", name, JimAioErrorString(af));
+/* A piece of output for writev() */
+struct JimAioIov {
+    const char *buf;
+    int len;
+};
+
+/* Makes wbuf into a string object at the end of the output queue, so more can be queued after it */
+static void JimAioQueue(AioFile *af, Jim_ObjPtr objPtr, int off)
+{
+    if (af->wlen) {
+        Jim_ObjPtr bufObj;
+
+        /* wbuf always has room for the null term */
+        af->wbuf[af->wlen] = 0;
+        bufObj = Jim_NewStringObjNoAlloc(af->interp, af->wbuf, af->wlen);
+        af->wbuf = NULL;
+        af->wlen = af->wcap = 0;
+        JimAioQueue(af, bufObj, 0);
     }
-    else {
-        Jim_SetResultString(interp, JimAioErrorString(af), -1);
+    if (af->wqLen == af->wqCap) {
+        af->wqCap = af->wqCap ? af->wqCap * 2 : 8; // #MagicNum
+        af->wq = realloc_Jim_ObjArray(af->wq, af->wqCap); // #AllocF
+    }
+    if (af->wqLen == 0) {
+        af->wqOff = off;
     }
+    Jim_IncrRefCount(objPtr);
+    af->wq[af->wqLen++] = objPtr;
+    af->wqBytes += Jim_Length(objPtr);
 }
 
-static int JimCheckStreamError(Jim_InterpPtr interp, AioFile *af)
+/* Copies output to the end of wbuf, making room as needed */
+static void JimAioBufferTail(AioFile *af, const char *buf, int len)
 {
-	int ret = af->fops->error(af);
-	if (ret) {
-		JimAioSetError(interp, af->filename);
-	}
-	return ret;
+    if (len == 0) {
+        return;
+    }
+    if (af->wlen + len > af->wcap) {
+        /* Doubles, so output piling up behind a slow non-blocking channel isn't copied over and over */
+        int cap = af->wcap * 2 > af->bufferSize ? af->wcap * 2 : af->bufferSize;
+
+        if (cap < af->wlen + len) {
+            cap = af->wlen + len;
+        }
+
+        af->wbuf = realloc_CharArray(af->wbuf, cap + 1); // #AllocF
+        af->wcap = cap;
+    }
+    memcpy(af->wbuf + af->wlen, buf, len);
+    af->wlen += len;
 }
 
-static void JimAioDelProc(Jim_InterpPtr interp, void *privData)
+static int JimAioHasOutput(const AioFile *af)
 {
-    AioFile *af = (AioFile*)privData;
+    return af->wlen || af->wqLen;
+}
 
-    JIM_NOTUSED(interp);
+static jim_wide JimAioOutputLength(const AioFile *af)
+{
+    return af->wlen + af->wqBytes - af->wqOff;
+}
 
-    Jim_DecrRefCount(interp, af->filename);
+/* Fills iov with up to max pieces of the pending output. Returns the count, and the bytes in *bytes. */
+static int JimAioPending(const AioFile *af, JimAioIov *iov, int max, int *bytes)
+{
+    int n = 0;
+    int i;
 
-#ifdef jim_ext_eventloop // #optionalCode
-    /* remove all existing EventHandlers */
-    Jim_DeleteFileHandler(interp_, af->fd, JIM_EVENT_READABLE | JIM_EVENT_WRITABLE | JIM_EVENT_EXCEPTION);
-#endif /* jim_ext_eventloop*/
+    *bytes = 0;
+    for (i = 0; i < af->wqLen && n < max; i++) {
+        int len;
+        const char *s = Jim_GetString(af->wq[i], &len);
+        int off = i ? 0 : af->wqOff;
 
-#if defined(JIM_SSL) // #optionalCode #WinOff
-    if (af->ssl != NULL) {
-        SSL_free((SSL*)af->ssl);
+        iov[n].buf = s + off;
+        iov[n].len = len - off;
+        *bytes += iov[n++].len;
     }
-#endif /* defined(JIM_SSL) */
-    if (!(af->openFlags & AIO_KEEPOPEN)) {
-        fclose(af->fp);
+    if (af->wlen && n < max) {
+        iov[n].buf = af->wbuf;
+        iov[n].len = af->wlen;
+        *bytes += iov[n++].len;
     }
-
-    free_AioFile(af); // #FreeF 
+    return n;
 }
 
-static Retval aio_cmd_read(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+/* Drops 'done' bytes from the front of the pending output */
+static void JimAioConsume(AioFile *af, int done)
 {
-    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
-    char buf[AIO_BUF_LEN];
-    Jim_ObjPtr objPtr;
-    int nonewline = 0;
-    jim_wide neededLen = -1;         /* -1 is "read as much as possible" */
+    while (done && af->wqLen) {
+        int len = Jim_Length(af->wq[0]) - af->wqOff;
 
-    if (argc && Jim_CompareStringImmediate(interp, argv[0], "-nonewline")) {
-        nonewline = 1;
-        argv++;
-        argc--;
-    }
-    if (argc == 1) {
-        if (Jim_GetWide(interp, argv[0], &neededLen) != JIM_OK)
-            return JIM_ERR;
-        if (neededLen < 0) {
-            Jim_SetResultString(interp, "invalid parameter: negative len", -1); // #ErrStr
-            return JIM_ERR;
+        if (done < len) {
+            af->wqOff += done;
+            return;
         }
+        done -= len;
+        af->wqBytes -= Jim_Length(af->wq[0]);
+        Jim_DecrRefCount(af->interp, af->wq[0]);
+        memmove(af->wq, af->wq + 1, (af->wqLen - 1) * sizeof(*af->wq));
+        af->wqLen--;
+        af->wqOff = 0;
     }
-    else if (argc) {
-        return -1;
+    if (done) {
+        af->wlen -= done;
+        memmove(af->wbuf, af->wbuf + done, af->wlen);
     }
-    objPtr = Jim_NewStringObj(interp, NULL, 0);
-    while (neededLen != 0) {
-        int retval;
-        int readlen;
+}
 
-        if (neededLen == -1) {
-            readlen = AIO_BUF_LEN;
+/* One gathering write. Channels that can't gather (ssl) write the first piece only. */
+static int JimAioWritev(AioFile *af, const JimAioIov *iov, int n)
+{
+#ifdef JIM_AIO_WRITEV // #optionalCode
+    if (n > 1 && af->fops == &g_fd_fops) {
+        struct iovec vec[AIO_IOV_MAX];
+        int ret;
+        int i;
+
+        for (i = 0; i < n; i++) {
+            vec[i].iov_base = (void*)iov[i].buf;
+            vec[i].iov_len = iov[i].len;
         }
-        else {
-            int64_t val = (neededLen > AIO_BUF_LEN ? AIO_BUF_LEN : neededLen);
-            readlen = testConv<int64_t, int>(val);
-        }
-        retval = af->fops->reader(af, buf, readlen);
-        if (retval > 0) {
-            Jim_AppendString(interp, objPtr, buf, retval);
-            if (neededLen != -1) {
-                neededLen -= retval;
-            }
+        do {
+            ret = CAST(int)writev(af->fd, vec, n); // #output
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            af->err = errno;
+            af->errWrite = 1;
         }
-        if (retval != readlen)
+        return ret;
+    }
+#endif
+    return af->fops->writer(af, iov[0].buf, iov[0].len);
+}
+
+/* Writes out pending output.
+ * Output that a non-blocking channel cannot take yet stays pending.
+ */
+static Retval JimAioFlushBuffer(AioFile *af)
+{
+    while (JimAioHasOutput(af)) {
+        JimAioIov iov[AIO_IOV_MAX];
+        int bytes;
+        int n = JimAioWritev(af, iov, JimAioPending(af, iov, AIO_IOV_MAX, &bytes));
+
+        if (n <= 0) {
             break;
+        }
+        JimAioConsume(af, n);
     }
-    /* Check for errorText_ conditions */
-    if (JimCheckStreamError(interp, af)) {
-        Jim_FreeObj(interp, objPtr);
+    if (JimAioHasOutput(af) && af->fops->error(af) != JIM_OK) {
         return JIM_ERR;
     }
-    if (nonewline) {
-        int len;
-        const char *s = Jim_GetString(objPtr, &len);
+    return JIM_OK;
+}
 
-        if (len > 0 && s[len - 1] == '\n') {
-            objPtr->lengthDecr();
-            objPtr->bytes_NULLterminate();
+/* Drops read-ahead so the descriptor offset matches the channel position again.
+ * Pipes and sockets can't seek, and there input and output are independent anyway.
+ */
+static void JimAioDropReadAhead(AioFile *af)
+{
+    if (af->rpos < af->rend && prj_lseek(af->fd, af->rpos - af->rend, SEEK_CUR) < 0) {
+        return;
+    }
+    af->rpos = af->rend = 0;
+}
+
+/* Writes the pending output and then the pieces, gathered into as few writes as possible.
+ * Whatever a non-blocking channel can't take yet is kept: pieces of objv (where not NULL)
+ * are queued by reference, the others copied.
+ */
+static Retval JimAioWritePieces(AioFile *af, const JimAioIov *pieces, Jim_ObjArray *objv, int count)
+{
+    int first = 0;      /* pieces before this one are written */
+    int off = 0;        /* and this much of it */
+
+    while (first < count) {
+        JimAioIov iov[AIO_IOV_MAX];
+        int bytes;
+        int n = JimAioPending(af, iov, AIO_IOV_MAX, &bytes);
+        int i;
+
+        for (i = first; i < count && n < AIO_IOV_MAX; i++) {
+            iov[n].buf = pieces[i].buf + (i == first ? off : 0);
+            iov[n].len = pieces[i].len - (i == first ? off : 0);
+            n++;
+        }
+        n = JimAioWritev(af, iov, n);
+        if (n <= 0) {
+            break;
+        }
+        if (n <= bytes) {
+            JimAioConsume(af, n);
+            continue;
+        }
+        JimAioConsume(af, bytes);
+        n -= bytes;
+        while (first < count && n >= pieces[first].len - off) {
+            n -= pieces[first].len - off;
+            first++;
+            off = 0;
+        }
+        off += n;
+    }
+    if (first == count) {
+        return JIM_OK;
+    }
+    if (af->fops->error(af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    for (; first < count; first++, off = 0) {
+        if (objv && objv[first]) {
+            JimAioQueue(af, objv[first], off);
+        }
+        else {
+            JimAioBufferTail(af, pieces[first].buf + off, pieces[first].len - off);
         }
     }
-    Jim_SetResult(interp, objPtr);
     return JIM_OK;
 }
 
-AioFile *Jim_AioFile(Jim_InterpPtr interp, Jim_ObjPtr command)
+/* Writes out what the buffering mode says should go now. 'newline' if the new output had one. */
+static Retval JimAioApplyBuffering(AioFile *af, int newline)
 {
-    Jim_CmdPtr cmdPtr = Jim_GetCommand(interp, command, JIM_ERRMSG);
+    if (af->buffering == AIO_BUFFER_NONE || (af->buffering == AIO_BUFFER_LINE && newline)) {
+        return JimAioFlushBuffer(af);
+    }
+    return JIM_OK;
+}
 
-    /* XXX: There ought to be a supported API for this */
-    if (cmdPtr && !cmdPtr->isproc() && cmdPtr->cmdProc() == JimAioSubCmdProc) {
-        return cmdPtr->getPrivData<AioFile*>();
+/* Buffers output according to the channel buffering mode. Returns JIM_ERR on a write error. */
+static Retval JimAioWrite(AioFile *af, const char *buf, int len)
+{
+    if (JimAioIsStdio(af)) {
+        return af->fops->writer(af, buf, len) == len ? JIM_OK : JIM_ERR;
     }
-    Jim_SetResultFormatted(interp, "Not a filehandle: \"%#s\"", command); // #ErrStr
-    return NULL;
+    if (af->rpos < af->rend) {
+        JimAioDropReadAhead(af);
+    }
+    if (len >= af->bufferSize) {
+        /* Too big to be worth copying */
+        JimAioIov piece;
+
+        piece.buf = buf;
+        piece.len = len;
+        return JimAioWritePieces(af, &piece, NULL, 1);
+    }
+    if (af->wlen + len > af->bufferSize && JimAioFlushBuffer(af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    JimAioBufferTail(af, buf, len);
+    return JimAioApplyBuffering(af, memchr(buf, '\n', len) != NULL);
 }
 
-JIM_EXPORT FILE *Jim_AioFilehandle(Jim_InterpPtr interp, Jim_ObjPtr command)
+/* Writes string objects, and a newline if asked, according to the channel buffering mode.
+ * Small output is gathered in wbuf, so [puts] is one write even unbuffered.
+ * Big strings go out in one writev() together with what is pending, and are queued
+ * rather than copied if a non-blocking channel can't take them yet.
+ */
+static Retval JimAioWriteObjs(AioFile *af, Jim_ObjArray *objv, int objc, int newline)
 {
-    AioFile *af;
+    JimAioIov pieces[AIO_IOV_MAX];
+    Jim_ObjArray pieceObjs[AIO_IOV_MAX];
+    jim_wide total = newline;
+    int hasNewline = newline;
+    int n = 0;
+    int i;
+
+    if (JimAioIsStdio(af)) {
+        for (i = 0; i < objc; i++) {
+            int len;
+            const char *s = Jim_GetString(objv[i], &len);
+
+            if (JimAioWrite(af, s, len) != JIM_OK) {
+                return JIM_ERR;
+            }
+        }
+        return newline ? JimAioWrite(af, "\n", 1) : JIM_OK;
+    }
+    if (af->rpos < af->rend) {
+        JimAioDropReadAhead(af);
+    }
+    for (i = 0; i < objc; i++) {
+        total += Jim_Length(objv[i]);
+    }
 
-    af = Jim_AioFile(interp, command);
-    if (af == NULL) {
-        return NULL;
+    if (total < af->bufferSize) {
+        if (af->wlen + total > af->bufferSize && JimAioFlushBuffer(af) != JIM_OK) {
+            return JIM_ERR;
+        }
+        for (i = 0; i < objc; i++) {
+            int len;
+            const char *s = Jim_GetString(objv[i], &len);
+
+            JimAioBufferTail(af, s, len);
+            if (!hasNewline && af->buffering == AIO_BUFFER_LINE && memchr(s, '\n', len)) {
+                hasNewline = 1;
+            }
+        }
+        if (newline) {
+            JimAioBufferTail(af, "\n", 1);
+        }
+        return JimAioApplyBuffering(af, hasNewline);
     }
 
-    return af->fp;
+    for (i = 0; i <= objc; i++) {
+        if (i < objc) {
+            pieces[n].buf = Jim_GetString(objv[i], &pieces[n].len);
+            pieceObjs[n++] = objv[i];
+        }
+        else if (newline) {
+            pieces[n].buf = "\n";
+            pieces[n].len = 1;
+            pieceObjs[n++] = NULL;
+        }
+        if (n == AIO_IOV_MAX || (i == objc && n)) {
+            if (JimAioWritePieces(af, pieces, pieceObjs, n) != JIM_OK) {
+                return JIM_ERR;
+            }
+            n = 0;
+        }
+    }
+    return JIM_OK;
 }
 
-static Retval aio_cmd_getfd(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+/* Reads more input into the read buffer, growing it if it is full.
+ * Returns the number of bytes added, 0 at end of file, or -1 if nothing could be read
+ * (an error, or a non-blocking channel with no input ready).
+ */
+static int JimAioFill(AioFile *af)
 {
-    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    int n;
 
-    fflush(af->fp);
-    Jim_SetResultInt(interp, prj_fileno(af->fp)); // #NonPortFuncFix
+    if (JimAioHasOutput(af)) {
+        /* Anything written should go out before waiting for a reply */
+        IGNORERET JimAioFlushBuffer(af);
+    }
+    if (af->rpos == af->rend) {
+        af->rpos = af->rend = 0;
+        if (af->rcap != af->bufferSize) {
+            /* Back to the configured size after a long line */
+            free_CharArray(af->rbuf); // #FreeF
+            af->rbuf = new_CharArray(af->bufferSize); // #AllocF
+            af->rcap = af->bufferSize;
+        }
+    }
+    else if (af->rend == af->rcap) {
+        if (af->rpos) {
+            memmove(af->rbuf, af->rbuf + af->rpos, af->rend - af->rpos);
+            af->rend -= af->rpos;
+            af->rpos = 0;
+        }
+        else {
+            af->rcap *= 2;
+            af->rbuf = realloc_CharArray(af->rbuf, af->rcap); // #AllocF
+        }
+    }
 
-    return JIM_OK;
+    n = af->fops->reader(af, af->rbuf + af->rend, af->rcap - af->rend);
+    if (n > 0) {
+        af->rend += n;
+        af->eof = 0;
+    }
+    else if (JimAioIsStdio(af) ? feof(af->fp) : n == 0) {
+        af->eof = 1;
+        n = 0;
+    }
+    else {
+        n = -1;
+    }
+    return n;
 }
 
-static Retval aio_cmd_copy(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+
+static int JimAioSubCmdProc(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
+#ifdef jim_ext_eventloop // #optionalCode
+static void JimAioCopyEnd(Jim_InterpPtr interp, JimAioCopy *cp);
+static void JimAioAsyncForget(Jim_InterpPtr interp, AioFile *af);
+#endif
+static AioFile *JimMakeChannel(Jim_InterpPtr interp, FILE *fh, int fd, Jim_ObjPtr filename,
+    const char *hdlfmt, int family, const char *mode);
+
+
+static const char *JimAioErrorString(AioFile *af)
+{
+    if (af && af->fops)
+        return af->fops->strerror(af);
+
+    return strerror(errno);
+}
+
+static void JimAioSetError(Jim_InterpPtr interp, Jim_ObjPtr name)
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
-    jim_wide count = 0;
-    jim_wide maxlen = JIM_WIDE_MAX;
-    AioFile *outf = Jim_AioFile(interp, argv[0]);
 
-    if (outf == NULL) {
-        return JIM_ERR;
+    if (name) {
+        Jim_SetResultFormatted(interp, "%#s: %s", name, JimAioErrorString(af));
     }
+    else {
+        Jim_SetResultString(interp, JimAioErrorString(af), -1);
+    }
+}
 
-    if (argc == 2) {
-        if (Jim_GetWide(interp, argv[1], &maxlen) != JIM_OK) {
-            return JIM_ERR;
+static int JimCheckStreamError(Jim_InterpPtr interp, AioFile *af)
+{
+	int ret = af->fops->error(af);
+	if (ret) {
+		Jim_SetResultFormatted(interp, "%#s: %s", af->filename, JimAioErrorString(af));
+	}
+	af->err = 0;
+	return ret;
+}
+
+/* Closes the file and frees what is left of a channel once its command is gone */
+static void JimAioFreeChannel(Jim_InterpPtr interp, AioFile *af)
+{
+#if defined(JIM_SSL) // #optionalCode #WinOff
+    if (af->ssl != NULL) {
+        SSL_free((SSL*)af->ssl);
+    }
+#endif /* defined(JIM_SSL) */
+    if (af->fdFp) {
+        /* Closes fd too, unless the stream is over a copy of it */
+        fclose(af->fdFp);
+    }
+    if (!(af->openFlags & AIO_KEEPOPEN)) {
+        if (af->fp) {
+            fclose(af->fp);
+        }
+        else if (af->fdFp == NULL) {
+            prj_close(af->fd); // #NonPortFuncFix
         }
     }
 
-    while (count < maxlen) {
-        char ch;
+    while (af->wqLen) {
+        Jim_DecrRefCount(interp, af->wq[--af->wqLen]);
+    }
+    free_Jim_ObjArray(af->wq); // #FreeF
+    if (af->hEvent) {
+        Jim_DecrRefCount(interp, af->hEvent);
+    }
+    free_CharArray(af->rbuf); // #FreeF
+    free_CharArray(af->wbuf); // #FreeF
+    free_AioFile(af); // #FreeF 
+}
+
+/* Writes out all pending output of a closed channel, waiting for the peer even if
+ * the channel is non-blocking, as nothing will be left to finish it later.
+ */
+static Retval JimAioFlushAll(AioFile *af)
+{
+#ifdef O_NDELAY // #optionalCode #WinOff
+    int fmode = prj_fcntl(af->fd, F_GETFL); // #NonPortFuncFix
+
+    if (fmode != -1 && (fmode & O_NDELAY)) {
+        (void)prj_fcntl(af->fd, F_SETFL, fmode & ~O_NDELAY); // #NonPortFuncFix
+    }
+#endif
+    if (JimAioFlushBuffer(af) != JIM_OK || JimAioHasOutput(af)) {
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+/* Whether the event loop can write out what a closed non-blocking channel has left */
+static int JimAioCanFlushLater(Jim_InterpPtr interp MAYBE_USED, AioFile *af MAYBE_USED)
+{
+#ifdef jim_ext_eventloop // #optionalCode
+    return af->fd >= 0 && Jim_GetAssocData(interp, "eventloop") != NULL;
+#else
+    return 0;
+#endif
+}
+
+#ifdef jim_ext_eventloop // #optionalCode
+/* A closed non-blocking channel writes out what is left as the peer takes it */
+static int JimAioCloseFlushHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    AioFile *af = (AioFile*)clientData;
+
+    if (JimAioFlushBuffer(af) != JIM_OK || !JimAioHasOutput(af)) {
+        Jim_DeleteFileHandler(interp, af->fd, JIM_EVENT_WRITABLE);
+    }
+    return JIM_OK;
+}
+
+static void JimAioCloseFlushFinalizer(Jim_InterpPtr interp, void *clientData)
+{
+    AioFile *af = (AioFile*)clientData;
+
+    /* Written out, failed, or the event loop is going away with the interpreter.
+     * Then the rest is written out waiting for the peer: only a write error loses it.
+     */
+    if (JimAioHasOutput(af)) {
+        IGNORERET JimAioFlushAll(af);
+    }
+    JimAioFreeChannel(interp, af);
+}
+#endif
+
+static void JimAioDelProc(Jim_InterpPtr interp, void *privData)
+{
+    AioFile *af = (AioFile*)privData;
+
+    Jim_DecrRefCount(interp, af->filename);
+
+#ifdef jim_ext_eventloop // #optionalCode
+    /* remove all existing EventHandlers */
+    Jim_DeleteFileHandler(interp, af->fd, JIM_EVENT_READABLE | JIM_EVENT_WRITABLE | JIM_EVENT_EXCEPTION);
+#endif /* jim_ext_eventloop*/
+
+    if (af->closedFlag) {
+        *af->closedFlag = 1;
+    }
+
+#ifdef jim_ext_eventloop // #optionalCode
+    if (af->copy) {
+        /* Closing either channel abandons a background copy */
+        JimAioCopyEnd(interp, af->copy);
+    }
+    if (af->asyncOps) {
+        JimAioAsyncForget(interp, af);
+    }
+#endif
+
+    /* A blocking channel writes out everything here. A non-blocking one must not wait
+     * for its peer, so the event loop takes over the file and whatever it could not write.
+     * Without one it has to wait after all; only a write error loses the output then.
+     */
+    if (JimAioHasOutput(af) && JimAioFlushBuffer(af) == JIM_OK && JimAioHasOutput(af)) {
+#ifdef jim_ext_eventloop // #optionalCode
+        if (JimAioCanFlushLater(interp, af)) {
+            if (af->hEvent) {
+                /* Nothing is left to tell about the water level */
+                Jim_DecrRefCount(interp, af->hEvent);
+                af->hEvent = NULL;
+            }
+            Jim_CreateFileHandler(interp, af->fd, JIM_EVENT_WRITABLE,
+                JimAioCloseFlushHandler, af, JimAioCloseFlushFinalizer);
+            return;
+        }
+#endif
+        IGNORERET JimAioFlushAll(af);
+    }
+
+    JimAioFreeChannel(interp, af);
+}
+
+/* A channel in a background copy belongs to the copy until it finishes */
+static Retval JimAioCheckBusy(Jim_InterpPtr interp, AioFile *af)
+{
+    if (af->copy) {
+        Jim_SetResultFormatted(interp, "%#s: channel is busy", af->filename); // #ErrStr
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+#ifdef jim_ext_eventloop // #optionalCode
+/* An asynchronous [$f read -async] or [$f puts -async].
+ * Its callback runs from the event loop once the transfer is over.
+ */
+struct JimAioOp {
+    AioFile *af;                /* NULL once the channel is closed: no callback then */
+    int fd;
+    Jim_ObjPtr command;
+    char *buf;
+    int len;                    /* bytes to transfer */
+    int done;                   /* bytes transferred so far */
+    jim_wide offset;            /* -1 to use the descriptor position (pipes and the like) */
+    int isWrite;
+    int stream;                 /* a pipe, socket or the like, where the transfer may wait for the other end */
+    int waitFd;                 /* -1, or a copy of fd the event loop watches until it is ready (no io_uring) */
+    int err;                    /* errno if the transfer failed */
+    JimAioOp *next;
+    JimAioOp *prev;
+};
+
+#define new_JimAioOp            Jim_TAllocZ<JimAioOp>(1,"JimAioOp")
+#define free_JimAioOp(ptr)      Jim_TFree<JimAioOp>(ptr,"JimAioOp")
+
+/* Per interp state of the asynchronous operations.
+ * With io_uring, operations queue up as submission entries and all those started by one
+ * script go to the kernel in a single io_uring_enter() when the event loop next runs.
+ * Completions are then picked up through a readable handler on the ring descriptor.
+ * Without it, each operation is done at once and only its callback is deferred.
+ */
+struct JimAioRing {
+    JimAioOp *ops;              /* not finished yet */
+    JimAioOp *done;             /* finished, callbacks still to run, oldest first */
+    JimAioOp *doneTail;
+    jim_wide timerId;           /* -1 unless a flush is scheduled */
+    int watching;               /* the readable handler on fd is in place */
+#ifdef JIM_AIO_URING // #optionalCode
+    int fd;                     /* -1 if io_uring is not available */
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    unsigned cqEntries;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingLen;
+    void *cqRing;               /* same as sqRing with IORING_FEAT_SINGLE_MMAP */
+    size_t cqRingLen;
+    size_t sqesLen;
+    unsigned queued;            /* entries not yet given to the kernel */
+    unsigned inflight;          /* queued, or given and not yet completed */
+#endif
+};
+
+#define new_JimAioRing          Jim_TAllocZ<JimAioRing>(1,"JimAioRing")
+#define free_JimAioRing(ptr)    Jim_TFree<JimAioRing>(ptr,"JimAioRing")
+
+#ifdef JIM_AIO_URING // #optionalCode
+enum {
+    AIO_RING_ENTRIES = 256 /* #MagicNum */
+};
+
+/* Sets up the ring, leaving ring->fd at -1 if the kernel can't do it (too old, or forbidden) */
+static void JimAioRingSetup(JimAioRing *ring)
+{
+    struct io_uring_params p;
+    int fd;
+    char *sq, *cq;
+
+    ring->fd = -1;
+    memset(&p, 0, sizeof(p));
+    fd = CAST(int)syscall(__NR_io_uring_setup, AIO_RING_ENTRIES, &p);
+    if (fd < 0) {
+        return; // #MissInCoverage
+    }
+    /* IORING_OP_READ and IORING_OP_WRITE came with IORING_FEAT_RW_CUR_POS */
+    if ((p.features & (IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS)) != (IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS)) {
+        prj_close(fd); // #NonPortFuncFix #MissInCoverage
+        return;
+    }
+    ring->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingLen > ring->sqRingLen) {
+            ring->sqRingLen = ring->cqRingLen;
+        }
+        ring->cqRingLen = 0;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cqRing = ring->sqRing;
+    if (ring->sqRing != MAP_FAILED && ring->cqRingLen) {
+        ring->cqRing = mmap(NULL, ring->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING); // #MissInCoverage
+    }
+    ring->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sqes != MAP_FAILED) IGNORERET munmap(ring->sqes, ring->sqesLen); // #MissInCoverage
+        if (ring->cqRing != MAP_FAILED && ring->cqRingLen) IGNORERET munmap(ring->cqRing, ring->cqRingLen);
+        if (ring->sqRing != MAP_FAILED) IGNORERET munmap(ring->sqRing, ring->sqRingLen);
+        prj_close(fd); // #NonPortFuncFix
+        return;
+    }
+
+    sq = (char*)ring->sqRing;
+    cq = (char*)ring->cqRing;
+    ring->sqHead = (unsigned*)(sq + p.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sqEntries = p.sq_entries;
+    ring->sqArray = (unsigned*)(sq + p.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + p.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqEntries = p.cq_entries;
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    ring->fd = fd;
+}
+
+/* Hands the queued entries to the kernel, and waits for 'wait' completions */
+static void JimAioRingEnter(JimAioRing *ring, unsigned wait)
+{
+    int n;
+
+    do {
+        n = CAST(int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        ring->queued -= n;
+    }
+}
+
+static void JimAioRingPrep(JimAioRing *ring, JimAioOp *op);
+static void JimAioRingReap(JimAioRing *ring);
+
+/* Gives the kernel what is queued and picks up what has finished */
+static void JimAioRingSubmit(JimAioRing *ring)
+{
+    if (ring->queued) {
+        JimAioRingEnter(ring, 0);
+    }
+    JimAioRingReap(ring);
+    if (ring->queued) {
+        /* Short writes went back for the rest */
+        JimAioRingEnter(ring, 0);
+    }
+}
+#endif
+
+static void JimAioOpDone(JimAioRing *ring, JimAioOp *op)
+{
+    if (op->prev) {
+        op->prev->next = op->next;
+    }
+    else {
+        ring->ops = op->next;
+    }
+    if (op->next) {
+        op->next->prev = op->prev;
+    }
+    op->next = NULL;
+    op->prev = ring->doneTail;
+    if (ring->doneTail) {
+        ring->doneTail->next = op;
+    }
+    else {
+        ring->done = op;
+    }
+    ring->doneTail = op;
+}
+
+#ifdef JIM_AIO_URING // #optionalCode
+/* Moves completed entries to the done list. Short writes go back for the rest. */
+static void JimAioRingReap(JimAioRing *ring)
+{
+    /* The head is read afresh each time round, as requeueing can reap too */
+    while (*ring->cqHead != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        unsigned head = *ring->cqHead;
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+        JimAioOp *op = (JimAioOp*)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+
+        __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+        ring->inflight--;
+        if (op == NULL) {
+            /* A cancel request */
+            continue;
+        }
+        if (res < 0) {
+            op->err = -res;
+        }
+        else {
+            op->done += res;
+            if (op->isWrite && res > 0 && op->done < op->len && op->af) {
+                JimAioRingPrep(ring, op);
+                continue;
+            }
+        }
+        JimAioOpDone(ring, op);
+    }
+}
+
+/* Returns the next submission entry, cleared. JimAioRingPush() then queues it. */
+static struct io_uring_sqe *JimAioRingSqe(JimAioRing *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *ring->sqTail;
+
+    /* Make room: in the submission queue, and for every completion in the completion queue */
+    while (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries || ring->inflight >= ring->cqEntries) {
+        JimAioRingEnter(ring, ring->inflight >= ring->cqEntries ? 1 : 0);
+        JimAioRingReap(ring);
+        tail = *ring->sqTail;
+    }
+    sqe = &ring->sqes[tail & ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void JimAioRingPush(JimAioRing *ring)
+{
+    unsigned tail = *ring->sqTail;
+
+    ring->sqArray[tail & ring->sqMask] = tail & ring->sqMask;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+    ring->inflight++;
+}
+
+static void JimAioRingPrep(JimAioRing *ring, JimAioOp *op)
+{
+    struct io_uring_sqe *sqe = JimAioRingSqe(ring);
+
+    sqe->opcode = op->isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = op->fd;
+    sqe->addr = (uintptr_t)(op->buf + op->done);
+    sqe->len = op->len - op->done;
+    sqe->off = op->offset < 0 ? (__u64)-1 : (__u64)(op->offset + op->done);
+    sqe->user_data = (uintptr_t)op;
+    JimAioRingPush(ring);
+}
+
+/* Calls off an operation. It completes soon after, with ECANCELED unless it was done already. */
+static void JimAioRingCancel(JimAioRing *ring, JimAioOp *op)
+{
+    struct io_uring_sqe *sqe = JimAioRingSqe(ring);
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)op;
+    sqe->user_data = 0;         /* no operation: JimAioRingReap() skips it */
+    JimAioRingPush(ring);
+}
+#endif
+
+/* One read or write of at most max bytes of what is left, for when there is no io_uring */
+static ssize_t JimAioOpIo(JimAioOp *op, size_t max)
+{
+    ssize_t n;
+    char *buf = op->buf + op->done;
+    size_t len = op->len - op->done;
+
+    if (len > max) {
+        len = max;
+    }
+    do {
+        if (op->offset < 0) {
+            n = op->isWrite ? prj_write(op->fd, buf, len) : prj_read(op->fd, buf, len); // #NonPortFuncFix
+        }
+        else {
+            n = op->isWrite ? pwrite(op->fd, buf, len, op->offset + op->done) : pread(op->fd, buf, len, op->offset + op->done);
+        }
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+/* Does a file transfer at once, for when there is no io_uring */
+static void JimAioOpRun(JimAioOp *op)
+{
+    while (op->done < op->len) {
+        ssize_t n = JimAioOpIo(op, op->len - op->done);
+
+        if (n < 0) {
+            op->err = errno;
+            break;
+        }
+        op->done += CAST(int)n;
+        if (n == 0 || (!op->isWrite && op->offset < 0)) {
+            /* End of file, or whatever a pipe had */
+            break;
+        }
+    }
+}
+
+static void JimAioRingDispatch(Jim_InterpPtr interp, JimAioRing *ring);
+
+/* Stops watching the descriptor of a transfer waiting for it */
+static void JimAioOpUnwatch(Jim_InterpPtr interp, JimAioOp *op)
+{
+    if (op->waitFd >= 0) {
+        Jim_DeleteFileHandler(interp, op->waitFd, JIM_EVENT_READABLE | JIM_EVENT_WRITABLE);
+        prj_close(op->waitFd); // #NonPortFuncFix
+        op->waitFd = -1;
+    }
+}
+
+/* Without io_uring, a transfer on a pipe or socket goes a step at a time as the descriptor
+ * is ready, so the event loop never blocks on the other end. A write step is at most
+ * PIPE_BUF bytes, which a writable pipe takes without waiting.
+ */
+static int JimAioOpHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimAioOp *op = (JimAioOp*)clientData;
+    JimAioRing *ring = (JimAioRing*)Jim_GetAssocData(interp, "aio.ring");
+    ssize_t n = JimAioOpIo(op, op->isWrite ? PIPE_BUF : (size_t)op->len);
+
+    if (n < 0) {
+        if (errno == EAGAIN
+#ifdef EWOULDBLOCK // #optionalCode
+            || errno == EWOULDBLOCK
+#endif
+            ) {
+            return JIM_OK; // #MissInCoverage
+        }
+        op->err = errno;
+    }
+    else {
+        op->done += CAST(int)n;
+        if (n > 0 && op->isWrite && op->done < op->len) {
+            return JIM_OK;
+        }
+    }
+    JimAioOpUnwatch(interp, op);
+    JimAioOpDone(ring, op);
+    JimAioRingDispatch(interp, ring);
+    return JIM_OK;
+}
+
+static Retval JimAioOpWatch(Jim_InterpPtr interp, JimAioOp *op)
+{
+    /* A copy of the descriptor, so that the handler is apart from those of the channel */
+    op->waitFd = prj_dup(op->fd); // #NonPortFuncFix
+    if (op->waitFd < 0) {
+        return JIM_ERR; // #MissInCoverage
+    }
+    Jim_CreateFileHandler(interp, op->waitFd, op->isWrite ? JIM_EVENT_WRITABLE : JIM_EVENT_READABLE,
+        JimAioOpHandler, op, NULL);
+    return JIM_OK;
+}
+
+static void JimAioOpFree(Jim_InterpPtr interp, JimAioOp *op)
+{
+    if (op->af) {
+        op->af->asyncOps--;
+        Jim_DecrRefCount(interp, op->command);
+    }
+    if (op->waitFd >= 0) {
+        /* Only when the interpreter goes, and with it the event loop */
+        prj_close(op->waitFd); // #NonPortFuncFix #MissInCoverage
+    }
+    free_CharArray(op->buf); // #FreeF
+    free_JimAioOp(op); // #FreeF
+}
+
+/* Runs the callbacks of finished operations: read gets the data, puts the byte count,
+ * and either also gets the error message if the transfer failed.
+ */
+static void JimAioRingDispatch(Jim_InterpPtr interp, JimAioRing *ring)
+{
+    while (ring->done) {
+        JimAioOp *op = ring->done;
+        Jim_ObjPtr objPtr = NULL;
+
+        ring->done = op->next;
+        if (ring->done == NULL) {
+            ring->doneTail = NULL;
+        }
+        if (op->af) {
+            objPtr = Jim_DuplicateObj(interp, op->command);
+            Jim_IncrRefCount(objPtr);
+            if (op->isWrite) {
+                Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, op->done));
+            }
+            else {
+                /* The buffer becomes the string */
+                op->buf[op->done] = 0;
+                Jim_ListAppendElement(interp, objPtr, Jim_NewStringObjNoAlloc(interp, op->buf, op->done));
+                op->buf = NULL;
+            }
+            if (op->err) {
+                Jim_ObjPtr msgObj = Jim_DuplicateObj(interp, op->af->filename);
+
+                Jim_AppendStrings(interp, msgObj, ": ", strerror(op->err), NULL);
+                Jim_ListAppendElement(interp, objPtr, msgObj);
+            }
+        }
+        JimAioOpFree(interp, op);
+        if (objPtr) {
+            IGNORERET Jim_EvalObjBackground(interp, objPtr);
+            Jim_DecrRefCount(interp, objPtr);
+        }
+    }
+}
+
+#ifdef JIM_AIO_URING // #optionalCode
+static int JimAioRingHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED);
+#endif
+
+/* Keeps the readable handler on the ring just while something is in flight, so that
+ * vwait still knows when there is nothing left to wait for
+ */
+static void JimAioRingWatch(Jim_InterpPtr interp MAYBE_USED, JimAioRing *ring MAYBE_USED)
+{
+#ifdef JIM_AIO_URING // #optionalCode
+    if (ring->inflight && !ring->watching) {
+        Jim_CreateFileHandler(interp, ring->fd, JIM_EVENT_READABLE, JimAioRingHandler, ring, NULL);
+        ring->watching = 1;
+    }
+    else if (!ring->inflight && ring->watching) {
+        Jim_DeleteFileHandler(interp, ring->fd, JIM_EVENT_READABLE);
+        ring->watching = 0;
+    }
+#endif
+}
+
+#ifdef JIM_AIO_URING // #optionalCode
+static int JimAioRingHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimAioRing *ring = (JimAioRing*)clientData;
+
+    JimAioRingSubmit(ring);
+    JimAioRingDispatch(interp, ring);
+    JimAioRingWatch(interp, ring);
+
+    /* Never an error: that would remove the handler */
+    return JIM_OK;
+}
+#endif
+
+/* Submits everything the script queued since the event loop last ran, in one go */
+static void JimAioRingTimerProc(Jim_InterpPtr interp, void *clientData)
+{
+    JimAioRing *ring = (JimAioRing*)clientData;
+
+    ring->timerId = -1;
+#ifdef JIM_AIO_URING // #optionalCode
+    if (ring->fd >= 0) {
+        JimAioRingSubmit(ring);
+    }
+#endif
+    JimAioRingDispatch(interp, ring);
+    JimAioRingWatch(interp, ring);
+}
+
+static void JimAioRingDelProc(Jim_InterpPtr interp, void *privData)
+{
+    JimAioRing *ring = (JimAioRing*)privData;
+    JimAioOp *op;
+
+    /* The event loop drops its handlers by itself, and the channels are all closed by now */
+#ifdef JIM_AIO_URING // #optionalCode
+    if (ring->fd >= 0) {
+        /* The kernel may still be writing into the buffers */
+        while (ring->inflight) {
+            unsigned inflight = ring->inflight;
+
+            JimAioRingEnter(ring, 1);
+            JimAioRingReap(ring);
+            if (ring->inflight == inflight) {
+                break; // #MissInCoverage
+            }
+        }
+        IGNORERET munmap(ring->sqes, ring->sqesLen);
+        if (ring->cqRingLen) {
+            IGNORERET munmap(ring->cqRing, ring->cqRingLen); // #MissInCoverage
+        }
+        IGNORERET munmap(ring->sqRing, ring->sqRingLen);
+        prj_close(ring->fd); // #NonPortFuncFix
+    }
+#endif
+    while ((op = ring->ops) != NULL) {
+        ring->ops = op->next;
+        JimAioOpFree(interp, op); // #MissInCoverage
+    }
+    while ((op = ring->done) != NULL) {
+        ring->done = op->next;
+        JimAioOpFree(interp, op);
+    }
+    free_JimAioRing(ring); // #FreeF
+}
+
+static JimAioRing *JimAioRingGet(Jim_InterpPtr interp)
+{
+    JimAioRing *ring = (JimAioRing*)Jim_GetAssocData(interp, "aio.ring");
+
+    if (ring == NULL) {
+        ring = new_JimAioRing; // #AllocF
+        ring->timerId = -1;
+#ifdef JIM_AIO_URING // #optionalCode
+        JimAioRingSetup(ring);
+#endif
+        IGNORERET Jim_SetAssocData(interp, "aio.ring", JimAioRingDelProc, ring);
+    }
+    return ring;
+}
+
+/* The channel is closing. Its file transfers are waited for, those on a pipe or socket
+ * are called off, and none of their callbacks run.
+ */
+static void JimAioAsyncForget(Jim_InterpPtr interp, AioFile *af)
+{
+    JimAioRing *ring = (JimAioRing*)Jim_GetAssocData(interp, "aio.ring");
+    JimAioOp *op;
+    JimAioOp *next;
+
+#ifdef JIM_AIO_URING // #optionalCode
+    if (ring->fd >= 0) {
+        for (op = ring->ops; op; op = op->next) {
+            if (op->af == af && op->stream) {
+                JimAioRingCancel(ring, op);
+            }
+        }
+        for (op = ring->ops; op; ) {
+            if (op->af == af) {
+                unsigned inflight = ring->inflight;
+
+                JimAioRingEnter(ring, 1);
+                JimAioRingReap(ring);
+                if (ring->inflight == inflight) {
+                    break; // #MissInCoverage
+                }
+                /* Anything could have finished, so start over */
+                op = ring->ops;
+                continue;
+            }
+            op = op->next;
+        }
+    }
+#endif
+    /* Whatever is still under way finishes without the channel */
+    for (op = ring->ops; op; op = next) {
+        next = op->next;
+        if (op->af == af) {
+            Jim_DecrRefCount(interp, op->command);
+            op->af = NULL;
+            if (op->waitFd >= 0) {
+                JimAioOpUnwatch(interp, op);
+                JimAioOpDone(ring, op);
+            }
+        }
+    }
+    for (op = ring->done; op; op = op->next) {
+        if (op->af == af) {
+            Jim_DecrRefCount(interp, op->command);
+            op->af = NULL;
+        }
+    }
+    af->asyncOps = 0;
+    JimAioRingWatch(interp, ring);
+    if (ring->done && ring->timerId < 0) {
+        ring->timerId = Jim_CreateTimeHandler(interp, 0, JimAioRingTimerProc, ring, NULL);
+    }
+}
+
+/* Starts [$f read -async] (wdata NULL, len -1 for the rest of the file)
+ * or [$f puts -async] of wdata, followed by a newline if asked.
+ * The transfer starts at the channel position, which moves on past it straight away,
+ * so a run of them covers consecutive parts of the file.
+ */
+static Retval JimAioAsync(Jim_InterpPtr interp, AioFile *af, Jim_ObjPtr command,
+    const char *wdata, jim_wide len, int newline)
+{
+    JimAioRing *ring;
+    JimAioOp *op;
+    struct stat sb;
+    jim_wide pos;
+    int stream;
+    int ahead;
+
+    /* Line the descriptor up with the channel */
+    if (JimAioIsStdio(af)) {
+        fflush(af->fp);
+    }
+    else if (JimAioFlushBuffer(af) != JIM_OK) {
+        JimAioSetError(interp, af->filename); // #MissInCoverage
+        af->err = 0;
+        return JIM_ERR;
+    }
+    JimAioDropReadAhead(af);
+    pos = prj_lseek(af->fd, 0, SEEK_CUR); // #NonPortFuncFix
+    stream = pos < 0;
+    /* What a pipe has read ahead can't go back, so a read takes that first */
+    ahead = wdata ? 0 : af->rend - af->rpos;
+    if (wdata) {
+        len += newline;
+        if (pos >= 0 && (prj_fcntl(af->fd, F_GETFL) & O_APPEND)) { // #NonPortFuncFix
+            pos = -1;
+        }
+    }
+    else {
+        if (pos >= 0 && fstat(af->fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+            /* Stop at the end of the file, and leave the position there */
+            jim_wide avail = sb.st_size > pos ? sb.st_size - pos : 0;
+
+            if (len < 0 || len > avail) {
+                len = avail;
+            }
+        }
+        if (ahead && (len < 0 || len > ahead)) {
+            len = ahead;
+        }
+        if (len < 0) {
+            len = af->bufferSize;
+        }
+    }
+    if (len > AIO_BUF_MAX) {
+        Jim_SetResultFormatted(interp, "%#s: too much to transfer at once", af->filename); // #ErrStr
+        return JIM_ERR;
+    }
+
+    ring = JimAioRingGet(interp);
+    op = new_JimAioOp; // #AllocF
+    op->af = af;
+    op->fd = af->fd;
+    op->stream = stream;
+    op->waitFd = -1;
+    op->command = command;
+    Jim_IncrRefCount(command);
+    op->len = CAST(int)len;
+    op->offset = pos;
+    op->isWrite = wdata != NULL;
+    op->buf = new_CharArray(op->len + 1); // #AllocF
+    if (wdata) {
+        memcpy(op->buf, wdata, op->len - newline);
+        if (newline) {
+            op->buf[op->len - 1] = '\n';
+        }
+    }
+    else if (ahead) {
+        memcpy(op->buf, af->rbuf + af->rpos, op->len);
+        af->rpos += op->len;
+        op->done = op->len;
+    }
+    if (pos >= 0) {
+        IGNORERET prj_lseek(af->fd, pos + len, SEEK_SET); // #NonPortFuncFix
+    }
+    af->asyncOps++;
+    op->next = ring->ops;
+    if (ring->ops) {
+        ring->ops->prev = op;
+    }
+    ring->ops = op;
+
+    if (op->done == op->len) {
+        JimAioOpDone(ring, op);
+    }
+#ifdef JIM_AIO_URING // #optionalCode
+    else if (ring->fd >= 0) {
+        JimAioRingPrep(ring, op);
+    }
+#endif
+    else if (!stream || JimAioOpWatch(interp, op) != JIM_OK) {
+        JimAioOpRun(op);
+        JimAioOpDone(ring, op);
+    }
+    if (ring->timerId < 0) {
+        ring->timerId = Jim_CreateTimeHandler(interp, 0, JimAioRingTimerProc, ring, NULL);
+    }
+    return JIM_OK;
+}
+#endif
+
+static Retval aio_cmd_read(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    Jim_ObjPtr objPtr;
+    int nonewline = 0;
+    jim_wide neededLen = -1;         /* -1 is "read as much as possible" */
+
+    Jim_ObjPtr command = NULL;
+
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    if (argc && Jim_CompareStringImmediate(interp, argv[0], "-nonewline")) {
+        nonewline = 1;
+        argv++;
+        argc--;
+    }
+#ifdef jim_ext_eventloop // #optionalCode
+    else if (argc >= 2 && Jim_CompareStringImmediate(interp, argv[0], "-async")) {
+        command = argv[1];
+        argv += 2;
+        argc -= 2;
+    }
+#endif
+    if (argc == 1) {
+        if (Jim_GetWide(interp, argv[0], &neededLen) != JIM_OK)
+            return JIM_ERR;
+        if (neededLen < 0) {
+            Jim_SetResultString(interp, "invalid parameter: negative len", -1); // #ErrStr
+            return JIM_ERR;
+        }
+    }
+    else if (argc) {
+        return -1;
+    }
+#ifdef jim_ext_eventloop // #optionalCode
+    if (command) {
+        return JimAioAsync(interp, af, command, NULL, neededLen, 0);
+    }
+#endif
+    objPtr = Jim_NewStringObj(interp, NULL, 0);
+    while (neededLen != 0) {
+        int avail = af->rend - af->rpos;
+
+        if (avail == 0) {
+            if (JimAioFill(af) <= 0) {
+                break;
+            }
+            continue;
+        }
+        if (neededLen != -1 && avail > neededLen) {
+            avail = CAST(int)neededLen;
+        }
+        Jim_AppendString(interp, objPtr, af->rbuf + af->rpos, avail);
+        af->rpos += avail;
+        if (neededLen != -1) {
+            neededLen -= avail;
+        }
+    }
+    /* Check for errorText_ conditions */
+    if (JimCheckStreamError(interp, af)) {
+        Jim_FreeObj(interp, objPtr);
+        return JIM_ERR;
+    }
+    if (nonewline) {
+        int len;
+        const char *s = Jim_GetString(objPtr, &len);
+
+        if (len > 0 && s[len - 1] == '\n') {
+            objPtr->lengthDecr();
+            objPtr->bytes_NULLterminate();
+        }
+    }
+    Jim_SetResult(interp, objPtr);
+    return JIM_OK;
+}
+
+AioFile *Jim_AioFile(Jim_InterpPtr interp, Jim_ObjPtr command)
+{
+    Jim_CmdPtr cmdPtr = Jim_GetCommand(interp, command, JIM_ERRMSG);
+
+    /* XXX: There ought to be a supported API for this */
+    if (cmdPtr && !cmdPtr->isproc() && cmdPtr->cmdProc() == JimAioSubCmdProc) {
+        return cmdPtr->getPrivData<AioFile*>();
+    }
+    Jim_SetResultFormatted(interp, "Not a filehandle: \"%#s\"", command); // #ErrStr
+    return NULL;
+}
+
+JIM_EXPORT FILE *Jim_AioFilehandle(Jim_InterpPtr interp, Jim_ObjPtr command)
+{
+    AioFile *af;
+
+    af = Jim_AioFile(interp, command);
+    if (af == NULL) {
+        return NULL;
+    }
+
+    if (af->fp) {
+        return af->fp;
+    }
+#ifndef JIM_ANSIC // #optionalCode #WinOff
+    if (af->fdFp == NULL) {
+        /* Unbuffered, so it can be mixed with the channel's own reads and writes.
+         * A channel that keeps its descriptor open gives the stream a copy to close.
+         */
+        int accmode = prj_fcntl(af->fd, F_GETFL) & O_ACCMODE; // #NonPortFuncFix
+        int fd = (af->openFlags & AIO_KEEPOPEN) ? prj_dup(af->fd) : af->fd; // #NonPortFuncFix
+
+        if (fd < 0) {
+            return NULL; // #MissInCoverage
+        }
+        IGNORERET JimAioFlushBuffer(af);
+        af->fdFp = prj_fdopen(fd, accmode == O_RDONLY ? "r" : accmode == O_WRONLY ? "w" : "r+"); // #NonPortFuncFix
+        if (af->fdFp) {
+            setvbuf(af->fdFp, NULL, _IONBF, 0);
+        }
+        else if (fd != af->fd) {
+            prj_close(fd); // #NonPortFuncFix #MissInCoverage
+        }
+    }
+#endif
+    return af->fdFp;
+}
+
+static Retval aio_cmd_getfd(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+
+    if (JimAioIsStdio(af)) {
+        fflush(af->fp);
+    }
+    else {
+        IGNORERET JimAioFlushBuffer(af);
+    }
+    Jim_SetResultInt(interp, af->fd);
+
+    return JIM_OK;
+}
+
+enum {
+    AIO_COPY_BUFFERED,      /* through the channel buffers */
+    AIO_COPY_RANGE,         /* copy_file_range(), file to file */
+    AIO_COPY_SENDFILE,      /* sendfile(), file to anything */
+    AIO_COPY_SPLICE         /* splice(), either end a pipe */
+};
+
+/* Picks the cheapest way to move data from src to dst */
+static int JimAioCopyMethod(AioFile *src MAYBE_USED, AioFile *dst MAYBE_USED)
+{
+#ifdef JIM_AIO_KERNEL_COPY // #optionalCode
+    struct stat ss, ds;
+
+    /* Only plain descriptors. stdio and ssl channels transform or buffer the data. */
+    if (src->fops != &g_fd_fops || dst->fops != &g_fd_fops || fstat(src->fd, &ss) || fstat(dst->fd, &ds)) {
+        return AIO_COPY_BUFFERED;
+    }
+    if (S_ISREG(ss.st_mode) && S_ISREG(ds.st_mode)) {
+        return AIO_COPY_RANGE;
+    }
+    if (S_ISFIFO(ss.st_mode) || S_ISFIFO(ds.st_mode)) {
+        return AIO_COPY_SPLICE;
+    }
+    if (S_ISREG(ss.st_mode)) {
+        return AIO_COPY_SENDFILE;
+    }
+#endif
+    return AIO_COPY_BUFFERED;
+}
+
+#ifdef JIM_AIO_KERNEL_COPY // #optionalCode
+/* One kernel-side copy of up to len bytes between the descriptors, which advances both offsets.
+ * Returns the bytes copied, 0 at end of input, or -1 on failure. If the method turns out not to
+ * apply to these descriptors, *method is moved to the next one to try and -1 is returned.
+ */
+static jim_wide JimAioKernelCopy(AioFile *src, AioFile *dst, int *method, jim_wide len)
+{
+    prj_ssize_t n;
+    size_t count = len > AIO_COPY_MAX ? CAST(size_t)AIO_COPY_MAX : CAST(size_t)len;
+
+    do {
+        switch (*method) {
+            case AIO_COPY_RANGE:
+                n = copy_file_range(src->fd, NULL, dst->fd, NULL, count, 0);
+                break;
+            case AIO_COPY_SENDFILE:
+                n = sendfile(dst->fd, src->fd, NULL, count);
+                break;
+            default:
+                n = splice(src->fd, NULL, dst->fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+                break;
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        switch (errno) {
+            case EXDEV:
+            case EINVAL:
+            case ENOSYS:
+            case EBADF:         /* copy_file_range() to an O_APPEND file */
+#ifdef EOPNOTSUPP // #optionalCode
+            case EOPNOTSUPP:
+#endif
+                /* Fall back: file to file goes on with sendfile(), everything else is buffered */
+                *method = *method == AIO_COPY_RANGE ? AIO_COPY_SENDFILE : AIO_COPY_BUFFERED;
+                return -1;
+            case EPIPE:
+            case ENOSPC:
+#ifdef ECONNRESET // #optionalCode
+            case ECONNRESET:
+#endif
+                dst->err = errno;
+                dst->errWrite = 1;
+                return -1;
+            default:
+                src->err = errno;
+                src->errWrite = 0;
+                return -1;
+        }
+    }
+    return n;
+}
+#endif
+
+/* Moves up to len bytes from src to dst, first whatever src has read ahead, then in the kernel
+ * if the descriptors allow it, else through the buffers.
+ * Stops early at end of input, on error, or when a non-blocking channel would block.
+ */
+static jim_wide JimAioCopyData(AioFile *src, AioFile *dst, int *method, jim_wide len)
+{
+    jim_wide count = 0;
+
+    /* Whatever src has read ahead goes first */
+    while (count < len && src->rpos < src->rend) {
+        int avail = src->rend - src->rpos;
+
+        if (avail > len - count) {
+            avail = CAST(int)(len - count);
+        }
+        if (JimAioWrite(dst, src->rbuf + src->rpos, avail) != JIM_OK) {
+            return count;
+        }
+        src->rpos += avail;
+        count += avail;
+    }
+#ifdef JIM_AIO_KERNEL_COPY // #optionalCode
+    if (*method != AIO_COPY_BUFFERED && count < len) {
+        /* The kernel writes behind the channel, so dst must have nothing pending */
+        if (JimAioFlushBuffer(dst) != JIM_OK || JimAioHasOutput(dst)) {
+            return count;
+        }
+        JimAioDropReadAhead(dst);
+        while (count < len && *method != AIO_COPY_BUFFERED) {
+            jim_wide n = JimAioKernelCopy(src, dst, method, len - count);
+
+            if (n == 0) {
+                src->eof = 1;
+                return count;
+            }
+            if (n < 0) {
+                if (src->err || dst->err) {
+                    return count;
+                }
+                continue;
+            }
+            count += n;
+        }
+    }
+#endif
+    while (count < len) {
+        int avail = src->rend - src->rpos;
+
+        if (avail == 0) {
+            if (JimAioFill(src) <= 0) {
+                break;
+            }
+            continue;
+        }
+        if (avail > len - count) {
+            avail = CAST(int)(len - count);
+        }
+        if (JimAioWrite(dst, src->rbuf + src->rpos, avail) != JIM_OK) {
+            break;
+        }
+        src->rpos += avail;
+        count += avail;
+    }
+    return count;
+}
+
+#ifdef jim_ext_eventloop // #optionalCode
+/* A background [$src copyto $dst ?size? -command script] */
+struct JimAioCopy {
+    AioFile *src;
+    AioFile *dst;
+    Jim_ObjPtr command;
+    jim_wide remaining;
+    jim_wide count;
+    int method;
+    int waitFd;             /* the handler is on waitFd for waitMask */
+    int waitMask;
+    int srcFlags;           /* descriptor flags to put back afterwards */
+    int dstFlags;
+};
+
+#define new_JimAioCopy          Jim_TAllocZ<JimAioCopy>(1,"JimAioCopy")
+#define free_JimAioCopy(ptr)    Jim_TFree<JimAioCopy>(ptr,"JimAioCopy")
+
+static int JimAioCopyHandler(Jim_InterpPtr interp, void *clientData, int mask);
+
+static void JimAioCopyWait(Jim_InterpPtr interp, JimAioCopy *cp, int fd, int mask)
+{
+    if (cp->waitFd == fd && cp->waitMask == mask) {
+        return;
+    }
+    if (cp->waitMask) {
+        Jim_DeleteFileHandler(interp, cp->waitFd, cp->waitMask);
+    }
+    cp->waitFd = fd;
+    cp->waitMask = mask;
+    Jim_CreateFileHandler(interp, fd, mask, JimAioCopyHandler, cp, NULL);
+}
+
+/* Releases both channels. The callback, if any, is left to the caller. */
+static void JimAioCopyEnd(Jim_InterpPtr interp, JimAioCopy *cp)
+{
+    if (cp->waitMask) {
+        Jim_DeleteFileHandler(interp, cp->waitFd, cp->waitMask);
+    }
+    (void)prj_fcntl(cp->src->fd, F_SETFL, cp->srcFlags); // #NonPortFuncFix
+    (void)prj_fcntl(cp->dst->fd, F_SETFL, cp->dstFlags); // #NonPortFuncFix
+    cp->src->copy = NULL;
+    cp->dst->copy = NULL;
+    Jim_DecrRefCount(interp, cp->command);
+    free_JimAioCopy(cp); // #FreeF
+}
+
+/* Copies the next piece once the channel it waited for is ready, then waits again or finishes */
+static int JimAioCopyHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimAioCopy *cp = (JimAioCopy*)clientData;
+    AioFile *src = cp->src;
+    AioFile *dst = cp->dst;
+    struct pollfd pfd[2];
+    Jim_ObjPtr objPtr;
+    AioFile *failed;
+
+    /* Find out which side would block, so that the copy only ever waits on that one */
+    pfd[0].fd = src->fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = dst->fd;
+    pfd[1].events = POLLOUT;
+    if (poll(pfd, 2, 0) >= 0) {
+        if (src->rpos == src->rend && !(pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            JimAioCopyWait(interp, cp, src->fd, JIM_EVENT_READABLE);
+            return JIM_OK;
+        }
+        if (!(pfd[1].revents & (POLLOUT | POLLHUP | POLLERR))) {
+            JimAioCopyWait(interp, cp, dst->fd, JIM_EVENT_WRITABLE);
+            return JIM_OK;
+        }
+    }
+
+    if (JimAioFlushBuffer(dst) == JIM_OK && !JimAioHasOutput(dst) && cp->remaining) {
+        jim_wide n = JimAioCopyData(src, dst, &cp->method,
+            cp->remaining < AIO_COPY_STEP ? cp->remaining : CAST(jim_wide)AIO_COPY_STEP);
+
+        cp->count += n;
+        cp->remaining -= n;
+    }
+    failed = src->fops->error(src) != JIM_OK ? src : dst->fops->error(dst) != JIM_OK ? dst : NULL;
+    if (failed == NULL) {
+        /* Only EAGAIN and the like, which just mean waiting */
+        src->err = dst->err = 0;
+        if (JimAioHasOutput(dst)) {
+            JimAioCopyWait(interp, cp, dst->fd, JIM_EVENT_WRITABLE);
+            return JIM_OK;
+        }
+        if (cp->remaining && !(src->eof && src->rpos == src->rend)) {
+            JimAioCopyWait(interp, cp, src->fd, JIM_EVENT_READABLE);
+            return JIM_OK;
+        }
+    }
+
+    /* Done. The callback gets the byte count, and the error message if the copy failed. */
+    objPtr = Jim_DuplicateObj(interp, cp->command);
+    Jim_IncrRefCount(objPtr);
+    Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cp->count));
+    if (failed) {
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, JimAioErrorString(failed), -1));
+        src->err = dst->err = 0;
+    }
+    JimAioCopyEnd(interp, cp);
+    IGNORERET Jim_EvalObjBackground(interp, objPtr);
+    Jim_DecrRefCount(interp, objPtr);
+
+    /* Never an error: that would remove whatever handler the callback set up on this fd */
+    return JIM_OK;
+}
+#endif
+
+static Retval aio_cmd_copy(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    jim_wide count;
+    jim_wide maxlen = JIM_WIDE_MAX;
+    AioFile *outf = Jim_AioFile(interp, argv[0]);
+    Jim_ObjPtr command = NULL;
+    int method;
+
+    if (outf == NULL) {
+        return JIM_ERR;
+    }
+
+    if (argc >= 3 && Jim_CompareStringImmediate(interp, argv[argc - 2], "-command")) {
+        command = argv[argc - 1];
+        argc -= 2;
+    }
+    if (argc > 2) {
+        return -1;
+    }
+    if (argc == 2) {
+        if (Jim_GetWide(interp, argv[1], &maxlen) != JIM_OK) {
+            return JIM_ERR;
+        }
+    }
+    if (JimAioCheckBusy(interp, af) != JIM_OK || JimAioCheckBusy(interp, outf) != JIM_OK) {
+        return JIM_ERR;
+    }
+    method = JimAioCopyMethod(af, outf);
+
+    if (command) {
+#ifdef jim_ext_eventloop // #optionalCode
+        JimAioCopy *cp;
+
+        if (af->rEvent || outf->wEvent) {
+            Jim_SetResultFormatted(interp, "%#s: channel is busy", af->rEvent ? af->filename : outf->filename); // #ErrStr
+            return JIM_ERR;
+        }
+        if (outf->flushing) {
+            /* The copy writes out what is pending first */
+            Jim_DeleteFileHandler(interp, outf->fd, JIM_EVENT_WRITABLE);
+        }
+        cp = new_JimAioCopy; // #AllocF
+        cp->src = af;
+        cp->dst = outf;
+        cp->command = command;
+        Jim_IncrRefCount(command);
+        cp->remaining = maxlen;
+        cp->method = method;
+        /* Non-blocking for the duration, so that no step can stall the event loop */
+        cp->srcFlags = prj_fcntl(af->fd, F_GETFL); // #NonPortFuncFix
+        cp->dstFlags = prj_fcntl(outf->fd, F_GETFL); // #NonPortFuncFix
+        (void)prj_fcntl(af->fd, F_SETFL, cp->srcFlags | O_NONBLOCK); // #NonPortFuncFix
+        (void)prj_fcntl(outf->fd, F_SETFL, cp->dstFlags | O_NONBLOCK); // #NonPortFuncFix
+        af->copy = outf->copy = cp;
+        JimAioCopyWait(interp, cp, af->fd, JIM_EVENT_READABLE);
+        return JIM_OK;
+#else
+        Jim_SetResultString(interp, "copyto -command needs the eventloop extension", -1); // #ErrStr
+        return JIM_ERR;
+#endif
+    }
+
+    count = JimAioCopyData(af, outf, &method, maxlen);
+
+    if (JimCheckStreamError(interp, af) || JimCheckStreamError(interp, outf)) {
+        return JIM_ERR;
+    }
+
+    Jim_SetResultInt(interp, count);
+
+    return JIM_OK;
+}
+
+/* Takes the next line out of the read buffer, reading more as needed.
+ * The last line of the input need not end with a newline.
+ * Returns NULL at end of file, after an error, or while a non-blocking channel has only part of a line.
+ */
+static Jim_ObjPtr JimAioNextLine(Jim_InterpPtr interp, AioFile *af)
+{
+    Jim_ObjPtr objPtr;
+    const char *nl = NULL;
+    int scanned = 0;        /* bytes past rpos already known to hold no newline */
+    int len;
+
+    while (1) {
+        if (af->rpos + scanned < af->rend) {
+            nl = (const char *)memchr(af->rbuf + af->rpos + scanned, '\n', af->rend - af->rpos - scanned);
+            if (nl) {
+                break;
+            }
+            scanned = af->rend - af->rpos;
+        }
+        if (JimAioFill(af) <= 0) {
+            break;
+        }
+    }
+
+    if (nl) {
+        len = CAST(int)(nl - (af->rbuf + af->rpos));
+        objPtr = Jim_NewStringObj(interp, af->rbuf + af->rpos, len);
+        af->rpos += len + 1;
+        return objPtr;
+    }
+    if (af->eof && af->rpos < af->rend) {
+        objPtr = Jim_NewStringObj(interp, af->rbuf + af->rpos, af->rend - af->rpos);
+        af->rpos = af->rend;
+        return objPtr;
+    }
+    /* A non-blocking channel holds on to a partial line until the rest arrives */
+    return NULL;
+}
+
+static Retval aio_cmd_gets(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    Jim_ObjPtr objPtr;
+
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    objPtr = JimAioNextLine(interp, af);
+
+    if (JimCheckStreamError(interp, af)) {
+        /* I/O errorText_ */
+        if (objPtr) {
+            Jim_FreeObj(interp, objPtr); // #MissInCoverage
+        }
+        return JIM_ERR;
+    }
+
+    if (argc) {
+        if (objPtr == NULL) {
+            /* On EOF, or with no complete line yet, returns -1 if varName was specified */
+            Jim_SetEmptyResult(interp);
+            if (Jim_SetVariable(interp, argv[0], Jim_GetResult(interp)) != JIM_OK) {
+                return JIM_ERR;
+            }
+            Jim_SetResultInt(interp, -1);
+            return JIM_OK;
+        }
+        if (Jim_SetVariable(interp, argv[0], objPtr) != JIM_OK) {
+            Jim_FreeObj(interp, objPtr);
+            return JIM_ERR;
+        }
+        Jim_SetResultInt(interp, Jim_Length(objPtr));
+    }
+    else if (objPtr) {
+        Jim_SetResult(interp, objPtr);
+    }
+    else {
+        Jim_SetEmptyResult(interp);
+    }
+    return JIM_OK;
+}
+
+/* [$f foreachline varName body]: the gets loop, without the commands around it */
+static Retval aio_cmd_foreachline(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    Retval ret = JIM_OK;
+    Jim_ObjPtr objPtr;
+
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    while ((objPtr = JimAioNextLine(interp, af)) != NULL) {
+        Jim_CmdPtr cmdPtr;
 
-        if (af->fops->reader(af, &ch, 1) != 1) {
+        if (Jim_SetVariable(interp, argv[2], objPtr) != JIM_OK) {
+            Jim_FreeObj(interp, objPtr);
+            ret = JIM_ERR;
+            break;
+        }
+        ret = Jim_EvalObj(interp, argv[3]);
+        if (ret != JIM_OK && ret != JIM_CONTINUE) {
+            break;
+        }
+        ret = JIM_OK;
+
+        /* af lives until this command returns, even if the body closes the channel */
+        cmdPtr = Jim_GetCommand(interp, argv[0], JIM_NONE);
+        if (cmdPtr == NULL || cmdPtr->isproc() || cmdPtr->getPrivData<AioFile*>() != af) {
             break;
         }
-        if (outf->fops->writer(outf, &ch, 1) != 1) {
-            break;
+    }
+    if (ret == JIM_OK && JimCheckStreamError(interp, af)) {
+        return JIM_ERR;
+    }
+    if (ret == JIM_OK || ret == JIM_CONTINUE || ret == JIM_BREAK) {
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+    return ret;
+}
+
+/* [$f lines ?-count n?]: many gets at once */
+static Retval aio_cmd_lines(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    jim_wide count = -1;    /* -1 is "to the end" */
+    Jim_ObjPtr listObj;
+    Jim_ObjPtr objPtr;
+
+    if (argc) {
+        if (argc != 2 || !Jim_CompareStringImmediate(interp, argv[0], "-count")) {
+            return -1;
+        }
+        if (Jim_GetWide(interp, argv[1], &count) != JIM_OK) {
+            return JIM_ERR;
+        }
+        if (count < 0) {
+            Jim_SetResultString(interp, "invalid parameter: negative count", -1); // #ErrStr
+            return JIM_ERR;
+        }
+    }
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    listObj = Jim_NewListObj(interp, NULL, 0);
+    while (count != 0 && (objPtr = JimAioNextLine(interp, af)) != NULL) {
+        Jim_ListAppendElement(interp, listObj, objPtr);
+        if (count > 0) {
+            count--;
         }
-        count++;
     }
-
-    if (JimCheckStreamError(interp, af) || JimCheckStreamError(interp, outf)) {
+    if (JimCheckStreamError(interp, af)) {
+        Jim_FreeObj(interp, listObj); // #MissInCoverage
         return JIM_ERR;
     }
-
-    Jim_SetResultInt(interp, count);
-
+    Jim_SetResult(interp, listObj);
     return JIM_OK;
 }
 
-static Retval aio_cmd_gets(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+#ifdef jim_ext_eventloop // #optionalCode
+/* Runs the highwater script with the pending byte count once output reaches the limit,
+ * and with 0 once it has all been written after that. The channel may be gone afterwards.
+ */
+static void JimAioCheckWater(Jim_InterpPtr interp, AioFile *af)
 {
-    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
-    char buf[AIO_BUF_LEN];
+    jim_wide pending;
     Jim_ObjPtr objPtr;
-    int len;
-
-    errno = 0;
 
-    objPtr = Jim_NewStringObj(interp, NULL, 0);
-    while (1) {
-        buf[AIO_BUF_LEN - 1] = '_';
-
-        if (af->fops->getline(af, buf, AIO_BUF_LEN) == NULL)
-            break;
-
-        if (buf[AIO_BUF_LEN - 1] == '\0' && buf[AIO_BUF_LEN - 2] != '\n') {
-            Jim_AppendString(interp, objPtr, buf, AIO_BUF_LEN - 1);
-        }
-        else {
-            size_t slen = strlen(buf);
-            len = testConv<size_t,int>(slen);
-
-            if (len && (buf[len - 1] == '\n')) {
-                /* strip "\n" */
-                len--;
-            }
-
-            Jim_AppendString(interp, objPtr, buf, len);
-            break;
-        }
+    if (af->hEvent == NULL) {
+        return;
     }
-
-    if (JimCheckStreamError(interp, af)) {
-        /* I/O errorText_ */
-        Jim_FreeObj(interp, objPtr);
-        return JIM_ERR;
+    pending = JimAioOutputLength(af);
+    if (af->overHigh ? pending != 0 : pending < af->highWater) {
+        return;
     }
+    af->overHigh = !af->overHigh;
+    objPtr = Jim_DuplicateObj(interp, af->hEvent);
+    Jim_IncrRefCount(objPtr);
+    Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, pending));
+    IGNORERET Jim_EvalObjBackground(interp, objPtr);
+    Jim_DecrRefCount(interp, objPtr);
+    Jim_SetEmptyResult(interp);
+}
 
-    if (argc) {
-        if (Jim_SetVariable(interp, argv[0], objPtr) != JIM_OK) {
-            Jim_FreeObj(interp, objPtr);
-            return JIM_ERR;
-        }
+static int JimAioFlushHandler(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    AioFile *af = (AioFile*)clientData;
 
-        len = Jim_Length(objPtr);
+    if (JimAioFlushBuffer(af) != JIM_OK || !JimAioHasOutput(af)) {
+        /* Done. A write error is left for the next command on the channel to report. */
+        Jim_DeleteFileHandler(interp, af->fd, JIM_EVENT_WRITABLE);
+        JimAioCheckWater(interp, af);
+    }
+    return JIM_OK;
+}
 
-        if (len == 0 && feof(af->fp)) {
-            /* On EOF returns -1 if varName was specified */
-            len = -1;
-        }
-        Jim_SetResultInt(interp, len);
+static void JimAioFlushFinalizer(Jim_InterpPtr interp MAYBE_USED, void *clientData)
+{
+    ((AioFile*)clientData)->flushing = 0;
+}
+
+/* Once a non-blocking channel has output it could not write, the event loop writes it out
+ * as the channel takes it. Not while a writable script or a background copy is in charge.
+ */
+static void JimAioWatchOutput(Jim_InterpPtr interp, AioFile *af)
+{
+    if (af->err != EAGAIN
+#ifdef EWOULDBLOCK // #optionalCode
+        && af->err != EWOULDBLOCK
+#endif
+        ) {
+        return;
     }
-    else {
-        Jim_SetResult(interp, objPtr);
+    af->err = 0;
+    if (JimAioHasOutput(af) && !af->flushing && af->wEvent == NULL && af->copy == NULL) {
+        af->flushing = 1;
+        Jim_CreateFileHandler(interp, af->fd, JIM_EVENT_WRITABLE, JimAioFlushHandler, af, JimAioFlushFinalizer);
     }
-    return JIM_OK;
 }
+#endif
 
 static Retval aio_cmd_puts(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
-    int wlen;
-    const char *wdata;
     Jim_ObjPtr strObj;
+    Jim_ObjArray *chunks;
+    int count;
+    int nonewline = 0;
+    Jim_ObjPtr command = NULL;
 
-    if (argc == 2) {
-        if (!Jim_CompareStringImmediate(interp, argv[0], "-nonewline")) {
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    while (argc > 1) {
+        if (!nonewline && Jim_CompareStringImmediate(interp, argv[0], "-nonewline")) {
+            nonewline = 1;
+            argv++;
+            argc--;
+        }
+#ifdef jim_ext_eventloop // #optionalCode
+        else if (!command && argc > 2 && Jim_CompareStringImmediate(interp, argv[0], "-async")) {
+            command = argv[1];
+            argv += 2;
+            argc -= 2;
+        }
+#endif
+        else {
             return -1;
         }
-        strObj = argv[1];
     }
-    else {
-        strObj = argv[0];
+    strObj = argv[0];
+#ifdef jim_ext_eventloop // #optionalCode
+    if (command) {
+        int wlen;
+        const char *wdata = Jim_GetString(strObj, &wlen);
+
+        return JimAioAsync(interp, af, command, wdata, wlen, !nonewline);
     }
+#endif
 
-    wdata = Jim_GetString(strObj, &wlen);
-    if (af->fops->writer(af, wdata, wlen) == wlen) {
-        if (argc == 2 || af->fops->writer(af, "\n", 1) == 1) {
-            return JIM_OK;
-        }
+    /* A rope is written a piece at a time rather than joined first */
+    count = Jim_StringChunks(interp, strObj, &chunks);
+    if (count == 0) {
+        chunks = &strObj;
+        count = 1;
+    }
+    if (JimAioWriteObjs(af, chunks, count, !nonewline) == JIM_OK) {
+#ifdef jim_ext_eventloop // #optionalCode
+        JimAioWatchOutput(interp, af);
+        JimAioCheckWater(interp, af);
+#endif
+        return JIM_OK;
     }
     JimAioSetError(interp, af->filename);
+    af->err = 0;
     return JIM_ERR;
 }
 
@@ -449,7 +2268,7 @@ static Retval aio_cmd_isatty(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjC
     if (prj_funcDef(prj_isatty)) // #Unsupported #NonPortFuncFix
     {
         AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
-        Jim_SetResultInt(interp, prj_isatty(prj_fileno(af->fp))); // #NonPortFuncFix
+        Jim_SetResultInt(interp, prj_isatty(af->fd)); // #NonPortFuncFix
     } else {
         Jim_SetResultInt(interp, 0);
     }
@@ -462,10 +2281,15 @@ static Retval aio_cmd_flush(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjCo
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
 
-    if (fflush(af->fp) == EOF) {
+    if (JimAioIsStdio(af) ? fflush(af->fp) == EOF : JimAioFlushBuffer(af) != JIM_OK) {
         JimAioSetError(interp, af->filename);
+        af->err = 0;
         return JIM_ERR;
     }
+#ifdef jim_ext_eventloop // #optionalCode
+    JimAioWatchOutput(interp, af);
+    JimAioCheckWater(interp, af);
+#endif
     return JIM_OK;
 }
 
@@ -473,7 +2297,7 @@ static Retval aio_cmd_eof(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjCons
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
 
-    Jim_SetResultInt(interp, feof(af->fp));
+    Jim_SetResultInt(interp, af->eof && af->rpos == af->rend);
     return JIM_OK;
 }
 
@@ -498,6 +2322,27 @@ static Retval aio_cmd_close(Jim_InterpPtr interp, int argc, Jim_ObjConstArray ar
 #endif
         return JIM_ERR;
     }
+    else {
+        AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+        Retval ret = JIM_OK;
+
+        if (!JimAioIsStdio(af)) {
+            ret = JimAioFlushBuffer(af);
+            if (ret == JIM_OK && JimAioHasOutput(af) && !JimAioCanFlushLater(interp, af)) {
+                /* Non-blocking with no event loop to write the rest: wait for it here */
+                ret = JimAioFlushAll(af);
+            }
+        }
+        if (ret != JIM_OK) {
+            /* Still closed, but the lost output is reported */
+            JimAioSetError(interp, af->filename);
+            af->err = 0;
+            af->wlen = 0;
+            JimAioConsume(af, CAST(int)JimAioOutputLength(af));
+            IGNORERET Jim_DeleteCommand(interp, Jim_String(argv[0]));
+            return JIM_ERR;
+        }
+    }
 
     return Jim_DeleteCommand(interp, Jim_String(argv[0]));
 }
@@ -508,6 +2353,9 @@ static Retval aio_cmd_seek(Jim_InterpPtr interp, int argc, Jim_ObjConstArray arg
     int orig = SEEK_SET;
     jim_wide offset;
 
+    if (JimAioCheckBusy(interp, af) != JIM_OK) {
+        return JIM_ERR;
+    }
     if (argc == 2) {
         if (Jim_CompareStringImmediate(interp, argv[1], "start"))
             orig = SEEK_SET;
@@ -522,18 +2370,45 @@ static Retval aio_cmd_seek(Jim_InterpPtr interp, int argc, Jim_ObjConstArray arg
     if (Jim_GetWide(interp, argv[0], &offset) != JIM_OK) {
         return JIM_ERR;
     }
-    if (compat_fseeko(af->fp, offset, orig) == -1) {
+    if (JimAioIsStdio(af)) {
+        if (compat_fseeko(af->fp, offset, orig) == -1) {
+            JimAioSetError(interp, af->filename);
+            return JIM_ERR;
+        }
+        return JIM_OK;
+    }
+    if (JimAioFlushBuffer(af) != JIM_OK) {
+        JimAioSetError(interp, af->filename);
+        af->err = 0;
+        return JIM_ERR;
+    }
+    if (orig == SEEK_CUR) {
+        /* Relative to what the script has read, not to what has been read ahead */
+        offset -= af->rend - af->rpos;
+    }
+    if (prj_lseek(af->fd, offset, orig) == -1) {
         JimAioSetError(interp, af->filename);
         return JIM_ERR;
     }
+    af->rpos = af->rend = 0;
+    af->eof = 0;
     return JIM_OK;
 }
 
 static Retval aio_cmd_tell(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    jim_wide pos;
 
-    Jim_SetResultInt(interp, compat_ftello(af->fp));
+    if (JimAioIsStdio(af)) {
+        Jim_SetResultInt(interp, compat_ftello(af->fp));
+        return JIM_OK;
+    }
+    pos = prj_lseek(af->fd, 0, SEEK_CUR);
+    if (pos >= 0) {
+        pos += JimAioOutputLength(af) - (af->rend - af->rpos);
+    }
+    Jim_SetResultInt(interp, pos);
     return JIM_OK;
 }
 
@@ -575,7 +2450,12 @@ static Retval aio_cmd_sync(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjCon
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
 
-    fflush(af->fp);
+    if (JimAioIsStdio(af)) {
+        fflush(af->fp);
+    }
+    else {
+        IGNORERET JimAioFlushBuffer(af);
+    }
     IGNORERET prj_fsync(af->fd); // #NonPortFuncFix
     return JIM_OK;
 }
@@ -601,6 +2481,15 @@ static Retval aio_cmd_buffering(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_O
     if (Jim_GetEnum(interp, argv[0], options, &option, NULL, JIM_ERRMSG) != JIM_OK) {
         return JIM_ERR;
     }
+    if (!JimAioIsStdio(af)) {
+        af->buffering = option;
+        if (option != AIO_BUFFER_FULL && JimAioFlushBuffer(af) != JIM_OK) {
+            JimAioSetError(interp, af->filename);
+            af->err = 0;
+            return JIM_ERR;
+        }
+        return JIM_OK;
+    }
     switch (option) {
         case OPT_NONE:
             setvbuf(af->fp, NULL, _IONBF, 0);
@@ -615,6 +2504,111 @@ static Retval aio_cmd_buffering(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_O
     return JIM_OK;
 }
 
+static Retval aio_cmd_buffersize(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+
+    if (argc) {
+        jim_wide size;
+
+        if (Jim_GetWide(interp, argv[0], &size) != JIM_OK) {
+            return JIM_ERR;
+        }
+        if (size < 1 || size > AIO_BUF_MAX) {
+            Jim_SetResultFormatted(interp, "bad buffer size \"%#s\"", argv[0]); // #ErrStr
+            return JIM_ERR;
+        }
+        /* The buffers take the new size once they are next empty */
+        af->bufferSize = CAST(int)size;
+    }
+    Jim_SetResultInt(interp, af->bufferSize);
+    return JIM_OK;
+}
+
+static Retval aio_cmd_pending(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+
+    Jim_SetResultInt(interp, JimAioOutputLength(af));
+    return JIM_OK;
+}
+
+#ifdef JIM_AIO_MMAP // #optionalCode
+/* Jim_ExternalBytesProc for the mapping made by aio_cmd_mmap(). clientData is the mapped size */
+static void JimAioUnmap(char *bytes, int len MAYBE_USED, void *clientData)
+{
+    IGNORERET munmap(bytes, (size_t)clientData);
+}
+
+static Retval aio_cmd_mmap(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    static const char * const options[] = {
+        "normal",
+        "sequential",
+        "random",
+        "willneed",
+        NULL
+    };
+    static const int advice[] = {
+        MADV_NORMAL,
+        MADV_SEQUENTIAL,
+        MADV_RANDOM,
+        MADV_WILLNEED,
+    };
+    int option = 0;
+    struct stat sb;
+    size_t pagesize, maplen;
+    char *base;
+
+    if (argc && Jim_GetEnum(interp, argv[0], options, &option, "advice", JIM_ERRMSG) != JIM_OK) {
+        return JIM_ERR;
+    }
+    /* The mapping sees the file, not what is still waiting in our buffer */
+    if (JimAioIsStdio(af)) {
+        fflush(af->fp);
+    }
+    else if (JimAioFlushBuffer(af) != JIM_OK) {
+        JimAioSetError(interp, af->filename); // #MissInCoverage
+        af->err = 0;
+        return JIM_ERR;
+    }
+    if (fstat(af->fd, &sb) != 0) {
+        JimAioSetError(interp, af->filename); // #MissInCoverage
+        return JIM_ERR;
+    }
+    if (!S_ISREG(sb.st_mode) || sb.st_size >= INT_MAX) {
+        Jim_SetResultFormatted(interp, "%#s: can't map a channel that is not a file or is too large", af->filename); // #ErrStr
+        return JIM_ERR;
+    }
+    if (sb.st_size == 0) {
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+
+    /* Reserve one byte more than the file, so the page after a file that fills
+     * its last page supplies the null term, then lay the file over the front.
+     * The mapping is private: writes to the string rep never reach the file.
+     */
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    maplen = ((size_t)sb.st_size + pagesize) / pagesize * pagesize;
+    base = (char*)mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        JimAioSetError(interp, af->filename); // #MissInCoverage
+        return JIM_ERR;
+    }
+    if (mmap(base, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, af->fd, 0) == MAP_FAILED) {
+        JimAioSetError(interp, af->filename); // #MissInCoverage
+        IGNORERET munmap(base, maplen);
+        return JIM_ERR;
+    }
+    IGNORERET madvise(base, (size_t)sb.st_size, advice[option]);
+
+    Jim_SetResult(interp, Jim_NewStringObjExternal(interp, base, CAST(int)sb.st_size, JimAioUnmap, (void*)maplen));
+    return JIM_OK;
+}
+#endif
+
 #ifdef jim_ext_eventloop // #optionalCode
 static void JimAioFileEventFinalizer(Jim_InterpPtr interp_, void *clientData)
 {
@@ -624,13 +2618,49 @@ static void JimAioFileEventFinalizer(Jim_InterpPtr interp_, void *clientData)
     *objPtrPtr = NULL;
 }
 
-static int JimAioFileEventHandler(Jim_InterpPtr interp_, void *clientData, int mask)
+static int JimAioFileEventHandler(Jim_InterpPtr interp_, void *clientData, int mask MAYBE_USED)
 {
     Jim_ObjArray *objPtrPtr = (Jim_ObjArray*)clientData;
 
     return Jim_EvalObjBackground(interp_, *objPtrPtr);
 }
 
+static void JimAioReadableFinalizer(Jim_InterpPtr interp_, void *clientData)
+{
+    JimAioFileEventFinalizer(interp_, &((AioFile*)clientData)->rEvent);
+}
+
+/* Input already read ahead into the channel buffer won't make the descriptor readable
+ * again, so the script is run again for as long as it keeps consuming buffered input.
+ */
+static int JimAioReadableHandler(Jim_InterpPtr interp_, void *clientData, int mask MAYBE_USED)
+{
+    AioFile *af = (AioFile*)clientData;
+    int *outerClosed = af->closedFlag;
+    int closed = 0;
+    int ret;
+
+    af->closedFlag = &closed;
+    while (1) {
+        int rpos = af->rpos;
+        int rend = af->rend;
+
+        ret = Jim_EvalObjBackground(interp_, af->rEvent);
+        if (closed) {
+            /* af is gone */
+            if (outerClosed) {
+                *outerClosed = 1;
+            }
+            return ret;
+        }
+        if (ret != JIM_OK || af->rEvent == NULL || af->rpos == af->rend || (af->rpos == rpos && af->rend == rend)) {
+            break;
+        }
+    }
+    af->closedFlag = outerClosed;
+    return ret;
+}
+
 static Retval aio_eventinfo(Jim_InterpPtr interp_, AioFile * af, unsigned_t mask, Jim_ObjArray *scriptHandlerObj,
     int argc, Jim_ObjConstArray argv)
 {
@@ -641,6 +2671,13 @@ static Retval aio_eventinfo(Jim_InterpPtr interp_, AioFile * af, unsigned_t mask
         }
         return JIM_OK;
     }
+    if (JimAioCheckBusy(interp_, af) != JIM_OK) {
+        return JIM_ERR;
+    }
+    if (mask == JIM_EVENT_WRITABLE && af->flushing) {
+        /* The writable script takes over from JimAioFlushHandler() */
+        Jim_DeleteFileHandler(interp_, af->fd, mask);
+    }
 
     if (*scriptHandlerObj) {
         /* Delete old handler */
@@ -657,8 +2694,14 @@ static Retval aio_eventinfo(Jim_InterpPtr interp_, AioFile * af, unsigned_t mask
     Jim_IncrRefCount(argv[0]);
     *scriptHandlerObj = argv[0];
 
-    Jim_CreateFileHandler(interp_, af->fd, mask,
-        JimAioFileEventHandler, scriptHandlerObj, JimAioFileEventFinalizer);
+    if (mask == JIM_EVENT_READABLE) {
+        Jim_CreateFileHandler(interp_, af->fd, mask,
+            JimAioReadableHandler, af, JimAioReadableFinalizer);
+    }
+    else {
+        Jim_CreateFileHandler(interp_, af->fd, mask,
+            JimAioFileEventHandler, scriptHandlerObj, JimAioFileEventFinalizer);
+    }
 
     return JIM_OK;
 }
@@ -670,6 +2713,46 @@ static Retval aio_cmd_readable(Jim_InterpPtr interp_, int argc, Jim_ObjConstArra
     return aio_eventinfo(interp_, af, JIM_EVENT_READABLE, &af->rEvent, argc, argv);
 }
 
+static Retval aio_cmd_highwater(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    AioFile *af = (AioFile*)Jim_CmdPrivData(interp);
+    jim_wide limit;
+
+    if (argc == 0) {
+        if (af->hEvent) {
+            Jim_ObjPtr listObj = Jim_NewListObj(interp, NULL, 0);
+
+            Jim_ListAppendElement(interp, listObj, Jim_NewIntObj(interp, af->highWater));
+            Jim_ListAppendElement(interp, listObj, af->hEvent);
+            Jim_SetResult(interp, listObj);
+        }
+        return JIM_OK;
+    }
+    if (argc != 2) {
+        return -1;
+    }
+    if (Jim_GetWide(interp, argv[0], &limit) != JIM_OK) {
+        return JIM_ERR;
+    }
+    if (limit < 1 && Jim_Length(argv[1])) {
+        Jim_SetResultFormatted(interp, "bad high water mark \"%#s\"", argv[0]); // #ErrStr
+        return JIM_ERR;
+    }
+    if (af->hEvent) {
+        Jim_DecrRefCount(interp, af->hEvent);
+        af->hEvent = NULL;
+    }
+    af->overHigh = 0;
+    if (Jim_Length(argv[1])) {
+        af->highWater = limit;
+        af->hEvent = argv[1];
+        Jim_IncrRefCount(af->hEvent);
+        /* Output may be over the new mark already */
+        JimAioCheckWater(interp, af);
+    }
+    return JIM_OK;
+}
+
 static Retval aio_cmd_writable(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray argv) // #JimCmd
 {
     AioFile *af = (AioFile*)Jim_CmdPrivData(interp_);
@@ -741,18 +2824,18 @@ static Retval aio_cmd_unlock(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray
 
 static const jim_subcmd_type g_aio_command_table[] = { // #JimSubCmdDef
     {   "read",
-        "?-nonewline? ?len?",
+        "?-nonewline|-async script? ?len?",
         aio_cmd_read,
         0,
-        2,
-        /* Description: Read and return bytes from the stream. To eof_ if no len_. */
+        3,
+        /* Description: Read and return bytes from the stream. To eof_ if no len_. With -async, pass them to script_ later */
     },
     {   "copyto",
-        "handle ?size?",
+        "handle ?size? ?-command script?",
         aio_cmd_copy,
         1,
-        2,
-        /* Description: Copy up to 'size_' bytes to the given filehandle, or to eof_ if no size_. */
+        4,
+        /* Description: Copy up to 'size_' bytes to the given filehandle, or to eof_ if no size_. In the background with -command. */
     },
     {   "getfd",
         NULL,
@@ -768,12 +2851,27 @@ static const jim_subcmd_type g_aio_command_table[] = { // #JimSubCmdDef
         1,
         /* Description: Read one lineNum_ and return it or store it in the var */
     },
+    {   "foreachline",
+        "varName body",
+        aio_cmd_foreachline,
+        2,
+        2,
+        JIM_MODFLAG_FULLARGV,
+        /* Description: Evaluate body with each line in turn in varName, to end of file */
+    },
+    {   "lines",
+        "?-count n?",
+        aio_cmd_lines,
+        0,
+        2,
+        /* Description: Return the rest of the lines, or the next n, as a list */
+    },
     {   "puts",
-        "?-nonewline? str",
+        "?-nonewline? ?-async script? str",
         aio_cmd_puts,
         1,
-        2,
-        /* Description: Write the string, with newline unless -nonewline */
+        4,
+        /* Description: Write the string, with newline unless -nonewline. With -async, pass the count to script_ later */
     },
     {   "isatty",
         NULL,
@@ -887,6 +2985,29 @@ static const jim_subcmd_type g_aio_command_table[] = { // #JimSubCmdDef
         1,
         /* Description: Sets buffering */
     },
+    {   "buffersize",
+        "?size?",
+        aio_cmd_buffersize,
+        0,
+        1,
+        /* Description: Returns or sets the size of the read and write buffers */
+    },
+    {   "pending",
+        NULL,
+        aio_cmd_pending,
+        0,
+        0,
+        /* Description: Returns the number of bytes of output not yet written */
+    },
+#ifdef JIM_AIO_MMAP // #optionalCode
+    {   "mmap",
+        "?normal|sequential|random|willneed?",
+        aio_cmd_mmap,
+        0,
+        1,
+        /* Description: Returns the whole file as a string backed by a private copy-on-write mapping */
+    },
+#endif
 #ifdef jim_ext_eventloop // #optionalCode
     {   "readable",
         "?readable-script?",
@@ -902,6 +3023,13 @@ static const jim_subcmd_type g_aio_command_table[] = { // #JimSubCmdDef
         1,
         /* Description: Returns script, or invoke writable-script when writable, {} to remove */
     },
+    {   "highwater",
+        "?bytes script?",
+        aio_cmd_highwater,
+        0,
+        2,
+        /* Description: Returns mark and script, or invoke script when pending output reaches bytes and when it drains, {} to remove */
+    },
     {   "onexception",
         "?exception-script?",
         aio_cmd_onexception,
@@ -1014,6 +3142,41 @@ static SSL_CTX *JimAioSslCtx(Jim_InterpPtr interp_)
 }
 #endif /* JIM_BOOTSTRAP */
 
+#ifndef JIM_ANSIC // #optionalCode #WinOff
+/**
+ * Opens 'filename' as for fopen() with 'mode', but returns the file descriptor.
+ */
+static int JimAioOpenFile(const char *filename, const char *mode)
+{
+    int flags;
+
+    switch (*mode++) {
+        case 'r':
+            flags = 0;
+            break;
+        case 'w':
+            flags = O_CREAT | O_TRUNC;
+            break;
+        case 'a':
+            flags = O_CREAT | O_APPEND;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    if (strchr(mode, '+')) {
+        flags |= O_RDWR;
+    }
+    else {
+        flags |= (flags ? O_WRONLY : O_RDONLY);
+    }
+    if (strchr(mode, 'x')) {
+        flags |= O_EXCL;
+    }
+    return prj_open(filename, flags, 0666); // #NonPortFuncFix #MagicNum
+}
+#endif
+
 /**
  * Creates a channel for fh/fd/filename.
  *
@@ -1021,6 +3184,10 @@ static SSL_CTX *JimAioSslCtx(Jim_InterpPtr interp_)
  * Otherwise, if fd is >= 0, uses that as the channel.
  * Otherwise opens 'filename' with mode 'mode'.
  *
+ * Channels read and write their descriptor directly through the channel buffers.
+ * Only fh channels opened for writing (stdout, stderr) stay on stdio, so that their
+ * output stays in order with what the interpreter itself prints.
+ *
  * hdlfmt is a sprintf format for the filehandle. Anything with %ld at the end will do.
  * mode is used for open or fdopen.
  *
@@ -1047,26 +3214,29 @@ static AioFile *JimMakeChannel(Jim_InterpPtr interp, FILE *fh, int fd, Jim_ObjPt
 
     Jim_IncrRefCount(filename);
 
-    if (fh == NULL) {
-        if (fd >= 0) {
 #ifndef JIM_ANSIC // #optionalCode #WinOff
-            fh = prj_fdopen(fd, mode); // #NonPortFuncFix 
-#endif
+    if (fh) {
+        fd = prj_fileno(fh); // #NonPortFuncFix
+    }
+    else if (fd < 0) {
+        fd = JimAioOpenFile(Jim_String(filename), mode);
+        if (fd < 0) {
+            JimAioSetError(interp, filename);
+            Jim_DecrRefCount(interp, filename);
+            return NULL;
         }
-        else
-            fh = fopen(Jim_String(filename), mode);
+    }
+#else
+    if (fh == NULL) {
+        fh = fopen(Jim_String(filename), mode);
 
         if (fh == NULL) {
             JimAioSetError(interp, filename);
-#ifndef JIM_ANSIC // #optionalCode #WinOff
-            if (fd >= 0) {
-                prj_close(fd); // #NonPortFuncFix
-            }
-#endif
             Jim_DecrRefCount(interp, filename);
             return NULL;
         }
     }
+#endif
 
     /* Create the file command_ */
     af = new_AioFile; // #AllocF 
@@ -1074,17 +3244,22 @@ static AioFile *JimMakeChannel(Jim_InterpPtr interp, FILE *fh, int fd, Jim_ObjPt
     af->fp = fh;
     af->filename = filename;
     af->openFlags = openFlags; 
+    af->fd = fd;
+    af->interp = interp;
 #ifndef JIM_ANSIC // #optionalCode #WinOff
-    af->fd = prj_fileno(fh);
 #ifdef FD_CLOEXEC // #optionalCode #WinOff
     if ((openFlags & AIO_KEEPOPEN) == 0) {
         (void)prj_fcntl(af->fd, F_SETFD, FD_CLOEXEC); // #NonPortFuncFix
     }
 #endif
+    af->fops = (fh && *mode != 'r') ? &g_stdio_fops : &g_fd_fops;
+#else
+    af->fops = &g_stdio_fops;
 #endif
     af->addr_family = family;
-    af->fops = &g_stdio_fops;
     af->ssl = NULL;
+    af->bufferSize = AIO_BUF_SIZE;
+    af->buffering = (prj_funcDef(prj_isatty) && prj_isatty(af->fd)) ? AIO_BUFFER_LINE : AIO_BUFFER_FULL; // #NonPortFuncFix
 
     IGNORERET Jim_CreateCommand(interp, buf, JimAioSubCmdProc, af, JimAioDelProc);
 
@@ -58,10 +58,11 @@ static Retval clock_cmd_format(Jim_InterpPtr interp, int argc, Jim_ObjConstArray
 {
     /* How big is big enough? */
     char buf[100];
-    time_t t;
+    prj_time_t t;
     jim_wide seconds;
     struct clock_options options = { 0, "%a %b %d %H:%M:%S %Z %Y" };
-    struct tm *tm;
+    struct prj_tm tmbuf;
+    struct prj_tm *tm;
 
     if (Jim_GetWide(interp, argv[0], &seconds) != JIM_OK) {
         return JIM_ERR;
@@ -74,9 +75,9 @@ static Retval clock_cmd_format(Jim_InterpPtr interp, int argc, Jim_ObjConstArray
     }
 
     t = seconds;
-    tm = options.gmt ? gmtime(&t) : localtime(&t); // #NonPortFunc #ConvFunc #prjFuncError
+    tm = options.gmt ? prj_gmtime_r(&t, &tmbuf) : prj_localtime_r(&t, &tmbuf); // #NonPortFuncFix
 
-    if (tm == NULL || strftime(buf, sizeof(buf), options.format, tm) == 0) {
+    if (tm == NULL || strftime(buf, sizeof(buf), options.format, (struct tm *)tm) == 0) {
         Jim_SetResultString(interp, "format string too long or invalid time", -1); // #ErrStr
         return JIM_ERR;
     }
@@ -165,6 +166,13 @@ static Retval clock_cmd_millis(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_Ob
     return JIM_OK;
 }
 
+static Retval clock_cmd_monotonic(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+{
+    Jim_SetResultInt(interp, (jim_wide) prj_monotonic_ns());
+
+    return JIM_OK;
+}
+
 static const jim_subcmd_type g_clock_command_table[] = { // #JimSubCmdDef
     {   "clicks",
         NULL,
@@ -194,6 +202,13 @@ static const jim_subcmd_type g_clock_command_table[] = { // #JimSubCmdDef
         0,
         /* Description: Returns the current time in milliseconds */
     },
+    {   "monotonic",
+        NULL,
+        clock_cmd_monotonic,
+        0,
+        0,
+        /* Description: Returns a monotonic time in nanoseconds, for measuring intervals */
+    },
 #ifdef HAVE_STRPTIME // #optionalCode #WinOff #removeCmds
     {   "scan",
         "str -format format ?-gmt boolean?",
@@ -49,6 +49,12 @@
 #include <unistd.h>
 #endif
 
+#if defined(PRJ_OS_LINUX) // #optionalCode
+#include <sys/epoll.h>
+#include <poll.h>
+#define JIM_EVENTLOOP_EPOLL 1
+#endif
+
 /* --- */
 BEGIN_JIM_NAMESPACE
 
@@ -60,7 +66,17 @@ struct Jim_FileEvent
     Jim_FileProc *fileProc;
     Jim_EventFinalizerProc *finalizerProc;
     void *clientData;
-    struct Jim_FileEvent *next;
+    struct Jim_FileEvent *next; /* next handler on the same fd */
+};
+
+/* The handlers of one file descriptor. The event loop keeps these in a table
+ * indexed by fd, so adding and removing a handler does not search a list. */
+struct Jim_FdEvents
+{
+    Jim_FileEvent *head;
+    int mask;                   /* union of the handler masks, as given to the poller */
+    int alwaysReady;            /* the poller refused the fd, e.g. a regular file */
+    int polled;                 /* epoll failed to take the fd for another reason, so poll() watches it */
 };
 
 /* Time event structure */
@@ -72,7 +88,7 @@ struct Jim_TimeEvent
     Jim_TimeProc *timeProc;
     Jim_EventFinalizerProc *finalizerProc;
     void *clientData;
-    struct Jim_TimeEvent *next;
+    int heapIndex;              /* position in the timer heap */
 };
 
 /* You might want to instrument or cache heap use so we wrap it access here. */
@@ -80,15 +96,36 @@ struct Jim_TimeEvent
 #define free_Jim_FileEvent(ptr) Jim_TFree<Jim_FileEvent>(ptr,"Jim_FileEvent")
 #define new_Jim_TimeEvent       Jim_TAlloc<Jim_TimeEvent>(1,"Jim_TimeEvent")
 #define free_Jim_TimeEvent(ptr) Jim_TFree<Jim_TimeEvent>(ptr,"Jim_TimeEvent")
+#define realloc_Jim_FdEvents(ptr, sz) Jim_TRealloc<Jim_FdEvents>(ptr, sz, "Jim_FdEvents")
+#define free_Jim_FdEvents(ptr)  Jim_TFree<Jim_FdEvents>(ptr,"Jim_FdEvents")
+#define realloc_Jim_TimeHeap(ptr, sz) Jim_TRealloc<Jim_TimeEvent*>(ptr, sz, "Jim_TimeHeap")
+#define free_Jim_TimeHeap(ptr)  Jim_TFree<Jim_TimeEvent*>(ptr,"Jim_TimeHeap")
+#define new_Jim_PollFds(sz)     Jim_TAlloc<struct pollfd>(sz,"Jim_PollFds")
+#define free_Jim_PollFds(ptr)   Jim_TFree<struct pollfd>(ptr,"Jim_PollFds")
+
+#define JIM_FD_TABLE_MIN 64     // #MagicNum
+#define JIM_POLL_BATCH 128      // #MagicNum events taken from the poller per wait
+#define JIM_TIME_HEAP_MIN 16    // #MagicNum
 
 
 /* Per-interp_ structure containing the state of the event loop */
 struct Jim_EventLoop
 {
-    Jim_FileEvent *fileEventHead;
-    Jim_TimeEvent *timeEventHead;
+    Jim_FdEvents *fdEvents;     /* file handlers, indexed by fd */
+    int fdEventsLen;            /* number of slots in fdEvents */
+    int fileEventCount;         /* file descriptors with at least one handler */
+    int alwaysReadyCount;       /* how many of those have alwaysReady set */
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+    int epfd;                   /* epoll instance, or -1 to fall back to select() */
+    int polledCount;            /* how many fds have polled set */
+#endif
+    Jim_TimeEvent **timeHeap;   /* pending time events, a binary min-heap on (when, id) */
+    int timeEventCount;         /* number of entries in timeHeap */
+    int timeHeapLen;            /* allocated entries in timeHeap */
+    Jim_HashTable timeEventIds; /* id -> Jim_TimeEvent, for cancel and info */
+    jim_wide timeSlack;         /* microseconds a wakeup may be delayed to batch timers */
     jim_wide timeEventNextId;   /* highest event id created, starting at 1 */
-    time_t timeBase;
+    jim_wide timeBase;          /* monotonic clock at creation, in microseconds */
     int suppress_bgerror; /* bgerror returned break, so don't call it again */
 };
 
@@ -134,20 +171,138 @@ int Jim_EvalObjBackground(Jim_InterpPtr interp, Jim_ObjPtr scriptObjPtr)
 }
 
 
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+static uint32_t JimEpollEvents(int mask)
+{
+    uint32_t events = 0;
+
+    if (mask & JIM_EVENT_READABLE)
+        events |= EPOLLIN;
+    if (mask & JIM_EVENT_WRITABLE)
+        events |= EPOLLOUT;
+    if (mask & JIM_EVENT_EXCEPTION)
+        events |= EPOLLPRI;
+    return events;
+}
+
+/* A hangup or error wakes both readers and writers, as select() does */
+static int JimEpollReadyMask(uint32_t events)
+{
+    int mask = 0;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        mask |= JIM_EVENT_READABLE;
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        mask |= JIM_EVENT_WRITABLE;
+    if (events & EPOLLPRI)
+        mask |= JIM_EVENT_EXCEPTION;
+    return mask;
+}
+#endif
+
+/**
+ * Recomputes the events wanted on 'fd' after its handlers changed and
+ * passes any difference on to the poller. Registrations persist between waits.
+ */
+static void JimUpdateFdMask(Jim_EventLoop *eventLoop, int fd)
+{
+    Jim_FdEvents *fde = &eventLoop->fdEvents[fd];
+    Jim_FileEvent *fe;
+    int mask = 0;
+
+    for (fe = fde->head; fe; fe = fe->next) {
+        mask |= fe->mask;
+    }
+    if (mask == fde->mask) {
+        return;
+    }
+    if (fde->mask == 0)
+        eventLoop->fileEventCount++;
+    else if (mask == 0)
+        eventLoop->fileEventCount--;
+
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+    if (eventLoop->epfd >= 0 && !fde->alwaysReady) {
+        struct epoll_event ev;
+        int op = (fde->mask == 0) ? EPOLL_CTL_ADD : (mask == 0) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = JimEpollEvents(mask);
+        ev.data.fd = fd;
+        if (epoll_ctl(eventLoop->epfd, op, fd, &ev) != 0) {
+            int ret = -1;
+
+            if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+                /* The fd was closed and reused without removing its handlers */
+                op = EPOLL_CTL_ADD; // #MissInCoverage
+                ret = epoll_ctl(eventLoop->epfd, op, fd, &ev);
+            }
+            else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+                /* Still registered from before its handlers went */
+                op = EPOLL_CTL_MOD; // #MissInCoverage
+                ret = epoll_ctl(eventLoop->epfd, op, fd, &ev);
+            }
+            if (ret == 0 || mask == 0) {
+                /* Done, or nothing more to watch anyway */
+            }
+            else if (op == EPOLL_CTL_ADD && errno == EPERM) {
+                /* Regular files can't be polled, but select() calls them always ready */
+                fde->alwaysReady = 1;
+                eventLoop->alwaysReadyCount++;
+            }
+            else {
+                /* Out of watches or the like: poll() takes this fd on each wait. A bad
+                 * fd then shows up as ready, so its handler gets the error. */
+                if (op == EPOLL_CTL_MOD) {
+                    IGNORERET epoll_ctl(eventLoop->epfd, EPOLL_CTL_DEL, fd, &ev); // #MissInCoverage
+                }
+                fde->polled = 1; // #MissInCoverage
+                eventLoop->polledCount++;
+            }
+        }
+    }
+    if (mask == 0 && fde->polled) {
+        fde->polled = 0; // #MissInCoverage
+        eventLoop->polledCount--;
+    }
+#endif
+    if (mask == 0 && fde->alwaysReady) {
+        fde->alwaysReady = 0;
+        eventLoop->alwaysReadyCount--;
+    }
+    fde->mask = mask;
+}
+
 void Jim_CreateFileHandler(Jim_InterpPtr interp, int fd, int mask,
     Jim_FileProc * proc, void *clientData, Jim_EventFinalizerProc * finalizerProc)
 {
     Jim_FileEvent *fe;
     Jim_EventLoop *eventLoop = (Jim_EventLoop*)Jim_GetAssocData(interp, "eventloop");
 
+    if (fd < 0) {
+        return; // #MissInCoverage
+    }
+    if (fd >= eventLoop->fdEventsLen) {
+        int len = eventLoop->fdEventsLen ? eventLoop->fdEventsLen : JIM_FD_TABLE_MIN;
+
+        while (len <= fd) {
+            len *= 2;
+        }
+        eventLoop->fdEvents = realloc_Jim_FdEvents(eventLoop->fdEvents, len); // #AllocF
+        memset(eventLoop->fdEvents + eventLoop->fdEventsLen, 0,
+            sizeof(Jim_FdEvents) * (len - eventLoop->fdEventsLen));
+        eventLoop->fdEventsLen = len;
+    }
+
     fe = new_Jim_FileEvent; // #AllocF 
     fe->fd = fd;
     fe->mask = mask;
     fe->fileProc = proc;
     fe->finalizerProc = finalizerProc;
     fe->clientData = clientData;
-    fe->next = eventLoop->fileEventHead;
-    eventLoop->fileEventHead = fe;
+    fe->next = eventLoop->fdEvents[fd].head;
+    eventLoop->fdEvents[fd].head = fe;
+    JimUpdateFdMask(eventLoop, fd);
 }
 
 /**
@@ -155,63 +310,349 @@ void Jim_CreateFileHandler(Jim_InterpPtr interp, int fd, int mask,
  */
 void Jim_DeleteFileHandler(Jim_InterpPtr interp, int fd, int mask)
 {
-    Jim_FileEvent *fe, *next, *prev = NULL;
+    Jim_FileEvent *fe, **fep, *removed = NULL;
     Jim_EventLoop *eventLoop = (Jim_EventLoop*)Jim_GetAssocData(interp, "eventloop");
 
-    for (fe = eventLoop->fileEventHead; fe; fe = next) {
-        next = fe->next;
-        if (fe->fd == fd && (fe->mask & mask)) {
-            /* Remove this entry from the list */
-            if (prev == NULL)
-                eventLoop->fileEventHead = next;
-            else
-                prev->next = next;
-            if (fe->finalizerProc)
-                fe->finalizerProc(interp, fe->clientData);
-            free_Jim_FileEvent(fe); // #FreeF 
+    if (eventLoop == NULL || fd < 0 || fd >= eventLoop->fdEventsLen) {
+        return;
+    }
+
+    fep = &eventLoop->fdEvents[fd].head;
+    while ((fe = *fep) != NULL) {
+        if (fe->mask & mask) {
+            /* Unlink now, finalize once the table is consistent again */
+            *fep = fe->next;
+            fe->next = removed;
+            removed = fe;
             continue;
         }
-        prev = fe;
+        fep = &fe->next;
+    }
+    if (removed == NULL) {
+        return;
+    }
+    JimUpdateFdMask(eventLoop, fd);
+
+    while ((fe = removed) != NULL) {
+        removed = fe->next;
+        if (fe->finalizerProc)
+            fe->finalizerProc(interp, fe->clientData);
+        free_Jim_FileEvent(fe); // #FreeF 
+    }
+}
+
+/**
+ * Calls the handlers of 'fd' that want some of the 'ready' events.
+ * A handler may add or remove handlers, so the list is rescanned after each call.
+ */
+static int JimFileEventReady(Jim_InterpPtr interp, Jim_EventLoop *eventLoop, int fd, int ready)
+{
+    int done = 0;
+    int processed = 0;
+
+    while (fd < eventLoop->fdEventsLen) {
+        Jim_FileEvent *fe;
+        int mask = 0;
+        int ret;
+
+        for (fe = eventLoop->fdEvents[fd].head; fe; fe = fe->next) {
+            mask = fe->mask & ready & ~done;
+            if (mask)
+                break;
+        }
+        if (fe == NULL) {
+            break;
+        }
+        done |= fe->mask;
+        ret = fe->fileProc(interp, fe->clientData, mask);
+        if (ret != JIM_OK && ret != JIM_RETURN) {
+            /* Remove the element on handler errorText_ */
+            Jim_DeleteFileHandler(interp, fd, mask);
+        }
+        processed++;
+    }
+    return processed;
+}
+
+/* Handlers on descriptors that can't be polled fire on every pass */
+static int JimAlwaysReadyEvents(Jim_InterpPtr interp, Jim_EventLoop *eventLoop)
+{
+    int fd;
+    int processed = 0;
+
+    for (fd = 0; fd < eventLoop->fdEventsLen && eventLoop->alwaysReadyCount; fd++) {
+        if (eventLoop->fdEvents[fd].alwaysReady) {
+            processed += JimFileEventReady(interp, eventLoop, fd, JIM_EVENT_READABLE | JIM_EVENT_WRITABLE);
+        }
+    }
+    return processed;
+}
+
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+/**
+ * Waits with poll() on the fds epoll would not take, together with the epoll instance itself,
+ * and runs the handlers of those that are ready. Returns 1 if the epoll instance has events,
+ * 0 if not, or -1 on error.
+ */
+static int JimPollPolledFds(Jim_InterpPtr interp, Jim_EventLoop *eventLoop, int timeout, int *processed)
+{
+    /* A handler may wait in the event loop again, so each wait has its own array */
+    struct pollfd *pfd = new_Jim_PollFds(eventLoop->polledCount + 1); // #AllocF
+    int fd, i, n;
+    int count = 1;
+
+    pfd[0].fd = eventLoop->epfd;
+    pfd[0].events = POLLIN;
+    for (fd = 0; fd < eventLoop->fdEventsLen && count <= eventLoop->polledCount; fd++) {
+        if (eventLoop->fdEvents[fd].polled) {
+            /* poll() and epoll share the event bits */
+            pfd[count].fd = fd;
+            pfd[count].events = (short)JimEpollEvents(eventLoop->fdEvents[fd].mask);
+            count++;
+        }
+    }
+    n = poll(pfd, count, timeout);
+    if (n < 0) {
+        n = errno == EINTR ? 0 : -1;
+        if (n < 0) {
+            Jim_SetResultString(interp, strerror(errno), -1);
+        }
+    }
+    else {
+        for (i = 1; i < count; i++) {
+            uint32_t ready = (pfd[i].revents & POLLNVAL) ? (uint32_t)EPOLLERR : (uint32_t)pfd[i].revents;
+
+            if (ready) {
+                *processed += JimFileEventReady(interp, eventLoop, pfd[i].fd, JimEpollReadyMask(ready));
+            }
+        }
+        n = pfd[0].revents != 0;
     }
+    free_Jim_PollFds(pfd); // #FreeF
+    return n;
 }
+#endif
 
-#ifdef CLOCK_MONOTONIC_RAW
-int g_CLOCK_MONOTONIC_RAW_VAL = 1;
+/**
+ * Waits up to 'sleep_us' microseconds (-1 is forever) for file events and
+ * runs their handlers. Returns the number of handlers called, or -2 on errorText_.
+ */
+static int JimPollFileEvents(Jim_InterpPtr interp, Jim_EventLoop *eventLoop, jim_wide sleep_us)
+{
+    int processed = 0;
+
+    if (eventLoop->alwaysReadyCount) {
+        sleep_us = 0;
+    }
+
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+    if (eventLoop->epfd >= 0) {
+        struct epoll_event ready[JIM_POLL_BATCH];
+        int timeout = -1;
+        int i, n;
+
+        if (sleep_us >= 0) {
+            /* Round up so a timer is never woken for early */
+            jim_wide ms = (sleep_us + 999) / 1000;
+            timeout = (ms > INT_MAX) ? INT_MAX : (int)ms;
+        }
+        if (eventLoop->polledCount) {
+            n = JimPollPolledFds(interp, eventLoop, timeout, &processed);
+            if (n <= 0) {
+                return n < 0 ? -2 : processed + JimAlwaysReadyEvents(interp, eventLoop); // #MissInCoverage
+            }
+            /* The epoll instance is ready: take its events without waiting again */
+            timeout = 0; // #MissInCoverage
+        }
+        n = epoll_wait(eventLoop->epfd, ready, JIM_POLL_BATCH, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                return 0; // #MissInCoverage
+            }
+            Jim_SetResultString(interp, strerror(errno), -1); // #MissInCoverage
+            return -2;
+        }
+        for (i = 0; i < n; i++) {
+            processed += JimFileEventReady(interp, eventLoop, ready[i].data.fd, JimEpollReadyMask(ready[i].events));
+        }
+        return processed + JimAlwaysReadyEvents(interp, eventLoop);
+    }
+#endif
+
+#ifdef HAVE_SELECT // #optionalCode #WinOff
+    {
+        int retval;
+        int fd, maxfd = -1;
+        struct timeval tv, *tvp = NULL;
+        fd_set rfds, wfds, efds;
+
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+
+        for (fd = 0; fd < eventLoop->fdEventsLen && fd < FD_SETSIZE; fd++) {
+            int mask = eventLoop->fdEvents[fd].mask;
+
+            if (mask & JIM_EVENT_READABLE)
+                FD_SET(fd, &rfds);
+            if (mask & JIM_EVENT_WRITABLE)
+                FD_SET(fd, &wfds);
+            if (mask & JIM_EVENT_EXCEPTION)
+                FD_SET(fd, &efds);
+            if (mask)
+                maxfd = fd;
+        }
+
+        if (sleep_us >= 0) {
+            tvp = &tv;
+            tvp->tv_sec = sleep_us / 1000000;
+            tvp->tv_usec = sleep_us % 1000000;
+        }
+
+        retval = prj_select(maxfd + 1, &rfds, &wfds, &efds, tvp); // #NonPortFunc #SockFunc
+
+        if (retval < 0) {
+            if (errno == EINVAL) {
+                /* This can happen on mingw32 if a non-socket filehandle is passed */
+                Jim_SetResultString(interp, "non-waitable filehandle", -1); // #ErrStr
+                return -2;
+            }
+        }
+        else if (retval > 0) {
+            for (fd = 0; fd <= maxfd; fd++) {
+                int mask = 0;
+
+                if (FD_ISSET(fd, &rfds))
+                    mask |= JIM_EVENT_READABLE;
+                if (FD_ISSET(fd, &wfds))
+                    mask |= JIM_EVENT_WRITABLE;
+                if (FD_ISSET(fd, &efds))
+                    mask |= JIM_EVENT_EXCEPTION;
+                if (mask)
+                    processed += JimFileEventReady(interp, eventLoop, fd, mask);
+            }
+        }
+    }
 #else
-int g_CLOCK_MONOTONIC_RAW_VAL = 0;
-#define CLOCK_MONOTONIC_RAW 0
+    if (sleep_us > 0) {
+        prj_usleep((prj_useconds_t)sleep_us); // #NonPortFuncFix
+    }
 #endif
+    return processed;
+}
 
 /**
  * Returns the time since interp_ creation in microseconds.
+ * The clock is monotonic, so changing the wall clock does not move timers.
  */
 static jim_wide JimGetTimeUsec(Jim_EventLoop *eventLoop)
 {
-    long_long now;
-    struct prj_timeval tv;
+    return prj_monotonic_ns() / 1000 - eventLoop->timeBase;
+}
+
+/* Time events are kept in a binary heap ordered by deadline, and by id
+ * between equal deadlines so timers created together fire in order. */
+static int JimTimeEventBefore(const Jim_TimeEvent *a, const Jim_TimeEvent *b)
+{
+    return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+/* qsort() comparator for an array of Jim_TimeEvent pointers */
+static int JimTimeEventCompare(const void *a, const void *b)
+{
+    const Jim_TimeEvent *ta = *(Jim_TimeEvent * const *)a;
+    const Jim_TimeEvent *tb = *(Jim_TimeEvent * const *)b;
+
+    return JimTimeEventBefore(ta, tb) ? -1 : JimTimeEventBefore(tb, ta) ? 1 : 0;
+}
 
-    struct prj_timespec ts;
+static void JimTimeHeapSet(Jim_EventLoop *eventLoop, int i, Jim_TimeEvent *te)
+{
+    eventLoop->timeHeap[i] = te;
+    te->heapIndex = i;
+}
+
+static void JimTimeHeapUp(Jim_EventLoop *eventLoop, int i)
+{
+    Jim_TimeEvent *te = eventLoop->timeHeap[i];
 
-    if (g_CLOCK_MONOTONIC_RAW_VAL && prj_clock_gettime &&  // #NonPortFuncFix
-        prj_clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == 0) {
-        now = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!JimTimeEventBefore(te, eventLoop->timeHeap[parent]))
+            break;
+        JimTimeHeapSet(eventLoop, i, eventLoop->timeHeap[parent]);
+        i = parent;
     }
-    else
-    {
-        prj_gettimeofday(&tv, NULL); // #NonPortFuncFix
+    JimTimeHeapSet(eventLoop, i, te);
+}
 
-        now = tv.tv_sec * 1000000LL + tv.tv_usec;
+static void JimTimeHeapDown(Jim_EventLoop *eventLoop, int i)
+{
+    Jim_TimeEvent *te = eventLoop->timeHeap[i];
+    int n = eventLoop->timeEventCount;
+
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= n)
+            break;
+        if (child + 1 < n && JimTimeEventBefore(eventLoop->timeHeap[child + 1], eventLoop->timeHeap[child]))
+            child++;
+        if (!JimTimeEventBefore(eventLoop->timeHeap[child], te))
+            break;
+        JimTimeHeapSet(eventLoop, i, eventLoop->timeHeap[child]);
+        i = child;
     }
+    JimTimeHeapSet(eventLoop, i, te);
+}
 
-    return now - eventLoop->timeBase;
+/* Takes 'te' out of the heap and the id table. The caller owns it afterwards. */
+static void JimTimeHeapRemove(Jim_EventLoop *eventLoop, Jim_TimeEvent *te)
+{
+    int i = te->heapIndex;
+    int last = --eventLoop->timeEventCount;
+
+    IGNORERET Jim_DeleteHashEntry(&eventLoop->timeEventIds, &te->id);
+    if (i != last) {
+        JimTimeHeapSet(eventLoop, i, eventLoop->timeHeap[last]);
+        JimTimeHeapUp(eventLoop, i);
+        JimTimeHeapDown(eventLoop, eventLoop->timeHeap[i]->heapIndex);
+    }
 }
 
+static unsigned_int JimTimeEventIdHash(const void *key)
+{
+    jim_wide id = *(const jim_wide *)key;
+
+    /* Ids are sequential, so spread them over the table */
+    return (unsigned_int)((id ^ (id >> 32)) * 2654435761U); // #MagicNum
+}
+
+static int JimTimeEventIdCompare(void *privdata, const void *key1, const void *key2)
+{
+    JIM_NOTUSED(privdata);
+
+    return *(const jim_wide *)key1 == *(const jim_wide *)key2;
+}
+
+/* The keys point at Jim_TimeEvent.id, so there is nothing to copy or free */
+static const Jim_HashTableType g_JimTimeEventIdsHashTableType = { // #JimHashTableType
+    JimTimeEventIdHash,         /* hash function_ */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    JimTimeEventIdCompare,      /* key compare */
+    NULL,                       /* key destructor */
+    NULL,                       /* val destructor */
+    JIM_HT_OPEN_ADDRESSING      /* flags */
+};
+
 jim_wide Jim_CreateTimeHandler(Jim_InterpPtr interp, jim_wide us,
     Jim_TimeProc * proc, void *clientData, Jim_EventFinalizerProc * finalizerProc)
 {
     Jim_EventLoop *eventLoop = (Jim_EventLoop*)Jim_GetAssocData(interp, "eventloop");
     jim_wide id = ++eventLoop->timeEventNextId;
-    Jim_TimeEvent *te, *e, *prev;
+    Jim_TimeEvent *te;
 
     te = new_Jim_TimeEvent; // #AllocF 
     te->id = id;
@@ -221,26 +662,24 @@ jim_wide Jim_CreateTimeHandler(Jim_InterpPtr interp, jim_wide us,
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
 
-    /* Add to the appropriate place in the list */
-    prev = NULL;
-    for (e = eventLoop->timeEventHead; e; e = e->next) {
-        if (te->when < e->when) {
-            break;
-        }
-        prev = e;
-    }
-    if (prev) {
-        te->next = prev->next;
-        prev->next = te;
-    }
-    else {
-        te->next = eventLoop->timeEventHead;
-        eventLoop->timeEventHead = te;
+    if (eventLoop->timeEventCount == eventLoop->timeHeapLen) {
+        eventLoop->timeHeapLen = eventLoop->timeHeapLen ? eventLoop->timeHeapLen * 2 : JIM_TIME_HEAP_MIN;
+        eventLoop->timeHeap = realloc_Jim_TimeHeap(eventLoop->timeHeap, eventLoop->timeHeapLen); // #AllocF
     }
+    JimTimeHeapSet(eventLoop, eventLoop->timeEventCount++, te);
+    JimTimeHeapUp(eventLoop, te->heapIndex);
+    IGNORERET Jim_AddHashEntry(&eventLoop->timeEventIds, &te->id, te);
 
     return id;
 }
 
+void Jim_SetTimeSlack(Jim_InterpPtr interp, jim_wide us)
+{
+    Jim_EventLoop *eventLoop = (Jim_EventLoop*)Jim_GetAssocData(interp, "eventloop");
+
+    eventLoop->timeSlack = (us < 0) ? 0 : us;
+}
+
 static jim_wide JimParseAfterId(Jim_ObjPtr idObj)
 {
     const char *tok = Jim_String(idObj);
@@ -255,46 +694,38 @@ static jim_wide JimParseAfterId(Jim_ObjPtr idObj)
 
 static jim_wide JimFindAfterByScript(Jim_EventLoop *eventLoop, Jim_ObjPtr scriptObj)
 {
-    Jim_TimeEvent *te;
+    Jim_TimeEvent *te = NULL;
+    int i;
+
+    /* The oldest matching event, as the list used to find */
+    for (i = 0; i < eventLoop->timeEventCount; i++) {
+        Jim_TimeEvent *e = eventLoop->timeHeap[i];
 
-    for (te = eventLoop->timeEventHead; te; te = te->next) {
         /* Is this an 'after' event? */
-        if (te->timeProc == JimAfterTimeHandler) {
-            if (Jim_StringEqObj(scriptObj, (Jim_ObjPtr )te->clientData)) {
-                return te->id;
+        if (e->timeProc == JimAfterTimeHandler && (te == NULL || JimTimeEventBefore(e, te))) {
+            if (Jim_StringEqObj(scriptObj, (Jim_ObjPtr )e->clientData)) {
+                te = e;
             }
         }
     }
-    return -1;                  /* NO event with the specified ID found */
+    return te ? te->id : -1;    /* -1: NO event with the specified ID found */
 }
 
 static Jim_TimeEvent *JimFindTimeHandlerById(Jim_EventLoop *eventLoop, jim_wide id)
 {
-    Jim_TimeEvent *te;
+    Jim_HashEntryPtr he = Jim_FindHashEntry(&eventLoop->timeEventIds, &id);
 
-    for (te = eventLoop->timeEventHead; te; te = te->next) {
-        if (te->id == id) {
-            return te;
-        }
-    }
-    return NULL;
+    return he ? (Jim_TimeEvent *)he->getVal() : NULL;
 }
 
 static Jim_TimeEvent *Jim_RemoveTimeHandler(Jim_EventLoop *eventLoop, jim_wide id)
 {
-    Jim_TimeEvent *te, *prev = NULL;
+    Jim_TimeEvent *te = JimFindTimeHandlerById(eventLoop, id);
 
-    for (te = eventLoop->timeEventHead; te; te = te->next) {
-        if (te->id == id) {
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            return te;
-        }
-        prev = te;
+    if (te) {
+        JimTimeHeapRemove(eventLoop, te);
     }
-    return NULL;
+    return te;
 }
 
 static void Jim_FreeTimeHandler(Jim_InterpPtr interp, Jim_TimeEvent *te)
@@ -347,35 +778,33 @@ int Jim_ProcessEvents(Jim_InterpPtr interp, int flags)
     jim_wide sleep_us = -1;
     int processed = 0;
     Jim_EventLoop *eventLoop = (Jim_EventLoop*)Jim_GetAssocData(interp, "eventloop");
-    Jim_FileEvent *fe = eventLoop->fileEventHead;
     Jim_TimeEvent *te;
     jim_wide maxId;
 
-    if ((flags & JIM_FILE_EVENTS) == 0 || fe == NULL) {
+    if ((flags & JIM_FILE_EVENTS) == 0 || eventLoop->fileEventCount == 0) {
         /* No file events */
-        if ((flags & JIM_TIME_EVENTS) == 0 || eventLoop->timeEventHead == NULL) {
+        if ((flags & JIM_TIME_EVENTS) == 0 || eventLoop->timeEventCount == 0) {
             /* No time events */
             return -1;
         }
     }
 
-    /* Note that we want call select() even if there are no
-     * file events to process as long as we want to process time
-     * events, in lsortOrder_ to sleep until the next_ time event is ready
-     * to fire. */
+    /* Even without file handlers to wait on we sleep until the
+     * next time event is ready to fire. */
 
     if (flags & JIM_DONT_WAIT) {
         /* Wait no time */
         sleep_us = 0;
     }
     else if (flags & JIM_TIME_EVENTS) {
-        /* The nearest timer is always at the head of the list */
-        if (eventLoop->timeEventHead) {
-            Jim_TimeEvent *shortest = eventLoop->timeEventHead;
-
-            /* Calculate the time missing_ for the nearest
-             * timer to fire. */
-            sleep_us = shortest->when - JimGetTimeUsec(eventLoop);
+        /* The nearest timer is always at the top of the heap */
+        if (eventLoop->timeEventCount) {
+            Jim_TimeEvent *shortest = eventLoop->timeHeap[0];
+
+            /* Calculate the time missing_ for the nearest timer to fire.
+             * With a slack the wakeup is late enough to also fire the
+             * timers due shortly after it. */
+            sleep_us = shortest->when + eventLoop->timeSlack - JimGetTimeUsec(eventLoop);
             if (sleep_us < 0) {
                 sleep_us = 0;
             }
@@ -386,118 +815,41 @@ int Jim_ProcessEvents(Jim_InterpPtr interp, int flags)
         }
     }
 
-#ifdef HAVE_SELECT // #optionalCode #WinOff
-    if (flags_ & JIM_FILE_EVENTS) {
-        int retval;
-        struct timeval tv, *tvp = NULL;
-        fd_set rfds, wfds, efds;
-        int maxfd = -1;
-
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-        FD_ZERO(&efds);
-
-        /* Check file events */
-        while (fe != NULL) {
-            if (fe->mask & JIM_EVENT_READABLE)
-                FD_SET(fe->fd, &rfds);
-            if (fe->mask & JIM_EVENT_WRITABLE)
-                FD_SET(fe->fd, &wfds);
-            if (fe->mask & JIM_EVENT_EXCEPTION)
-                FD_SET(fe->fd, &efds);
-            if (maxfd < fe->fd)
-                maxfd = fe->fd;
-            fe = fe->next_;
-        }
-
-        if (sleep_us >= 0) {
-            tvp = &tv;
-            tvp->tv_sec = sleep_us / 1000000;
-            tvp->tv_usec = sleep_us % 1000000;
-        }
+    if ((flags & JIM_FILE_EVENTS) && eventLoop->fileEventCount) {
+        int n = JimPollFileEvents(interp, eventLoop, sleep_us);
 
-        retval = prj_select(maxfd + 1, &rfds, &wfds, &efds, tvp); // #NonPortFunc #SockFunc
-
-        if (retval < 0) {
-            if (errno == EINVAL) {
-                /* This can happen on mingw32 if a non-socket filehandle is passed */
-                Jim_SetResultString(interp_, "non-waitable filehandle", -1); // #ErrStr
-                return -2;
-            }
-        }
-        else if (retval > 0) {
-            fe = eventLoop->fileEventHead;
-            while (fe != NULL) {
-                int mask = 0;
-                int fd = fe->fd;
-
-                if ((fe->mask & JIM_EVENT_READABLE) && FD_ISSET(fd, &rfds))
-                    mask |= JIM_EVENT_READABLE;
-                if (fe->mask & JIM_EVENT_WRITABLE && FD_ISSET(fd, &wfds))
-                    mask |= JIM_EVENT_WRITABLE;
-                if (fe->mask & JIM_EVENT_EXCEPTION && FD_ISSET(fd, &efds))
-                    mask |= JIM_EVENT_EXCEPTION;
-
-                if (mask) {
-                    int ret = fe->fileProc(interp_, fe->clientData, mask);
-                    if (ret != JIM_OK && ret != JIM_RETURN) {
-                        /* Remove the element on handler errorText_ */
-                        Jim_DeleteFileHandler(interp_, fd, mask);
-                        /* At this point fe is no longer valid - it will be assigned below */
-                    }
-                    processed++;
-                    /* After an event is processed our file event list
-                     * may no longer be the same, so what we do
-                     * is to clear the bit for this file descriptor and
-                     * restart again from the head. */
-                    FD_CLR(fd, &rfds);
-                    FD_CLR(fd, &wfds);
-                    FD_CLR(fd, &efds);
-                    fe = eventLoop->fileEventHead;
-                }
-                else {
-                    fe = fe->next_;
-                }
-            }
+        if (n < 0) {
+            return n;
         }
+        processed += n;
     }
-#else
-    if (sleep_us > 0) {
+    else if (sleep_us > 0) {
         prj_usleep((prj_useconds_t)sleep_us); // #NonPortFuncFix
     }
-#endif
 
-    /* Check time events */
-    te = eventLoop->timeEventHead;
+    /* Check time events. We make sure to don't process events registered
+     * by event handlers itself in lsortOrder_ to don't loop forever
+     * even in case an [after 0] that continuously register itself.
+     * To do so we saved the max ID we want to handle. Reaching a newer event
+     * ends the pass, leaving it and anything behind it for the next one. */
     maxId = eventLoop->timeEventNextId;
-    while (te) {
-        jim_wide id;
-
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
-        }
-        if (JimGetTimeUsec(eventLoop) >= te->when) {
-            id = te->id;
-            /* Remove from the list before executing */
-            Jim_RemoveTimeHandler(eventLoop, id);
-            te->timeProc(interp, te->clientData);
-            /* After an event is processed our time event list may
-             * no longer be the same, so we restart from head.
-             * Still we make sure to don't process events registered
-             * by event handlers itself in lsortOrder_ to don't loop forever
-             * even in case an [after 0] that continuously register
-             * itself. To do so we saved the max ID we want to handle. */
-            Jim_FreeTimeHandler(interp, te);
-
-            te = eventLoop->timeEventHead;
-            processed++;
-        }
-        else {
-            te = te->next;
+    while (eventLoop->timeEventCount) {
+        te = eventLoop->timeHeap[0];
+        if (te->id > maxId || JimGetTimeUsec(eventLoop) < te->when) {
+            break;
         }
+        /* Remove from the heap before executing */
+        JimTimeHeapRemove(eventLoop, te);
+        te->timeProc(interp, te->clientData);
+        Jim_FreeTimeHandler(interp, te);
+        processed++;
     }
 
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+    /* Give the reference collector a time slice between events */
+    Jim_CollectIfNeeded(interp);
+#endif
+
     return processed;
 }
 
@@ -509,24 +861,34 @@ static void JimELAssocDataDeleProc(Jim_InterpPtr interp, void *data)
     Jim_FileEvent *fe;
     Jim_TimeEvent *te;
     Jim_EventLoop *eventLoop = (Jim_EventLoop*)data;
+    int fd;
 
-    fe = eventLoop->fileEventHead;
-    while (fe) {
-        next = fe->next;
-        if (fe->finalizerProc)
-            fe->finalizerProc(interp, fe->clientData);
-        free_Jim_FileEvent(fe); // #FreeF 
-        fe = (Jim_FileEvent*)next;
+    for (fd = 0; fd < eventLoop->fdEventsLen; fd++) {
+        fe = eventLoop->fdEvents[fd].head;
+        while (fe) {
+            next = fe->next;
+            if (fe->finalizerProc)
+                fe->finalizerProc(interp, fe->clientData);
+            free_Jim_FileEvent(fe); // #FreeF 
+            fe = (Jim_FileEvent*)next;
+        }
     }
+    if (eventLoop->fdEvents)
+        free_Jim_FdEvents(eventLoop->fdEvents); // #FreeF
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+    if (eventLoop->epfd >= 0)
+        close(eventLoop->epfd);
+#endif
 
-    te = eventLoop->timeEventHead;
-    while (te) {
-        next = te->next;
+    while (eventLoop->timeEventCount) {
+        te = eventLoop->timeHeap[--eventLoop->timeEventCount];
         if (te->finalizerProc)
             te->finalizerProc(interp, te->clientData);
         free_Jim_TimeEvent(te); // #FreeF 
-        te = (Jim_TimeEvent*)next;
     }
+    if (eventLoop->timeHeap)
+        free_Jim_TimeHeap(eventLoop->timeHeap); // #FreeF
+    IGNORERET Jim_FreeHashTable(&eventLoop->timeEventIds);
     Jim_TFree<void>(data); // #FreeF 
 }
 
@@ -626,10 +988,10 @@ static Retval JimELAfterCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArra
     jim_wide id;
     Jim_Obj* objPtr, *idObjPtr;
     static const char * const options[] = {
-        "cancel", "info", "idle", NULL
+        "cancel", "info", "idle", "slack", NULL
     };
     enum
-    { AFTER_CANCEL, AFTER_INFO, AFTER_IDLE, AFTER_RESTART, AFTER_EXPIRE, AFTER_CREATE };
+    { AFTER_CANCEL, AFTER_INFO, AFTER_IDLE, AFTER_SLACK, AFTER_RESTART, AFTER_EXPIRE, AFTER_CREATE };
     int option = AFTER_CREATE;
 
     if (argc < 2) {
@@ -697,16 +1059,24 @@ static Retval JimELAfterCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArra
 
         case AFTER_INFO:
             if (argc == 2) {
-                Jim_TimeEvent *te = eventLoop->timeEventHead;
                 Jim_ObjPtr listObj = Jim_NewListObj(interp, NULL, 0);
                 char buf[30];
                 const char *fmt = "after#%" JIM_WIDE_MODIFIER;
-
-                while (te) {
-                    snprintf(buf, sizeof(buf), fmt, te->id);
+                int i, n = eventLoop->timeEventCount;
+                Jim_TimeEvent **sorted;
+
+                /* In the order they will fire */
+                sorted = Jim_TAlloc<Jim_TimeEvent*>(n ? n : 1, "Jim_TimeHeap"); // #AllocF
+                if (n) {
+                    /* timeHeap is still NULL before the first event */
+                    memcpy(sorted, eventLoop->timeHeap, n * sizeof(*sorted));
+                }
+                qsort(sorted, n, sizeof(*sorted), JimTimeEventCompare);
+                for (i = 0; i < n; i++) {
+                    snprintf(buf, sizeof(buf), fmt, sorted[i]->id);
                     Jim_ListAppendElement(interp, listObj, Jim_NewStringObj(interp, buf, -1));
-                    te = te->next;
                 }
+                free_Jim_TimeHeap(sorted); // #FreeF
                 Jim_SetResult(interp, listObj);
             }
             else if (argc == 3) {
@@ -729,6 +1099,21 @@ static Retval JimELAfterCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArra
                 return JIM_ERR;
             }
             break;
+
+        case AFTER_SLACK:
+            /* Milliseconds a wakeup may be late so that timers due close together fire at once */
+            if (argc > 3) {
+                Jim_WrongNumArgs(interp, 2, argv, "?ms?");
+                return JIM_ERR;
+            }
+            if (argc == 3) {
+                if (Jim_GetDouble(interp, argv[2], &ms) != JIM_OK) {
+                    return JIM_ERR;
+                }
+                Jim_SetTimeSlack(interp, (jim_wide)(ms * 1000));
+            }
+            Jim_SetResult(interp, Jim_NewDoubleObj(interp, eventLoop->timeSlack / 1000.0));
+            break;
     }
     return JIM_OK;
 }
@@ -746,6 +1131,12 @@ Retval Jim_eventloopInit(Jim_InterpPtr interp)
 
     eventLoop = Jim_TAllocZ<Jim_EventLoop>(1,"Jim_EventLoop"); // #AllocF 
     //memset(eventLoop, 0, sizeof(*eventLoop));
+    IGNORERET Jim_InitHashTable(&eventLoop->timeEventIds, &g_JimTimeEventIdsHashTableType, NULL);
+    eventLoop->timeBase = prj_monotonic_ns() / 1000;
+#ifdef JIM_EVENTLOOP_EPOLL // #optionalCode
+    /* Without epoll, file events fall back to select() */
+    eventLoop->epfd = epoll_create1(EPOLL_CLOEXEC);
+#endif
 
     IGNORERET Jim_SetAssocData(interp, "eventloop", JimELAssocDataDeleProc, eventLoop);
 
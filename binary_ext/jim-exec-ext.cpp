@@ -68,6 +68,19 @@ END_JIM_NAMESPACE
 #include <signal.h> // #NonPortHeader
 #include <jim-signal.h>
 #include <sys/stat.h>
+#ifdef HAVE_POSIX_SPAWN // #optionalCode #WinOff
+#  include <spawn.h> // #NonPortHeader
+#endif
+#ifdef jim_ext_eventloop // #optionalCode
+#  include <fcntl.h>
+#  include <jim-eventloop.h>
+#  if defined(PRJ_OS_LINUX) // #optionalCode
+#    include <sys/syscall.h> // #NonPortHeader
+#    ifdef __NR_pidfd_open
+#      define JIM_EXEC_PIDFD
+#    endif
+#  endif
+#endif
 #endif
 
 BEGIN_JIM_NAMESPACE 
@@ -141,8 +154,6 @@ int Jim_execInit(Jim_InterpPtr interp) // #JimCmdInit
 struct WaitInfoTable;
 
 static char **JimOriginalEnviron(void);
-static char **JimSaveEnv(char **env);
-static void JimRestoreEnv(char **env);
 static int JimCreatePipeline(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray argv,
     pidtype **pidArrayPtr, int *inPipePtr, int *outPipePtr, int *errFilePtr);
 static void JimDetachPids(struct WaitInfoTable *table, int numPids, const pidtype *pidPtr);
@@ -151,6 +162,9 @@ static Retval Jim_WaitCommand(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray
 
 #if defined(__MINGW32__) // #optionalCode
 static pidtype JimStartWinProcess(Jim_InterpPtr interp_, char **argv, char **env, int inputId, int outputId, int errorId);
+#elif defined(HAVE_POSIX_SPAWN) // #optionalCode #WinOff
+static pidtype JimStartPosixProcess(char **argv, char **env, int inputId, int outputId, int errorId,
+    const int *closeIds, int numClose, int *errPtr);
 #endif
 
 /*
@@ -197,15 +211,11 @@ static int JimAppendStreamToString(Jim_InterpPtr interp_, int fd, Jim_ObjPtr str
 }
 
 /**
- * Builds the environment array from $::env
- *
- * If $::env is not set, simply returns environ.
+ * Builds the environment array from the contents of $::env, 'objPtr_'
  *
- * Otherwise allocates the environ array from the contents of $::env
- *
- * If the exec fails, memory can be freed via JimFreeEnv()
+ * The memory is freed via JimFreeEnv()
  */
-static char **JimBuildEnv(Jim_InterpPtr interp_)
+static char **JimBuildEnv(Jim_InterpPtr interp_, Jim_ObjPtr objPtr_)
 {
     int i;
     int size_;
@@ -214,12 +224,6 @@ static char **JimBuildEnv(Jim_InterpPtr interp_)
     char **envptr;
     char *envdata;
 
-    Jim_ObjPtr objPtr_ = Jim_GetGlobalVariableStr(interp_, "env", JIM_NONE);
-
-    if (!objPtr_) {
-        return JimOriginalEnviron();
-    }
-
     /* We build the array as a single block consisting of the pointers followed by
      * the strings. This has the advantage of being easy to allocate/free and being
      * compatible with both unix and windows
@@ -273,6 +277,60 @@ static void JimFreeEnv(char **env, char **original_environ)
     }
 }
 
+/*
+ * Data structures of the following tokenType_ are used by exec and
+ * wait to keep track of child processes.
+ */
+
+struct WaitInfo
+{
+    pidtype pid;                /* Process id of child. */
+    int status;                 /* Status returned when child exited or suspended. */
+    int flags_;                  /* Various flag bits;  see below for definitions. */
+};
+
+#define free_WaitInfo(ptr)                  Jim_TFree<struct WaitInfo>(ptr,"WaitInfo")
+#define realloc_WaitInfo(orgPtr, newSz)     Jim_TRealloc<struct WaitInfo>(orgPtr, newSz, "WaitInfo")
+
+/* This table is shared by exec and wait */
+struct WaitInfoTable {
+    struct WaitInfo *info;      /* Table of outstanding processes */
+    int size_;                   /* size of the allocated table */
+    int used;                   /* Number of entries in use */
+    int refcount;               /* Free the table once the refcount drops to 0 */
+    Jim_ObjPtr envObj;          /* $::env value that 'env' was built from, or NULL */
+    char **env;                 /* environment for children, cached until $::env changes */
+};
+
+/**
+ * Returns the environment for child processes.
+ *
+ * If $::env is not set, simply returns environ.
+ *
+ * Otherwise returns the environ array built from $::env. It is kept until $::env
+ * changes, along with a reference to the value it was built from. Holding the
+ * reference makes the value shared, so any change to $::env has to replace it
+ * with a new object, and comparing the pointers is enough to tell.
+ */
+static char **JimGetChildEnv(Jim_InterpPtr interp_, struct WaitInfoTable *table)
+{
+    Jim_ObjPtr objPtr_ = Jim_GetGlobalVariableStr(interp_, "env", JIM_NONE);
+
+    if (!objPtr_) {
+        return JimOriginalEnviron();
+    }
+    if (objPtr_ != table->envObj) {
+        if (table->envObj) {
+            Jim_DecrRefCount(interp_, table->envObj);
+            JimFreeEnv(table->env, JimOriginalEnviron());
+        }
+        table->env = JimBuildEnv(interp_, objPtr_);
+        table->envObj = objPtr_;
+        Jim_IncrRefCount(objPtr_);
+    }
+    return table->env;
+}
+
 static Jim_ObjPtr JimMakeErrorCode(Jim_InterpPtr interp_, pidtype pid, int waitStatus, Jim_ObjPtr errStrObj)
 {
     Jim_ObjPtr errorCode = Jim_NewListObj(interp_, NULL, 0);
@@ -337,29 +395,6 @@ static Retval JimCheckWaitStatus(Jim_InterpPtr interp_, pidtype pid, int waitSta
     return JIM_ERR;
 }
 
-/*
- * Data structures of the following tokenType_ are used by exec and
- * wait to keep track of child processes.
- */
-
-struct WaitInfo
-{
-    pidtype pid;                /* Process id of child. */
-    int status;                 /* Status returned when child exited or suspended. */
-    int flags_;                  /* Various flag bits;  see below for definitions. */
-};
-
-#define free_WaitInfo(ptr)                  Jim_TFree<struct WaitInfo>(ptr,"WaitInfo")
-#define realloc_WaitInfo(orgPtr, newSz)     Jim_TRealloc<struct WaitInfo>(orgPtr, newSz, "WaitInfo")
-
-/* This table is shared by exec and wait */
-struct WaitInfoTable {
-    struct WaitInfo *info;      /* Table of outstanding processes */
-    int size_;                   /* size of the allocated table */
-    int used;                   /* Number of entries in use */
-    int refcount;               /* Free the table once the refcount drops to 0 */
-};
-
 /* You might want to instrument or cache heap use so we wrap it access here. */
 #define new_WaitInfoTable           Jim_TAlloc<struct WaitInfoTable>(1,"WaitInfoTable")
 //#define new_WaitInfoTableArray(sz)  Jim_TAlloc<struct WaitInfoTable>(sz,"WaitInfoTable")
@@ -382,6 +417,10 @@ static void JimFreeWaitInfoTable(Jim_InterpPtr interp MAYBE_USED, void *privData
     struct WaitInfoTable *table = (struct WaitInfoTable*)privData;
 
     if (--table->refcount == 0) {
+        if (table->envObj) {
+            Jim_DecrRefCount(interp, table->envObj);
+            JimFreeEnv(table->env, JimOriginalEnviron());
+        }
         free_WaitInfo(table->info); // #FreeF
         free_WaitInfoTable(table); // #FreeF 
     }
@@ -393,6 +432,8 @@ static struct WaitInfoTable *JimAllocWaitInfoTable(void)
     table->info = NULL;
     table->size_ = table->used = 0;
     table->refcount = 1;
+    table->envObj = NULL;
+    table->env = NULL;
 
     return table;
 }
@@ -419,20 +460,355 @@ static int JimWaitRemove(struct WaitInfoTable *table, pidtype pid)
     return -1;
 }
 
+/**
+ * Appends the pipeline's standard errorText_ output, read from errorId which is then closed,
+ * to outObj. If there was none, appends childErrObj (details of abnormal exits) instead.
+ * Finally removes any trailing newline.
+ *
+ * Note that unlike Tcl, the presence of stderr output does not cause
+ * exec to return an errorText_.
+ *
+ * Returns JIM_ERR if errorId could not be read.
+ */
+static Retval JimExecAppendErrors(Jim_InterpPtr interp_, Jim_ObjPtr outObj, int errorId, Jim_ObjPtr childErrObj)
+{
+    Retval result = JIM_OK;
+    int child_siginfo = 1;
+
+    if (errorId != -1) {
+        int ret;
+        prj_lseek(errorId, 0, SEEK_SET); // #NonPortFuncFix 
+        ret = JimAppendStreamToString(interp_, errorId, outObj);
+        if (ret < 0) {
+            Jim_SetResultErrno(interp_, "error reading from error pipe");
+            result = JIM_ERR;
+        }
+        else if (ret > 0) {
+            /* Got some errorText_ output, so discard the abnormal info string */
+            child_siginfo = 0;
+        }
+    }
+
+    if (child_siginfo) {
+        /* Append the child siginfo to the result */
+        Jim_AppendObj(interp_, outObj, childErrObj);
+    }
+
+    /* Finally remove any trailing newline from the result */
+    Jim_RemoveTrailingNewline(outObj);
+    return result;
+}
+
+#ifdef jim_ext_eventloop // #optionalCode
+/* One command_ of a pipeline started by [exec -async] */
+struct JimExecStage {
+    pidtype pid;
+    int status;                 /* wait status, once reaped */
+    int reaped;
+    int pidfd;                  /* becomes readable when the child exits, or -1 if not watched */
+};
+
+/* A pipeline started by [exec -async], followed from the event loop */
+struct JimExecAsync {
+    struct WaitInfoTable *table;
+    Jim_ObjPtr command;         /* callback */
+    Jim_ObjPtr outObj;          /* output read so far */
+    int outputId;               /* output pipe, or -1 once it is at eof */
+    int errorId;                /* temp file collecting standard errorText_ */
+    struct JimExecStage *stages;
+    int numStages;
+    int running;                /* stages not yet reaped */
+    int handlers;               /* event handlers referring to this */
+    int busy;                   /* handlers are being removed here, so finalizers must not free it */
+    jim_wide timerId;           /* polls for exits that no pidfd can report, or 0 */
+};
+
+#define new_JimExecAsync            Jim_TAlloc<struct JimExecAsync>(1,"JimExecAsync")
+#define free_JimExecAsync(ptr)      Jim_TFree<struct JimExecAsync>(ptr,"JimExecAsync")
+#define new_JimExecStageArray(sz)   Jim_TAlloc<struct JimExecStage>(sz,"JimExecStage")
+#define free_JimExecStageArray(ptr) Jim_TFree<struct JimExecStage>(ptr,"JimExecStage")
+
+enum {
+    EXEC_ASYNC_READ_SIZE = 16384,   /* bytes of output read per event */ // #MagicNum
+    EXEC_ASYNC_POLL_US = 10000      /* without pidfd, how often exits are checked */ // #MagicNum
+};
+
+static int JimPidfdOpen(pidtype pid MAYBE_USED)
+{
+#ifdef JIM_EXEC_PIDFD // #optionalCode
+    return CAST(int)syscall(__NR_pidfd_open, (pid_t)pid, 0);
+#else
+    return -1;
+#endif
+}
+
+static void JimExecAsyncFree(Jim_InterpPtr interp, struct JimExecAsync *ea)
+{
+    int i;
+
+    for (i = 0; i < ea->numStages; i++) {
+        if (ea->stages[i].pidfd != -1) {
+            prj_close(ea->stages[i].pidfd); // #NonPortFuncFix
+        }
+        if (!ea->stages[i].reaped) {
+            /* The interpreter is going away. [wait] can still reap it. */
+            JimDetachPids(ea->table, 1, &ea->stages[i].pid);
+        }
+    }
+    if (ea->outputId != -1) {
+        prj_close(ea->outputId); // #NonPortFuncFix
+    }
+    if (ea->errorId != -1) {
+        prj_close(ea->errorId); // #NonPortFuncFix
+    }
+    Jim_DecrRefCount(interp, ea->command);
+    Jim_DecrRefCount(interp, ea->outObj);
+    JimFreeWaitInfoTable(interp, ea->table);
+    free_JimExecStageArray(ea->stages); // #FreeF
+    free_JimExecAsync(ea); // #FreeF
+}
+
+static void JimExecAsyncFinalizer(Jim_InterpPtr interp, void *clientData)
+{
+    struct JimExecAsync *ea = (struct JimExecAsync*)clientData;
+
+    if (--ea->handlers == 0 && !ea->busy) {
+        JimExecAsyncFree(interp, ea);
+    }
+}
+
+/* Stops watching *fdPtr and closes it */
+static void JimExecAsyncUnwatch(Jim_InterpPtr interp, struct JimExecAsync *ea, int *fdPtr)
+{
+    int fd = *fdPtr;
+
+    *fdPtr = -1;
+    ea->busy++;
+    Jim_DeleteFileHandler(interp, fd, JIM_EVENT_READABLE);
+    ea->busy--;
+    prj_close(fd); // #NonPortFuncFix
+}
+
+/* The callback with the output, and the errorCode of a failed stage if any */
+static Jim_ObjPtr JimExecAsyncCallback(Jim_InterpPtr interp, struct JimExecAsync *ea)
+{
+    Jim_ObjPtr childErrObj = Jim_NewStringObj(interp, "", 0);
+    Jim_ObjPtr errCodeObj = NULL;
+    Jim_ObjPtr objPtr;
+    int i;
+
+    Jim_IncrRefCount(childErrObj);
+    for (i = 0; i < ea->numStages; i++) {
+        int status = ea->stages[i].status;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            Jim_ObjPtr codeObj = JimMakeErrorCode(interp, ea->stages[i].pid, status, childErrObj);
+
+            /* As with [exec], the last failure is the one reported */
+            Jim_IncrRefCount(codeObj);
+            if (errCodeObj) {
+                Jim_DecrRefCount(interp, errCodeObj);
+            }
+            errCodeObj = codeObj;
+        }
+    }
+    IGNORERET JimExecAppendErrors(interp, ea->outObj, ea->errorId, childErrObj);
+    ea->errorId = -1;
+    Jim_DecrRefCount(interp, childErrObj);
+
+    objPtr = Jim_DuplicateObj(interp, ea->command);
+    Jim_IncrRefCount(objPtr);
+    Jim_ListAppendElement(interp, objPtr, ea->outObj);
+    if (errCodeObj) {
+        Jim_ListAppendElement(interp, objPtr, errCodeObj);
+        Jim_DecrRefCount(interp, errCodeObj);
+    }
+    return objPtr;
+}
+
+static void JimExecAsyncUpdate(Jim_InterpPtr interp, struct JimExecAsync *ea);
+
+static void JimExecAsyncPoll(Jim_InterpPtr interp, void *clientData)
+{
+    struct JimExecAsync *ea = (struct JimExecAsync*)clientData;
+
+    ea->timerId = 0;
+    JimExecAsyncUpdate(interp, ea);
+}
+
+/* Stages that have no pidfd to report their exit are checked on a timer */
+static void JimExecAsyncArmPoll(Jim_InterpPtr interp, struct JimExecAsync *ea)
+{
+    int i;
+
+    if (ea->timerId) {
+        return;
+    }
+    for (i = 0; i < ea->numStages; i++) {
+        if (!ea->stages[i].reaped && ea->stages[i].pidfd == -1) {
+            ea->handlers++;
+            ea->timerId = Jim_CreateTimeHandler(interp, EXEC_ASYNC_POLL_US, JimExecAsyncPoll, ea, JimExecAsyncFinalizer);
+            return;
+        }
+    }
+}
+
+/* Called whenever the pipeline may have moved on. Reaps the stages that have exited,
+ * and once the output is at eof and every stage is reaped, runs the callback.
+ */
+static void JimExecAsyncUpdate(Jim_InterpPtr interp, struct JimExecAsync *ea)
+{
+    Jim_ObjPtr objPtr;
+    int i;
+
+    for (i = 0; i < ea->numStages; i++) {
+        struct JimExecStage *stage = &ea->stages[i];
+
+        if (!stage->reaped) {
+            pidtype pid = prj_waitpid((prj_pid_t)stage->pid, &stage->status, WNOHANG); // #NonPortFuncFix
+
+            if (pid == JIM_NO_PID || (pid == JIM_BAD_PID && errno == EINTR)) {
+                continue;
+            }
+            if (pid == JIM_BAD_PID) {
+                /* Someone else reaped it with [wait] */
+                stage->status = 0; // #MissInCoverage
+            }
+            stage->reaped = 1;
+            ea->running--;
+            IGNORERET JimWaitRemove(ea->table, stage->pid);
+        }
+        if (stage->pidfd != -1) {
+            JimExecAsyncUnwatch(interp, ea, &stage->pidfd);
+        }
+    }
+    if (ea->outputId != -1 || ea->running) {
+        JimExecAsyncArmPoll(interp, ea);
+        return;
+    }
+
+    /* Done */
+    objPtr = JimExecAsyncCallback(interp, ea);
+    if (ea->timerId) {
+        ea->busy++;
+        IGNORERET Jim_DeleteTimeHandler(interp, ea->timerId);
+        ea->timerId = 0;
+        ea->busy--;
+    }
+    if (ea->handlers == 0) {
+        JimExecAsyncFree(interp, ea);
+    }
+    IGNORERET Jim_EvalObjBackground(interp, objPtr);
+    Jim_DecrRefCount(interp, objPtr);
+}
+
+static int JimExecAsyncOutput(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    struct JimExecAsync *ea = (struct JimExecAsync*)clientData;
+    char buf[EXEC_ASYNC_READ_SIZE];
+    int n = CAST(int)prj_read(ea->outputId, buf, sizeof(buf)); // #input
+
+    if (n > 0) {
+        Jim_AppendString(interp, ea->outObj, buf, n);
+    }
+    else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        JimExecAsyncUnwatch(interp, ea, &ea->outputId);
+        JimExecAsyncUpdate(interp, ea);
+    }
+    return JIM_OK;
+}
+
+static int JimExecAsyncExited(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimExecAsyncUpdate(interp, (struct JimExecAsync*)clientData);
+    return JIM_OK;
+}
+
 /*
- * The main [exec] command_
+ * exec -async command_ arg ?arg ...?
+ *
+ * Starts the pipeline and returns its pids. Output is collected from the event loop,
+ * children are reaped as they exit, and then command_ is run with the output
+ * as [exec] would have returned it and, if a stage failed, the errorCode [exec] would have set.
  */
+static Retval JimExecAsyncStart(Jim_InterpPtr interp_, Jim_ObjPtr command, int argc, Jim_ObjConstArray argv)
+{
+    struct WaitInfoTable *table = (struct WaitInfoTable*)Jim_CmdPrivData(interp_);
+    struct JimExecAsync *ea;
+    pidtype *pidPtr;
+    int outputId;
+    int errorId;
+    Jim_ObjPtr listObj;
+    int numPids = JimCreatePipeline(interp_, argc, argv, &pidPtr, NULL, &outputId, &errorId);
+    int i;
+
+    if (numPids < 0) {
+        return JIM_ERR;
+    }
+
+    ea = new_JimExecAsync; // #AllocF
+    memset(ea, 0, sizeof(*ea));
+    ea->table = table;
+    table->refcount++;
+    ea->command = command;
+    Jim_IncrRefCount(command);
+    ea->outObj = Jim_NewStringObj(interp_, "", 0);
+    Jim_IncrRefCount(ea->outObj);
+    ea->outputId = outputId;
+    ea->errorId = errorId;
+    ea->stages = new_JimExecStageArray(numPids); // #AllocF
+    ea->numStages = ea->running = numPids;
+
+    /* Keep these out of later children */
+    if (errorId != -1) {
+        (void)prj_fcntl(errorId, F_SETFD, FD_CLOEXEC); // #NonPortFuncFix
+    }
+
+    listObj = Jim_NewListObj(interp_, NULL, 0);
+    for (i = 0; i < numPids; i++) {
+        struct JimExecStage *stage = &ea->stages[i];
+
+        stage->pid = pidPtr[i];
+        stage->status = 0;
+        stage->reaped = 0;
+        stage->pidfd = JimPidfdOpen(pidPtr[i]);
+        if (stage->pidfd != -1) {
+            ea->handlers++;
+            Jim_CreateFileHandler(interp_, stage->pidfd, JIM_EVENT_READABLE, JimExecAsyncExited, ea, JimExecAsyncFinalizer);
+        }
+        Jim_ListAppendElement(interp_, listObj, Jim_NewIntObj(interp_, (jim_wide)pidPtr[i]));
+    }
+    Jim_TFree<pidtype>(pidPtr,"pidtype"); // #FreeF
+
+    if (outputId != -1) {
+        (void)prj_fcntl(outputId, F_SETFD, FD_CLOEXEC); // #NonPortFuncFix
+        (void)prj_fcntl(outputId, F_SETFL, prj_fcntl(outputId, F_GETFL) | O_NONBLOCK); // #NonPortFuncFix
+        ea->handlers++;
+        Jim_CreateFileHandler(interp_, outputId, JIM_EVENT_READABLE, JimExecAsyncOutput, ea, JimExecAsyncFinalizer);
+    }
+    JimExecAsyncArmPoll(interp_, ea);
+
+    Jim_SetResult(interp_, listObj);
+    return JIM_OK;
+}
+#endif
+
 static Retval Jim_ExecCmd(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray argv) // #JimCmd #PosixCmd
 {
     int outputId;    /* File id for output pipe. -1 means command_ overrode. */
     int errorId;     /* File id for temporary file containing errorText_ output. */
     pidtype *pidPtr;
     int numPids; Retval result;
-    int child_siginfo = 1;
     Jim_ObjPtr childErrObj;
     Jim_ObjPtr errStrObj;
     struct WaitInfoTable *table = (struct WaitInfoTable*)Jim_CmdPrivData(interp_);
 
+#ifdef jim_ext_eventloop // #optionalCode
+    if (argc > 3 && Jim_CompareStringImmediate(interp_, argv[1], "-async")) {
+        return JimExecAsyncStart(interp_, argv[2], argc - 3, argv + 3);
+    }
+#endif
+
     /*
      * See if the command_ is to be run in the background; if so, create
      * the command_, detach it, and return.
@@ -487,35 +863,12 @@ static Retval Jim_ExecCmd(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray arg
         result = JIM_ERR;
     }
 
-    /*
-     * Read the child's errorText_ output (if any) and put it into the result.
-     *
-     * Note that unlike Tcl, the presence of stderr output does not cause
-     * exec to return an errorText_.
-     */
-    if (errorId != -1) {
-        int ret;
-        prj_lseek(errorId, 0, SEEK_SET); // #NonPortFuncFix 
-        ret = JimAppendStreamToString(interp_, errorId, errStrObj);
-        if (ret < 0) {
-            Jim_SetResultErrno(interp_, "error reading from error pipe");
-            result = JIM_ERR;
-        }
-        else if (ret > 0) {
-            /* Got some errorText_ output, so discard the abnormal info string */
-            child_siginfo = 0;
-        }
-    }
-
-    if (child_siginfo) {
-        /* Append the child siginfo to the result */
-        Jim_AppendObj(interp_, errStrObj, childErrObj);
+    /* Read the child's errorText_ output (if any) and put it into the result */
+    if (JimExecAppendErrors(interp_, errStrObj, errorId, childErrObj) != JIM_OK) {
+        result = JIM_ERR;
     }
     Jim_DecrRefCount(interp_, childErrObj);
 
-    /* Finally remove any trailing newline from the result */
-    Jim_RemoveTrailingNewline(errStrObj);
-
     /* Set this as the result */
     Jim_SetResult(interp_, errStrObj);
 
@@ -775,10 +1128,7 @@ enum {
     int lastBar;
     int i;
     pidtype pid;
-    char **save_environ;
-#ifndef __MINGW32__ // #optionalCode #WinOff
     char **child_environ;
-#endif
     struct WaitInfoTable *table = (struct WaitInfoTable*)Jim_CmdPrivData(interp_);
 
     /* Holds the args_ which will be used to exec */
@@ -895,8 +1245,11 @@ badargs:
         return -1;
     }
 
-    /* Must do this before vfork(), so do it now */
-    save_environ = JimSaveEnv(JimBuildEnv(interp_));
+    /* Must do this before vfork(), so do it now. The block is handed to the child
+     * directly rather than swapped into the process wide environ, which other
+     * threads may be reading.
+     */
+    child_environ = JimGetChildEnv(interp_, table);
 
     /*
      * Set up the redirected input source for the pipeline, if
@@ -1081,15 +1434,40 @@ badargs:
         /* Now fork the child */
 
 #ifdef __MINGW32__ // #optionalCode #WinOff
-        pid = JimStartWinProcess(interp_, &arg_array[firstArg], save_environ, inputId, outputId, errorId);
+        pid = JimStartWinProcess(interp_, &arg_array[firstArg], child_environ, inputId, outputId, errorId);
         if (pid == JIM_BAD_PID) {
             Jim_SetResultFormatted(interp_, "couldn't exec \"%s\"", arg_array[firstArg]);
             goto errorText_;
         }
+#elif defined(HAVE_POSIX_SPAWN) // #optionalCode #WinOff
+        {
+            /* Parent-only file descriptors */
+            int closeIds[4];
+            int numClose = 0;
+            int err;
+
+            if (outPipePtr && *outPipePtr != -1) {
+                closeIds[numClose++] = *outPipePtr;
+            }
+            if (errFilePtr && *errFilePtr != -1) {
+                closeIds[numClose++] = *errFilePtr;
+            }
+            if (pipeIds[0] != -1) {
+                closeIds[numClose++] = pipeIds[0];
+            }
+            if (lastOutputId != -1) {
+                closeIds[numClose++] = lastOutputId;
+            }
+            pid = JimStartPosixProcess(&arg_array[firstArg], child_environ, inputId, outputId, errorId,
+                closeIds, numClose, &err);
+            if (pid == JIM_BAD_PID) {
+                Jim_SetResultFormatted(interp_, "couldn't exec \"%s\": %s", arg_array[firstArg], strerror(err));
+                goto errorText_;
+            }
+        }
 #else
         i = strlen(arg_array[firstArg]);
 
-        child_environ = Jim_GetEnviron();
         /*
          * Make a new process and enter it into the table if the vfork
          * is successful.
@@ -1202,8 +1580,6 @@ badargs:
     }
     Jim_TFree<charArray>(arg_array,"charArray"); // #FreeF
 
-    JimRestoreEnv(save_environ);
-
     return numPids;
 
     /*
@@ -1283,6 +1659,58 @@ static Retval JimCleanupChildren(Jim_InterpPtr interp_, int numPids, pidtype *pi
     return result;
 }
 
+#if !defined(__MINGW32__) && defined(HAVE_POSIX_SPAWN) // #optionalCode #WinOff
+/*
+ * Starts one command_ of a pipeline with posix_spawnp().
+ * Like vfork() the cost doesn't grow with the size of this process, and none of
+ * our code runs in the child: the redirections are done as spawn file actions.
+ * The descriptors in closeIds are closed in the child.
+ *
+ * Returns the pid, or JIM_BAD_PID with the errno value in *errPtr.
+ */
+static pidtype JimStartPosixProcess(char **argv, char **env, int inputId, int outputId, int errorId,
+    const int *closeIds, int numClose, int *errPtr)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    pid_t pid;
+    int i;
+
+    IGNORERET posix_spawn_file_actions_init(&actions);
+    if (inputId != -1) {
+        IGNORERET posix_spawn_file_actions_adddup2(&actions, inputId, prj_fileno(stdin));
+        IGNORERET posix_spawn_file_actions_addclose(&actions, inputId);
+    }
+    if (outputId != -1) {
+        IGNORERET posix_spawn_file_actions_adddup2(&actions, outputId, prj_fileno(stdout));
+        if (outputId != errorId) {
+            IGNORERET posix_spawn_file_actions_addclose(&actions, outputId);
+        }
+    }
+    if (errorId != -1) {
+        IGNORERET posix_spawn_file_actions_adddup2(&actions, errorId, prj_fileno(stderr));
+        IGNORERET posix_spawn_file_actions_addclose(&actions, errorId);
+    }
+    for (i = 0; i < numClose; i++) {
+        IGNORERET posix_spawn_file_actions_addclose(&actions, closeIds[i]);
+    }
+
+    /* Restore SIGPIPE behaviour */
+    IGNORERET posix_spawnattr_init(&attr);
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    IGNORERET posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    IGNORERET posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    *errPtr = posix_spawnp(&pid, argv[0], &actions, &attr, argv, env);
+
+    IGNORERET posix_spawnattr_destroy(&attr);
+    IGNORERET posix_spawn_file_actions_destroy(&actions);
+    return *errPtr ? JIM_BAD_PID : (pidtype)pid;
+}
+#endif
+
 #undef JIM_VERSION
 #define JIM_VERSION(MAJOR, MINOR) static const char* version = #MAJOR "." #MINOR ;
 #include <jim-exec-version.h>
@@ -1340,16 +1768,6 @@ JimWinFindExecutable(const char *originalName, char fullPath[MAX_PATH])
     return -1;
 }
 
-static char **JimSaveEnv(char **env)
-{
-    return env;
-}
-
-static void JimRestoreEnv(char **env)
-{
-    JimFreeEnv(env, Jim_GetEnviron());
-}
-
 static char **JimOriginalEnviron(void)
 {
     return NULL;
@@ -1559,19 +1977,6 @@ static char **JimOriginalEnviron(void)
 {
     return Jim_GetEnviron();
 }
-
-static char **JimSaveEnv(char **env)
-{
-    char **saveenv = Jim_GetEnviron();
-    Jim_SetEnviron(env);
-    return saveenv;
-}
-
-static void JimRestoreEnv(char **env)
-{
-    JimFreeEnv(Jim_GetEnviron(), env);
-    Jim_SetEnviron(env);
-}
 #endif
 #endif
 
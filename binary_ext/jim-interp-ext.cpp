@@ -12,14 +12,12 @@ static void JimInterpDelProc(Jim_InterpPtr interp MAYBE_USED, void *privData)
     Jim_FreeInterp((Jim_InterpPtr )privData);
 }
 
-/* Everything passing between interpreters must be converted to a string */
+/* Objects can't be shared between interpreters, so values passing between them are copied.
+ * Lists, dicts and numbers keep their internal reps and large strings aren't copied.
+ */
 static Jim_ObjPtr JimInterpCopyObj(Jim_InterpPtr target, Jim_ObjPtr obj)
 {
-    const char *rep;
-    int len;
-
-    rep = Jim_GetString(obj, &len);
-    return Jim_NewStringObj(target, rep, len);
+    return Jim_CopyObjToInterp(target, obj);
 }
 
 #define JimInterpCopyResult(to, from) Jim_SetResult((to), JimInterpCopyObj((to), Jim_GetResult((from))))
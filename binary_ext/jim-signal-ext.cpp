@@ -11,6 +11,8 @@
 
 #include <signal.h> // #NonPortHeader
 #include <ctype.h>
+#include <atomic>
+#include <mutex>
 
 #ifdef HAVE_UNISTD_H
     #include <unistd.h> // #NonPortHeader
@@ -29,7 +31,10 @@ enum { MAX_SIGNALS_WIDE = (sizeof(jim_wide) * 8) };
     enum { MAX_SIGNALS = (int)MAX_SIGNALS_WIDE };
 #endif
 
-static jim_wide *sigloc;
+/* Signal dispositions are process wide, so only one interpreter at a time (the first to
+ * load the extension, on whichever thread) owns them. Others get alarm, kill and sleep only.
+ */
+static std::atomic<jim_wide *> sigloc;
 static jim_wide sigsblocked;
 static struct sigaction *sa_old;
 static struct {
@@ -45,7 +50,11 @@ static void signal_handler(int sig)
     /* We just remember which signals occurred. Jim_Eval() will
      * notice this as soon as it can and throw an errorText_
      */
-    *sigloc |= sig_to_bit(sig);
+    jim_wide *loc = sigloc.load();
+
+    if (loc) {
+        *loc |= sig_to_bit(sig);
+    }
 }
 
 static void signal_ignorer(int sig)
@@ -54,7 +63,7 @@ static void signal_ignorer(int sig)
     sigsblocked |= sig_to_bit(sig);
 }
 
-static void signal_init_names(void)
+static void signal_set_names(void)
 {
 #define SET_SIG_NAME(SIG) siginfo[SIG].name_ = #SIG
 
@@ -109,6 +118,13 @@ static void signal_init_names(void)
 #endif
 }
 
+static void signal_init_names(void)
+{
+    static std::once_flag once;
+
+    std::call_once(once, signal_set_names);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -420,7 +436,7 @@ static void JimSignalCmdDelete(Jim_InterpPtr interp MAYBE_USED, void *privData M
     }
     Jim_Free(sa_old);
     sa_old = NULL;
-    sigloc = NULL;
+    sigloc.store(NULL);
 }
 
 static Retval Jim_AlarmCmd(Jim_InterpPtr interp_, int argc, Jim_ObjConstArray argv) // #JimCmd #PosixCmd
@@ -541,13 +557,12 @@ Retval Jim_signalInit(Jim_InterpPtr interp_)
     /* Teach the jim core how to set a result from a sigmask */
     interp_->signal_set_result_ = signal_set_sigmask_result;
 
-    /* Currently only the top level_ interp_ supports signals */
-    if (!sigloc) {
-        signal_init_names();
-
-        /* Make sure we know where to store the signals which occur */
-        sigloc = interp_->getSigmaskPtr();
+    /* Names are also used by exec to report how children died */
+    signal_init_names();
 
+    /* Currently only one interp_ supports signals. Make sure we know where to store the signals which occur */
+    jim_wide *expected = NULL;
+    if (sigloc.compare_exchange_strong(expected, interp_->getSigmaskPtr())) {
         IGNORERET Jim_CreateCommand(interp_, "signal", Jim_SubCmdProc, (void *)signal_command_table, JimSignalCmdDelete);
     }
 
@@ -0,0 +1,1089 @@
+/*
+ * jim-thread-ext.cpp
+ *
+ * Worker interpreters on OS threads.
+ *
+ *   thread create ?script?     - Starts a thread running its own interpreter and event loop,
+ *                                evaluates script in it and returns a handle for the thread
+ *   thread cores               - The number of processors online
+ *
+ *   $t eval script ...         - Evaluates the script in the worker and waits for the result
+ *   $t send script ?callback?  - Queues the script and returns at once. Once it is done,
+ *                                callback is run from the event loop with the return code and result
+ *   $t set name value          - Queues setting the global variable name in the worker
+ *   $t pending                 - The number of queued scripts not yet done
+ *   $t delete                  - Waits for the current script, then stops the thread
+ *
+ *   parallel lmap ?-workers n? varList list ?varList list ...? body
+ *   parallel foreach ?-workers n? varList list ?varList list ...? body
+ *                              - Like lmap and foreach, but the iterations are split into
+ *                                runs over n worker interpreters (default: thread cores), each
+ *                                on its own thread with the caller's procs. The body only sees
+ *                                the loop variables and the procs. lmap results come back in order
+ *
+ * Jim objects never cross threads: an interpreter, and the slab pool its objects
+ * come from, belong to the thread that created it. Scripts, values and results are
+ * passed as strings, as [interp] does, with the buffers handed over rather than copied again.
+ */
+#include <string.h>
+#include <errno.h>
+
+#include <jimautoconf.h>
+#include <jim.h> // #TODO Replace with <jim-api.h>
+
+#if jim_ext_thread
+
+#ifndef _WIN32 
+
+#include <pthread.h> // #NonPortHeader
+#include <unistd.h> // #NonPortHeader
+#include <fcntl.h> // #NonPortHeader
+#include <jim-eventloop.h>
+#include <prj_compat.h>
+
+BEGIN_JIM_NAMESPACE
+
+enum {
+    JIM_THREAD_EVAL = 0,            /* Evaluate a script */
+    JIM_THREAD_SET = 1,             /* Set a global variable */
+    JIM_THREAD_QUIT = 2             /* Leave the event loop */
+};
+
+/* A message to the worker, which also carries the reply back */
+struct JimThreadMsg {
+    JimThreadMsg *next;
+    int kind;
+    char *script;                   /* Script or variable name, handed over to the worker */
+    int scriptLen;
+    char *value;                    /* Variable value */
+    int valueLen;
+    int sync;                       /* The sender is waiting for done */
+    int done;
+    Retval code;
+    char *result;                   /* Handed over to the sender */
+    int resultLen;
+    Jim_ObjPtr callback;            /* Belongs to the parent, never touched by the worker */
+};
+
+struct JimThread {
+    pthread_t tid;
+    pthread_mutex_t lock;           /* Guards everything below but quit */
+    pthread_cond_t doneCond;        /* Broadcast as sync messages are done */
+    JimThreadMsg *inHead;           /* To the worker */
+    JimThreadMsg *inTail;
+    JimThreadMsg *outHead;          /* Replies with a callback, back to the parent */
+    JimThreadMsg *outTail;
+    int inSignalled;                /* A byte for the queue is in the pipe */
+    int outSignalled;
+    int inPipe[2];                  /* Wakes the worker */
+    int outPipe[2];                 /* Wakes the parent */
+    int pending;                    /* Scripts queued and not yet done */
+    int finished;                   /* The worker has left its event loop */
+    int quit;                       /* Worker only */
+};
+
+#define new_JimThreadMsg            Jim_TAllocZ<JimThreadMsg>(1,"JimThreadMsg")
+#define free_JimThreadMsg(ptr)      Jim_TFree<JimThreadMsg>(ptr,"JimThreadMsg")
+#define new_JimThread               Jim_TAllocZ<JimThread>(1,"JimThread")
+#define free_JimThread(ptr)         Jim_TFree<JimThread>(ptr,"JimThread")
+
+static const char g_threadExited[] = "thread has exited"; // #ErrStr
+
+static void JimThreadFreeMsg(JimThreadMsg *msg)
+{
+    Jim_Free(msg->script);
+    Jim_Free(msg->value);
+    Jim_Free(msg->result);
+    free_JimThreadMsg(msg); // #FreeF
+}
+
+/* Queues msg, and wakes the reader of fd if the queue was empty. Called with the lock held.
+ * At most one byte is ever in the pipe, so the write cannot block.
+ */
+static void JimThreadPost(JimThreadMsg **head, JimThreadMsg **tail, int *signalled, int fd, JimThreadMsg *msg)
+{
+    msg->next = NULL;
+    if (*tail) {
+        (*tail)->next = msg;
+    }
+    else {
+        *head = msg;
+    }
+    *tail = msg;
+    if (!*signalled) {
+        char c = 0;
+
+        *signalled = 1;
+        IGNORERET prj_write(fd, &c, 1); // #output
+    }
+}
+
+/* Takes the whole queue, and the byte that announced it. Called with the lock held. */
+static JimThreadMsg *JimThreadTake(JimThreadMsg **head, JimThreadMsg **tail, int *signalled, int fd)
+{
+    JimThreadMsg *msg = *head;
+
+    if (*signalled) {
+        char c;
+
+        *signalled = 0;
+        IGNORERET prj_read(fd, &c, 1); // #input
+    }
+    *head = *tail = NULL;
+    return msg;
+}
+
+/* ----- The worker side ----- */
+
+/* Hands back the reply to msg. Called with the lock held. */
+static void JimThreadReply(JimThread *t, JimThreadMsg *msg, Retval code, char *result, int resultLen)
+{
+    if (msg->kind == JIM_THREAD_EVAL) {
+        t->pending--;
+    }
+    msg->code = code;
+    msg->result = result;
+    msg->resultLen = resultLen;
+    if (msg->sync) {
+        msg->done = 1;
+        pthread_cond_broadcast(&t->doneCond);
+    }
+    else if (msg->callback) {
+        JimThreadPost(&t->outHead, &t->outTail, &t->outSignalled, t->outPipe[1], msg);
+    }
+    else {
+        JimThreadFreeMsg(msg);
+    }
+}
+
+/* Evaluates at the top level, as [interp eval] would in a fresh interpreter */
+static Retval JimThreadEvalTop(Jim_InterpPtr interp, Jim_ObjPtr scriptObj)
+{
+    Jim_CallFramePtr savedFramePtr = interp->framePtr();
+    Retval ret;
+
+    interp->framePtr(Jim_TopCallFrame(interp));
+    Jim_IncrRefCount(scriptObj);
+    ret = Jim_EvalObj(interp, scriptObj);
+    Jim_DecrRefCount(interp, scriptObj);
+    interp->framePtr(savedFramePtr);
+    return ret;
+}
+
+static void JimThreadRun(Jim_InterpPtr interp, JimThread *t, JimThreadMsg *msg)
+{
+    Retval ret = JIM_OK;
+    char *result = NULL;
+    int resultLen = 0;
+
+    if (msg->kind == JIM_THREAD_QUIT) {
+        t->quit = 1;
+        JimThreadFreeMsg(msg);
+        return;
+    }
+    if (t->quit) {
+        /* [exit] earlier in the same batch */
+        ret = JIM_ERR;
+        result = Jim_StrDup(g_threadExited);
+        resultLen = sizeof(g_threadExited) - 1;
+    }
+    else if (msg->kind == JIM_THREAD_SET) {
+        ret = Jim_SetGlobalVariableStr(interp, msg->script, Jim_NewStringObjNoAlloc(interp, msg->value, msg->valueLen));
+        msg->value = NULL;
+    }
+    else {
+        ret = JimThreadEvalTop(interp, Jim_NewStringObjNoAlloc(interp, msg->script, msg->scriptLen));
+        msg->script = NULL;
+        if (ret == JIM_EXIT) {
+            /* Only this thread stops */
+            t->quit = 1;
+            ret = JIM_OK;
+            Jim_SetEmptyResult(interp);
+        }
+    }
+
+    if (result == NULL) {
+        if (msg->sync || msg->callback) {
+            const char *rep = Jim_GetString(Jim_GetResult(interp), &resultLen);
+
+            result = Jim_StrDupLen(rep, resultLen);
+        }
+        else if (ret == JIM_ERR) {
+            /* Nobody is waiting to hear about it */
+            Jim_MakeErrorMessage(interp);
+            IGNORERET fprintf(stderr, "%s\n", Jim_String(Jim_GetResult(interp)));
+        }
+    }
+    pthread_mutex_lock(&t->lock);
+    JimThreadReply(t, msg, ret, result, resultLen);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static int JimThreadReceive(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimThread *t = (JimThread *)clientData;
+    JimThreadMsg *msg;
+
+    pthread_mutex_lock(&t->lock);
+    msg = JimThreadTake(&t->inHead, &t->inTail, &t->inSignalled, t->inPipe[0]);
+    pthread_mutex_unlock(&t->lock);
+
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+
+        JimThreadRun(interp, t, msg);
+        msg = next;
+    }
+    return JIM_OK;
+}
+
+static void *JimThreadMain(void *arg)
+{
+    JimThread *t = (JimThread *)arg;
+    Jim_InterpPtr interp = Jim_CreateInterp();
+    JimThreadMsg *msg;
+
+    Jim_RegisterCoreCommands(interp);
+    IGNORERET Jim_InitStaticExtensions(interp);
+
+    Jim_CreateFileHandler(interp, t->inPipe[0], JIM_EVENT_READABLE, JimThreadReceive, t, NULL);
+    while (!t->quit && Jim_ProcessEvents(interp, JIM_ALL_EVENTS) >= 0) {
+    }
+
+    /* Anything still queued is answered as an error */
+    pthread_mutex_lock(&t->lock);
+    t->finished = 1;
+    msg = JimThreadTake(&t->inHead, &t->inTail, &t->inSignalled, t->inPipe[0]);
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+
+        JimThreadReply(t, msg, JIM_ERR, Jim_StrDup(g_threadExited), sizeof(g_threadExited) - 1);
+        msg = next;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    Jim_FreeInterp(interp);
+    return NULL;
+}
+
+/* ----- The parent side ----- */
+
+static JimThreadMsg *JimThreadNewMsg(int kind, Jim_ObjPtr scriptObj, Jim_ObjPtr valueObj)
+{
+    JimThreadMsg *msg = new_JimThreadMsg; // #AllocF
+    const char *rep;
+    int len;
+
+    msg->kind = kind;
+    if (scriptObj) {
+        rep = Jim_GetString(scriptObj, &len);
+        msg->script = Jim_StrDupLen(rep, len);
+        msg->scriptLen = len;
+    }
+    if (valueObj) {
+        rep = Jim_GetString(valueObj, &len);
+        msg->value = Jim_StrDupLen(rep, len);
+        msg->valueLen = len;
+    }
+    return msg;
+}
+
+/* Queues msg for the worker. Frees it, and its callback, if the worker has exited. */
+static Retval JimThreadSend(Jim_InterpPtr interp, JimThread *t, JimThreadMsg *msg)
+{
+    pthread_mutex_lock(&t->lock);
+    if (t->finished) {
+        pthread_mutex_unlock(&t->lock);
+        if (msg->callback) {
+            Jim_DecrRefCount(interp, msg->callback);
+        }
+        JimThreadFreeMsg(msg);
+        Jim_SetResultString(interp, g_threadExited, -1);
+        return JIM_ERR;
+    }
+    if (msg->kind == JIM_THREAD_EVAL) {
+        t->pending++;
+    }
+    JimThreadPost(&t->inHead, &t->inTail, &t->inSignalled, t->inPipe[1], msg);
+    pthread_mutex_unlock(&t->lock);
+    return JIM_OK;
+}
+
+/* Sends the script and waits for its result */
+static Retval JimThreadEval(Jim_InterpPtr interp, JimThread *t, Jim_ObjPtr scriptObj)
+{
+    JimThreadMsg *msg = JimThreadNewMsg(JIM_THREAD_EVAL, scriptObj, NULL);
+    Retval ret;
+
+    msg->sync = 1;
+    if (JimThreadSend(interp, t, msg) != JIM_OK) {
+        return JIM_ERR;
+    }
+    pthread_mutex_lock(&t->lock);
+    while (!msg->done) {
+        pthread_cond_wait(&t->doneCond, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    ret = msg->code;
+    Jim_SetResult(interp, Jim_NewStringObjNoAlloc(interp, msg->result, msg->resultLen));
+    msg->result = NULL;
+    JimThreadFreeMsg(msg);
+    return ret;
+}
+
+/* Runs the callback for msg as: callback code result */
+static void JimThreadCallback(Jim_InterpPtr interp, JimThreadMsg *msg)
+{
+    Jim_ObjPtr objPtr = Jim_DuplicateObj(interp, msg->callback);
+
+    Jim_IncrRefCount(objPtr);
+    Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, msg->code));
+    Jim_ListAppendElement(interp, objPtr, Jim_NewStringObjNoAlloc(interp, msg->result, msg->resultLen));
+    msg->result = NULL;
+    Jim_DecrRefCount(interp, msg->callback);
+    JimThreadFreeMsg(msg);
+
+    IGNORERET Jim_EvalObjBackground(interp, objPtr);
+    Jim_DecrRefCount(interp, objPtr);
+}
+
+static int JimThreadReplies(Jim_InterpPtr interp, void *clientData, int mask MAYBE_USED)
+{
+    JimThread *t = (JimThread *)clientData;
+    JimThreadMsg *msg;
+
+    pthread_mutex_lock(&t->lock);
+    msg = JimThreadTake(&t->outHead, &t->outTail, &t->outSignalled, t->outPipe[0]);
+    pthread_mutex_unlock(&t->lock);
+
+    /* A callback may delete the thread, but the taken replies are no longer linked to it */
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+
+        JimThreadCallback(interp, msg);
+        msg = next;
+    }
+    return JIM_OK;
+}
+
+/* Stops the worker, once its current script is done, and discards the replies not yet delivered */
+static void JimThreadDelProc(Jim_InterpPtr interp, void *privData)
+{
+    JimThread *t = (JimThread *)privData;
+    JimThreadMsg *msg;
+    int i;
+
+    msg = new_JimThreadMsg; // #AllocF
+    msg->kind = JIM_THREAD_QUIT;
+    pthread_mutex_lock(&t->lock);
+    if (!t->finished) {
+        JimThreadPost(&t->inHead, &t->inTail, &t->inSignalled, t->inPipe[1], msg);
+        msg = NULL;
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (msg) {
+        JimThreadFreeMsg(msg);
+    }
+    pthread_join(t->tid, NULL);
+
+    Jim_DeleteFileHandler(interp, t->outPipe[0], JIM_EVENT_READABLE);
+    msg = t->outHead;
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+
+        Jim_DecrRefCount(interp, msg->callback);
+        JimThreadFreeMsg(msg);
+        msg = next;
+    }
+    for (i = 0; i < 2; i++) {
+        prj_close(t->inPipe[i]); // #NonPortFuncFix
+        prj_close(t->outPipe[i]); // #NonPortFuncFix
+    }
+    pthread_cond_destroy(&t->doneCond);
+    pthread_mutex_destroy(&t->lock);
+    free_JimThread(t); // #FreeF
+}
+
+static Retval thread_cmd_eval(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    JimThread *t = (JimThread *)Jim_CmdPrivData(interp);
+    Jim_ObjPtr scriptObj = Jim_ConcatObj(interp, argc, argv);
+    Retval ret;
+
+    Jim_IncrRefCount(scriptObj);
+    ret = JimThreadEval(interp, t, scriptObj);
+    Jim_DecrRefCount(interp, scriptObj);
+    return ret;
+}
+
+static Retval thread_cmd_send(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    JimThread *t = (JimThread *)Jim_CmdPrivData(interp);
+    JimThreadMsg *msg = JimThreadNewMsg(JIM_THREAD_EVAL, argv[0], NULL);
+
+    if (argc == 2 && Jim_Length(argv[1])) {
+        msg->callback = argv[1];
+        Jim_IncrRefCount(msg->callback);
+    }
+    return JimThreadSend(interp, t, msg);
+}
+
+static Retval thread_cmd_set(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv) // #JimCmd
+{
+    JimThread *t = (JimThread *)Jim_CmdPrivData(interp);
+
+    return JimThreadSend(interp, t, JimThreadNewMsg(JIM_THREAD_SET, argv[0], argv[1]));
+}
+
+static Retval thread_cmd_pending(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+{
+    JimThread *t = (JimThread *)Jim_CmdPrivData(interp);
+    int pending;
+
+    pthread_mutex_lock(&t->lock);
+    pending = t->pending;
+    pthread_mutex_unlock(&t->lock);
+    Jim_SetResultInt(interp, pending);
+    return JIM_OK;
+}
+
+static Retval thread_cmd_delete(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv) // #JimCmd
+{
+    return Jim_DeleteCommand(interp, Jim_String(argv[0]));
+}
+
+static const jim_subcmd_type g_thread_handle_table[] = { // #JimSubCmdDef
+    {   "eval",
+        "script ...",
+        thread_cmd_eval,
+        1,
+        -1,
+        /* Description: Concat the args and evaluate the script in the thread, waiting for the result */
+    },
+    {   "send",
+        "script ?callback?",
+        thread_cmd_send,
+        1,
+        2,
+        /* Description: Queue the script, and call back with the code and result once done */
+    },
+    {   "set",
+        "name value",
+        thread_cmd_set,
+        2,
+        2,
+        /* Description: Queue setting a global variable in the thread */
+    },
+    {   "pending",
+        NULL,
+        thread_cmd_pending,
+        0,
+        0,
+        /* Description: Returns the number of queued scripts not yet done */
+    },
+    {   "delete",
+        NULL,
+        thread_cmd_delete,
+        0,
+        0,
+        JIM_MODFLAG_FULLARGV,
+        /* Description: Stop the thread once the current script is done */
+    },
+    {  }
+};
+
+static Retval JimThreadSubCmdProc(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    return Jim_CallSubCmd(interp, Jim_ParseSubCmd(interp, g_thread_handle_table, argc, argv), argc, argv);
+}
+
+/* Queues setting var in the worker to its value here, as [interp] copies them */
+static void JimThreadCopyVariable(Jim_InterpPtr interp, JimThread *t, const char *var)
+{
+    Jim_ObjPtr value = Jim_GetGlobalVariableStr(interp, var, JIM_NONE);
+
+    if (value) {
+        JimThreadMsg *msg = JimThreadNewMsg(JIM_THREAD_SET, NULL, value);
+
+        msg->script = Jim_StrDup(var);
+        IGNORERET JimThreadSend(interp, t, msg);
+    }
+}
+
+/* Sets up the queues and starts the worker. Returns 0, or an errno with nothing left to free. */
+static int JimThreadStart(Jim_InterpPtr interp, JimThread *t)
+{
+    JimThreadMsg *msg;
+    int err;
+    int i;
+
+    if (prj_pipe(t->inPipe) != 0) { // #NonPortFuncFix
+        return errno; // #MissInCoverage
+    }
+    if (prj_pipe(t->outPipe) != 0) { // #NonPortFuncFix
+        err = errno; // #MissInCoverage
+        prj_close(t->inPipe[0]); // #NonPortFuncFix
+        prj_close(t->inPipe[1]); // #NonPortFuncFix
+        return err;
+    }
+    for (i = 0; i < 2; i++) {
+        /* Keep these out of children */
+        (void)prj_fcntl(t->inPipe[i], F_SETFD, FD_CLOEXEC); // #NonPortFuncFix
+        (void)prj_fcntl(t->outPipe[i], F_SETFD, FD_CLOEXEC); // #NonPortFuncFix
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->doneCond, NULL);
+
+    JimThreadCopyVariable(interp, t, "argv");
+    JimThreadCopyVariable(interp, t, "argc");
+    JimThreadCopyVariable(interp, t, "argv0");
+    JimThreadCopyVariable(interp, t, "jim::argv0");
+    JimThreadCopyVariable(interp, t, "jim::exe");
+    JimThreadCopyVariable(interp, t, "auto_path");
+
+    err = pthread_create(&t->tid, NULL, JimThreadMain, t);
+    if (err == 0) {
+        return 0;
+    }
+    msg = t->inHead; // #MissInCoverage
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+
+        JimThreadFreeMsg(msg);
+        msg = next;
+    }
+    for (i = 0; i < 2; i++) {
+        prj_close(t->inPipe[i]); // #NonPortFuncFix
+        prj_close(t->outPipe[i]); // #NonPortFuncFix
+    }
+    pthread_cond_destroy(&t->doneCond);
+    pthread_mutex_destroy(&t->lock);
+    return err;
+}
+
+static Retval thread_cmd_create(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    JimThread *t = new_JimThread; // #AllocF
+    char buf[40]; // #MagicNum
+    int err = JimThreadStart(interp, t);
+
+    if (err != 0) {
+        free_JimThread(t); // #FreeF #MissInCoverage
+        Jim_SetResultFormatted(interp, "couldn't create thread: %s", strerror(err)); // #ErrStr
+        return JIM_ERR;
+    }
+
+    Jim_CreateFileHandler(interp, t->outPipe[0], JIM_EVENT_READABLE, JimThreadReplies, t, NULL);
+    snprintf(buf, sizeof(buf), "thread.handle%ld", Jim_GetId(interp));
+    IGNORERET Jim_CreateCommand(interp, buf, JimThreadSubCmdProc, t, JimThreadDelProc);
+
+    if (argc == 1 && JimThreadEval(interp, t, argv[0]) != JIM_OK) {
+        /* Keep the error across the delete */
+        Jim_ObjPtr resultObj = Jim_GetResult(interp);
+
+        Jim_IncrRefCount(resultObj);
+        IGNORERET Jim_DeleteCommand(interp, buf);
+        Jim_SetResult(interp, resultObj);
+        Jim_DecrRefCount(interp, resultObj);
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, Jim_MakeGlobalNamespaceName(interp, Jim_NewStringObj(interp, buf, -1)));
+    return JIM_OK;
+}
+
+static long JimThreadCores(void)
+{
+    long n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN // #optionalCode
+    n = sysconf(_SC_NPROCESSORS_ONLN); // #NonPortFunc
+    if (n < 1) {
+        n = 1; // #MissInCoverage
+    }
+#endif
+    return n;
+}
+
+static Retval thread_cmd_cores(Jim_InterpPtr interp, int argc MAYBE_USED, Jim_ObjConstArray argv MAYBE_USED) // #JimCmd
+{
+    Jim_SetResultInt(interp, JimThreadCores());
+    return JIM_OK;
+}
+
+static const jim_subcmd_type g_thread_command_table[] = { // #JimSubCmdDef
+    {   "create",
+        "?script?",
+        thread_cmd_create,
+        0,
+        1,
+        /* Description: Start a worker interpreter on a new thread, running script first */
+    },
+    {   "cores",
+        NULL,
+        thread_cmd_cores,
+        0,
+        0,
+        /* Description: Returns the number of processors online */
+    },
+    {  }
+};
+
+/* ----- parallel lmap/foreach ----- */
+
+enum {
+    JIM_PARALLEL_WORKERS_PER_CORE = 4 /* Most -workers allowed per processor #MagicNum */
+};
+
+/* A string handed to a worker */
+struct JimParallelText {
+    char *bytes;
+    int len;
+    int *lens;                      /* For a list, the lengths of its elements, which follow */
+    int numElems;                   /* each other in bytes with a NUL after each. Else NULL */
+};
+
+/* The same for every worker, and only read by them */
+struct JimParallelJob {
+    JimParallelText procs;          /* Defines the caller's procs */
+    JimParallelText body;
+    JimParallelText *varLists;      /* One per list */
+    int numLists;
+    int doMap;
+};
+
+/* A run of iterations for one worker */
+struct JimParallelRun {
+    pthread_t tid;
+    const JimParallelJob *job;
+    int count;                      /* Iterations */
+    JimParallelText *values;        /* Per list, the values for these iterations as a list */
+    Retval code;                    /* JIM_OK, JIM_BREAK or whatever else stopped the loop */
+    JimParallelText result;         /* The results so far as a list, or else the error */
+};
+
+#define new_JimParallelTextArray(sz)    Jim_TAllocZ<JimParallelText>(sz,"JimParallelText")
+#define free_JimParallelTextArray(ptr)  Jim_TFree<JimParallelText>(ptr,"JimParallelText")
+#define new_JimParallelRunArray(sz)     Jim_TAllocZ<JimParallelRun>(sz,"JimParallelRun")
+#define free_JimParallelRunArray(ptr)   Jim_TFree<JimParallelRun>(ptr,"JimParallelRun")
+
+static void JimParallelSetText(JimParallelText *text, Jim_ObjPtr objPtr)
+{
+    const char *rep = Jim_GetString(objPtr, &text->len);
+
+    text->bytes = Jim_StrDupLen(rep, text->len);
+    text->lens = NULL;
+    text->numElems = 0;
+}
+
+/* Hands over count elements of a list from first on, as their strings, so that the
+ * other side builds the list from them instead of quoting and parsing it
+ */
+static void JimParallelSetElements(Jim_InterpPtr interp, JimParallelText *text, Jim_ObjPtr listObj, int first, int count)
+{
+    int i, len = 0;
+    char *p;
+
+    if (count > Jim_ListLength(interp, listObj) - first) {
+        count = Jim_ListLength(interp, listObj) - first;
+    }
+    if (count < 0) {
+        count = 0; // #MissInCoverage
+    }
+    text->numElems = count;
+    text->lens = Jim_TAlloc<int>(count ? count : 1, "int"); // #AllocF
+    for (i = 0; i < count; i++) {
+        IGNORERET Jim_GetString(Jim_ListGetIndex(interp, listObj, first + i), &text->lens[i]);
+        len += text->lens[i] + 1;
+    }
+    text->bytes = p = Jim_TAlloc<char>(len + 1, "char"); // #AllocF
+    for (i = 0; i < count; i++) {
+        IGNORERET memcpy(p, Jim_String(Jim_ListGetIndex(interp, listObj, first + i)), text->lens[i]);
+        p += text->lens[i];
+        *p++ = '\0';
+    }
+    text->len = len;
+}
+
+static void JimParallelFreeText(JimParallelText *text)
+{
+    Jim_Free(text->bytes);
+    if (text->lens) {
+        Jim_TFree<int>(text->lens, "int"); // #FreeF
+    }
+}
+
+static Jim_ObjPtr JimParallelTextObj(Jim_InterpPtr interp, const JimParallelText *text)
+{
+    return Jim_NewStringObj(interp, text->bytes, text->len);
+}
+
+/* Appends the elements handed over in text to elems */
+static int JimParallelElements(Jim_InterpPtr interp, const JimParallelText *text, Jim_ObjArray *elems)
+{
+    const char *p = text->bytes;
+    int i;
+
+    for (i = 0; i < text->numElems; i++) {
+        elems[i] = Jim_NewStringObj(interp, p, text->lens[i]);
+        p += text->lens[i] + 1;
+    }
+    return text->numElems;
+}
+
+static Jim_ObjPtr JimParallelElementsObj(Jim_InterpPtr interp, const JimParallelText *text)
+{
+    Jim_ObjArray *elems = new_Jim_ObjArray(text->numElems ? text->numElems : 1); // #AllocF
+    Jim_ObjPtr listObj = Jim_NewListObj(interp, elems, JimParallelElements(interp, text, elems));
+
+    free_Jim_ObjArray(elems); // #FreeF
+    return listObj;
+}
+
+/* Runs the iterations of run in a fresh interpreter, as JimForeachMapHelper() would */
+static void *JimParallelMain(void *arg)
+{
+    JimParallelRun *run = (JimParallelRun *)arg;
+    const JimParallelJob *job = run->job;
+    Jim_InterpPtr interp = Jim_CreateInterp();
+    Jim_ObjArray *objv = new_Jim_ObjArray(job->numLists * 2); // #AllocF
+    Jim_ObjPtr bodyObj;
+    Jim_ObjPtr resultObj;
+    Retval ret;
+    int i, j, k;
+
+    Jim_RegisterCoreCommands(interp);
+    IGNORERET Jim_InitStaticExtensions(interp);
+
+    /* varList and values for each list */
+    for (j = 0; j < job->numLists; j++) {
+        objv[j * 2] = JimParallelTextObj(interp, &job->varLists[j]);
+        objv[j * 2 + 1] = JimParallelElementsObj(interp, &run->values[j]);
+        Jim_IncrRefCount(objv[j * 2]);
+        Jim_IncrRefCount(objv[j * 2 + 1]);
+    }
+    bodyObj = JimParallelTextObj(interp, &job->body);
+    Jim_IncrRefCount(bodyObj);
+    resultObj = Jim_NewListObj(interp, NULL, 0);
+    Jim_IncrRefCount(resultObj);
+
+    ret = JimThreadEvalTop(interp, JimParallelTextObj(interp, &job->procs));
+    for (i = 0; ret == JIM_OK && i < run->count; i++) {
+        for (j = 0; j < job->numLists && ret == JIM_OK; j++) {
+            int numVars = Jim_ListLength(interp, objv[j * 2]);
+
+            for (k = 0; k < numVars && ret == JIM_OK; k++) {
+                Jim_ObjPtr valObj = Jim_ListGetIndex(interp, objv[j * 2 + 1], i * numVars + k);
+
+                if (!valObj) {
+                    /* Ran out, so store the empty string */
+                    valObj = Jim_NewEmptyStringObj(interp);
+                }
+                ret = Jim_SetVariable(interp, Jim_ListGetIndex(interp, objv[j * 2], k), valObj);
+            }
+        }
+        if (ret != JIM_OK) {
+            break; // #MissInCoverage
+        }
+        switch (ret = Jim_EvalObj(interp, bodyObj)) {
+            case JIM_OK:
+                if (job->doMap) {
+                    Jim_ListAppendElement(interp, resultObj, Jim_GetResult(interp));
+                }
+                break;
+            case JIM_CONTINUE:
+                ret = JIM_OK;
+                break;
+            default:
+                break;
+        }
+    }
+
+    run->code = ret;
+    if (ret == JIM_OK || ret == JIM_BREAK) {
+        JimParallelSetElements(interp, &run->result, resultObj, 0, Jim_ListLength(interp, resultObj));
+    }
+    else {
+        JimParallelSetText(&run->result, Jim_GetResult(interp));
+    }
+
+    Jim_DecrRefCount(interp, resultObj);
+    Jim_DecrRefCount(interp, bodyObj);
+    for (j = 0; j < job->numLists * 2; j++) {
+        Jim_DecrRefCount(interp, objv[j]);
+    }
+    free_Jim_ObjArray(objv); // #FreeF
+    Jim_FreeInterp(interp);
+    return NULL;
+}
+
+/* Turns the name value pairs of [info statics] into {name value} statics for [proc] */
+static Jim_ObjPtr JimParallelStatics(Jim_InterpPtr interp, Jim_ObjPtr pairsObj)
+{
+    Jim_ObjPtr staticsObj = Jim_NewListObj(interp, NULL, 0);
+    int i, len = Jim_ListLength(interp, pairsObj);
+
+    for (i = 0; i + 1 < len; i += 2) {
+        Jim_ObjPtr pair[2];
+
+        pair[0] = Jim_ListGetIndex(interp, pairsObj, i);
+        pair[1] = Jim_ListGetIndex(interp, pairsObj, i + 1);
+        Jim_ListAppendElement(interp, staticsObj, Jim_NewListObj(interp, pair, 2));
+    }
+    return staticsObj;
+}
+
+/* Returns a script defining every proc of interp, with a reference, or NULL on error */
+static Jim_ObjPtr JimParallelProcs(Jim_InterpPtr interp)
+{
+    Jim_ObjPtr namesObj;
+    Jim_ObjPtr procsObj;
+    int i, len;
+
+    if (Jim_EvalGlobal(interp, "info procs") != JIM_OK) {
+        return NULL; // #MissInCoverage
+    }
+    namesObj = Jim_GetResult(interp);
+    Jim_IncrRefCount(namesObj);
+    procsObj = Jim_NewEmptyStringObj(interp);
+    Jim_IncrRefCount(procsObj);
+    len = Jim_ListLength(interp, namesObj);
+    for (i = 0; i < len; i++) {
+        Jim_ObjPtr nameObj = Jim_ListGetIndex(interp, namesObj, i);
+        Jim_CmdPtr cmdPtr = Jim_GetCommand(interp, nameObj, JIM_NONE);
+        Jim_ObjPtr defObj;
+
+        if (cmdPtr == NULL || !cmdPtr->isproc()) {
+            continue; // #MissInCoverage
+        }
+        defObj = Jim_NewListObj(interp, NULL, 0);
+        Jim_IncrRefCount(defObj);
+        Jim_ListAppendElement(interp, defObj, Jim_NewStringObj(interp, "proc", -1));
+        Jim_ListAppendElement(interp, defObj, Jim_MakeGlobalNamespaceName(interp, nameObj));
+        Jim_ListAppendElement(interp, defObj, cmdPtr->proc_argListObjPtr());
+        if (cmdPtr->proc_staticVars()) {
+            /* Each worker starts from the values they have now */
+            Jim_ObjPtr objv[3];
+
+            objv[0] = Jim_NewStringObj(interp, "info", -1);
+            objv[1] = Jim_NewStringObj(interp, "statics", -1);
+            objv[2] = nameObj;
+            if (Jim_EvalObjVector(interp, 3, objv) != JIM_OK) {
+                Jim_DecrRefCount(interp, defObj); // #MissInCoverage
+                Jim_DecrRefCount(interp, procsObj);
+                Jim_DecrRefCount(interp, namesObj);
+                return NULL;
+            }
+            Jim_ListAppendElement(interp, defObj, JimParallelStatics(interp, Jim_GetResult(interp)));
+        }
+        Jim_ListAppendElement(interp, defObj, cmdPtr->proc_bodyObjPtr());
+        Jim_AppendObj(interp, procsObj, defObj);
+        Jim_AppendString(interp, procsObj, "\n", 1);
+        Jim_DecrRefCount(interp, defObj);
+    }
+    Jim_DecrRefCount(interp, namesObj);
+    return procsObj;
+}
+
+/* Joins the runs' result lists, up to the first one stopped by break or anything else.
+ * The runs all start together, so the ones after a break have already been done
+ * and their side effects stay; only their results are dropped.
+ */
+static Retval JimParallelGather(Jim_InterpPtr interp, JimParallelRun *runs, int numRuns, int doMap)
+{
+    Jim_ObjArray *elems;
+    int i, len = 0;
+
+    for (i = 0; i < numRuns; i++) {
+        if (runs[i].code != JIM_OK && runs[i].code != JIM_BREAK) {
+            Jim_SetResult(interp, Jim_NewStringObjNoAlloc(interp, runs[i].result.bytes, runs[i].result.len));
+            runs[i].result.bytes = NULL;
+            return runs[i].code;
+        }
+        len += runs[i].result.numElems;
+        if (runs[i].code == JIM_BREAK) {
+            numRuns = i + 1;
+        }
+    }
+    if (!doMap) {
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+
+    /* One list of all the runs' elements, with nothing to parse */
+    elems = new_Jim_ObjArray(len ? len : 1); // #AllocF
+    len = 0;
+    for (i = 0; i < numRuns; i++) {
+        len += JimParallelElements(interp, &runs[i].result, elems + len);
+    }
+    Jim_SetResult(interp, Jim_NewListObj(interp, elems, len));
+    free_Jim_ObjArray(elems); // #FreeF
+    return JIM_OK;
+}
+
+static Retval JimParallelCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv, int doMap)
+{
+    long numWorkers = JimThreadCores();
+    JimParallelJob job;
+    JimParallelRun *runs;
+    Jim_ObjPtr procsObj;
+    Retval ret;
+    int iterations = 0;
+    int i, j;
+
+    if (argc >= 2 && Jim_CompareStringImmediate(interp, argv[0], "-workers")) {
+        if (Jim_GetLong(interp, argv[1], &numWorkers) != JIM_OK) {
+            return JIM_ERR;
+        }
+        if (numWorkers < 1) {
+            Jim_SetResultFormatted(interp, "bad number of workers \"%#s\"", argv[1]); // #ErrStr
+            return JIM_ERR;
+        }
+        if (numWorkers > JimThreadCores() * JIM_PARALLEL_WORKERS_PER_CORE) {
+            Jim_SetResultFormatted(interp, "bad number of workers \"%#s\": must be at most %d", argv[1], // #ErrStr
+                CAST(int)(JimThreadCores() * JIM_PARALLEL_WORKERS_PER_CORE));
+            return JIM_ERR;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 3 || argc % 2 == 0) {
+        return -1;
+    }
+
+    job.numLists = (argc - 1) / 2;
+    for (j = 0; j < job.numLists; j++) {
+        int numVars = Jim_ListLength(interp, argv[j * 2]);
+        int n;
+
+        if (numVars == 0) {
+            Jim_SetResultString(interp, "foreach varlist is empty", -1); // #ErrStr
+            return JIM_ERR;
+        }
+        n = (Jim_ListLength(interp, argv[j * 2 + 1]) + numVars - 1) / numVars;
+        if (n > iterations) {
+            iterations = n;
+        }
+    }
+    if (iterations == 0) {
+        Jim_SetEmptyResult(interp);
+        return JIM_OK;
+    }
+    if (numWorkers > iterations) {
+        numWorkers = iterations;
+    }
+    if ((procsObj = JimParallelProcs(interp)) == NULL) {
+        return JIM_ERR; // #MissInCoverage
+    }
+
+    JimParallelSetText(&job.procs, procsObj);
+    Jim_DecrRefCount(interp, procsObj);
+    JimParallelSetText(&job.body, argv[argc - 1]);
+    job.varLists = new_JimParallelTextArray(job.numLists); // #AllocF
+    job.doMap = doMap;
+    for (j = 0; j < job.numLists; j++) {
+        JimParallelSetText(&job.varLists[j], argv[j * 2]);
+    }
+
+    /* Split the iterations into one contiguous run per worker */
+    runs = new_JimParallelRunArray(numWorkers); // #AllocF
+    for (i = 0; i < numWorkers; i++) {
+        int first = CAST(int)(iterations * i / numWorkers);
+        JimParallelRun *run = &runs[i];
+
+        run->job = &job;
+        run->count = CAST(int)(iterations * (i + 1) / numWorkers) - first;
+        run->values = new_JimParallelTextArray(job.numLists); // #AllocF
+        for (j = 0; j < job.numLists; j++) {
+            int numVars = Jim_ListLength(interp, argv[j * 2]);
+
+            JimParallelSetElements(interp, &run->values[j], argv[j * 2 + 1], first * numVars, run->count * numVars);
+        }
+    }
+    for (i = 0; i < numWorkers; i++) {
+        if (pthread_create(&runs[i].tid, NULL, JimParallelMain, &runs[i]) != 0) {
+            /* Do this run here instead */
+            runs[i].tid = pthread_self(); // #MissInCoverage
+            IGNORERET JimParallelMain(&runs[i]);
+        }
+    }
+    for (i = 0; i < numWorkers; i++) {
+        if (!pthread_equal(runs[i].tid, pthread_self())) {
+            pthread_join(runs[i].tid, NULL);
+        }
+    }
+
+    ret = JimParallelGather(interp, runs, CAST(int)numWorkers, doMap);
+
+    for (i = 0; i < numWorkers; i++) {
+        for (j = 0; j < job.numLists; j++) {
+            JimParallelFreeText(&runs[i].values[j]);
+        }
+        free_JimParallelTextArray(runs[i].values); // #FreeF
+        JimParallelFreeText(&runs[i].result);
+    }
+    free_JimParallelRunArray(runs); // #FreeF
+    for (j = 0; j < job.numLists; j++) {
+        Jim_Free(job.varLists[j].bytes);
+    }
+    free_JimParallelTextArray(job.varLists); // #FreeF
+    Jim_Free(job.body.bytes);
+    Jim_Free(job.procs.bytes);
+    return ret;
+}
+
+static Retval parallel_cmd_lmap(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    return JimParallelCommand(interp, argc, argv, 1);
+}
+
+static Retval parallel_cmd_foreach(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
+{
+    return JimParallelCommand(interp, argc, argv, 0);
+}
+
+static const jim_subcmd_type g_parallel_command_table[] = { // #JimSubCmdDef
+    {   "lmap",
+        "?-workers n? varList list ?varList list ...? body",
+        parallel_cmd_lmap,
+        3,
+        -1,
+        /* Description: lmap with the iterations split over worker threads, returning the results in order. Iterations after a break may already have run */
+    },
+    {   "foreach",
+        "?-workers n? varList list ?varList list ...? body",
+        parallel_cmd_foreach,
+        3,
+        -1,
+        /* Description: foreach with the iterations split over worker threads. Iterations after a break may already have run */
+    },
+    {  }
+};
+
+#undef JIM_VERSION
+#define JIM_VERSION(MAJOR, MINOR) static const char* version = #MAJOR "." #MINOR ;
+#include <jim-thread-version.h>
+
+Retval Jim_threadInit(Jim_InterpPtr interp) // #JimCmdInit
+{
+    if (Jim_PackageProvide(interp, "thread", version, JIM_ERRMSG))
+        return JIM_ERR;
+
+    IGNORERET Jim_CreateCommand(interp, "thread", Jim_SubCmdProc, (void *)g_thread_command_table, NULL);
+    IGNORERET Jim_CreateCommand(interp, "parallel", Jim_SubCmdProc, (void *)g_parallel_command_table, NULL);
+    return JIM_OK;
+}
+
+#else
+/* No pthreads: the extension loads, but without commands */
+BEGIN_JIM_NAMESPACE
+
+Retval Jim_threadInit(Jim_InterpPtr interp MAYBE_USED) // #JimCmdInit
+{
+    return JIM_OK;
+}
+#endif /* ifndef _WIN32 */
+
+END_JIM_NAMESPACE
+
+#endif // #if jim_ext_thread
@@ -82,6 +82,9 @@ JIM_EXPORT Retval Jim_InitStaticExtensions(Jim_InterpPtr interp)
 #if jim_ext_tree
 	extern int Jim_treeInit(Jim_InterpPtr );
 #endif
+#if jim_ext_thread
+	extern int Jim_threadInit(Jim_InterpPtr );
+#endif
 
 #if jim_ext_signal
     Jim_signalInit(interp);
@@ -113,7 +116,7 @@ JIM_EXPORT Retval Jim_InitStaticExtensions(Jim_InterpPtr interp)
 	Jim_clockInit(interp);
 #endif
 #if jim_ext_eventloop
-	Jim_eventloopInit(interp_);
+	Jim_eventloopInit(interp);
 #endif
 #if jim_ext_file
 	Jim_fileInit(interp);
@@ -163,6 +166,9 @@ JIM_EXPORT Retval Jim_InitStaticExtensions(Jim_InterpPtr interp)
 #if jim_ext_tree
 	Jim_treeInit(interp);
 #endif
+#if jim_ext_thread
+	Jim_threadInit(interp);
+#endif
 
 	return JIM_OK;
 }
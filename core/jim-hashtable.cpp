@@ -4,6 +4,11 @@
 #include <time.h>
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64) // #optionalCode #NonPortHeader
+#  include <emmintrin.h>
+#  define JIM_HT_SSE2 1
+#endif
+
 #include <prj_trace.h>
 #include <jim-hashtable.h>
 #include <jim.h>
@@ -12,6 +17,13 @@ BEGIN_JIM_NAMESPACE
 
 extern int g_JIM_RANDOMISE_HASH_VAL;
 
+enum {
+    JIM_HT_GROUP = 16,              /* Slots probed together. A table has at least one group. #MagicNum */
+    JIM_HT_CTRL_EMPTY = 0x80,       /* #MagicNum */
+    JIM_HT_CTRL_DELETED = 0xFE,     /* #MagicNum */
+    JIM_HT_MIGRATE_STEP = 32        /* Old slots moved on each insert during a resize #MagicNum */
+};
+
 JIM_EXPORT void Jim_ExpandHashTable(Jim_HashTablePtr ht, unsigned_int size);
 static unsigned_int Jim_GenHashFunction(const_unsigned_char* buf, int len);
 //static unsigned_int Jim_IntHashFunction(unsigned_int key);
@@ -24,6 +36,7 @@ JIM_EXPORT int Jim_ReplaceHashEntry(Jim_HashTablePtr ht, const void* key, void*
 JIM_EXPORT Retval Jim_DeleteHashEntry(Jim_HashTablePtr ht, const void* key);
 JIM_EXPORT Retval Jim_FreeHashTable(Jim_HashTablePtr ht);
 JIM_EXPORT Jim_HashEntryPtr Jim_FindHashEntry(Jim_HashTablePtr ht, const void* key);
+JIM_EXPORT Jim_HashEntryPtr Jim_FindHashEntryHashed(Jim_HashTablePtr ht, const void* key, unsigned_int keyHash);
 JIM_EXPORT Jim_HashTableIterator* Jim_GetHashTableIterator(Jim_HashTablePtr ht);
 JIM_EXPORT Jim_HashEntryPtr Jim_NextHashEntry(Jim_HashTableIterator* iter);
 static void JimExpandHashTableIfNeeded(Jim_HashTablePtr ht);
@@ -33,8 +46,27 @@ static unsigned_int JimStringCopyHTHashFunction(const void* key);
 static void* JimStringCopyHTDup(void* privdata, const void* key);
 static int JimStringCopyHTKeyCompare(void* privdata, const void* key1, const void* key2);
 static void JimStringCopyHTKeyDestructor(void* privdata, void* key);
+static inline int JimHtIsOpen(Jim_HashTablePtr ht);
+static inline int JimHtIsFull(unsigned_char c);
+static void JimHtRehash(Jim_HashTablePtr ht, unsigned_int size);
+static Jim_HashEntryPtr JimHtFind(Jim_HashTablePtr ht, const void* key, unsigned_int keyHash);
+static Jim_HashEntryPtr JimHtInsert(Jim_HashTablePtr ht, const void* key, int replace);
+static Retval JimHtDelete(Jim_HashTablePtr ht, const void* key);
+static void JimHtFreeEntries(Jim_HashTablePtr ht);
 
 inline void Jim_HashTable::freeTable() { Jim_TFree<Jim_HashEntryArray>(table_, "Jim_HashEntryArray"); } // #FreeF 
+/* Open addressing tables allocate the control bytes after the entries */
+inline void Jim_HashTable::freeEntries() { // #FreeF 
+    Jim_TFree<Jim_HashEntry>(entries_, "Jim_HashEntry");
+    ctrl_ = NULL;
+}
+inline void Jim_HashTable::freeOldEntries() { // #FreeF 
+    Jim_TFree<Jim_HashEntry>(oldEntries_, "Jim_HashEntry");
+    oldCtrl_ = NULL;
+    oldSize_ = 0;
+    oldUsed_ = 0;
+    migrated_ = 0;
+}
 
 /* -------------------------- hash functions -------------------------------- */
 
@@ -71,6 +103,14 @@ static void JimResetHashTable(Jim_HashTablePtr ht) {
     ht->setSizemask(0);
     ht->setUsed(0);
     ht->setCollisions(0);
+    ht->setCtrl(NULL);
+    ht->setEntries(NULL);
+    ht->setTombstones(0);
+    ht->setOldCtrl(NULL);
+    ht->setOldEntries(NULL);
+    ht->setOldSize(0);
+    ht->setOldUsed(0);
+    ht->setMigrated(0);
     if (g_JIM_RANDOMISE_HASH_VAL) {
         /* This is initialized to a random value to avoid a hash collision attack.
          * See: n.runs-SA-2011.004
@@ -121,6 +161,13 @@ JIM_EXPORT void Jim_ExpandHashTable(Jim_HashTablePtr ht, unsigned_int size) {
     if (size <= ht->used())
         return;
 
+    if (JimHtIsOpen(ht)) {
+        /* Leave room for the maximum load factor */
+        JimHtRehash(ht, JimHashTableNextPower(size + size / 7 + 1));
+        PRJ_TRACE_HT(::prj_trace::ACTION_HT_RESIZE_POST, __FUNCTION__, ht);
+        return;
+    }
+
     IGNORERET Jim_InitHashTable(&n, ht->type(), ht->privdata());
     n.setSize(realsize);
     n.setSizemask(realsize - 1);
@@ -172,7 +219,7 @@ JIM_EXPORT Retval Jim_AddHashEntry(Jim_HashTablePtr ht, const void* key, void* v
 
     /* Get the index of the new element, or -1 if
      * the element already exists. */
-    entry = JimInsertHashEntry(ht, key, 0);
+    entry = JimHtIsOpen(ht) ? JimHtInsert(ht, key, 0) : JimInsertHashEntry(ht, key, 0);
     if (entry == NULL)
         return JIM_RETURNS::JIM_ERR;
 
@@ -190,7 +237,7 @@ JIM_EXPORT int Jim_ReplaceHashEntry(Jim_HashTablePtr ht, const void* key, void*
 
     /* Get the index of the new element, or -1 if
      * the element already exists. */
-    entry = JimInsertHashEntry(ht, key, 1);
+    entry = JimHtIsOpen(ht) ? JimHtInsert(ht, key, 1) : JimInsertHashEntry(ht, key, 1);
     if (entry->keyAsVoid()) {
         /* It already exists, so only replace the value.
          * Note if both a destructor and a duplicate function_ exist,
@@ -224,6 +271,8 @@ JIM_EXPORT Retval Jim_DeleteHashEntry(Jim_HashTablePtr ht, const void* key) {
 
     if (ht->used() == 0)
         return JIM_RETURNS::JIM_ERR;
+    if (JimHtIsOpen(ht))
+        return JimHtDelete(ht, key);
     h = Jim_HashKey(ht, key) & ht->sizemask();
     he = ht->getEntry(h);
 
@@ -253,6 +302,13 @@ JIM_EXPORT Retval Jim_FreeHashTable(Jim_HashTablePtr ht) {
     PRJ_TRACE_HT(::prj_trace::ACTION_HT_DELETE, __FUNCTION__, ht);
     unsigned_int i;
 
+    if (JimHtIsOpen(ht)) {
+        JimHtFreeEntries(ht);
+        ht->freeEntries(); // #FreeF 
+        JimResetHashTable(ht);
+        return JIM_RETURNS::JIM_OK;
+    }
+
     /* Free all the elements */
     for (i = 0; ht->used() > 0; i++) {
         Jim_HashEntryPtr  he; Jim_HashEntryPtr nextHe;
@@ -276,14 +332,55 @@ JIM_EXPORT Retval Jim_FreeHashTable(Jim_HashTablePtr ht) {
     return JIM_RETURNS::JIM_OK;              /* never fails */
 }
 
+/* Remove all the elements, but keep the table allocated for reuse */
+JIM_EXPORT void Jim_ClearHashTable(Jim_HashTablePtr ht) {
+    PRJ_TRACE;
+    unsigned_int i;
+
+    if (JimHtIsOpen(ht)) {
+        JimHtFreeEntries(ht);
+        if (ht->ctrl())
+            memset(ht->ctrl(), JIM_HT_CTRL_EMPTY, ht->size());
+        ht->setTombstones(0);
+        return;
+    }
+    for (i = 0; ht->used() > 0; i++) {
+        Jim_HashEntryPtr  he; Jim_HashEntryPtr nextHe;
+
+        if ((he = ht->getEntry(i)) == NULL)
+            continue;
+        while (he) {
+            nextHe = he->next();
+            Jim_FreeEntryKey(ht, he);
+            Jim_FreeEntryVal(ht, he);
+            free_Jim_HashEntry(he); // #FreeF 
+            ht->decrUsed();
+            he = nextHe;
+        }
+        ht->setEntry(i, NULL);
+    }
+}
+
 JIM_EXPORT Jim_HashEntryPtr Jim_FindHashEntry(Jim_HashTablePtr ht, const void* key) {
+    PRJ_TRACE;
+    if (ht->used() == 0)
+        return NULL;
+    return Jim_FindHashEntryHashed(ht, key, ht->type()->hashFunction(key));
+}
+
+/* As Jim_FindHashEntry(), given the result of the table type's hash function
+ * for key. Lets a key looked up in several tables with the same hash function
+ * be hashed once. */
+JIM_EXPORT Jim_HashEntryPtr Jim_FindHashEntryHashed(Jim_HashTablePtr ht, const void* key, unsigned_int keyHash) {
     PRJ_TRACE;
     Jim_HashEntryPtr he;
     unsigned_int h;
 
     if (ht->used() == 0)
         return NULL;
-    h = Jim_HashKey(ht, key) & ht->sizemask();
+    if (JimHtIsOpen(ht))
+        return JimHtFind(ht, key, keyHash);
+    h = (keyHash + ht->uniq()) & ht->sizemask();
     he = ht->getEntry(h);
     while (he) {
         if (Jim_CompareHashKeys(ht, key, he->keyAsVoid()))
@@ -293,6 +390,33 @@ JIM_EXPORT Jim_HashEntryPtr Jim_FindHashEntry(Jim_HashTablePtr ht, const void* k
     return NULL;
 }
 
+/* For statistics: the number of buckets (chains, or groups of slots
+ * for open addressing) and the number of entries in bucket 'i' */
+JIM_EXPORT unsigned_int Jim_HashTableBuckets(Jim_HashTablePtr ht) {
+    PRJ_TRACE;
+    return JimHtIsOpen(ht) ? ht->size() / JIM_HT_GROUP : ht->size();
+}
+
+JIM_EXPORT int Jim_HashTableBucketUsed(Jim_HashTablePtr ht, unsigned_int i) {
+    PRJ_TRACE;
+    int entries = 0;
+
+    if (JimHtIsOpen(ht)) {
+        unsigned_int j;
+
+        for (j = i * JIM_HT_GROUP; j < (i + 1) * JIM_HT_GROUP; j++) {
+            if (JimHtIsFull(ht->ctrl()[j]))
+                entries++;
+        }
+    } else {
+        Jim_HashEntryPtr he;
+
+        for (he = ht->getEntry(i); he; he = he->next())
+            entries++;
+    }
+    return entries;
+}
+
 JIM_EXPORT Jim_HashTableIterator* Jim_GetHashTableIterator(Jim_HashTablePtr ht) // #MissInCoverage
 {
     PRJ_TRACE;
@@ -303,6 +427,28 @@ JIM_EXPORT Jim_HashTableIterator* Jim_GetHashTableIterator(Jim_HashTablePtr ht)
 
 JIM_EXPORT Jim_HashEntryPtr Jim_NextHashEntry(Jim_HashTableIterator* iter) {
     PRJ_TRACE;
+    if (JimHtIsOpen(iter->ht())) {
+        /* Slots of a table being migrated, then those of the current table.
+         * Deleting the returned entry only marks its slot. */
+        Jim_HashTablePtr ht = iter->ht();
+
+        while (1) {
+            unsigned_int i;
+
+            iter->indexIncr();
+            i = CAST(unsigned_int) iter->index();
+            if (i < ht->oldSize()) {
+                if (JimHtIsFull(ht->oldCtrl()[i]))
+                    return &ht->oldEntries()[i];
+                continue;
+            }
+            i -= ht->oldSize();
+            if (i >= ht->size())
+                return NULL;
+            if (JimHtIsFull(ht->ctrl()[i]))
+                return &ht->entries()[i];
+        }
+    }
     while (1) {
         if (iter->entry() == NULL) {
             iter->indexIncr();
@@ -380,6 +526,298 @@ static Jim_HashEntryPtr JimInsertHashEntry(Jim_HashTablePtr ht, const void* key,
     return he;
 }
 
+/* ------------------------ open addressing tables -------------------------- */
+
+/* Entries live in a flat array with a parallel array of control bytes.
+ * A full slot's control byte holds 7 bits of the entry's hash, so a lookup
+ * compares a whole group of control bytes at once (with SSE2 when available)
+ * and only compares keys on a match. The table grows by allocating the new
+ * arrays and moving a few old slots on each insert, rather than rehashing
+ * everything at once; lookups search both tables until the move is done. */
+
+static inline int JimHtIsOpen(Jim_HashTablePtr ht) {
+    return ht->type()->flags & JIM_HT_OPEN_ADDRESSING;
+}
+
+static inline int JimHtIsFull(unsigned_char c) {
+    return (c & JIM_HT_CTRL_EMPTY) == 0;
+}
+
+/* The type's hash functions keep little entropy in the high bits for short
+ * keys and cluster similar keys in the low bits, which open addressing copes
+ * with much worse than chaining. So mix them before splitting into a group
+ * index and a control byte. */
+static inline unsigned_int JimHtMix(unsigned_int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU; // #MagicNum
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U; // #MagicNum
+    h ^= h >> 16;
+    return h;
+}
+
+static inline unsigned_int JimHtGroupIndex(unsigned_int h, unsigned_int groupMask) {
+    return (h >> 7) & groupMask;
+}
+
+static inline unsigned_char JimHtH2(unsigned_int h) {
+    return CAST(unsigned_char)(h & 0x7F); // #MagicNum
+}
+
+/* Returns a bit for each slot of the group whose control byte is 'c' */
+static inline unsigned_int JimHtGroupMatch(const_unsigned_char* group, unsigned_char c) {
+#ifdef JIM_HT_SSE2 // #optionalCode
+    __m128i g = _mm_loadu_si128(CAST(const __m128i*) group);
+    return CAST(unsigned_int) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(CAST(char) c)));
+#else
+    unsigned_int i, m = 0;
+
+    for (i = 0; i < JIM_HT_GROUP; i++) {
+        if (group[i] == c)
+            m |= 1U << i;
+    }
+    return m;
+#endif
+}
+
+/* Returns a bit for each empty or deleted slot of the group */
+static inline unsigned_int JimHtGroupFree(const_unsigned_char* group) {
+#ifdef JIM_HT_SSE2 // #optionalCode
+    return CAST(unsigned_int) _mm_movemask_epi8(_mm_loadu_si128(CAST(const __m128i*) group));
+#else
+    unsigned_int i, m = 0;
+
+    for (i = 0; i < JIM_HT_GROUP; i++) {
+        if (group[i] & JIM_HT_CTRL_EMPTY)
+            m |= 1U << i;
+    }
+    return m;
+#endif
+}
+
+static inline int JimHtFirstBit(unsigned_int m) {
+#if defined(__GNUC__) // #optionalCode
+    return __builtin_ctz(m);
+#else
+    int i = 0;
+
+    while ((m & 1) == 0) {
+        m >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* Groups are probed quadratically, which visits every group as there is a
+ * power of two of them. There is always an empty slot, so probing ends. */
+static Jim_HashEntryPtr JimHtProbe(Jim_HashTablePtr ht, const_unsigned_char* ctrl, Jim_HashEntry* entries,
+                                   unsigned_int size, const void* key, unsigned_int h) {
+    PRJ_TRACE;
+    unsigned_int groupMask = size / JIM_HT_GROUP - 1;
+    unsigned_int g = JimHtGroupIndex(h, groupMask), step = 0;
+    unsigned_char h2 = JimHtH2(h);
+
+    while (1) {
+        const_unsigned_char* group = ctrl + g * JIM_HT_GROUP;
+        unsigned_int m = JimHtGroupMatch(group, h2);
+
+        while (m) {
+            Jim_HashEntryPtr he = &entries[g * JIM_HT_GROUP + JimHtFirstBit(m)];
+
+            if (he->hash() == h && Jim_CompareHashKeys(ht, key, he->keyAsVoid()))
+                return he;
+            m &= m - 1;
+        }
+        if (JimHtGroupMatch(group, JIM_HT_CTRL_EMPTY))
+            return NULL;
+        g = (g + ++step) & groupMask;
+    }
+}
+
+/* Returns the index of the first empty or deleted slot on the probe sequence of 'h' */
+static unsigned_int JimHtFindFree(const_unsigned_char* ctrl, unsigned_int size, unsigned_int h) {
+    PRJ_TRACE;
+    unsigned_int groupMask = size / JIM_HT_GROUP - 1;
+    unsigned_int g = JimHtGroupIndex(h, groupMask), step = 0;
+
+    while (1) {
+        unsigned_int m = JimHtGroupFree(ctrl + g * JIM_HT_GROUP);
+
+        if (m)
+            return g * JIM_HT_GROUP + JimHtFirstBit(m);
+        g = (g + ++step) & groupMask;
+    }
+}
+
+/* Places an entry known not to be in the table and returns its slot */
+static Jim_HashEntryPtr JimHtPlace(Jim_HashTablePtr ht, unsigned_int h) {
+    unsigned_int i = JimHtFindFree(ht->ctrl(), ht->size(), h);
+
+    if (ht->ctrl()[i] == JIM_HT_CTRL_DELETED)
+        ht->setTombstones(ht->tombstones() - 1);
+    ht->ctrl()[i] = JimHtH2(h);
+    return &ht->entries()[i];
+}
+
+/* Moves up to 'n' slots of the old table into the current one */
+static void JimHtMigrate(Jim_HashTablePtr ht, unsigned_int n) {
+    PRJ_TRACE;
+    while (n-- > 0 && ht->migrated() < ht->oldSize()) {
+        unsigned_int i = ht->migrated();
+
+        ht->setMigrated(i + 1);
+        if (JimHtIsFull(ht->oldCtrl()[i])) {
+            Jim_HashEntryPtr he = JimHtPlace(ht, ht->oldEntries()[i].hash());
+
+            *he = ht->oldEntries()[i];
+            /* Keep probe sequences through this slot intact */
+            ht->oldCtrl()[i] = JIM_HT_CTRL_DELETED;
+            ht->setOldUsed(ht->oldUsed() - 1);
+        }
+    }
+    if (ht->migrated() == ht->oldSize() && ht->oldCtrl()) {
+        ht->freeOldEntries(); // #FreeF 
+    }
+}
+
+/* Starts moving the entries into new arrays of 'size' slots. */
+static void JimHtStartResize(Jim_HashTablePtr ht, unsigned_int size) {
+    PRJ_TRACE;
+    /* Only one resize at a time */
+    JimHtMigrate(ht, ht->oldSize());
+
+    if (ht->ctrl()) {
+        ht->setOldCtrl(ht->ctrl());
+        ht->setOldEntries(ht->entries());
+        ht->setOldSize(ht->size());
+        ht->setOldUsed(ht->used());
+        ht->setMigrated(0);
+    }
+    /* Entries are only read once their control byte is set */
+    ht->setEntries(Jim_TAlloc<Jim_HashEntry>(size + (size + sizeof(Jim_HashEntry) - 1) / sizeof(Jim_HashEntry), "Jim_HashEntry")); // #AllocF 
+    ht->setCtrl(CAST(unsigned_char*)(ht->entries() + size));
+    memset(ht->ctrl(), JIM_HT_CTRL_EMPTY, size);
+    ht->setSize(size);
+    ht->setSizemask(size - 1);
+    ht->setTombstones(0);
+}
+
+/* Rebuilds the table with 'size' slots at once */
+static void JimHtRehash(Jim_HashTablePtr ht, unsigned_int size) {
+    PRJ_TRACE;
+    JimHtStartResize(ht, size);
+    JimHtMigrate(ht, ht->oldSize());
+}
+
+static Jim_HashEntryPtr JimHtFind(Jim_HashTablePtr ht, const void* key, unsigned_int keyHash) {
+    PRJ_TRACE;
+    unsigned_int h = JimHtMix(keyHash + ht->uniq());
+    Jim_HashEntryPtr he = JimHtProbe(ht, ht->ctrl(), ht->entries(), ht->size(), key, h);
+
+    if (he == NULL && ht->oldUsed())
+        he = JimHtProbe(ht, ht->oldCtrl(), ht->oldEntries(), ht->oldSize(), key, h);
+    return he;
+}
+
+/* As JimInsertHashEntry() */
+static Jim_HashEntryPtr JimHtInsert(Jim_HashTablePtr ht, const void* key, int replace) {
+    PRJ_TRACE;
+    unsigned_int h, keyHash;
+    Jim_HashEntryPtr he;
+
+    if (ht->oldCtrl())
+        JimHtMigrate(ht, JIM_HT_MIGRATE_STEP);
+    if (ht->size() == 0)
+        JimHtRehash(ht, JIM_HT_INITIAL_SIZE);
+
+    keyHash = ht->type()->hashFunction(key);
+    h = JimHtMix(keyHash + ht->uniq());
+    if (ht->used()) {
+        he = JimHtFind(ht, key, keyHash);
+        if (he)
+            return replace ? he : NULL;
+    }
+
+    /* Keep at least 1/8 of the slots empty. Grow unless most of the
+     * used slots are deletions, when rebuilding at the same size will do. */
+    if ((ht->used() - ht->oldUsed() + ht->tombstones() + 1) * 8 > ht->size() * 7) {
+        PRJ_TRACE_HT(::prj_trace::ACTION_HT_RESIZE_PRE, __FUNCTION__, ht);
+        JimHtStartResize(ht, ht->tombstones() > ht->used() / 2 ? ht->size() : ht->size() * 2);
+        JimHtMigrate(ht, JIM_HT_MIGRATE_STEP);
+        PRJ_TRACE_HT(::prj_trace::ACTION_HT_RESIZE_POST, __FUNCTION__, ht);
+    }
+
+    he = JimHtPlace(ht, h);
+    he->setKey(NULL);
+    he->setNext(NULL);
+    he->setHash(h);
+    ht->incrUsed();
+    return he;
+}
+
+/* Frees a deleted entry and marks its slot. A slot can go back to empty if
+ * its group has an empty slot, since no probe sequence then passes it. */
+static void JimHtRemove(Jim_HashTablePtr ht, unsigned_char* ctrl, Jim_HashEntry* entries, Jim_HashEntryPtr he) {
+    unsigned_int i = CAST(unsigned_int)(he - entries);
+    unsigned_char* group = ctrl + (i & ~(JIM_HT_GROUP - 1));
+
+    Jim_FreeEntryKey(ht, he);
+    Jim_FreeEntryVal(ht, he);
+    he->setKey(NULL);
+    if (JimHtGroupMatch(group, JIM_HT_CTRL_EMPTY)) {
+        ctrl[i] = JIM_HT_CTRL_EMPTY;
+    } else {
+        ctrl[i] = JIM_HT_CTRL_DELETED;
+        if (ctrl == ht->ctrl())
+            ht->setTombstones(ht->tombstones() + 1);
+    }
+    ht->decrUsed();
+}
+
+static Retval JimHtDelete(Jim_HashTablePtr ht, const void* key) {
+    PRJ_TRACE;
+    unsigned_int h = JimHtMix(Jim_HashKey(ht, key));
+    Jim_HashEntryPtr he = JimHtProbe(ht, ht->ctrl(), ht->entries(), ht->size(), key, h);
+
+    if (he) {
+        JimHtRemove(ht, ht->ctrl(), ht->entries(), he);
+        return JIM_RETURNS::JIM_OK;
+    }
+    if (ht->oldUsed()) {
+        he = JimHtProbe(ht, ht->oldCtrl(), ht->oldEntries(), ht->oldSize(), key, h);
+        if (he) {
+            JimHtRemove(ht, ht->oldCtrl(), ht->oldEntries(), he);
+            ht->setOldUsed(ht->oldUsed() - 1);
+            return JIM_RETURNS::JIM_OK;
+        }
+    }
+    return JIM_RETURNS::JIM_ERR;             /* not found */
+}
+
+/* Frees every element, and the old table of an unfinished resize */
+static void JimHtFreeEntries(Jim_HashTablePtr ht) {
+    PRJ_TRACE;
+    unsigned_int i;
+
+    for (i = 0; i < ht->oldSize(); i++) {
+        if (JimHtIsFull(ht->oldCtrl()[i])) {
+            Jim_FreeEntryKey(ht, &ht->oldEntries()[i]);
+            Jim_FreeEntryVal(ht, &ht->oldEntries()[i]);
+        }
+    }
+    if (ht->oldCtrl()) {
+        ht->freeOldEntries(); // #FreeF 
+    }
+    for (i = 0; i < ht->size(); i++) {
+        if (JimHtIsFull(ht->ctrl()[i])) {
+            Jim_FreeEntryKey(ht, &ht->entries()[i]);
+            Jim_FreeEntryVal(ht, &ht->entries()[i]);
+        }
+    }
+    ht->setUsed(0);
+}
+
 /* ----------------------- StringCopy Hash Table Type ------------------------*/
 
 static unsigned_int JimStringCopyHTHashFunction(const void* key) {
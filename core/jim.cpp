@@ -60,6 +60,8 @@
 #include <errno.h>
 #include <time.h>
 
+#include <mutex>
+
 #if defined(_DEBUG) // #Debug
 #  if defined(_MSC_VER)
 #    include <intrin.h>
@@ -211,6 +213,16 @@ int g_JIM_OPTIMIZATION_VAL = 1;
 #  define JIM_IF_OPTIM(X)
 int g_JIM_OPTIMIZATION_VAL = 0;
 #endif
+#ifdef JIM_BYTECODE // #optionalCode
+int g_JIM_BYTECODE_VAL = 1;
+#else
+int g_JIM_BYTECODE_VAL = 0;
+#endif
+#ifdef JIM_PROC_SLOTS // #optionalCode
+int g_JIM_PROC_SLOTS_VAL = 1;
+#else
+int g_JIM_PROC_SLOTS_VAL = 0;
+#endif
 
 /* -----------------------------------------------------------------------------
  * Global variables
@@ -229,7 +241,7 @@ CHKRET static Retval ListSetIndex(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int
 CHKRET static Retval JimDeleteLocalProcs(Jim_InterpPtr interp, Jim_StackPtr localCommands);
 CHKRET static Jim_ObjPtr JimExpandDictSugar(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
 static void SetDictSubstFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
-CHKRET static Jim_ObjArray *JimDictPairs(Jim_ObjPtr dictPtr, int *len);
+CHKRET static Jim_ObjArray *JimDictTakeTable(Jim_ObjPtr dictPtr, int *len);
 static void JimSetFailedEnumResult(Jim_InterpPtr interp, const char *arg, const char *badtype,
     const char *prefix, const char *const *tablePtr, const char *name);
 CHKRET static Retval JimCallProcedure(Jim_InterpPtr interp, Jim_CmdPtr cmd, int argc, Jim_ObjConstArray argv);
@@ -238,6 +250,11 @@ CHKRET static int JimSign(jim_wide w);
 CHKRET static Retval JimValidName(Jim_InterpPtr interp, const char *type, Jim_ObjPtr nameObjPtr);
 static void JimPrngSeed(Jim_InterpPtr interp, unsigned_char *seed, int seedLen);
 static void JimRandomBytes(Jim_InterpPtr interp, void *dest, unsigned_int len);
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+static void JimCollectorCreate(Jim_InterpPtr interp);
+static void JimCollectorFree(Jim_InterpPtr interp);
+static inline void JimCollectForgetObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
+#endif
 
 
 /* Fast access to the int (wide) value of an object which is known to be of int tokenType_ */
@@ -790,6 +807,267 @@ JIM_EXPORT void *Jim_Realloc(void *ptr, int size)
     return realloc(ptr, size);
 }
 
+/* Slab allocator.
+ *
+ * Small structures with a registered type name are carved out of chunks,
+ * one list of free slots per size class. Interpreters created on the same
+ * thread share a pool, and the chunks are released in bulk when the last of
+ * them is freed and no slot is still in use; otherwise the last slot freed
+ * releases them. Chunks are aligned to their size, so a slot finds its
+ * pool from the chunk header. Larger types, and all types when slabs are
+ * disabled, use Jim_Alloc() but are still counted in the statistics. */
+enum {
+    JIM_SLAB_ALIGN = 16,            /* Slot sizes are multiples of this #MagicNum */
+    JIM_SLAB_MAX_SIZE = 512,        /* Larger structures use Jim_Alloc() #MagicNum */
+    JIM_SLAB_CLASSES = JIM_SLAB_MAX_SIZE / JIM_SLAB_ALIGN,
+    JIM_SLAB_CHUNK = 16384,         /* Bytes allocated for a size class at a time #MagicNum */
+    JIM_SLAB_MAX_TYPES = 32         /* #MagicNum */
+};
+
+/* Set this before the first interpreter is created to use Jim_Alloc()
+ * for everything, e.g. when looking for memory errors with valgrind */
+int g_JIM_DISABLE_SLAB_ALLOC = 0;
+
+struct JimSlabType {
+    const char *typeName_;
+    int size_;
+    int sizeClass_;                 /* -1 if not slab allocated */
+};
+
+struct JimSlabStats {
+    jim_wide allocs_;
+    jim_wide frees_;
+};
+
+struct JimSlabChunk;
+
+struct JimSlabPool {
+    int refCount_;                  /* Interpreters using the pool */
+    int released_;                  /* No longer the pool of its thread */
+    jim_wide liveSlots_;            /* Slots handed out and not yet freed */
+    void *freeSlots_[JIM_SLAB_CLASSES]; /* Linked through their first word */
+    char *next_[JIM_SLAB_CLASSES];  /* Rest of the newest chunk of each size class */
+    char *end_[JIM_SLAB_CLASSES];
+    JimSlabChunk *chunks_;          /* All chunks */
+    jim_wide chunkBytes_;
+    JimSlabStats stats_[JIM_SLAB_MAX_TYPES];
+};
+
+/* Header in the first slot of each chunk */
+struct JimSlabChunk {
+    JimSlabChunk *next_;
+    JimSlabPool *pool_;             /* Owner of every slot in the chunk */
+};
+
+/* Types are shared by all threads and only ever added to, under g_JimSlabTypesLock */
+static JimSlabType g_JimSlabTypes[JIM_SLAB_MAX_TYPES];
+static int g_JimSlabNumTypes = 0;
+static std::mutex g_JimSlabTypesLock;
+static thread_local JimSlabPool *g_JimSlabPool = NULL;
+
+/* Returns the type for typeName, registering it if needed, or -1 if there are too many types */
+JIM_EXPORT int Jim_SlabType(const char *typeName, int size)
+{
+    std::lock_guard<std::mutex> lock(g_JimSlabTypesLock);
+    int i;
+
+    for (i = 0; i < g_JimSlabNumTypes; i++) {
+        if (g_JimSlabTypes[i].size_ == size && strcmp(g_JimSlabTypes[i].typeName_, typeName) == 0) {
+            return i;
+        }
+    }
+    if (g_JimSlabNumTypes == JIM_SLAB_MAX_TYPES) {
+        return -1; // #MissInCoverage
+    }
+    g_JimSlabTypes[i].typeName_ = typeName;
+    g_JimSlabTypes[i].size_ = size;
+    g_JimSlabTypes[i].sizeClass_ = (size + JIM_SLAB_ALIGN - 1) / JIM_SLAB_ALIGN - 1;
+#ifdef JIM_SLAB_ALLOC // #optionalCode
+    if (g_JIM_DISABLE_SLAB_ALLOC || size > JIM_SLAB_MAX_SIZE)
+#endif
+    {
+        g_JimSlabTypes[i].sizeClass_ = -1;
+    }
+    return g_JimSlabNumTypes++;
+}
+
+static JimSlabPool *JimSlabPoolGet(void)
+{
+    if (g_JimSlabPool == NULL) {
+        g_JimSlabPool = CAST(JimSlabPool *)Jim_Alloc(sizeof(JimSlabPool)); // #AllocF 
+        memset(g_JimSlabPool, 0, sizeof(JimSlabPool));
+    }
+    return g_JimSlabPool;
+}
+
+/* Chunks are aligned to JIM_SLAB_CHUNK so JimSlabChunkOf() can find the header */
+static char *JimSlabChunkAlloc(void)
+{
+    void *chunk;
+#ifdef _WIN32 // #optionalCode
+    chunk = _aligned_malloc(JIM_SLAB_CHUNK, JIM_SLAB_CHUNK); // #AllocF 
+#else
+    if (posix_memalign(&chunk, JIM_SLAB_CHUNK, JIM_SLAB_CHUNK) != 0) { // #AllocF 
+        chunk = NULL; // #MissInCoverage
+    }
+#endif
+    if (chunk == NULL) {
+        JimPanic((1, "out of memory for a slab chunk")); // #MissInCoverage
+    }
+    return CAST(char *)chunk;
+}
+
+static void JimSlabChunkFree(JimSlabChunk *chunk)
+{
+#ifdef _WIN32 // #optionalCode
+    _aligned_free(chunk); // #FreeF 
+#else
+    free(chunk); // #FreeF 
+#endif
+}
+
+static JimSlabChunk *JimSlabChunkOf(void *ptr)
+{
+    return CAST(JimSlabChunk *)(CAST(uintptr_t)ptr & ~CAST(uintptr_t)(JIM_SLAB_CHUNK - 1));
+}
+
+/* Carves a new chunk into slots for sizeClass */
+static void JimSlabNewChunk(JimSlabPool *pool, int sizeClass)
+{
+    int slotSize = (sizeClass + 1) * JIM_SLAB_ALIGN;
+    char *chunk = JimSlabChunkAlloc();
+    JimSlabChunk *header = CAST(JimSlabChunk *)chunk;
+
+    static_assert(sizeof(JimSlabChunk) <= JIM_SLAB_ALIGN, "slab chunk header must fit in a slot");
+    header->next_ = pool->chunks_;
+    header->pool_ = pool;
+    pool->chunks_ = header;
+    pool->chunkBytes_ += JIM_SLAB_CHUNK;
+    /* The first slot holds the chunk header */
+    pool->next_[sizeClass] = chunk + JIM_SLAB_ALIGN;
+    pool->end_[sizeClass] = pool->next_[sizeClass] + (JIM_SLAB_CHUNK - JIM_SLAB_ALIGN) / slotSize * slotSize;
+}
+
+/* Frees the chunks and the pool itself */
+static void JimSlabPoolRelease(JimSlabPool *pool)
+{
+    while (pool->chunks_) {
+        JimSlabChunk *next = pool->chunks_->next_;
+
+        JimSlabChunkFree(pool->chunks_);
+        pool->chunks_ = next;
+    }
+    Jim_Free(pool);
+}
+
+JIM_EXPORT void *Jim_SlabAlloc(int type, int size)
+{
+    JimSlabPool *pool = JimSlabPoolGet();
+    int sizeClass;
+    void *ptr;
+
+    if (type < 0) {
+        return Jim_Alloc(size); // #MissInCoverage
+    }
+    pool->stats_[type].allocs_++;
+    sizeClass = g_JimSlabTypes[type].sizeClass_;
+    if (sizeClass < 0) {
+        return Jim_Alloc(size);
+    }
+    pool->liveSlots_++;
+    ptr = pool->freeSlots_[sizeClass];
+    if (ptr) {
+        pool->freeSlots_[sizeClass] = *CAST(void **)ptr;
+        return ptr;
+    }
+    if (pool->next_[sizeClass] == pool->end_[sizeClass]) {
+        JimSlabNewChunk(pool, sizeClass);
+    }
+    ptr = pool->next_[sizeClass];
+    pool->next_[sizeClass] += (sizeClass + 1) * JIM_SLAB_ALIGN;
+    return ptr;
+}
+
+JIM_EXPORT void Jim_SlabFree(int type, void *ptr)
+{
+    JimSlabPool *pool = g_JimSlabPool;
+    int sizeClass = type < 0 ? -1 : g_JimSlabTypes[type].sizeClass_;
+
+    if (ptr == NULL) {
+        return;
+    }
+    if (sizeClass < 0) {
+        if (pool && type >= 0) {
+            pool->stats_[type].frees_++;
+        }
+        Jim_Free(ptr);
+        return;
+    }
+    /* The slot goes back to the pool it came from, which may have been
+     * released by its interpreters since. Pools are per thread, so only
+     * that thread may return slots to a pool still in use. */
+    pool = JimSlabChunkOf(ptr)->pool_;
+    JimPanic((pool != g_JimSlabPool && !pool->released_, "Jim_SlabFree() of a slot from another thread's pool"));
+    pool->stats_[type].frees_++;
+    *CAST(void **)ptr = pool->freeSlots_[sizeClass];
+    pool->freeSlots_[sizeClass] = ptr;
+    if (--pool->liveSlots_ == 0 && pool->released_) {
+        JimSlabPoolRelease(pool);
+    }
+}
+
+/* Called for each new interpreter */
+static void JimSlabPoolAttach(void)
+{
+    JimSlabPoolGet()->refCount_++;
+}
+
+/* Called for each freed interpreter. Releases the pool with the last one,
+ * or leaves that to Jim_SlabFree() while slots are still in use. */
+static void JimSlabPoolDetach(void)
+{
+    JimSlabPool *pool = g_JimSlabPool;
+
+    if (pool == NULL || --pool->refCount_ > 0) {
+        return;
+    }
+    g_JimSlabPool = NULL;
+    if (pool->liveSlots_ == 0) {
+        JimSlabPoolRelease(pool);
+    }
+    else {
+        pool->released_ = 1;
+    }
+}
+
+/* Returns a dict of the slab statistics by type name */
+JIM_EXPORT Jim_ObjPtr Jim_SlabStats(Jim_InterpPtr interp)
+{
+    PRJ_TRACE;
+    JimSlabPool *pool = JimSlabPoolGet();
+    Jim_ObjPtr statsObj = Jim_NewDictObj(interp, NULL, 0);
+    int numTypes;
+    int i;
+
+    {
+        std::lock_guard<std::mutex> lock(g_JimSlabTypesLock);
+        numTypes = g_JimSlabNumTypes;
+    }
+    for (i = 0; i < numTypes; i++) {
+        const JimSlabType *t = &g_JimSlabTypes[i];
+        const JimSlabStats *s = &pool->stats_[i];
+        Jim_ObjPtr typeObj = Jim_NewDictObj(interp, NULL, 0);
+
+        IGNORERET Jim_DictAddElement(interp, typeObj, Jim_NewStringObj(interp, "size", -1), Jim_NewIntObj(interp, t->size_));
+        IGNORERET Jim_DictAddElement(interp, typeObj, Jim_NewStringObj(interp, "slot", -1),
+            Jim_NewIntObj(interp, t->sizeClass_ < 0 ? 0 : (t->sizeClass_ + 1) * JIM_SLAB_ALIGN));
+        IGNORERET Jim_DictAddElement(interp, typeObj, Jim_NewStringObj(interp, "allocs", -1), Jim_NewIntObj(interp, s->allocs_));
+        IGNORERET Jim_DictAddElement(interp, typeObj, Jim_NewStringObj(interp, "frees", -1), Jim_NewIntObj(interp, s->frees_));
+        IGNORERET Jim_DictAddElement(interp, typeObj, Jim_NewStringObj(interp, "live", -1), Jim_NewIntObj(interp, s->allocs_ - s->frees_));
+        IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, t->typeName_, -1), typeObj);
+    }
+    return statsObj;
+}
 JIM_EXPORT char *Jim_StrDup(const char *s) // #5Refs
 {
     return prj_strdup(s);
@@ -885,7 +1163,8 @@ static const Jim_HashTableType g_JimPackageHashTableType = { // #JimHashTableTyp
     NULL,                            /* val dup */
     JimStringCopyHTKeyCompare,       /* key compare */
     JimStringCopyHTKeyDestructor,    /* key destructor */
-    NULL                             /* val destructor */
+    NULL,                            /* val destructor */
+    JIM_HT_OPEN_ADDRESSING           /* flags */
 };
 const Jim_HashTableType& JimPackageHashTableType() { return g_JimPackageHashTableType; }
 
@@ -920,7 +1199,8 @@ static const Jim_HashTableType g_JimAssocDataHashTableType = { // #JimHashTableT
     NULL,                           /* val dup */
     JimStringCopyHTKeyCompare,      /* key compare */
     JimStringCopyHTKeyDestructor,   /* key destructor */
-    JimAssocDataHashTableValueDestructor        /* val destructor */
+    JimAssocDataHashTableValueDestructor,       /* val destructor */
+    JIM_HT_OPEN_ADDRESSING                      /* flags */
 };
 const Jim_HashTableType& JimAssocDataHashTableType() { return g_JimAssocDataHashTableType; }
 
@@ -2043,6 +2323,112 @@ CHKRET static Retval JimParseListStr(JimParserCtxPtr pc)
  * Jim_Obj related functions
  * ---------------------------------------------------------------------------*/
 
+/* String representations not allocated on the heap, such as file mappings
+ * (see Jim_NewStringObjExternal()), or shared by several objects (see JimShareBytes()).
+ * Keyed by the bytes pointer, so freeing any heap string costs one lookup while there are some.
+ */
+struct JimExternalBytes {
+    char *bytes;
+    int len;
+    int users; /* Objects whose string rep is 'bytes' */
+    Jim_ExternalBytesProc *releaseProc;
+    void *clientData;
+};
+
+CHKRET static unsigned_int JimExternalBytesHashFunction(const void *key)
+{
+    /* The low bits of a heap pointer are mostly alignment */
+    return Jim_IntHashFunction(CAST(unsigned_int)(CAST(unsigned_jim_wide)key >> 4)); // #MagicNum
+}
+
+static const Jim_HashTableType g_JimExternalBytesHashTableType = { // #JimHashTableType
+    JimExternalBytesHashFunction,   /* hash function_ */
+    NULL,                           /* key dup */
+    NULL,                           /* val dup */
+    NULL,                           /* key compare */
+    NULL,                           /* key destructor */
+    NULL,                           /* val destructor */
+    JIM_HT_OPEN_ADDRESSING          /* flags */
+};
+
+/* Per thread, like the objects holding them */
+static thread_local Jim_HashTablePtr g_JimExternalBytes = NULL;
+static thread_local int g_JimExternalBytesCount = 0;
+
+static JimExternalBytes *JimFindExternalBytes(const char *bytes)
+{
+    Jim_HashEntryPtr he;
+
+    if (g_JimExternalBytesCount == 0) {
+        return NULL;
+    }
+    he = Jim_FindHashEntry(g_JimExternalBytes, bytes);
+    return he ? CAST(JimExternalBytes *)Jim_GetHashEntryVal(he) : NULL;
+}
+
+static int JimIsExternalBytes(const char *bytes)
+{
+    return JimFindExternalBytes(bytes) != NULL;
+}
+
+static void JimAddExternalBytes(char *bytes, int len, int users, Jim_ExternalBytesProc *releaseProc, void *clientData)
+{
+    JimExternalBytes *eb = Jim_TAlloc<JimExternalBytes>(1, "JimExternalBytes"); // #AllocF
+
+    if (g_JimExternalBytes == NULL) {
+        g_JimExternalBytes = new_Jim_HashTable; // #AllocF
+        IGNORERET Jim_InitHashTable(g_JimExternalBytes, &g_JimExternalBytesHashTableType, NULL);
+        g_JimExternalBytes->setTypeName("externalBytes");
+    }
+    eb->bytes = bytes;
+    eb->len = len;
+    eb->users = users;
+    eb->releaseProc = releaseProc;
+    eb->clientData = clientData;
+    IGNORERET Jim_AddHashEntry(g_JimExternalBytes, bytes, eb);
+    g_JimExternalBytesCount++;
+}
+
+/* Lets go of external bytes for one object, giving them back to their owner
+ * once no object holds them. Returns 0 if 'bytes' is not external. */
+static int JimReleaseExternalBytes(char *bytes)
+{
+    JimExternalBytes *eb = JimFindExternalBytes(bytes);
+
+    if (eb == NULL) {
+        return 0;
+    }
+    if (--eb->users == 0) {
+        IGNORERET Jim_DeleteHashEntry(g_JimExternalBytes, bytes);
+        if (--g_JimExternalBytesCount == 0) {
+            IGNORERET Jim_FreeHashTable(g_JimExternalBytes);
+            free_Jim_HashTable(g_JimExternalBytes); // #FreeF
+            g_JimExternalBytes = NULL;
+        }
+        eb->releaseProc(eb->bytes, eb->len, eb->clientData);
+        Jim_TFree<JimExternalBytes>(eb, "JimExternalBytes"); // #FreeF
+    }
+    return 1;
+}
+
+/* Bytes that more than one object points at, so must not be written in place */
+static int JimIsSharedBytes(const char *bytes)
+{
+    JimExternalBytes *eb = JimFindExternalBytes(bytes);
+
+    return eb && eb->users > 1;
+}
+
+/* Frees the string representation of objPtr, which is neither NULL nor the empty rep. */
+static void JimFreeBytes(Jim_ObjPtr objPtr)
+{
+    if (g_JimExternalBytesCount && !objPtr->bytesInline() && JimReleaseExternalBytes(objPtr->bytes())) {
+        objPtr->bytes_setNULL();
+        return;
+    }
+    objPtr->freeBytes(); // #FreeF
+}
+
 /* Return a new initialized object. */
 JIM_EXPORT Jim_ObjPtr Jim_NewObj(Jim_InterpPtr interp) // #ManyRefs
 {
@@ -2093,8 +2479,11 @@ JIM_EXPORT void Jim_FreeObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #ManyRef
     /* Free the string representation */
     if (objPtr->bytes() != NULL) {
         if (objPtr->bytes() != g_JimEmptyStringRep)
-            objPtr->freeBytes(); // #FreeF
+            JimFreeBytes(objPtr); // #FreeF
     }
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+    JimCollectForgetObj(interp, objPtr);
+#endif
     /* Unlink the object from the live objects list */
     if (objPtr->prevObjPtr())
         objPtr->prevObjPtr()->setNextObjPtr(objPtr->nextObjPtr());
@@ -2121,7 +2510,7 @@ JIM_EXPORT void Jim_InvalidateStringRep(Jim_ObjPtr objPtr) // #ManyRefs
     PRJ_TRACE;
     if (objPtr->bytes() != NULL) {
         if (objPtr->bytes() != g_JimEmptyStringRep) {
-            objPtr->freeBytes(); // #FreeF 
+            JimFreeBytes(objPtr); // #FreeF 
         }
     }
     objPtr->bytes_setNULL();
@@ -2148,7 +2537,7 @@ JIM_EXPORT Jim_ObjPtr Jim_DuplicateObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr)
         return dupPtr;
     }
     else {
-        dupPtr->setBytes( new_CharArray(objPtr->length() + 1)); // #AllocF 
+        dupPtr->allocBytes(objPtr->length()); // #AllocF 
         dupPtr->setLength(objPtr->length());
         /* Copy the null byte too */
         dupPtr->copyBytes(objPtr);
@@ -2186,10 +2575,16 @@ JIM_EXPORT const char *Jim_GetString(Jim_ObjPtr objPtr, int *lenPtr) // #ManyRef
 }
 
 /* Just returns the length (in bytes) of the object's string rep */
+static int JimIsRope(Jim_ObjPtr objPtr);
+
 JIM_EXPORT int Jim_Length(Jim_ObjPtr objPtr) // #ManyRefs
 {
     PRJ_TRACE;
     if (objPtr->bytes() == NULL) {
+        if (JimIsRope(objPtr)) {
+            /* Known without joining the pieces */
+            return objPtr->get_ropeValue_length();
+        }
         /* Invalid string repr. Generate it. */
         IGNORERET Jim_GetString(objPtr, NULL);
     }
@@ -2210,8 +2605,10 @@ JIM_EXPORT const char *Jim_String(Jim_ObjPtr objPtr) // #ManyRefs
 static void JimSetStringBytes(Jim_ObjPtr objPtr, const char *str)
 {
     PRJ_TRACE;
-    objPtr->setBytes(Jim_StrDup(str));
-    objPtr->setLength((int)strlen(str));
+    int len = (int)strlen(str);
+
+    IGNORERET memcpy(objPtr->allocBytes(len), str, len + 1); // #AllocF 
+    objPtr->setLength(len);
 }
 
 static void FreeDictSubstInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
@@ -2336,7 +2733,8 @@ JIM_EXPORT Jim_ObjPtr Jim_NewStringObj(Jim_InterpPtr interp, const char *s, int
         objPtr->setBytes( g_JimEmptyStringRep);
     }
     else {
-        objPtr->setBytes( Jim_StrDupLen(s, len));
+        IGNORERET memcpy(objPtr->allocBytes(len), s, len); // #AllocF 
+        objPtr->setBytes(len, '\0');
     }
     objPtr->setLength(len);
 
@@ -2380,6 +2778,206 @@ JIM_EXPORT Jim_ObjPtr Jim_NewStringObjNoAlloc(Jim_InterpPtr interp, char *s, int
     return objPtr;
 }
 
+/* Like Jim_NewStringObjNoAlloc(), for bytes that are not on the heap.
+ * s[len] must be the null term. s may be written to in place like any other string rep,
+ * but is never grown or freed: releaseProc is called instead, once the object lets go of it.
+ */
+JIM_EXPORT Jim_ObjPtr Jim_NewStringObjExternal(Jim_InterpPtr interp, char *s, int len, // #JimStr
+    Jim_ExternalBytesProc *releaseProc, void *clientData)
+{
+    PRJ_TRACE;
+
+    if (len < JIM_OBJ_INLINE_BYTES) {
+        /* Too small to be worth keeping around */
+        Jim_ObjPtr objPtr = Jim_NewStringObj(interp, s, len);
+
+        releaseProc(s, len, clientData);
+        return objPtr;
+    }
+    JimAddExternalBytes(s, len, 1, releaseProc, clientData);
+    return Jim_NewStringObjNoAlloc(interp, s, len);
+}
+
+/* -----------------------------------------------------------------------------
+ * Rope Object
+ *
+ * A string being built by appends, kept as a list of pieces until its
+ * bytes are needed. Large objects are appended as pieces of their own
+ * without copying them, smaller strings go to the end of the last piece
+ * when no other rope can see it.
+ * ---------------------------------------------------------------------------*/
+static void FreeRopeInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
+static void DupRopeInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr);
+static void UpdateStringOfRopeCB(Jim_ObjPtr objPtr);
+
+static const Jim_ObjType g_ropeObjType = { // #JimType #JimRope
+    "rope",
+    FreeRopeInternalRepCB,
+    DupRopeInternalRepCB,
+    UpdateStringOfRopeCB,
+    JIM_TYPE_REFERENCES,
+};
+const Jim_ObjType& ropeType() { return g_ropeObjType; }
+
+enum {
+    JIM_ROPE_MIN_CHUNK = 1024 /* Appended objects this long aren't copied #MagicNum */
+};
+
+static void FreeRopeInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimRope #dtor_like
+{
+    PRJ_TRACE;
+    Jim_DecrRefCount(interp, objPtr->get_ropeValue_chunks());
+}
+
+/* The duplicate shares the list of pieces until one of them appends. */
+static void DupRopeInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr) // #JimRope #copy_ctor_like
+{
+    PRJ_TRACE;
+    JIM_NOTUSED(interp);
+
+    Jim_IncrRefCount(srcPtr->get_ropeValue_chunks());
+    dupPtr->setRopeValue(srcPtr->get_ropeValue_chunks(), srcPtr->get_ropeValue_length());
+    dupPtr->setTypePtr(&g_ropeObjType);
+}
+
+static void UpdateStringOfRopeCB(Jim_ObjPtr objPtr) // #JimRope
+{
+    PRJ_TRACE;
+    Jim_ObjPtr chunksObj = objPtr->get_ropeValue_chunks();
+    int len = objPtr->get_ropeValue_length();
+    char *p = objPtr->allocBytes(len); // #AllocF
+    int i;
+
+    for (i = 0; i < chunksObj->get_listValue_len(); i++) {
+        int chunkLen;
+        const char *str = Jim_GetString(chunksObj->get_listValue_objArray(i), &chunkLen);
+
+        IGNORERET memcpy(p, str, chunkLen);
+        p += chunkLen;
+    }
+    *p = '\0';
+    objPtr->setLength(len);
+}
+
+/* True if objPtr is a rope that hasn't been joined into a string yet */
+static int JimIsRope(Jim_ObjPtr objPtr) // #JimRope
+{
+    PRJ_TRACE;
+    return objPtr->typePtr() == &g_ropeObjType && objPtr->bytes() == NULL;
+}
+
+/* Makes the unshared objPtr a rope of one piece: its current string. */
+static void JimRopeFromString(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimRope
+{
+    PRJ_TRACE;
+    int len;
+    const char *str = Jim_GetString(objPtr, &len);
+    Jim_ObjPtr chunksObj = Jim_NewListObj(interp, NULL, 0);
+
+    if (len) {
+        Jim_ObjPtr chunkPtr;
+
+        if (objPtr->bytesInline()) {
+            chunkPtr = Jim_NewStringObj(interp, str, len);
+        }
+        else {
+            /* The piece takes the buffer over */
+            chunkPtr = Jim_NewStringObjNoAlloc(interp, objPtr->bytes(), len);
+        }
+        Jim_ListAppendElement(interp, chunksObj, chunkPtr);
+    }
+    else if (!objPtr->bytesInline() && objPtr->bytes() != g_JimEmptyStringRep) {
+        JimFreeBytes(objPtr); // #FreeF #MissInCoverage
+    }
+    Jim_FreeIntRep(interp, objPtr);
+    objPtr->bytes_setNULL();
+    Jim_IncrRefCount(chunksObj);
+    objPtr->setTypePtr(&g_ropeObjType);
+    objPtr->setRopeValue(chunksObj, len);
+}
+
+/* Returns the list of pieces of the rope objPtr, unshared. */
+static Jim_ObjPtr JimRopeChunks(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimRope
+{
+    PRJ_TRACE;
+    Jim_ObjPtr chunksObj = objPtr->get_ropeValue_chunks();
+
+    if (Jim_IsShared(chunksObj)) {
+        Jim_ObjPtr dupObj = Jim_DuplicateObj(interp, chunksObj);
+
+        Jim_IncrRefCount(dupObj);
+        Jim_DecrRefCount(interp, chunksObj);
+        objPtr->setRopeValue(dupObj, objPtr->get_ropeValue_length());
+        chunksObj = dupObj;
+    }
+    return chunksObj;
+}
+
+/* Appends appendObjPtr to the rope objPtr as a piece, without copying it.
+ * The pieces of a rope are appended one by one. */
+static void JimRopeAppendObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr, Jim_ObjPtr appendObjPtr) // #JimRope
+{
+    PRJ_TRACE;
+    Jim_ObjPtr chunksObj = JimRopeChunks(interp, objPtr);
+
+    if (JimIsRope(appendObjPtr)) {
+        Jim_ObjPtr srcObj = appendObjPtr->get_ropeValue_chunks();
+        int count = srcObj->get_listValue_len();
+        int i;
+
+        /* srcObj may be chunksObj, so only look at the pieces it had */
+        Jim_IncrRefCount(srcObj);
+        for (i = 0; i < count; i++) {
+            Jim_ObjPtr chunkPtr = srcObj->get_listValue_objArray(i);
+
+            objPtr->incrRopeValueLength(Jim_Length(chunkPtr));
+            Jim_ListAppendElement(interp, chunksObj, chunkPtr);
+        }
+        Jim_DecrRefCount(interp, srcObj);
+        return;
+    }
+    objPtr->incrRopeValueLength(Jim_Length(appendObjPtr));
+    Jim_ListAppendElement(interp, chunksObj, appendObjPtr);
+}
+
+/* Appends a copy of str to the rope objPtr. */
+static void JimRopeAppendString(Jim_InterpPtr interp, Jim_ObjPtr objPtr, const char *str, int len) // #JimRope
+{
+    PRJ_TRACE;
+    Jim_ObjPtr chunksObj = JimRopeChunks(interp, objPtr);
+    int count = chunksObj->get_listValue_len();
+    Jim_ObjPtr lastPtr = count ? chunksObj->get_listValue_objArray(count - 1) : NULL;
+
+    if (len == -1)
+        len = CAST(int)strlen(str);
+    /* The last piece can grow if this rope is the only one holding it */
+    if (lastPtr && !Jim_IsShared(lastPtr) && chunksObj->get_listValue_store()->refCount_ == 1) {
+        Jim_AppendString(interp, lastPtr, str, len);
+    }
+    else {
+        Jim_ListAppendElement(interp, chunksObj, Jim_NewStringObj(interp, str, len));
+    }
+    objPtr->incrRopeValueLength(len);
+}
+
+/**
+ * Gets the pieces of a rope without joining them, e.g. to write them out.
+ * Returns the number of pieces, or 0 if objPtr isn't an unjoined rope and
+ * Jim_GetString() has to be used instead.
+ */
+JIM_EXPORT int Jim_StringChunks(Jim_InterpPtr interp, Jim_ObjPtr objPtr, Jim_ObjArray **chunkVec) // #JimRope
+{
+    PRJ_TRACE;
+    JIM_NOTUSED(interp);
+
+    if (!JimIsRope(objPtr)) {
+        *chunkVec = NULL;
+        return 0;
+    }
+    *chunkVec = objPtr->get_ropeValue_chunks()->get_listValue_ele();
+    return objPtr->get_ropeValue_chunks()->get_listValue_len();
+}
+
 /* Low-level_ string append. Use it only against unshared objects
  * of tokenType_ "string". */
 static void StringAppendString(Jim_ObjPtr objPtr, const char *str, int len) // #JimStr
@@ -2390,15 +2988,29 @@ static void StringAppendString(Jim_ObjPtr objPtr, const char *str, int len) // #
     if (len == -1)
         len = CAST(int)strlen(str);
     needlen = objPtr->length() + len;
-    if (objPtr->get_strValue_maxLen() < needlen ||
-        objPtr->get_strValue_maxLen() == 0) {
+    if (objPtr->bytesInline() && needlen < JIM_OBJ_INLINE_BYTES) {
+        /* Still fits inside the object */
+    }
+    else if (objPtr->get_strValue_maxLen() < needlen ||
+        objPtr->get_strValue_maxLen() == 0 || objPtr->bytesInline()) {
         needlen *= 2;
         /* Inefficient to malloc() for less than 8 bytes */
         if (needlen < 7) {
             needlen = 7; // #MagicNum
         }
-        if (objPtr->bytes() == g_JimEmptyStringRep) {
-            objPtr->setBytes( new_CharArray(needlen + 1)); // #AllocF 
+        if (objPtr->bytes() == g_JimEmptyStringRep || objPtr->bytesInline()) {
+            char *buf = new_CharArray(needlen + 1); // #AllocF 
+
+            IGNORERET memcpy(buf, objPtr->bytes(), objPtr->length());
+            objPtr->setBytes(buf);
+        }
+        else if (g_JimExternalBytesCount && JimIsExternalBytes(objPtr->bytes())) {
+            /* Can't grow a mapping, so the string moves to the heap */
+            char *buf = new_CharArray(needlen + 1); // #AllocF #MissInCoverage
+
+            IGNORERET memcpy(buf, objPtr->bytes(), objPtr->length());
+            IGNORERET JimReleaseExternalBytes(objPtr->bytes());
+            objPtr->setBytes(buf);
         }
         else {
             objPtr->setBytes(CAST(char*) realloc_CharArray(objPtr->bytes(), needlen + 1)); // #AllocF 
@@ -2422,6 +3034,13 @@ JIM_EXPORT void Jim_AppendString(Jim_InterpPtr interp, Jim_ObjPtr objPtr, const
 {
     PRJ_TRACE;
     JimPanic((Jim_IsShared(objPtr), "Jim_AppendString called with shared object"));
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+    Jim_CollectRememberObj(interp, objPtr);
+#endif
+    if (JimIsRope(objPtr)) {
+        JimRopeAppendString(interp, objPtr, str, len);
+        return;
+    }
     IGNORERET SetStringFromAny(interp, objPtr);
     StringAppendString(objPtr, str, len);
 }
@@ -2429,8 +3048,21 @@ JIM_EXPORT void Jim_AppendString(Jim_InterpPtr interp, Jim_ObjPtr objPtr, const
 JIM_EXPORT void Jim_AppendObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr, Jim_ObjPtr appendObjPtr) // #JimStr #ManyRefs
 {
     PRJ_TRACE;
-    int len;
-    const char *str = Jim_GetString(appendObjPtr, &len);
+    int len = 0;
+    const char *str = JimIsRope(appendObjPtr) ? NULL : Jim_GetString(appendObjPtr, &len);
+
+    if (str == NULL || len >= JIM_ROPE_MIN_CHUNK) {
+        /* Large, so keep it as a piece rather than copy it */
+        JimPanic((Jim_IsShared(objPtr), "Jim_AppendObj called with shared object"));
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+        Jim_CollectRememberObj(interp, objPtr);
+#endif
+        if (!JimIsRope(objPtr)) {
+            JimRopeFromString(interp, objPtr);
+        }
+        JimRopeAppendObj(interp, objPtr, appendObjPtr);
+        return;
+    }
     Jim_AppendString(interp, objPtr, str, len);
 }
 
@@ -2870,7 +3502,7 @@ CHKRET static Jim_ObjPtr JimStringTrimRight(Jim_InterpPtr interp, Jim_ObjPtr str
         return strObjPtr;
     }
 
-    if (Jim_IsShared(strObjPtr)) {
+    if (Jim_IsShared(strObjPtr) || JimIsSharedBytes(strObjPtr->bytes())) {
         strObjPtr = Jim_NewStringObj(interp, strObjPtr->bytes(), CAST(int)(nontrim - strObjPtr->bytes()));
     }
     else {
@@ -3244,6 +3876,7 @@ struct ScriptToken
 
 struct ParseTokenList;
 struct ParseToken;
+struct JimByteCode;
 
 struct ScriptObj // #JimScript
 {
@@ -3257,6 +3890,8 @@ struct ScriptObj // #JimScript
     int firstLineNum_ = 0;              /* Line number of the first lineNum_ */
     int errorLineNum_ = 0;              /* Error lineNum_ number, if any */
     int missingChar_ = 0;               /* Missing char if script failed to parse, (or space or backslash if OK) */
+    int bcRuns_ = 0;                    /* Number of evaluations before the script was compiled */
+    JimByteCode* bc_ = NULL;            /* Compiled form of the script, see JimCompileScript() */
 
     inline int firstLineNum() const { return firstLineNum_; }
     inline int setFirstLineNum(int val) { firstLineNum_ = val; return firstLineNum_; }
@@ -3288,12 +3923,13 @@ struct ScriptObj // #JimScript
 };
 
 /* You might want to instrument or cache heap use so we wrap it access here. */
-#define new_ScriptObj       Jim_TAllocZ<ScriptObj>(1,"ScriptObj")
-#define free_ScriptObj(ptr) Jim_TFree<ScriptObj>(ptr,"ScriptObj")
+#define new_ScriptObj       Jim_TSlabAllocZ<ScriptObj>("ScriptObj")
+#define free_ScriptObj(ptr) Jim_TSlabFree<ScriptObj>(ptr,"ScriptObj")
 
 static void JimSetScriptFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
 static Retval JimParseCheckMissing(Jim_InterpPtr interp, int ch);
 static ScriptObj *JimGetScript(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
+static void JimFreeByteCode(JimByteCode *bc);
 
 static void FreeScriptInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimScript #dtor_like
 {
@@ -3303,6 +3939,9 @@ static void FreeScriptInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) //
 
     if (--script->inUse_ != 0)
         return;
+    if (script->bc_) {
+        JimFreeByteCode(script->bc_);
+    }
     for (i = 0; i < script->Num_tokenArray(); i++) {
         Jim_DecrRefCount(interp, script->tokenArray_[i].objPtr_);
     }
@@ -3806,6 +4445,12 @@ static void JimDecrCmdRefCount(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr)
                 IGNORERET Jim_FreeHashTable(cmdPtr->proc_staticVars());
                 cmdPtr->proc_freeStaticVars(); // #FreeF 
             }
+            if (cmdPtr->proc_slotNames()) {
+                IGNORERET Jim_FreeHashTable(cmdPtr->proc_slotNames());
+                cmdPtr->proc_freeSlotNames(); // #FreeF 
+                /* Compiled scripts bound to these slots compare the epoch */
+                Jim_InterpIncrProcEpoch(interp);
+            }
         }
         else {
             /* native (C) */
@@ -3828,8 +4473,10 @@ static void JimDecrCmdRefCount(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr)
 static void JimVariablesHTValDestructor(void *interp, void *val)
 {
     PRJ_TRACE;
-    Jim_DecrRefCount((Jim_InterpPtr )interp, (CAST(Jim_VarPtr )val)->objPtr());
-    Jim_TFree<void>(val,"void"); // #FreeF 
+    Jim_VarPtr varPtr = CAST(Jim_VarPtr )val;
+
+    Jim_DecrRefCount((Jim_InterpPtr )interp, varPtr->objPtr());
+    free_Jim_Var(varPtr); // #FreeF 
 }
 
 static const Jim_HashTableType g_JimVariablesHashTableType = { // #JimHashTableType
@@ -3838,7 +4485,8 @@ static const Jim_HashTableType g_JimVariablesHashTableType = { // #JimHashTableT
     NULL,                               /* val dup */
     JimStringCopyHTKeyCompare,  /* key compare */
     JimStringCopyHTKeyDestructor,       /* key destructor */
-    JimVariablesHTValDestructor /* val destructor */
+    JimVariablesHTValDestructor, /* val destructor */
+    JIM_HT_OPEN_ADDRESSING      /* flags */
 };
 const Jim_HashTableType& JimVariablesHashTableType() { return g_JimVariablesHashTableType; }
 
@@ -3858,7 +4506,8 @@ static const Jim_HashTableType g_JimCommandsHashTableType = { // #JimHashTableTy
     NULL,                           /* val dup */
     JimStringCopyHTKeyCompare,      /* key compare */
     JimStringCopyHTKeyDestructor,   /* key destructor */
-    JimCommandsHT_ValDestructor     /* val destructor */
+    JimCommandsHT_ValDestructor,    /* val destructor */
+    JIM_HT_OPEN_ADDRESSING          /* flags */
 };
 const Jim_HashTableType& JimCommandsHashTableType() { return g_JimCommandsHashTableType; }
 
@@ -4095,6 +4744,217 @@ static void JimUpdateProcNamespace(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr, cons
 #endif
 }
 
+/* Compiled local variables.
+ *
+ * When a procedure is created the names of its arguments, and of the
+ * variables its body visibly uses ($name, [set name ...], [foreach name ...]
+ * and so on, including the bodies of the control commands), are given a slot
+ * index. Each call frame of the procedure then stores these variables in a
+ * plain Jim_Var array instead of its vars_ hash table, which is only used for
+ * other (dynamically named) variables. See JimFindFrameVar().
+ */
+enum {
+    JIM_PROC_MAX_SLOTS = 64,        /* Further locals use the frame hash table #MagicNum */
+    JIM_PROC_SCAN_DEPTH = 8,        /* Nesting of bodies scanned for local names #MagicNum */
+    JIM_PROC_SCAN_WORDS = 32        /* Words of a command_ examined for local names #MagicNum */
+};
+
+/* Returns the slot index of a local variable name_, adding it if needed,
+ * or -1 if the name_ can't be a compiled local. */
+static int JimProcAddSlot(Jim_CmdPtr cmdPtr, const char *name)
+{
+    PRJ_TRACE;
+    Jim_HashEntryPtr he;
+    int idx;
+
+    if (name[0] == 0 || strstr(name, "::") || strchr(name, '(')) {
+        return -1;
+    }
+    if (cmdPtr->proc_slotNames() == NULL) {
+        cmdPtr->proc_setSlotNames(new_Jim_HashTable); // #AllocF 
+        IGNORERET Jim_InitHashTable(cmdPtr->proc_slotNames(), &g_JimPackageHashTableType, NULL);
+        cmdPtr->proc_slotNames()->setTypeName("slotNames");
+    }
+    he = Jim_FindHashEntry(cmdPtr->proc_slotNames(), name);
+    if (he) {
+        return CAST(int)(CAST(intptr_t)Jim_GetHashEntryVal(he) - 1);
+    }
+    if (cmdPtr->proc_numSlots() >= JIM_PROC_MAX_SLOTS) {
+        return -1;
+    }
+    idx = cmdPtr->proc_numSlots();
+    IGNORERET Jim_AddHashEntry(cmdPtr->proc_slotNames(), name, CAST(void *)CAST(intptr_t)(idx + 1));
+    cmdPtr->proc_setNumSlots(idx + 1);
+    return idx;
+}
+
+static void JimScanProcSlots(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr, Jim_ObjPtr scriptObjPtr, int depth);
+
+/* Adds the local names found in one command_ of a procedure body, given the
+ * command_ name_ and its constant words (NULL for words that need substitution). */
+static void JimScanCommandSlots(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr, int argc, Jim_ObjArray *words, int depth)
+{
+    PRJ_TRACE;
+    const char *cmd = Jim_String(words[0]);
+    int j;
+
+    if (!strcmp(cmd, "set") || !strcmp(cmd, "incr") || !strcmp(cmd, "append") || !strcmp(cmd, "lappend")) {
+        if (argc > 1 && words[1]) {
+            IGNORERET JimProcAddSlot(cmdPtr, Jim_String(words[1]));
+        }
+    }
+    else if (!strcmp(cmd, "global")) {
+        for (j = 1; j < argc; j++) {
+            if (words[j]) {
+                IGNORERET JimProcAddSlot(cmdPtr, Jim_String(words[j]));
+            }
+        }
+    }
+    else if (!strcmp(cmd, "foreach") || !strcmp(cmd, "lmap")) {
+        for (j = 1; j < argc - 1; j += 2) {
+            if (words[j]) {
+                int k, len = Jim_ListLength(interp, words[j]);
+                for (k = 0; k < len; k++) {
+                    IGNORERET JimProcAddSlot(cmdPtr, Jim_String(Jim_ListGetIndex(interp, words[j], k)));
+                }
+            }
+        }
+        if (argc > 2 && words[argc - 1]) {
+            JimScanProcSlots(interp, cmdPtr, words[argc - 1], depth + 1);
+        }
+    }
+    else if (!strcmp(cmd, "while")) {
+        if (argc == 3 && words[2]) {
+            JimScanProcSlots(interp, cmdPtr, words[2], depth + 1);
+        }
+    }
+    else if (!strcmp(cmd, "catch")) {
+        /* catch script ?resultVarName? ?optionsVarName? */
+        if (argc >= 2 && words[1] && Jim_String(words[1])[0] != '-') {
+            JimScanProcSlots(interp, cmdPtr, words[1], depth + 1);
+            for (j = 2; j < argc && j < 4; j++) {
+                if (words[j]) {
+                    IGNORERET JimProcAddSlot(cmdPtr, Jim_String(words[j]));
+                }
+            }
+        }
+    }
+    else if (!strcmp(cmd, "for")) {
+        for (j = 1; j < argc; j++) {
+            if (j != 2 && words[j]) {
+                JimScanProcSlots(interp, cmdPtr, words[j], depth + 1);
+            }
+        }
+    }
+    else if (!strcmp(cmd, "if")) {
+        /* if cond ?then? body ?elseif cond ?then? body ...? ?else? ?body? */
+        j = 2;
+        while (j < argc) {
+            if (words[j] && !strcmp(Jim_String(words[j]), "then")) {
+                j++;
+            }
+            if (j < argc && words[j]) {
+                JimScanProcSlots(interp, cmdPtr, words[j], depth + 1);
+            }
+            if (++j >= argc || !words[j]) {
+                break;
+            }
+            if (!strcmp(Jim_String(words[j]), "elseif")) {
+                j += 2;
+                continue;
+            }
+            if (!strcmp(Jim_String(words[j]), "else")) {
+                j++;
+            }
+            if (j < argc && words[j]) {
+                JimScanProcSlots(interp, cmdPtr, words[j], depth + 1);
+            }
+            break;
+        }
+    }
+}
+
+/* Adds the local names used by a procedure body (or a nested body). */
+static void JimScanProcSlots(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr, Jim_ObjPtr scriptObjPtr, int depth)
+{
+    PRJ_TRACE;
+    ScriptObj *script;
+    ScriptTokenPtr token;
+    int i;
+
+    if (depth > JIM_PROC_SCAN_DEPTH) {
+        return;
+    }
+    script = JimGetScript(interp, scriptObjPtr);
+    if (script->missingChar_ != ' ' && script->missingChar_ != '\\') {
+        return;
+    }
+    token = script->tokenArray_;
+    for (i = 0; i < script->Num_tokenArray(); ) {
+        Jim_ObjPtr words[JIM_PROC_SCAN_WORDS];
+        int argc = token[i].objPtr_->get_scriptLineValue_argc();
+        int j;
+
+        i++;
+        for (j = 0; j < argc; j++) {
+            long wordtokens = 1;
+            int k;
+
+            if (token[i].tokenType_ == JIM_TT_WORD) {
+                wordtokens = CAST(long)JimWideValue(token[i++].objPtr_);
+                if (wordtokens < 0) {
+                    wordtokens = -wordtokens;
+                }
+            }
+            for (k = 0; k < wordtokens; k++) {
+                if (token[i + k].tokenType_ == JIM_TT_VAR) {
+                    IGNORERET JimProcAddSlot(cmdPtr, Jim_String(token[i + k].objPtr_));
+                }
+                else if (token[i + k].tokenType_ == JIM_TT_CMD) {
+                    JimScanProcSlots(interp, cmdPtr, token[i + k].objPtr_, depth + 1);
+                }
+            }
+            if (j < JIM_PROC_SCAN_WORDS) {
+                words[j] = NULL;
+                if (wordtokens == 1 && (token[i].tokenType_ == JIM_TT_ESC || token[i].tokenType_ == JIM_TT_STR)) {
+                    words[j] = token[i].objPtr_;
+                }
+            }
+            i += CAST(int)wordtokens;
+        }
+        if (argc > 0 && argc <= JIM_PROC_SCAN_WORDS && words[0]) {
+            JimScanCommandSlots(interp, cmdPtr, argc, words, depth);
+        }
+    }
+}
+
+
+/* Gives the arguments the first slots, then scans the body. */
+static void JimCreateProcedureSlots(Jim_InterpPtr interp, Jim_CmdPtr cmdPtr)
+{
+    PRJ_TRACE;
+    int d, argSlots = 1;
+
+    for (d = 0; d < cmdPtr->proc_argListLen(); d++) {
+        Jim_ObjPtr nameObjPtr = cmdPtr->proc_arglist(d).nameObjPtr();
+        const char *name;
+
+        if (d == cmdPtr->proc_argsPos() && cmdPtr->proc_arglist(d).defaultObjPtr()) {
+            nameObjPtr = cmdPtr->proc_arglist(d).defaultObjPtr();
+        }
+        name = Jim_String(nameObjPtr);
+        if (*name == '&') {
+            argSlots = 0;
+            name++;
+        }
+        if (JimProcAddSlot(cmdPtr, name) != d) {
+            argSlots = 0;
+        }
+    }
+    cmdPtr->proc_setArgSlots(argSlots);
+    JimScanProcSlots(interp, cmdPtr, cmdPtr->proc_bodyObjPtr(), 0);
+}
+
 CHKRET static Jim_CmdPtr JimCreateProcedureCmd(Jim_InterpPtr interp, Jim_ObjPtr argListObjPtr,
     Jim_ObjPtr staticsListObjPtr, Jim_ObjPtr bodyObjPtr, Jim_ObjPtr nsObj)
 {
@@ -4177,7 +5037,11 @@ err:
         cmdPtr->proc_arglist(i).setNamedObjPtr(nameObjPtr);
         cmdPtr->proc_arglist(i).setDefaultObjPtr(defaultObjPtr);
     }
+    if (g_JIM_PROC_SLOTS_VAL) {
+        JimCreateProcedureSlots(interp, cmdPtr);
+    }
     PRJ_TRACE_GEN(::prj_trace::ACTION_PROC_CREATE, __FUNCTION__, cmdPtr, NULL);
+
     return cmdPtr;
 }
 
@@ -4391,6 +5255,61 @@ CHKRET static Retval JimValidName(Jim_InterpPtr interp, const char *type, Jim_Ob
     return JIM_OK;
 }
 
+/* Returns the compiled local slot for name_ in framePtr, or NULL if
+ * the name_ isn't one of the frame's slot names. */
+static Jim_VarPtr JimFrameSlot(Jim_CallFramePtr framePtr, const char *name)
+{
+    PRJ_TRACE;
+    Jim_HashEntryPtr he;
+
+    if (framePtr->slotNames() == NULL) {
+        return NULL;
+    }
+    he = Jim_FindHashEntry(framePtr->slotNames(), name);
+    if (he == NULL) {
+        return NULL;
+    }
+    return &framePtr->slots()[CAST(intptr_t)Jim_GetHashEntryVal(he) - 1];
+}
+
+/* Finds an existing local variable of framePtr, either in its slots or in
+ * its variables hash table. Returns NULL if there is no such variable.
+ * Both tables hash names with the same function, so name_ is hashed once.
+ * Compiled scripts don't come here for slot names, see JimBcSlotVar(). */
+static Jim_VarPtr JimFindFrameVar(Jim_CallFramePtr framePtr, const char *name)
+{
+    PRJ_TRACE;
+    Jim_HashEntryPtr he;
+    unsigned_int keyHash;
+
+    if (framePtr->slotNames() == NULL) {
+        he = Jim_FindHashEntry(&framePtr->vars(), name);
+        return he ? CAST(Jim_VarPtr) Jim_GetHashEntryVal(he) : NULL;
+    }
+    keyHash = framePtr->slotNames()->type()->hashFunction(name);
+    he = Jim_FindHashEntryHashed(framePtr->slotNames(), name, keyHash);
+    if (he) {
+        Jim_VarPtr varPtr = &framePtr->slots()[CAST(intptr_t)Jim_GetHashEntryVal(he) - 1];
+
+        return varPtr->objPtr() ? varPtr : NULL;
+    }
+    he = Jim_FindHashEntryHashed(&framePtr->vars(), name, keyHash);
+    return he ? CAST(Jim_VarPtr) Jim_GetHashEntryVal(he) : NULL;
+}
+
+/* Returns the variables hash table of framePtr, giving it its type on the
+ * first variable added by name_. Procedure frames whose locals all live in
+ * slots never get that far, and lookups in an empty table don't hash. */
+static Jim_HashTablePtr JimFrameVars(Jim_InterpPtr interp, Jim_CallFramePtr framePtr)
+{
+    PRJ_TRACE;
+    if (framePtr->vars().type() == NULL) {
+        IGNORERET Jim_InitHashTable(&framePtr->vars(), &g_JimVariablesHashTableType, interp);
+        framePtr->vars().setTypeName("variables");
+    }
+    return &framePtr->vars();
+}
+
 /* This method should be called only by the variable API.
  * It returns JIM_OK on success (variable already exists),
  * JIM_ERR if it does not exist, JIM_DICT_SUGAR if it's not
@@ -4401,7 +5320,7 @@ CHKRET static Retval SetVariableFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr)
     PRJ_TRACE;
     const char *varName;
     Jim_CallFramePtr framePtr;
-    Jim_HashEntryPtr he;
+    Jim_VarPtr varPtr;
     int global;
     int len;
 
@@ -4440,14 +5359,17 @@ CHKRET static Retval SetVariableFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr)
         framePtr = interp->framePtr();
     }
 
-    /* Resolve this name_ in the variables hash table */
-    he = Jim_FindHashEntry(&framePtr->vars(), varName);
-    if (he == NULL) {
+    /* Resolve this name_ in the compiled locals or the variables hash table */
+    varPtr = JimFindFrameVar(framePtr, varName);
+    if (varPtr == NULL) {
         if (!global && framePtr->staticVars()) {
             /* Try with static vars. */
-            he = Jim_FindHashEntry(framePtr->staticVars(), varName);
+            Jim_HashEntryPtr he = Jim_FindHashEntry(framePtr->staticVars(), varName);
+            if (he) {
+                varPtr = CAST(Jim_VarPtr ) Jim_GetHashEntryVal(he);
+            }
         }
-        if (he == NULL) {
+        if (varPtr == NULL) {
             return JIM_ERR;
         }
     }
@@ -4455,7 +5377,7 @@ CHKRET static Retval SetVariableFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr)
     /* Free the old internal repr and set the new one. */
     Jim_FreeIntRep(interp, objPtr);
     objPtr->setTypePtr(&g_variableObjType);
-    objPtr->setVarValue(framePtr->id(), CAST(Jim_VarPtr ) Jim_GetHashEntryVal(he), global);
+    objPtr->setVarValue(framePtr->id(), varPtr, global);
     return JIM_OK;
 }
 
@@ -4468,15 +5390,9 @@ CHKRET static Jim_VarPtr JimCreateVariable(Jim_InterpPtr interp, Jim_ObjPtr name
     PRJ_TRACE;
     const char *name;
     Jim_CallFramePtr framePtr;
+    Jim_VarPtr var;
     int global;
 
-    /* New variable to create */
-    Jim_VarPtr  var = new_Jim_Var; // #AllocF 
-
-    var->setObjPtr(valObjPtr);
-    Jim_IncrRefCount(valObjPtr);
-    var->setLinkFramePtr( NULL);
-
     name = Jim_String(nameObjPtr);
     if (name[0] == ':' && name[1] == ':') {
         while (*++name == ':') {
@@ -4489,8 +5405,17 @@ CHKRET static Jim_VarPtr JimCreateVariable(Jim_InterpPtr interp, Jim_ObjPtr name
         global = 0;
     }
 
-    /* Insert the new variable */
-    IGNORERET Jim_AddHashEntry(&framePtr->vars(), name, var);
+    /* New variable to create, in its slot if it is a compiled local */
+    var = JimFrameSlot(framePtr, name);
+    if (var == NULL) {
+        var = new_Jim_Var; // #AllocF 
+
+        /* Insert the new variable */
+        IGNORERET Jim_AddHashEntry(JimFrameVars(interp, framePtr), name, var);
+    }
+    var->setObjPtr(valObjPtr);
+    Jim_IncrRefCount(valObjPtr);
+    var->setLinkFramePtr( NULL);
 
     /* Make the object int rep a variable */
     Jim_FreeIntRep(interp, nameObjPtr);
@@ -4799,7 +5724,14 @@ JIM_EXPORT Retval Jim_UnsetVariable(Jim_InterpPtr interp, Jim_ObjPtr nameObjPtr,
                 framePtr = interp->framePtr();
             }
 
-            retval = Jim_DeleteHashEntry(&framePtr->vars(), name);
+            if (varPtr == JimFrameSlot(framePtr, name)) {
+                Jim_DecrRefCount(interp, varPtr->objPtr());
+                varPtr->setObjPtr(NULL);
+                retval = JIM_OK;
+            }
+            else {
+                retval = Jim_DeleteHashEntry(&framePtr->vars(), name);
+            }
             if (retval == JIM_OK) {
                 /* Change the callframe id, invalidating var lookup caching */
                 framePtr->setId( interp->callFrameEpoch()); interp->incrCallFrameEpoch();
@@ -5033,10 +5965,8 @@ CHKRET static Jim_CallFramePtr JimCreateCallFrame(Jim_InterpPtr interp, Jim_Call
         cf->setTailcallCmd( NULL);
     }
     else {
+        /* The variables hash table is set up by JimFrameVars() when needed */
         cf = new_Jim_CallFrame; // #AllocF 
-
-        IGNORERET Jim_InitHashTable(&cf->vars(), &g_JimVariablesHashTableType, interp);
-        cf->vars().setTypeName("variables");
     }
 
     cf->setId(interp->callFrameEpoch());  interp->incrCallFrameEpoch();
@@ -5049,6 +5979,25 @@ CHKRET static Jim_CallFramePtr JimCreateCallFrame(Jim_InterpPtr interp, Jim_Call
     return cf;
 }
 
+/* Gives a new procedure call frame empty slots for the compiled locals of cmd.
+ * The slots array is kept across reuse of the frame and only ever grows. */
+static void JimInitFrameSlots(Jim_CallFramePtr cf, Jim_CmdPtr cmd)
+{
+    PRJ_TRACE;
+    int n = cmd->proc_numSlots();
+
+    if (n == 0) {
+        return;
+    }
+    if (n > cf->slotsCapacity()) {
+        cf->setSlots(realloc_Jim_VarArray(cf->slots(), n)); // #AllocF 
+        cf->setSlotsCapacity(n);
+    }
+    memset(CAST(void *)cf->slots(), 0, sizeof(Jim_Var) * n);
+    cf->setSlotNames(cmd->proc_slotNames());
+    cf->setNumSlots(n);
+}
+
 CHKRET static Retval JimDeleteLocalProcs(Jim_InterpPtr interp, Jim_StackPtr localCommands)
 {
     PRJ_TRACE;
@@ -5165,27 +6114,23 @@ static void JimFreeCallFrame(Jim_InterpPtr interp, Jim_CallFramePtr cf, int acti
     if (cf->procBodyObjPtr())
         Jim_DecrRefCount(interp, cf->procBodyObjPtr());
     Jim_DecrRefCount(interp, cf->nsObj());
-    if (action == JIM_FCF_FULL || cf->vars().size() != JIM_HT_INITIAL_SIZE)
-        IGNORERET Jim_FreeHashTable(&cf->vars());
-    else {
+    if (cf->numSlots()) {
         int i;
-        Jim_HashEntry **table = cf->vars().table(), *he;
-
-        for (i = 0; i < JIM_HT_INITIAL_SIZE; i++) {
-            he = table[i];
-            while (he != NULL) {
-                Jim_HashEntryPtr nextEntry = he->next();
-                Jim_VarPtr varPtr = CAST(Jim_VarPtr )Jim_GetHashEntryVal(he);
 
-                Jim_DecrRefCount(interp, varPtr->objPtr());
-                Jim_TFreeNR<void>(Jim_GetHashEntryKey(he),"void"); // #FreeF 
-                free_Jim_Var(varPtr); // #FreeF 
-                free_Jim_HashEntry(he); // #FreeF 
-                table[i] = NULL;
-                he = nextEntry;
+        for (i = 0; i < cf->numSlots(); i++) {
+            if (cf->slots()[i].objPtr()) {
+                Jim_DecrRefCount(interp, cf->slots()[i].objPtr());
             }
         }
-        cf->vars().setUsed(0);
+        cf->setSlotNames(NULL);
+        cf->setNumSlots(0);
+    }
+    /* The variables hash table has no type if no variable was ever added by name_ */
+    if (cf->vars().type() != NULL) {
+        if (action == JIM_FCF_FULL || cf->vars().size() != JIM_HT_INITIAL_SIZE)
+            IGNORERET Jim_FreeHashTable(&cf->vars());
+        else
+            Jim_ClearHashTable(&cf->vars());
     }
     cf->setNext( interp->freeFramesList());
     interp->setFreeFramesList(cf);
@@ -5257,7 +6202,8 @@ static const Jim_HashTableType g_JimReferencesHashTableType = { // #JimHashTable
     NULL,                       /* val dup */
     JimReferencesHTKeyCompare,  /* key compare */
     JimReferencesHTKeyDestructor,       /* key destructor */
-    JimReferencesHTValDestructor        /* val destructor */
+    JimReferencesHTValDestructor,       /* val destructor */
+    JIM_HT_OPEN_ADDRESSING              /* flags */
 };
 const Jim_HashTableType& JimReferencesHashTableType() { return g_JimReferencesHashTableType; }
 
@@ -5460,100 +6406,290 @@ static const Jim_HashTableType g_JimRefMarkHashTableType = { // #JimHashTableTyp
     NULL,                       /* val dup */
     JimReferencesHTKeyCompare,  /* key compare */
     JimReferencesHTKeyDestructor,       /* key destructor */
-    NULL                        /* val destructor */
+    NULL,                       /* val destructor */
+    JIM_HT_OPEN_ADDRESSING      /* flags */
 };
 const Jim_HashTableType& JimRefMarkHashTableType() { return g_JimRefMarkHashTableType; }
 
-/* Performs the garbage collection. */
-JIM_EXPORT int Jim_Collect(Jim_InterpPtr interp) //#2Refs
+/* Collector modes, see [collect configure -mode] */
+enum {
+    JIM_COLLECT_MODE_FULL,          /* every cycle rescans all the live objects */
+    JIM_COLLECT_MODE_GENERATIONAL   /* cycles rescan only the young generation */
+};
+
+enum {
+    JIM_COLLECT_ID_PERIOD = 5000, // #MagicNum
+    JIM_COLLECT_TIME_PERIOD = 300, // #MagicNum
+    JIM_COLLECT_FULL_EVERY = 16, // #MagicNum
+    JIM_COLLECT_STEP_USECS = 1000, // #MagicNum
+    JIM_COLLECT_CLOCK_EVERY = 64 // #MagicNum
+};
+
+/* Reference collector state.
+ *
+ * liveList_ is split in two generations. Objects from the head up to oldGen_
+ * were created, or appended to, after the last cycle started. The ones from
+ * oldGen_ onwards were scanned by an earlier cycle and the references they
+ * hold are already in marks_, so a generational cycle only scans the young
+ * ones. marks_ is conservative: it only forgets references on a full cycle.
+ *
+ * A cycle scans [cycleStart_, oldGen_) a slice at a time. Objects created in
+ * between go in front of cycleStart_ and are scanned when the cycle finishes,
+ * as are the ones moved there by Jim_CollectRememberObj(). */
+struct Jim_Collector {
+    int mode_;
+    int idPeriod_;              /* reference ids between automatic cycles */
+    int timePeriod_;            /* seconds between automatic cycles */
+    int fullEvery_;             /* generational cycles between full ones */
+    int stepUsecs_;             /* time slice used by Jim_CollectIfNeeded() */
+    int running_;               /* a cycle is in progress */
+    int full_;                  /* ... and it is a full one */
+    int minorCycles_;           /* generational cycles since the last full one */
+    unsigned_long cycleId_;     /* referenceNextId_ when the running cycle began */
+    Jim_ObjPtr oldGen_;         /* first object of the old generation, NULL if none */
+    Jim_ObjPtr cycleStart_;     /* first object of the running cycle */
+    Jim_ObjPtr scanPtr_;        /* next object to scan */
+    Jim_HashTable marks_;       /* ids of the references held by scanned objects */
+    prj_trace::Collect_Stats stats_;
+};
+
+static void JimCollectorCreate(Jim_InterpPtr interp)
 {
     PRJ_TRACE;
-    PRJ_TRACE_GEN(::prj_trace::ACTION_COLLECT_PRE, __FUNCTION__, interp, NULL);
+    Jim_Collector *gc = new_Jim_Collector; // #AllocF
 
-    int collected = 0;
-    Jim_HashTable marks;
-    Jim_HashTableIterator htiter;
-    Jim_HashEntryPtr he;
-    Jim_ObjPtr objPtr;
+    gc->mode_ = JIM_COLLECT_MODE_FULL;
+    gc->idPeriod_ = JIM_COLLECT_ID_PERIOD;
+    gc->timePeriod_ = JIM_COLLECT_TIME_PERIOD;
+    gc->fullEvery_ = JIM_COLLECT_FULL_EVERY;
+    gc->stepUsecs_ = JIM_COLLECT_STEP_USECS;
+    IGNORERET Jim_InitHashTable(&gc->marks_, &g_JimRefMarkHashTableType, NULL);
+    gc->marks_.setTypeName("refMark");
+    interp->setCollector(gc);
+}
 
-    /* Avoid recursive calls */
-    if (interp->lastCollectId() == CAST(unsigned_long)~0) { 
-        /* Jim_Collect() already running. Return just now. */
-        return 0; // #MissInCoverage
+static void JimCollectorFree(Jim_InterpPtr interp)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+
+    IGNORERET Jim_FreeHashTable(&gc->marks_);
+    free_Jim_Collector(gc); // #FreeF
+    interp->setCollector(NULL);
+}
+
+/* Called before objPtr leaves its place in liveList_. */
+static inline void JimCollectForgetObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr)
+{
+    Jim_Collector *gc = interp->collector();
+
+    if (gc->oldGen_ == objPtr)
+        gc->oldGen_ = objPtr->nextObjPtr();
+    if (gc->cycleStart_ == objPtr)
+        gc->cycleStart_ = objPtr->nextObjPtr();
+    if (gc->scanPtr_ == objPtr)
+        gc->scanPtr_ = objPtr->nextObjPtr();
+}
+
+/* objPtr's string is about to grow in place, or to outlive the internal
+ * representation it was built from, and may then hold the only copy of
+ * references the scan already went past: move it to the young generation.
+ * Jim_FreeIntRep() calls it for objects that keep their string. */
+JIM_EXPORT void Jim_CollectRememberObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #ManyRefs
+{
+    Jim_Collector *gc = interp->collector();
+
+    if (gc->mode_ != JIM_COLLECT_MODE_GENERATIONAL && !gc->running_)
+        return;
+    if (interp->liveList() == objPtr)
+        return;
+    JimCollectForgetObj(interp, objPtr);
+    /* It isn't the head, so it has a previous object */
+    objPtr->prevObjPtr()->setNextObjPtr(objPtr->nextObjPtr());
+    if (objPtr->nextObjPtr())
+        objPtr->nextObjPtr()->setPrevObjPtr(objPtr->prevObjPtr());
+    objPtr->setPrevObjPtr(NULL);
+    objPtr->setNextObjPtr(interp->liveList());
+    interp->liveList()->setPrevObjPtr(objPtr);
+    interp->setLiveList(objPtr);
+}
+
+/* Adds to 'marks' the ids of the references found in the null terminated 'str'. */
+static void JimCollectScanString(Jim_HashTablePtr marks, const char *str, int len) // #JimRef
+{
+    PRJ_TRACE;
+    const char *p = str;
+
+    /* Skip strings too little to contain references. */
+    if (len < JIM_REFERENCE_SPACE)
+        return;
+    /* Extract references from the string. */
+    while (1) {
+        int i;
+        unsigned_long id;
+
+        if ((p = strstr(p, "<reference.<")) == NULL)
+            break;
+        /* Check if it's a valid reference. */
+        if (len - (p - str) < JIM_REFERENCE_SPACE)
+            break; // #MissInCoverage
+        if (p[41] != '>' || p[19] != '>' || p[20] != '.') // #MagicNum
+            break;
+        for (i = 21; i <= 40; i++) // #MagicNum
+            if (!isdigit(UCHAR(p[i])))
+                break; // #MissInCoverage
+        /* Get the ID */
+        id = strtoul(p + 21, NULL, 10);
+
+        /* Ok, a reference for the given ID
+         * was found. Mark it. */
+        IGNORERET Jim_AddHashEntry(marks, &id, NULL);
+        if (g_JIM_DEBUG_GC) { // #Debug
+            IGNORERET printf("MARK: %d\n", CAST(int)id); // #stdoutput
+        }
+        p += JIM_REFERENCE_SPACE;
     }
-    interp->lastCollectId_ = ~0; // #JI_access lastCollectId_
+}
 
-    /* Mark all the references found into the 'mark' hash table.
-     * The references are searched in every live object that
-     * is of a tokenType_ that can contain references. */
-    IGNORERET Jim_InitHashTable(&marks, &g_JimRefMarkHashTableType, NULL);
-    marks.setTypeName("refMark");
-    objPtr = interp->liveList();
-    while (objPtr) {
-        if (objPtr->typePtr() == NULL || objPtr->typePtr()->getFlags() & JIM_TYPE_REFERENCES) {
-            const char *str, *p;
-            int len;
-
-            /* If the object is of tokenType_ reference, to get the
-             * Id is simple... */
-            if (objPtr->typePtr() == &g_referenceObjType) {
-                IGNORERET Jim_AddHashEntry(&marks, objPtr->get_refValue_idPtr(), NULL); // #MissInCoverage
-                if (g_JIM_DEBUG_GC) { // #Debug
-                    IGNORERET printf("MARK (reference): %d refcount: %d\n", // #stdoutput
-                        CAST(int)objPtr->get_refValue_id(), objPtr->refCount());
-                }
-                objPtr = objPtr->nextObjPtr();
-                continue;
-            }
-            /* Get the string repr of the object we want
-             * to scan for references. */
-            p = str = Jim_GetString(objPtr, &len);
-            /* Skip objects too little to contain references. */
-            if (len < JIM_REFERENCE_SPACE) {
-                objPtr = objPtr->nextObjPtr();
-                continue;
-            }
-            /* Extract references from the object string repr. */
-            while (1) {
-                int i;
-                unsigned_long id;
+/* The pieces of a rope are live objects scanned on their own, so only
+ * references split between two pieces are left to find. */
+static void JimCollectScanRope(Jim_HashTablePtr marks, Jim_ObjPtr objPtr) // #JimRef
+{
+    PRJ_TRACE;
+    Jim_ObjPtr chunksObj = objPtr->get_ropeValue_chunks();
+    /* The last JIM_REFERENCE_SPACE-1 bytes before the join, then as many after */
+    char seam[2 * JIM_REFERENCE_SPACE];
+    int seamLen = 0;
+    int i;
 
-                if ((p = strstr(p, "<reference.<")) == NULL)
-                    break;
-                /* Check if it's a valid reference. */
-                if (len - (p - str) < JIM_REFERENCE_SPACE)
-                    break; // #MissInCoverage
-                if (p[41] != '>' || p[19] != '>' || p[20] != '.') // #MagicNum
-                    break;
-                for (i = 21; i <= 40; i++) // #MagicNum
-                    if (!isdigit(UCHAR(p[i])))
-                        break; // #MissInCoverage
-                /* Get the ID */
-                id = strtoul(p + 21, NULL, 10);
+    for (i = 0; i < chunksObj->get_listValue_len(); i++) {
+        int len, head;
+        const char *str = Jim_GetString(chunksObj->get_listValue_objArray(i), &len);
 
-                /* Ok, a reference for the given ID
-                 * was found. Mark it. */
-                IGNORERET Jim_AddHashEntry(&marks, &id, NULL);
-                if (g_JIM_DEBUG_GC) { // #Debug
-                    IGNORERET printf("MARK: %d\n", CAST(int)id); // #stdoutput
-                }
-                p += JIM_REFERENCE_SPACE;
+        head = len < JIM_REFERENCE_SPACE - 1 ? len : JIM_REFERENCE_SPACE - 1;
+        IGNORERET memcpy(seam + seamLen, str, head);
+        seam[seamLen + head] = '\0';
+        if (seamLen) {
+            JimCollectScanString(marks, seam, seamLen + head);
+        }
+        if (head < len) {
+            IGNORERET memcpy(seam, str + len - head, head);
+            seamLen = head;
+        }
+        else {
+            /* A short piece, keep it after what came before */
+            seamLen += head;
+            if (seamLen > JIM_REFERENCE_SPACE - 1) {
+                IGNORERET memmove(seam, seam + seamLen - (JIM_REFERENCE_SPACE - 1), JIM_REFERENCE_SPACE - 1);
+                seamLen = JIM_REFERENCE_SPACE - 1;
             }
         }
-        objPtr = objPtr->nextObjPtr();
     }
+}
 
-    /* Run the references hash table to destroy every reference that
-     * is not referenced outside (not present in the mark HT). */
-    JimInitHashTableIterator(&interp->references(), &htiter);
-    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+/* Adds to 'marks' the ids of the references found in objPtr. */
+static void JimCollectScanObj(Jim_HashTablePtr marks, Jim_ObjPtr objPtr)
+{
+    PRJ_TRACE;
+    const char *str;
+    int len;
+
+    if (objPtr->typePtr() != NULL && !(objPtr->typePtr()->getFlags() & JIM_TYPE_REFERENCES))
+        return;
+    /* If the object is of tokenType_ reference, to get the
+     * Id is simple... */
+    if (objPtr->typePtr() == &g_referenceObjType) {
+        IGNORERET Jim_AddHashEntry(marks, objPtr->get_refValue_idPtr(), NULL); // #MissInCoverage
+        if (g_JIM_DEBUG_GC) { // #Debug
+            IGNORERET printf("MARK (reference): %d refcount: %d\n", // #stdoutput
+                CAST(int)objPtr->get_refValue_id(), objPtr->refCount());
+        }
+        return;
+    }
+    if (JimIsRope(objPtr)) {
+        JimCollectScanRope(marks, objPtr);
+        return;
+    }
+    /* Get the string repr of the object we want
+     * to scan for references. */
+    str = Jim_GetString(objPtr, &len);
+    JimCollectScanString(marks, str, len);
+}
+
+/* Starts a cycle over the young generation, or over every live object
+ * if 'full'. A cycle already running is restarted. */
+static void JimCollectBegin(Jim_InterpPtr interp, int full)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+
+    if (full) {
+        IGNORERET Jim_FreeHashTable(&gc->marks_);
+        gc->oldGen_ = NULL;
+    }
+    gc->running_ = 1;
+    gc->full_ = full;
+    gc->cycleId_ = interp->referenceNextId();
+    gc->cycleStart_ = gc->scanPtr_ = interp->liveList();
+}
+
+/* Scans objects until 'end' is reached, or until 'deadline' (JimClock()
+ * time, 0 for none) has passed. Returns true if 'end' was reached.
+ * 'end' is re-read at every step as freeing objects may move it. */
+CHKRET static bool JimCollectScan(Jim_InterpPtr interp, Jim_ObjPtr Jim_Collector::*end, jim_wide deadline)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+    int n = 0;
+
+    while (gc->scanPtr_ != gc->*end) {
+        Jim_ObjPtr objPtr = gc->scanPtr_;
+
+        gc->scanPtr_ = objPtr->nextObjPtr();
+        JimCollectScanObj(&gc->marks_, objPtr);
+        gc->stats_.scanned_++;
+        if (deadline && ++n % JIM_COLLECT_CLOCK_EVERY == 0 && JimClock() >= deadline)
+            return gc->scanPtr_ == gc->*end;
+    }
+    return true;
+}
+
+/* Ends the running cycle. Returns the number of references collected. */
+static int JimCollectFinish(Jim_InterpPtr interp)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+    int collected = 0;
+    Jim_HashTableIterator htiter;
+    Jim_HashEntryPtr he;
+
+    /* Objects created or appended to while the cycle ran. */
+    gc->scanPtr_ = interp->liveList();
+    IGNORERET JimCollectScan(interp, &Jim_Collector::cycleStart_, 0);
+
+    gc->oldGen_ = interp->liveList();
+    gc->cycleStart_ = gc->scanPtr_ = NULL;
+    gc->running_ = 0;
+    gc->stats_.cycles_++;
+    if (gc->full_) {
+        gc->stats_.fullCycles_++;
+        gc->minorCycles_ = 0;
+    } else {
+        gc->minorCycles_++;
+    }
+
+    /* Run the references hash table to destroy every reference that
+     * is not referenced outside (not present in the mark HT).
+     * References created while the cycle ran are left for the next one. */
+    JimInitHashTableIterator(&interp->references(), &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
         const_unsigned_long *refId;
         Jim_ReferencePtr refPtr;
 
         refId = CAST(const_unsigned_long *)he->keyAsVoid();
         /* Check if in the mark phase we encountered
          * this reference. */
-        if (Jim_FindHashEntry(&marks, refId) == NULL) {
+        if (*refId < gc->cycleId_ && Jim_FindHashEntry(&gc->marks_, refId) == NULL) {
             if (g_JIM_DEBUG_GC) { // #Debug
                 IGNORERET printf("COLLECTING %d\n", CAST(int)*refId); // #stdoutput #MissInCoverage
             }
@@ -5562,7 +6698,7 @@ JIM_EXPORT int Jim_Collect(Jim_InterpPtr interp) //#2Refs
              * finalizer first if registered. */
             refPtr = CAST(Jim_ReferencePtr )Jim_GetHashEntryVal(he);
             if (refPtr->finalizerCmdNamePtr()) {
-                char* refstr = new_CharArray(JIM_REFERENCE_SPACE + 1); // #AllocF 
+                char* refstr = new_CharArray(JIM_REFERENCE_SPACE + 1); // #AllocF
                 Jim_Obj *objv[3], *oldResult;
 
                 IGNORERET JimFormatReference(refstr, refPtr, *refId);
@@ -5590,33 +6726,129 @@ JIM_EXPORT int Jim_Collect(Jim_InterpPtr interp) //#2Refs
             IGNORERET Jim_DeleteHashEntry(&interp->references(), refId);
         }
     }
-    IGNORERET Jim_FreeHashTable(&marks);
-    interp->setLastCollectedId(interp->referenceNextId());
-    interp->lastCollectTime(time(NULL));
-    PRJ_TRACE_GEN(::prj_trace::ACTION_COLLECT_POST, __FUNCTION__, interp, NULL);
+    if (gc->mode_ != JIM_COLLECT_MODE_GENERATIONAL) {
+        /* The next cycle rescans everything anyway. */
+        IGNORERET Jim_FreeHashTable(&gc->marks_);
+        gc->oldGen_ = NULL;
+    }
+    gc->stats_.collected_ += collected;
+    return collected;
+}
+
+/* Runs the cycle begun by JimCollectBegin() for at most 'usecs'
+ * microseconds, or to the end if 'usecs' <= 0. Returns the number of
+ * references collected, or -1 if the cycle is not over yet. */
+static int JimCollectSlice(Jim_InterpPtr interp, long usecs)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+    unsigned_long lastCollectId = interp->lastCollectId();
+    jim_wide start = JimClock();
+    int collected = -1;
+
+    PRJ_TRACE_GEN(::prj_trace::ACTION_COLLECT_PRE, __FUNCTION__, interp, &gc->stats_);
+    /* Finalizers calling [collect] return at once */
+    interp->lastCollectId_ = ~0; // #JI_access lastCollectId_
+
+    if (JimCollectScan(interp, &Jim_Collector::oldGen_, usecs > 0 ? start + usecs : 0)) {
+        collected = JimCollectFinish(interp);
+        lastCollectId = interp->referenceNextId();
+        interp->lastCollectTime(time(NULL));
+    }
+    interp->setLastCollectedId(lastCollectId);
+
+    gc->stats_.steps_++;
+    gc->stats_.lastPause_ = JimClock() - start;
+    gc->stats_.totalPause_ += gc->stats_.lastPause_;
+    if (gc->stats_.lastPause_ > gc->stats_.maxPause_)
+        gc->stats_.maxPause_ = gc->stats_.lastPause_;
+    PRJ_TRACE_GEN(::prj_trace::ACTION_COLLECT_POST, __FUNCTION__, interp, &gc->stats_);
 
     return collected;
 }
 
-enum {
-    JIM_COLLECT_ID_PERIOD = 5000, // #MagicNum
-    JIM_COLLECT_TIME_PERIOD = 300 // #MagicNum
-};
+/* Performs a full garbage collection at once, finishing any cycle
+ * in progress. Returns the number of references collected. */
+JIM_EXPORT int Jim_Collect(Jim_InterpPtr interp) //#2Refs
+{
+    PRJ_TRACE;
+
+    /* Avoid recursive calls */
+    if (interp->lastCollectId() == CAST(unsigned_long)~0) {
+        /* Jim_Collect() already running. Return just now. */
+        return 0; // #MissInCoverage
+    }
+    JimCollectBegin(interp, 1);
+    return JimCollectSlice(interp, 0);
+}
+
+/* Advances the collection for at most 'usecs' microseconds (no limit if
+ * <= 0), beginning a cycle if none is running. Returns the number of
+ * references collected if the cycle finished, -1 otherwise. */
+JIM_EXPORT int Jim_CollectStep(Jim_InterpPtr interp, long usecs) //#1Ref
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+
+    if (interp->lastCollectId() == CAST(unsigned_long)~0) {
+        return 0; // #MissInCoverage
+    }
+    if (!gc->running_) {
+        JimCollectBegin(interp, gc->mode_ != JIM_COLLECT_MODE_GENERATIONAL || gc->minorCycles_ >= gc->fullEvery_);
+    }
+    return JimCollectSlice(interp, usecs);
+}
 
-JIM_EXPORT void Jim_CollectIfNeeded(Jim_InterpPtr interp) //#1Ref
+/* Called whenever references are created, and from the event loop.
+ * In generational mode the work is spread in slices of 'stepUsecs_'. */
+JIM_EXPORT void Jim_CollectIfNeeded(Jim_InterpPtr interp) //#2Refs
 {
     PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
     jim_wide elapsedId;
     int elapsedTime;
 
-    elapsedId = interp->referenceNextId() - interp->lastCollectTime(); 
-    elapsedTime = CAST(int)(time(NULL) - interp->lastCollectTime());
+    if (gc->running_) {
+        IGNORERET Jim_CollectStep(interp, gc->stepUsecs_);
+        return;
+    }
+    if (interp->references().used() == 0)
+        return;
 
+    elapsedId = interp->referenceNextId() - interp->lastCollectId();
+    elapsedTime = CAST(int)(time(NULL) - interp->lastCollectTime());
 
-    if (elapsedId > JIM_COLLECT_ID_PERIOD || elapsedTime > JIM_COLLECT_TIME_PERIOD) {
-        IGNORERET Jim_Collect(interp); // #MissInCoverage
+    if (elapsedId > gc->idPeriod_ || elapsedTime > gc->timePeriod_) {
+        if (gc->mode_ == JIM_COLLECT_MODE_GENERATIONAL) {
+            IGNORERET Jim_CollectStep(interp, gc->stepUsecs_);
+        } else {
+            IGNORERET Jim_Collect(interp); // #MissInCoverage
+        }
     }
 }
+
+/* Returns the collector configuration and statistics as a dict. */
+static Jim_ObjPtr JimCollectStats(Jim_InterpPtr interp)
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+    const prj_trace::Collect_Stats *s = &gc->stats_;
+    Jim_ObjPtr statsObj = Jim_NewDictObj(interp, NULL, 0);
+
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "running", -1), Jim_NewIntObj(interp, gc->running_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "cycles", -1), Jim_NewIntObj(interp, s->cycles_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "fullcycles", -1), Jim_NewIntObj(interp, s->fullCycles_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "steps", -1), Jim_NewIntObj(interp, s->steps_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "scanned", -1), Jim_NewIntObj(interp, s->scanned_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "collected", -1), Jim_NewIntObj(interp, s->collected_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "marks", -1), Jim_NewIntObj(interp, gc->marks_.used()));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "lastpause", -1), Jim_NewIntObj(interp, s->lastPause_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "maxpause", -1), Jim_NewIntObj(interp, s->maxPause_));
+    IGNORERET Jim_DictAddElement(interp, statsObj, Jim_NewStringObj(interp, "totalpause", -1), Jim_NewIntObj(interp, s->totalPause_));
+    return statsObj;
+}
+#else
+JIM_EXPORT void Jim_CollectRememberObj(Jim_InterpPtr interp MAYBE_USED, Jim_ObjPtr objPtr MAYBE_USED) { }
 #endif /* JIM_REFERENCES && !JIM_BOOTSTRAP */
 
 JIM_EXPORT int Jim_IsBigEndian(void) // #5Refs
@@ -5639,6 +6871,11 @@ JIM_EXPORT Jim_InterpPtr Jim_CreateInterp(void) //#2Refs
     PRJ_TRACE;
     Jim_InterpPtr  i = new_Jim_Interp; // #AllocF 
 
+    JimSlabPoolAttach();
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+    JimCollectorCreate(i);
+#endif
+
     i->setMaxCallFrameDepth(JIM_MAX_CALLFRAME_DEPTH); // #MagicNum
     i->setMaxEvalDepth(JIM_MAX_EVAL_DEPTH); // #MagicNum
     i->lastCollectTime(time(NULL));
@@ -5772,11 +7009,18 @@ JIM_EXPORT void Jim_FreeInterp(Jim_InterpPtr i) // #2Refs
         cfx = cf->next();
         if (cf->vars().tableAllocated())
             IGNORERET Jim_FreeHashTable(&cf->vars());
+        if (cf->slots())
+            free_Jim_VarArray(cf->slots()); // #FreeF 
         free_Jim_CallFrame(cf); // #FreeF 
     }
 
+#if defined(JIM_REFERENCES) && !defined(JIM_BOOTSTRAP) // #optionalCode
+    JimCollectorFree(i); // #FreeF
+#endif
+
     /* Free the interpreter structure. */
     free_Jim_Interp(i); // #FreeF 
+    JimSlabPoolDetach();
 }
 
 /* Returns the call frame relative to the level_ represented by
@@ -6336,8 +7580,8 @@ CHKRET static Retval SetBooleanFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr,
 /* -----------------------------------------------------------------------------
  * List object
  * ---------------------------------------------------------------------------*/
-static void ListInsertElements(Jim_ObjPtr listPtr, int idx, int elemc, Jim_ObjConstArray elemVec);
-static void ListAppendElement(Jim_ObjPtr listPtr, Jim_ObjPtr objPtr);
+static void ListInsertElements(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int idx, int elemc, Jim_ObjConstArray elemVec);
+static void ListAppendElement(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim_ObjPtr objPtr);
 static void FreeListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
 static void DupListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr);
 static void UpdateStringOfListCB(Jim_ObjPtr objPtr);
@@ -6356,32 +7600,137 @@ static const Jim_ObjType g_listObjType = { // #JimType #JimList
 };
 const Jim_ObjType& listType() { return g_listObjType; }
 
-static void FreeListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimList #dtor_like
+enum {
+    JIM_LIST_SPAN_MIN = 64 // #MagicNum
+};
+
+/* Returns an unshared store with room for maxLen elements, holding none. */
+static Jim_ListStore *JimListStoreNew(int maxLen) // #JimList
+{
+    PRJ_TRACE;
+    Jim_ListStore *store = new_Jim_ListStore(sizeof(Jim_ListStore) + (maxLen - 1) * sizeof(Jim_ObjPtr)); // #AllocF
+
+    store->refCount_ = 1;
+    store->len_ = 0;
+    store->maxLen_ = maxLen;
+    return store;
+}
+
+/* Grows the unshared store of listPtr to at least requiredLen slots. */
+static void JimListStoreGrow(Jim_ObjPtr listPtr, int requiredLen) // #JimList
+{
+    PRJ_TRACE;
+    Jim_ListStore *store = listPtr->get_listValue_store();
+
+    if (requiredLen < 2) {
+        /* Don't do allocations of under 4 pointers. */
+        requiredLen = 4; // #MagicNum
+    }
+    else {
+        requiredLen *= 2; // #MagicNum
+    }
+    if (store == NULL) {
+        store = JimListStoreNew(requiredLen);
+    }
+    else {
+        store = realloc_Jim_ListStore(store, sizeof(Jim_ListStore) + (requiredLen - 1) * sizeof(Jim_ObjPtr)); // #AllocF
+        store->maxLen_ = requiredLen;
+    }
+    listPtr->setListValue(store, listPtr->get_listValue_first(), listPtr->get_listValue_len());
+}
+
+static void JimListStoreRelease(Jim_InterpPtr interp, Jim_ListStore *store) // #JimList
 {
     PRJ_TRACE;
     int i;
 
-    for (i = 0; i < objPtr->get_listValue_len(); i++) {
-        Jim_DecrRefCount(interp, objPtr->get_listValue_objArray(i));
+    if (--store->refCount_ > 0)
+        return;
+    for (i = 0; i < store->len_; i++) {
+        Jim_DecrRefCount(interp, store->ele_[i]);
     }
-    objPtr->free_listValue_ele(); // #FreeF
+    free_Jim_ListStore(store); // #FreeF
 }
 
-static void DupListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr)  // #JimList #copy_ctor_like
+/* Makes listPtr the only user of its store, holding just the elements
+ * of the list from the first slot, with room for 'extra' more.
+ * Needed before changing the elements in place. */
+static void JimListStoreOwn(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int extra) // #JimList
 {
     PRJ_TRACE;
+    Jim_ListStore *store = listPtr->get_listValue_store();
+    int first = listPtr->get_listValue_first();
+    int len = listPtr->get_listValue_len();
     int i;
 
+    if (store && store->refCount_ > 1) {
+        /* Shared, so copy this list's span to a store of its own */
+        Jim_ListStore *newStore = JimListStoreNew(len + extra > 4 ? len + extra : 4); // #MagicNum
+
+        IGNORERET memcpy(newStore->ele_, store->ele_ + first, len * sizeof(Jim_ObjPtr));
+        for (i = 0; i < len; i++) {
+            Jim_IncrRefCount(newStore->ele_[i]);
+        }
+        newStore->len_ = len;
+        store->refCount_--;
+        listPtr->setListValue(newStore, 0, len);
+        return;
+    }
+    if (store && (first || store->len_ != len)) {
+        /* Drop what is left of the elements other lists were using */
+        for (i = 0; i < first; i++) {
+            Jim_DecrRefCount(interp, store->ele_[i]);
+        }
+        for (i = first + len; i < store->len_; i++) {
+            Jim_DecrRefCount(interp, store->ele_[i]);
+        }
+        IGNORERET memmove(store->ele_, store->ele_ + first, len * sizeof(Jim_ObjPtr));
+        store->len_ = len;
+        listPtr->setListValue(store, 0, len);
+    }
+    if (store == NULL || len + extra > store->maxLen_) {
+        JimListStoreGrow(listPtr, len + extra);
+    }
+}
+
+/* Sets the empty list listPtr to 'len' elements of srcPtr from 'first'.
+ * Large ranges share the store of srcPtr instead of being copied. */
+static void JimListSetRange(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim_ObjPtr srcPtr, int first, int len) // #JimList
+{
+    PRJ_TRACE;
+    Jim_ListStore *store = srcPtr->get_listValue_store();
+
+    /* Don't keep a large store alive for a small part of it */
+    if (len >= JIM_LIST_SPAN_MIN && len * 2 >= store->len_) {
+        store->refCount_++;
+        listPtr->setListValue(store, srcPtr->get_listValue_first() + first, len);
+    }
+    else {
+        ListInsertElements(interp, listPtr, -1, len, srcPtr->get_listValue_ele() + first);
+    }
+}
+
+static void FreeListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimList #dtor_like
+{
+    PRJ_TRACE;
+    if (objPtr->get_listValue_store()) {
+        JimListStoreRelease(interp, objPtr->get_listValue_store());
+    }
+}
+
+/* The duplicate shares the store, copying is left to whichever list
+ * is changed first. */
+static void DupListInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr)  // #JimList #copy_ctor_like
+{
+    PRJ_TRACE;
+    Jim_ListStore *store = srcPtr->get_listValue_store();
+
     JIM_NOTUSED(interp);
-    
-    dupPtr->setListValue(
-        srcPtr->get_listValue_len(),
-        srcPtr->get_listValue_maxLen(),
-        CAST(Jim_ObjArray*) new_Jim_ObjArray(srcPtr->get_listValue_maxLen())); // #AllocF 
-    dupPtr->copy_listValue_ele(srcPtr);
-    for (i = 0; i < dupPtr->get_listValue_len(); i++) {
-        Jim_IncrRefCount(dupPtr->get_listValue_objArray(i));
+
+    if (store) {
+        store->refCount_++;
     }
+    dupPtr->setListValue(store, srcPtr->get_listValue_first(), srcPtr->get_listValue_len());
     dupPtr->setTypePtr(&g_listObjType);
 }
 
@@ -6591,7 +7940,7 @@ static void JimMakeListStringRep(Jim_ObjPtr objPtr, Jim_ObjArray *objv, int objc
     bufLen++;
 
     /* Generate the string rep. */
-    p = objPtr->setBytes( new_CharArray(bufLen + 1)); // #AllocF 
+    p = objPtr->allocBytes(bufLen); // #AllocF 
     realLength = 0;
     for (i = 0; i < objc; i++) {
         int len, qlen;
@@ -6664,18 +8013,19 @@ CHKRET static Retval SetListFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr) //
      */
     if (Jim_IsDict(objPtr) && objPtr->bytes() == NULL) {
         Jim_ObjArray *listObjPtrPtr;
+        Jim_ListStore *store;
         int len;
-        int i;
-
-        listObjPtrPtr = JimDictPairs(objPtr, &len);
-        for (i = 0; i < len; i++) {
-            Jim_IncrRefCount(listObjPtrPtr[i]);
-        }
+        /* The dict pairs are already a list, so take them over */
+        listObjPtrPtr = JimDictTakeTable(objPtr, &len);
+        store = JimListStoreNew(len ? len : 1);
+        IGNORERET memcpy(store->ele_, listObjPtrPtr, len * sizeof(Jim_ObjPtr));
+        store->len_ = len;
+        free_Jim_ObjArray(listObjPtrPtr); // #FreeF
 
         /* Now just switch the internal rep */
         Jim_FreeIntRep(interp, objPtr);
         objPtr->setTypePtr(&g_listObjType);
-        objPtr->setListValue(len, len, listObjPtrPtr);
+        objPtr->setListValue(store, 0, len);
 
         return JIM_OK;
     }
@@ -6698,7 +8048,7 @@ CHKRET static Retval SetListFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr) //
      * new one just now. The string->list conversion can't fail. */
     Jim_FreeIntRep(interp, objPtr);
     objPtr->setTypePtr(&g_listObjType);
-    objPtr->setListValue(0, 0, NULL);
+    objPtr->setListValue(NULL, 0, 0);
 
     /* Convert into a list */
     if (strLen) {
@@ -6711,7 +8061,7 @@ CHKRET static Retval SetListFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr) //
                 continue;
             elementPtr = JimParserGetTokenObj(interp, &parser);
             JimSetSourceInfo(interp, elementPtr, fileNameObj, parser.retTokenLineNum_);
-            ListAppendElement(objPtr, elementPtr);
+            ListAppendElement(interp, objPtr, elementPtr);
         }
     }
     Jim_DecrRefCount(interp, fileNameObj);
@@ -6726,10 +8076,10 @@ JIM_EXPORT Jim_ObjPtr Jim_NewListObj(Jim_InterpPtr interp, Jim_ObjConstArray ele
     objPtr = Jim_NewObj(interp);
     objPtr->setTypePtr(&g_listObjType);
     objPtr->bytes_setNULL();
-    objPtr->setListValue(0, 0, NULL);
+    objPtr->setListValue(NULL, 0, 0);
 
     if (len) {
-        ListInsertElements(objPtr, 0, len, elements);
+        ListInsertElements(interp, objPtr, 0, len, elements);
     }
 
     return objPtr;
@@ -6782,7 +8132,7 @@ struct lsort_info {
     int (*sortingFuncPtr_)(Jim_ObjArray* , Jim_ObjArray* ) = NULL;
 };
 
-static lsort_info *g_sort_info; // #threadIssue
+static thread_local lsort_info *g_sort_info;
 
 CHKRET static Retval ListSortIndexHelper(Jim_ObjArray* lhsObj, Jim_ObjArray* rhsObj) // #JimList
 {
@@ -6886,13 +8236,11 @@ static void ListRemoveDuplicates(Jim_ObjPtr listObjPtr, int (*comp)(Jim_ObjArray
         ele[dst] = ele[src];
     }
 
-    /* At end of list, keep the final element unless all elements were kept */
+    /* The final element was moved into ele[dst] by the loop. Nothing past the end may be read. */
     dst++;
-    if (dst < listObjPtr->get_listValue_len()) {
-        ele[dst] = ele[src];
-    }
 
-    /* Set the new length */
+    /* Set the new length. The sort made the store unshared. */
+    listObjPtr->get_listValue_store()->len_ = dst;
     listObjPtr->setListValueLen( dst);
 }
 
@@ -6910,6 +8258,7 @@ CHKRET static int ListSortElements(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr,
 
     JimPanic((Jim_IsShared(listObjPtr), "ListSortElements called with shared object"));
     IGNORERET SetListFromAny(interp, listObjPtr);
+    JimListStoreOwn(interp, listObjPtr, 0);
 
     /* Allow lsort to be called reentrant */
     prev_info = g_sort_info;
@@ -6975,55 +8324,64 @@ CHKRET static int ListSortElements(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr,
  *
  * An insertion point (idx_) of -1 means end-of-list.
  */
-static void ListInsertElements(Jim_ObjPtr listPtr, int idx, int elemc, Jim_ObjConstArray elemVec) // #JimList
+static void ListInsertElements(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int idx, int elemc, Jim_ObjConstArray elemVec) // #JimList
 {
     PRJ_TRACE;
+    Jim_ListStore *store = listPtr->get_listValue_store();
     int currentLen = listPtr->get_listValue_len();
-    int requiredLen = currentLen + elemc;
     int i;
     Jim_ObjArray *point;
 
-    if (requiredLen > listPtr->get_listValue_maxLen()) {
-        if (requiredLen < 2) {
-            /* Don't do allocations of under 4 pointers. */
-            requiredLen = 4; // #MagicNum
-        }
-        else {
-            requiredLen *= 2; // #MagicNum
-        }
-
-        listPtr->resize_listValue_ele(requiredLen);
-
-        listPtr->setListValueMaxLen( requiredLen);
-    }
     if (idx < 0) {
         idx = currentLen;
     }
-    point = listPtr->get_listValue_ele() + idx; 
-    IGNORERET memmove(point + elemc, point, (currentLen - idx) * sizeof(Jim_ObjPtr ));
+    if (elemc == 0) {
+        return;
+    }
+    if (idx == currentLen && store && store->len_ == listPtr->get_listValue_first() + currentLen &&
+        (store->len_ + elemc <= store->maxLen_ || store->refCount_ == 1)) {
+        /* The list ends where the store does, so append in place even if
+         * the store is shared: the other lists don't see the new slots. */
+        if (store->len_ + elemc > store->maxLen_) {
+            JimListStoreGrow(listPtr, store->len_ + elemc);
+            store = listPtr->get_listValue_store();
+        }
+        point = store->ele_ + store->len_;
+    }
+    else {
+        JimListStoreOwn(interp, listPtr, elemc);
+        store = listPtr->get_listValue_store();
+        point = store->ele_ + idx;
+        IGNORERET memmove(point + elemc, point, (currentLen - idx) * sizeof(Jim_ObjPtr ));
+    }
     for (i = 0; i < elemc; ++i) {
         point[i] = elemVec[i];
         Jim_IncrRefCount(point[i]);
     }
+    store->len_ += elemc;
     listPtr->incrListValueLen( elemc);
 }
 
 /* Convenience call to ListInsertElements() to append a single element.
  */
-static void ListAppendElement(Jim_ObjPtr listPtr, Jim_ObjPtr objPtr) // #JimList
+static void ListAppendElement(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim_ObjPtr objPtr) // #JimList
 {
     PRJ_TRACE;
-    ListInsertElements(listPtr, -1, 1, &objPtr);
+    ListInsertElements(interp, listPtr, -1, 1, &objPtr);
 }
 
 /* Appends every element of appendListPtr into listPtr.
  * Both have to be of the list tokenType_.
  * Convenience call to ListInsertElements()
  */
-static void ListAppendList(Jim_ObjPtr listPtr, Jim_ObjPtr appendListPtr) // #JimList
+static void ListAppendList(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim_ObjPtr appendListPtr) // #JimList
 {
     PRJ_TRACE;
-    ListInsertElements(listPtr, -1,
+    if (listPtr->get_listValue_store() == NULL && appendListPtr->get_listValue_len()) {
+        JimListSetRange(interp, listPtr, appendListPtr, 0, appendListPtr->get_listValue_len());
+        return;
+    }
+    ListInsertElements(interp, listPtr, -1,
         appendListPtr->get_listValue_len(), appendListPtr->get_listValue_ele()); 
 }
 
@@ -7033,7 +8391,7 @@ JIM_EXPORT void Jim_ListAppendElement(Jim_InterpPtr interp, Jim_ObjPtr listPtr,
     JimPanic((Jim_IsShared(listPtr), "Jim_ListAppendElement called with shared object"));
     IGNORERET SetListFromAny(interp, listPtr);
     Jim_InvalidateStringRep(listPtr);
-    ListAppendElement(listPtr, objPtr);
+    ListAppendElement(interp, listPtr, objPtr);
 }
 
 JIM_EXPORT void Jim_ListAppendList(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim_ObjPtr appendListPtr) // #JimList
@@ -7043,7 +8401,7 @@ JIM_EXPORT void Jim_ListAppendList(Jim_InterpPtr interp, Jim_ObjPtr listPtr, Jim
     IGNORERET SetListFromAny(interp, listPtr);
     IGNORERET SetListFromAny(interp, appendListPtr);
     Jim_InvalidateStringRep(listPtr);
-    ListAppendList(listPtr, appendListPtr);
+    ListAppendList(interp, listPtr, appendListPtr);
 }
 
 JIM_EXPORT int Jim_ListLength(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimList #ManyRefs
@@ -7064,7 +8422,7 @@ JIM_EXPORT void Jim_ListInsertElements(Jim_InterpPtr interp, Jim_ObjPtr listPtr,
     else if (idx < 0)
         idx = 0; /// #MissInCoverage
     Jim_InvalidateStringRep(listPtr);
-    ListInsertElements(listPtr, idx, objc, objVec);
+    ListInsertElements(interp, listPtr, idx, objc, objVec);
 }
 
 CHKRET Jim_ObjPtr Jim_ListGetIndex(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int idx) // #JimList #ManyRefs
@@ -7107,6 +8465,7 @@ CHKRET static Retval ListSetIndex(Jim_InterpPtr interp, Jim_ObjPtr listPtr, int
     }
     if (listindex < 0)
         listindex = listPtr->get_listValue_len() + listindex;
+    JimListStoreOwn(interp, listPtr, 0);
     Jim_DecrRefCount(interp, listPtr->get_listValue_objArray(listindex));
     listPtr->set_listValue_objArray(listindex, newObjPtr); 
     Jim_IncrRefCount(newObjPtr);
@@ -7190,7 +8549,7 @@ JIM_EXPORT Jim_ObjPtr Jim_ConcatObj(Jim_InterpPtr interp, int objc, Jim_ObjConst
         Jim_ObjPtr objPtr = Jim_NewListObj(interp, NULL, 0);
 
         for (i = 0; i < objc; i++)
-            ListAppendList(objPtr, objv[i]);
+            ListAppendList(interp, objPtr, objv[i]);
         return objPtr;
     }
     else {
@@ -7250,6 +8609,7 @@ JIM_EXPORT Jim_ObjPtr Jim_ListRange(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr,
     PRJ_TRACE;
     int first, last;
     int len, rangeLen;
+    Jim_ObjPtr objPtr;
 
     if (Jim_GetIndex(interp, firstObjPtr, &first) != JIM_OK ||
         Jim_GetIndex(interp, lastObjPtr, &last) != JIM_OK)
@@ -7261,7 +8621,11 @@ JIM_EXPORT Jim_ObjPtr Jim_ListRange(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr,
     if (first == 0 && last == len) {
         return listObjPtr;  // #MissInCoverage
     }
-    return Jim_NewListObj(interp, listObjPtr->get_listValue_ele() + first, rangeLen); 
+    objPtr = Jim_NewListObj(interp, NULL, 0);
+    if (rangeLen) {
+        JimListSetRange(interp, objPtr, listObjPtr, first, rangeLen);
+    }
+    return objPtr;
 }
 
 /* -----------------------------------------------------------------------------
@@ -7309,7 +8673,8 @@ static const Jim_HashTableType g_JimDictHashTableType = { // #JimHashTableType
     JimObjectHTKeyValDup,       /* val dup */
     JimObjectHTKeyCompare,      /* key compare */
     JimObjectHTKeyValDestructor,    /* key destructor */
-    JimObjectHTKeyValDestructor /* val destructor */
+    JimObjectHTKeyValDestructor, /* val destructor */
+    JIM_HT_OPEN_ADDRESSING      /* flags */
 };
 const Jim_HashTableType& JimDictHashTableType() { return g_JimDictHashTableType; }
 
@@ -7326,138 +8691,403 @@ static const Jim_ObjType g_dictObjType = { // #JimType #JimDict
 };
 const Jim_ObjType& dictType() { return g_dictObjType; }
 
-static void FreeDictInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimDict #dtor_like
+/* Dicts keep their keys and values in a dense array in insertion order,
+ * plus an open addressing index into it once they have JIM_DICT_INDEX_MIN
+ * entries. Smaller dicts are searched linearly without hashing. A removed
+ * entry leaves a hole (NULL key) in the array until the holes are compacted
+ * away, which also happens before the array is used as a flat list. */
+enum {
+    JIM_DICT_INDEX_MIN = 8,         /* Entries before a dict builds an index #MagicNum */
+    JIM_DICT_INITIAL_LEN = 8,       /* Initial Jim_ObjPtr slots in the table #MagicNum */
+    JIM_DICT_REMOVED = -1           /* Jim_DictIndexEntry offset_ of a removed key */
+};
+
+struct Jim_DictIndexEntry {
+    int offset_;                    /* Offset of the key in table_ + 1, 0 if empty or JIM_DICT_REMOVED */
+    unsigned_int hash_;
+};
+
+struct Jim_Dict {
+    Jim_ObjArray *table_;           /* Key, value, key, value... NULL key for a removed entry */
+    int len_;                       /* Used slots in table_, including removed entries */
+    int maxLen_;                    /* Allocated slots in table_ */
+    int dummy_;                     /* Removed entries still in table_ */
+    Jim_DictIndexEntry *ht_;        /* Index, or NULL for small dicts */
+    unsigned_int size_;             /* Entries in ht_, a power of two */
+    unsigned_int tombstones_;       /* JIM_DICT_REMOVED entries in ht_ */
+    unsigned_int uniq_;
+    // Number of entries
+    inline int entries() const { return len_ / 2 - dummy_; }
+};
+
+static inline Jim_Dict *JimDictRep(Jim_ObjPtr objPtr)
+{
+    return CAST(Jim_Dict *)objPtr->getVoidPtr();
+}
+
+static Jim_Dict *JimNewDict(void)
 {
     PRJ_TRACE;
-    JIM_NOTUSED(interp);
+    /* Zero filled: an empty small dict */
+    return new_Jim_Dict; // #AllocF 
+}
 
-    IGNORERET Jim_FreeHashTable(CAST(Jim_HashTablePtr )objPtr->getVoidPtr());
-    Jim_TFreeNR<void>(objPtr->getVoidPtr(),"void"); // #FreeF 
+/* The string hash is weak in the low bits used for the index slot, so mix it (murmur3 fmix32) */
+static inline unsigned_int JimDictHashKey(Jim_Dict *dict, Jim_ObjPtr keyObjPtr)
+{
+    unsigned_int h = JimObjectHTHashFunction(keyObjPtr) + dict->uniq_;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bU; // #MagicNum
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U; // #MagicNum
+    h ^= h >> 16;
+    return h;
 }
 
-static void DupDictInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr) // #JimDict #copy_ctor_like
+/* Adds table_ offset 'offset' to the index, which has room and doesn't hold the key */
+static void JimDictIndexAdd(Jim_Dict *dict, int offset, unsigned_int h)
 {
-    PRJ_TRACE;
-    Jim_HashTablePtr ht; Jim_HashTablePtr dupHt;
-    Jim_HashTableIterator htiter;
-    Jim_HashEntryPtr he;
+    unsigned_int idx = h & (dict->size_ - 1);
 
-    /* Create a new hash table */
-    ht = CAST(Jim_HashTablePtr )srcPtr->getVoidPtr();
-    dupHt = new_Jim_HashTable; // #AllocF 
-    IGNORERET Jim_InitHashTable(dupHt, &g_JimDictHashTableType, interp);
-    dupHt->setTypeName("dict");
-    if (ht->size() != 0)
-        Jim_ExpandHashTable(dupHt, ht->size());
-    /* Copy every element from the source to the dup hash table */
-    JimInitHashTableIterator(ht, &htiter);
-    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
-        IGNORERET Jim_AddHashEntry(dupHt, he->keyAsVoid(), he->getVal());
+    while (dict->ht_[idx].offset_ > 0) {
+        idx = (idx + 1) & (dict->size_ - 1);
     }
-
-    dupPtr->setPtr<Jim_HashTable*>( dupHt);
-    dupPtr->setTypePtr(&g_dictObjType);
+    if (dict->ht_[idx].offset_ == JIM_DICT_REMOVED) {
+        dict->tombstones_--;
+    }
+    dict->ht_[idx].offset_ = offset + 1;
+    dict->ht_[idx].hash_ = h;
 }
 
-CHKRET static Jim_ObjArray *JimDictPairs(Jim_ObjPtr dictPtr, int *len) // #JimDict
+/* Rebuilds the index for the current entries, or drops it if the dict is small */
+static void JimDictRebuildIndex(Jim_Dict *dict)
 {
     PRJ_TRACE;
-    Jim_HashTablePtr ht;
-    Jim_HashTableIterator htiter;
-    Jim_HashEntryPtr he;
-    Jim_ObjArray *objv;
     int i;
 
-    ht = CAST(Jim_HashTablePtr )dictPtr->getVoidPtr();
-
-    /* Turn the hash table into a flat vector of Jim_Objects. */
-    objv = new_Jim_ObjArray((ht->used() * 2)); // #AllocF 
-    JimInitHashTableIterator(ht, &htiter);
-    i = 0;
-    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
-        objv[i++] = CAST(Jim_ObjPtr )Jim_GetHashEntryKey(he);
-        objv[i++] = CAST(Jim_ObjPtr )Jim_GetHashEntryVal(he);
+    if (dict->ht_) {
+        free_Jim_DictIndex(dict->ht_); // #FreeF 
+    }
+    dict->tombstones_ = 0;
+    if (dict->entries() < JIM_DICT_INDEX_MIN) {
+        dict->size_ = 0;
+        return;
+    }
+    /* Keep the index at most half full, counting removed entries */
+    dict->size_ = JIM_DICT_INDEX_MIN * 2;
+    while (dict->size_ < CAST(unsigned_int)dict->len_ * 2) {
+        dict->size_ *= 2;
+    }
+    if (dict->uniq_ == 0 && g_JIM_RANDOMISE_HASH_VAL) {
+        /* See JimResetHashTable() */
+        dict->uniq_ = (rand() ^ CAST(unsigned_int)time(NULL) ^ clock()) | 1; // #NonPortFunc
+    }
+    dict->ht_ = new_Jim_DictIndex(dict->size_); // #AllocF 
+    for (i = 0; i < dict->len_; i += 2) {
+        if (dict->table_[i]) {
+            JimDictIndexAdd(dict, i, JimDictHashKey(dict, dict->table_[i]));
+        }
     }
-    *len = i;
-    return objv;
 }
 
-static void UpdateStringOfDictCB(Jim_ObjPtr objPtr) // #JimDict
+/* Removes the holes left by removed entries, keeping the order */
+static void JimDictCompact(Jim_Dict *dict)
 {
     PRJ_TRACE;
-    /* Turn the hash table into a flat vector of Jim_Objects. */
-    int len;
-    Jim_ObjArray *objv = JimDictPairs(objPtr, &len);
-
-    /* And now generate the string rep as a list */
-    JimMakeListStringRep(objPtr, objv, len);
+    int i, j;
 
-    free_Jim_ObjArray(objv); // #FreeF 
+    if (dict->dummy_ == 0) {
+        return;
+    }
+    for (i = j = 0; i < dict->len_; i += 2) {
+        if (dict->table_[i]) {
+            dict->table_[j] = dict->table_[i];
+            dict->table_[j + 1] = dict->table_[i + 1];
+            j += 2;
+        }
+    }
+    dict->len_ = j;
+    dict->dummy_ = 0;
+    JimDictRebuildIndex(dict);
 }
 
-CHKRET static Retval SetDictFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimDict #ctor_like
+/* Returns the table_ offset of the key, or -1 if not found.
+ * If found and the dict is indexed, *idxPtr is set to its index slot. */
+static int JimDictFind(Jim_Dict *dict, Jim_ObjPtr keyObjPtr, unsigned_int *hashPtr, unsigned_int *idxPtr)
 {
     PRJ_TRACE;
-    int listlen;
+    unsigned_int h, idx;
 
-    if (objPtr->typePtr() == &g_dictObjType) {
-        return JIM_OK;
-    }
+    if (dict->ht_ == NULL) {
+        int i;
 
-    if (Jim_IsList(objPtr) && Jim_IsShared(objPtr)) {
-        /* A shared list, so get the string representation now to avoid
-         * changing the lsortOrder_ in case of fast conversion to dict.
-         */
-        IGNORERET Jim_String(objPtr);
+        for (i = 0; i < dict->len_; i += 2) {
+            if (dict->table_[i] && Jim_StringEqObj(dict->table_[i], keyObjPtr)) {
+                return i;
+            }
+        }
+        return -1;
     }
-
-    /* For simplicity, convert a non-list object to a list and then to a dict */
-    listlen = Jim_ListLength(interp, objPtr);
-    if (listlen % 2) {
-        Jim_SetResultString(interp, "missing value to go with key", -1);
-        return JIM_ERR;
+    h = JimDictHashKey(dict, keyObjPtr);
+    if (hashPtr) {
+        *hashPtr = h;
     }
-    else {
-        /* Converting from a list to a dict can't fail */
-        Jim_HashTablePtr ht;
-        int i;
-
-        ht = new_Jim_HashTable; // #AllocF 
-        IGNORERET Jim_InitHashTable(ht, &g_JimDictHashTableType, interp);
-        ht->setTypeName("dict");
-
-        for (i = 0; i < listlen; i += 2) {
-            Jim_ObjPtr keyObjPtr = Jim_ListGetIndex(interp, objPtr, i);
-            Jim_ObjPtr valObjPtr = Jim_ListGetIndex(interp, objPtr, i + 1);
+    idx = h & (dict->size_ - 1);
+    while (dict->ht_[idx].offset_ != 0) {
+        int offset = dict->ht_[idx].offset_ - 1;
 
-            IGNORERET Jim_ReplaceHashEntry(ht, keyObjPtr, valObjPtr);
+        if (offset >= 0 && dict->ht_[idx].hash_ == h && Jim_StringEqObj(dict->table_[offset], keyObjPtr)) {
+            if (idxPtr) {
+                *idxPtr = idx;
+            }
+            return offset;
         }
-
-        Jim_FreeIntRep(interp, objPtr);
-        objPtr->setTypePtr(&g_dictObjType);
-        objPtr->setPtr<Jim_HashTable*>( ht);
-
-        return JIM_OK;
+        idx = (idx + 1) & (dict->size_ - 1);
     }
+    return -1;
 }
 
-/* Dict object API */
+/* Sets the value of a key, adding it at the end if it is new. */
+static void JimDictReplace(Jim_InterpPtr interp, Jim_Dict *dict, Jim_ObjPtr keyObjPtr, Jim_ObjPtr valObjPtr)
+{
+    PRJ_TRACE;
+    unsigned_int h = 0;
+    int offset = JimDictFind(dict, keyObjPtr, &h, NULL);
 
-/* Add an element to a dict. objPtr_ must be of the "dict" tokenType_.
- * The higher-level_ exported function_ is Jim_DictAddElement().
- * If an element with the specified key already exists, the value
- * associated is replaced with the new one.
- *
+    Jim_IncrRefCount(valObjPtr);
+    if (offset >= 0) {
+        Jim_DecrRefCount(interp, dict->table_[offset + 1]);
+        dict->table_[offset + 1] = valObjPtr;
+        return;
+    }
+    if (dict->len_ + 2 > dict->maxLen_) {
+        dict->maxLen_ = dict->maxLen_ ? dict->maxLen_ * 2 : JIM_DICT_INITIAL_LEN;
+        dict->table_ = realloc_Jim_ObjArray(dict->table_, dict->maxLen_); // #AllocF 
+    }
+    Jim_IncrRefCount(keyObjPtr);
+    offset = dict->len_;
+    dict->table_[offset] = keyObjPtr;
+    dict->table_[offset + 1] = valObjPtr;
+    dict->len_ += 2;
+
+    if (dict->ht_ == NULL) {
+        if (dict->entries() >= JIM_DICT_INDEX_MIN) {
+            JimDictRebuildIndex(dict);
+        }
+    }
+    else if (CAST(unsigned_int)dict->len_ > dict->size_ ||
+        CAST(unsigned_int)(dict->entries() + dict->tombstones_) * 2 > dict->size_) {
+        /* More than half full, counting removed entries, which deleting at the end
+         * leaves in the index but not in table_ */
+        if (dict->dummy_) {
+            JimDictCompact(dict);
+        }
+        else {
+            JimDictRebuildIndex(dict);
+        }
+    }
+    else {
+        JimDictIndexAdd(dict, offset, h);
+    }
+}
+
+/* Removes a key. Returns JIM_ERR if it doesn't exist. */
+static Retval JimDictDelete(Jim_InterpPtr interp, Jim_Dict *dict, Jim_ObjPtr keyObjPtr)
+{
+    PRJ_TRACE;
+    unsigned_int idx = 0;
+    int offset = JimDictFind(dict, keyObjPtr, NULL, &idx);
+
+    if (offset < 0) {
+        return JIM_ERR;
+    }
+    Jim_DecrRefCount(interp, dict->table_[offset]);
+    Jim_DecrRefCount(interp, dict->table_[offset + 1]);
+    dict->table_[offset] = dict->table_[offset + 1] = NULL;
+    if (dict->ht_) {
+        dict->ht_[idx].offset_ = JIM_DICT_REMOVED;
+        dict->tombstones_++;
+    }
+    if (offset == dict->len_ - 2) {
+        dict->len_ -= 2;
+    }
+    else {
+        dict->dummy_++;
+        if (dict->dummy_ > dict->entries()) {
+            JimDictCompact(dict);
+        }
+    }
+    return JIM_OK;
+}
+
+static void FreeDictInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimDict #dtor_like
+{
+    PRJ_TRACE;
+    Jim_Dict *dict = JimDictRep(objPtr);
+    int i;
+
+    for (i = 0; i < dict->len_; i += 2) {
+        if (dict->table_[i]) {
+            Jim_DecrRefCount(interp, dict->table_[i]);
+            Jim_DecrRefCount(interp, dict->table_[i + 1]);
+        }
+    }
+    if (dict->table_) {
+        free_Jim_ObjArray(dict->table_); // #FreeF 
+    }
+    if (dict->ht_) {
+        free_Jim_DictIndex(dict->ht_); // #FreeF 
+    }
+    free_Jim_Dict(dict); // #FreeF 
+}
+
+static void DupDictInternalRepCB(Jim_InterpPtr interp, Jim_ObjPtr srcPtr, Jim_ObjPtr dupPtr) // #JimDict #copy_ctor_like
+{
+    PRJ_TRACE;
+    JIM_NOTUSED(interp);
+    Jim_Dict *dict = JimDictRep(srcPtr);
+    Jim_Dict *dupDict = JimNewDict();
+    int i;
+
+    /* Compacting doesn't change the value, and lets the index be copied as is */
+    JimDictCompact(dict);
+    if (dict->len_) {
+        dupDict->maxLen_ = dict->len_;
+        dupDict->table_ = new_Jim_ObjArray(dict->len_); // #AllocF 
+        memcpy(dupDict->table_, dict->table_, sizeof(Jim_ObjPtr) * dict->len_);
+        for (i = 0; i < dict->len_; i++) {
+            Jim_IncrRefCount(dupDict->table_[i]);
+        }
+        dupDict->len_ = dict->len_;
+    }
+    if (dict->ht_) {
+        dupDict->size_ = dict->size_;
+        dupDict->tombstones_ = dict->tombstones_;
+        dupDict->uniq_ = dict->uniq_;
+        dupDict->ht_ = new_Jim_DictIndex(dict->size_); // #AllocF 
+        memcpy(CAST(void *)dupDict->ht_, dict->ht_, sizeof(Jim_DictIndexEntry) * dict->size_);
+    }
+
+    dupPtr->setPtr<Jim_Dict*>( dupDict);
+    dupPtr->setTypePtr(&g_dictObjType);
+}
+
+/* Returns the dict's key/value pairs as a flat array, which belongs to the dict */
+static Jim_ObjArray *JimDictTable(Jim_ObjPtr dictPtr, int *len) // #JimDict
+{
+    PRJ_TRACE;
+    Jim_Dict *dict = JimDictRep(dictPtr);
+
+    JimDictCompact(dict);
+    *len = dict->len_;
+    return dict->table_;
+}
+
+/* Returns the dict's key/value pairs as a flat array and leaves the dict empty.
+ * The caller owns the array and the references it holds. */
+CHKRET static Jim_ObjArray *JimDictTakeTable(Jim_ObjPtr dictPtr, int *len) // #JimDict
+{
+    PRJ_TRACE;
+    Jim_Dict *dict = JimDictRep(dictPtr);
+    Jim_ObjArray *table = JimDictTable(dictPtr, len);
+
+    if (table == NULL) {
+        table = new_Jim_ObjArray(1); // #AllocF 
+    }
+    dict->table_ = NULL;
+    dict->len_ = dict->maxLen_ = 0;
+    JimDictRebuildIndex(dict);
+    return table;
+}
+
+CHKRET static Jim_ObjArray *JimDictPairs(Jim_ObjPtr dictPtr, int *len) // #JimDict
+{
+    PRJ_TRACE;
+    Jim_ObjArray *table = JimDictTable(dictPtr, len);
+    Jim_ObjArray *objv;
+
+    /* A copy the caller can keep while the dict changes */
+    objv = new_Jim_ObjArray((*len ? *len : 1)); // #AllocF 
+    if (*len) {
+        memcpy(objv, table, sizeof(Jim_ObjPtr) * *len);
+    }
+    return objv;
+}
+
+static void UpdateStringOfDictCB(Jim_ObjPtr objPtr) // #JimDict
+{
+    PRJ_TRACE;
+    int len;
+    Jim_ObjArray *objv = JimDictTable(objPtr, &len);
+
+    /* The pairs are already a flat vector, so generate the string rep as a list */
+    JimMakeListStringRep(objPtr, objv, len);
+}
+
+CHKRET static Retval SetDictFromAny(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #JimDict #ctor_like
+{
+    PRJ_TRACE;
+    int listlen;
+
+    if (objPtr->typePtr() == &g_dictObjType) {
+        return JIM_OK;
+    }
+
+    if (Jim_IsList(objPtr) && Jim_IsShared(objPtr)) {
+        /* A shared list, so get the string representation now to avoid
+         * changing the lsortOrder_ in case of fast conversion to dict.
+         */
+        IGNORERET Jim_String(objPtr);
+    }
+
+    /* For simplicity, convert a non-list object to a list and then to a dict */
+    listlen = Jim_ListLength(interp, objPtr);
+    if (listlen % 2) {
+        Jim_SetResultString(interp, "missing value to go with key", -1);
+        return JIM_ERR;
+    }
+    else {
+        /* Converting from a list to a dict can't fail */
+        Jim_Dict *dict = JimNewDict();
+        int i;
+
+        if (listlen) {
+            dict->maxLen_ = listlen;
+            dict->table_ = new_Jim_ObjArray(listlen); // #AllocF 
+        }
+        for (i = 0; i < listlen; i += 2) {
+            Jim_ObjPtr keyObjPtr = Jim_ListGetIndex(interp, objPtr, i);
+            Jim_ObjPtr valObjPtr = Jim_ListGetIndex(interp, objPtr, i + 1);
+
+            JimDictReplace(interp, dict, keyObjPtr, valObjPtr);
+        }
+
+        Jim_FreeIntRep(interp, objPtr);
+        objPtr->setTypePtr(&g_dictObjType);
+        objPtr->setPtr<Jim_Dict*>( dict);
+
+        return JIM_OK;
+    }
+}
+
+/* Dict object API */
+
+/* Add an element to a dict. objPtr_ must be of the "dict" tokenType_.
+ * The higher-level_ exported function_ is Jim_DictAddElement().
+ * If an element with the specified key already exists, the value
+ * associated is replaced with the new one.
+ *
  * if valueObjPtr == NULL, the key is instead removed if it exists. */
 CHKRET static Retval DictAddElement(Jim_InterpPtr interp MAYBE_USED, Jim_ObjPtr objPtr,  // #JimDict
     Jim_ObjPtr keyObjPtr, Jim_ObjPtr valueObjPtr)
 {
-    Jim_HashTablePtr ht = CAST(Jim_HashTablePtr )objPtr->getVoidPtr();
+    Jim_Dict *dict = JimDictRep(objPtr);
 
     if (valueObjPtr == NULL) {  /* unset */
-        return Jim_DeleteHashEntry(ht, keyObjPtr);
+        return JimDictDelete(interp, dict, keyObjPtr);
     }
-    IGNORERET Jim_ReplaceHashEntry(ht, keyObjPtr, valueObjPtr);
+    JimDictReplace(interp, dict, keyObjPtr, valueObjPtr);
     return JIM_OK;
 }
 
@@ -7486,9 +9116,7 @@ JIM_EXPORT Jim_ObjPtr Jim_NewDictObj(Jim_InterpPtr interp, Jim_ObjConstArray ele
     objPtr = Jim_NewObj(interp);
     objPtr->setTypePtr(&g_dictObjType);
     objPtr->bytes_setNULL();
-    objPtr->setPtr<Jim_HashTable*>( new_Jim_HashTable);  // #AllocF 
-    IGNORERET Jim_InitHashTable(CAST(Jim_HashTablePtr )objPtr->getVoidPtr(), &g_JimDictHashTableType, interp);
-    (CAST(Jim_HashTablePtr) objPtr->getVoidPtr())->setTypeName("dict");
+    objPtr->setPtr<Jim_Dict*>( JimNewDict());
     for (i = 0; i < len; i += 2)
         IGNORERET DictAddElement(interp, objPtr, elements[i], elements[i + 1]);
     return objPtr;
@@ -7503,21 +9131,21 @@ JIM_EXPORT Retval Jim_DictKey(Jim_InterpPtr interp, Jim_ObjPtr dictPtr, Jim_ObjP
                               Jim_ObjArray *objPtrPtr, int flags)
 {
     PRJ_TRACE;
-    Jim_HashEntryPtr he;
-    Jim_HashTablePtr ht;
+    Jim_Dict *dict;
+    int offset;
 
     if (SetDictFromAny(interp, dictPtr) != JIM_OK) {
         return -1;
     }
-    ht = CAST(Jim_HashTablePtr )dictPtr->getVoidPtr();
-    if ((he = Jim_FindHashEntry(ht, keyPtr)) == NULL) {
+    dict = JimDictRep(dictPtr);
+    if ((offset = JimDictFind(dict, keyPtr, NULL, NULL)) < 0) {
         if (flags & JIM_ERRMSG) {
             Jim_SetResultFormatted(interp, "key \"%#s\" not known in dictionary", keyPtr);
         }
         return JIM_ERR;
     }
     else {
-        *objPtrPtr = CAST(Jim_ObjPtr )Jim_GetHashEntryVal(he);
+        *objPtrPtr = dict->table_[offset + 1];
         return JIM_OK;
     }
 }
@@ -7648,6 +9276,110 @@ JIM_EXPORT Retval Jim_SetDictKeysVector(Jim_InterpPtr interp, Jim_ObjPtr varName
     return JIM_ERR;
 }
 
+/* -----------------------------------------------------------------------------
+ * Copying objects between interpreters
+ *
+ * Interpreters on the same thread may pass values to each other (see the interp
+ * extension). Numbers, lists and dicts are rebuilt from their internal reps, so
+ * they don't have to be turned into text and parsed again, and large string reps
+ * are shared by both objects instead of being copied.
+ * ---------------------------------------------------------------------------*/
+enum {
+    JIM_SHARE_BYTES_MIN = 1024 /* String reps at least this long are shared, not copied #MagicNum */
+};
+
+static void JimFreeSharedBytes(char *bytes, int len MAYBE_USED, void *clientData MAYBE_USED)
+{
+    free_CharArray(bytes); // #FreeF
+}
+
+/* Lets a second object point at the heap string rep of objPtr. From then on the
+ * bytes are freed with the last object holding them and are not written in place.
+ */
+static void JimShareBytes(Jim_ObjPtr objPtr)
+{
+    JimExternalBytes *eb = JimFindExternalBytes(objPtr->bytes());
+
+    if (eb) {
+        eb->users++;
+        return;
+    }
+    JimAddExternalBytes(objPtr->bytes(), objPtr->length(), 2, JimFreeSharedBytes, NULL);
+    if (objPtr->typePtr() == &g_stringObjType) {
+        /* No spare room, so appending copies the bytes out */
+        objPtr->setStrValue_maxLen(objPtr->length());
+    }
+}
+
+static void JimCopyBytesToObj(Jim_ObjPtr copyPtr, Jim_ObjPtr objPtr)
+{
+    if (objPtr->bytes() == NULL) {
+        copyPtr->bytes_setNULL();
+    }
+    else if (objPtr->length() == 0) {
+        copyPtr->setBytes(g_JimEmptyStringRep);
+        copyPtr->setLength(0);
+    }
+    else if (objPtr->length() >= JIM_SHARE_BYTES_MIN && !objPtr->bytesInline()) {
+        JimShareBytes(objPtr);
+        copyPtr->setBytes(objPtr->bytes());
+        copyPtr->setLength(objPtr->length());
+    }
+    else {
+        copyPtr->allocBytes(objPtr->length()); // #AllocF
+        copyPtr->setLength(objPtr->length());
+        copyPtr->copyBytes(objPtr);
+    }
+}
+
+static Jim_ObjPtr JimCopyObjVector(Jim_InterpPtr target, Jim_ObjConstArray objv, int objc, int dict)
+{
+    Jim_ObjArray *copyv = new_Jim_ObjArray(objc ? objc : 1); // #AllocF
+    Jim_ObjPtr copyPtr;
+    int i;
+
+    for (i = 0; i < objc; i++) {
+        copyv[i] = Jim_CopyObjToInterp(target, objv[i]);
+    }
+    copyPtr = dict ? Jim_NewDictObj(target, copyv, objc) : Jim_NewListObj(target, copyv, objc);
+    free_Jim_ObjArray(copyv); // #FreeF
+    return copyPtr;
+}
+
+/* Returns a new object in 'target' with the same value as objPtr, which belongs
+ * to another interpreter on the same thread. objPtr may gain an internal rep.
+ */
+JIM_EXPORT Jim_ObjPtr Jim_CopyObjToInterp(Jim_InterpPtr target, Jim_ObjPtr objPtr) // #ManyRefs
+{
+    PRJ_TRACE;
+    const Jim_ObjType *typePtr = objPtr->typePtr();
+    Jim_ObjPtr copyPtr;
+
+    if (typePtr == &g_intObjType || typePtr == &g_coercedDoubleObjType || typePtr == &g_doubleObjType) {
+        copyPtr = Jim_NewObj(target);
+        copyPtr->setTypePtr(typePtr);
+        copyPtr->copyInterpRep(objPtr);
+    }
+    else if (typePtr == &g_listObjType) {
+        copyPtr = JimCopyObjVector(target, objPtr->get_listValue_ele(), objPtr->get_listValue_len(), 0);
+    }
+    else if (typePtr == &g_dictObjType) {
+        int len;
+        Jim_ObjArray *pairs = JimDictTable(objPtr, &len);
+
+        copyPtr = JimCopyObjVector(target, pairs, len, 1);
+    }
+    else {
+        /* Anything else may refer to its interpreter, so goes as a plain string */
+        copyPtr = Jim_NewObj(target);
+        IGNORERET Jim_GetString(objPtr, NULL);
+        copyPtr->setTypePtr(NULL);
+    }
+    /* Keep the string rep as is: it need not be the canonical one */
+    JimCopyBytesToObj(copyPtr, objPtr);
+    return copyPtr;
+}
+
 /* -----------------------------------------------------------------------------
  * Index object
  * ---------------------------------------------------------------------------*/
@@ -7933,6 +9665,10 @@ struct JimExprNode {
     JimExprNodePtr right_ = NULL;   /* For binary operators */
     JimExprNodePtr ternary_ = NULL; /* For ternary_ operator only */
 
+    Jim_HashTablePtr slotNames_ = NULL; /* JIM_TT_VAR: slot names slot_ was bound to, see JimExprVarValue() */
+    unsigned_long procEpoch_ = 0;   /* JIM_TT_VAR: proc epoch of the binding */
+    int slot_ = -1;                 /* JIM_TT_VAR: compiled local slot of the variable, or -1 */
+
     inline int tokenType() const { return tokenType_; }
     inline void setTokenType(int val) { tokenType_ = val; }
 
@@ -8947,7 +10683,7 @@ CHKRET const char *jim_tt_name(int type) // #MissInCoverage
     }
     else {
         const_Jim_ExprOperatorPtr  op = JimExprOperatorInfoByOpcode(type);
-        static char buf[20]; // #MagicNum
+        static thread_local char buf[20]; // #MagicNum
 
         if (op->name()) {
             return op->name();
@@ -8990,8 +10726,8 @@ struct ExprTree
 };
 
 /* You might want to instrument or cache heap use so we wrap it access here. */
-#define new_ExprTree                Jim_TAlloc<ExprTree>(1,"ExprTree")
-#define free_ExprTree(ptr)          Jim_TFree<ExprTree>(ptr,"ExprTree")
+#define new_ExprTree                Jim_TSlabAlloc<ExprTree>("ExprTree")
+#define free_ExprTree(ptr)          Jim_TSlabFree<ExprTree>(ptr,"ExprTree")
 
 static void ExprTreeFreeNodes(Jim_InterpPtr interp, JimExprNodePtr nodes, int num) // #JimExpr #2Refs
 {
@@ -9500,13 +11236,42 @@ CHKRET static ExprTreePtr JimGetExpression(Jim_InterpPtr interp, Jim_ObjPtr objP
     return CAST(ExprTreePtr ) Jim_GetIntRepPtr(objPtr);
 }
 
+/* Reads the variable of a JIM_TT_VAR term. In a procedure the term is bound
+ * to the frame's compiled local slots like a bytecode word, see
+ * JimBcBindSlots(), and reads the slot while the binding holds. Each read
+ * checks it, as the same expression may run in frames of other procedures. */
+CHKRET static Jim_ObjPtr JimExprVarValue(Jim_InterpPtr interp, JimExprNodePtr node, int flags) // #JimExpr
+{
+    PRJ_TRACE;
+    Jim_CallFramePtr framePtr = interp->framePtr();
+    Jim_HashTablePtr slotNames = framePtr->slotNames();
+
+    if (slotNames) {
+        if (node->slotNames_ != slotNames || node->procEpoch_ != interp->procEpoch()) {
+            Jim_HashEntryPtr he = Jim_FindHashEntry(slotNames, Jim_String(node->objPtr_));
+
+            node->slot_ = he ? CAST(int)(CAST(intptr_t)Jim_GetHashEntryVal(he) - 1) : -1;
+            node->slotNames_ = slotNames;
+            node->procEpoch_ = interp->procEpoch();
+        }
+        if (node->slot_ >= 0) {
+            Jim_VarPtr varPtr = &framePtr->slots()[node->slot_];
+
+            if (varPtr->objPtr() && varPtr->linkFramePtr() == NULL) {
+                return varPtr->objPtr();
+            }
+        }
+    }
+    return Jim_GetVariable(interp, node->objPtr_, flags);
+}
+
 CHKRET static Jim_ObjPtr JimExprIntValOrVar(Jim_InterpPtr interp, JimExprNodePtr node) // #JimExpr
 {
     PRJ_TRACE;
     if (node->tokenType() == JIM_TT_EXPR_INT)
         return node->objPtr_;
     else if (node->tokenType() == JIM_TT_VAR)
-        return Jim_GetVariable(interp, node->objPtr_, JIM_NONE);
+        return JimExprVarValue(interp, node, JIM_NONE);
     else if (node->tokenType() == JIM_TT_DICTSUGAR)
         return JimExpandDictSugar(interp, node->objPtr_);
     else
@@ -9549,7 +11314,7 @@ CHKRET static Retval JimExprEvalTermNode(Jim_InterpPtr interp, JimExprNodePtr no
                 return JIM_OK;
 
             case JIM_TT_VAR:
-                objPtr = Jim_GetVariable(interp, node->objPtr_, JIM_ERRMSG);
+                objPtr = JimExprVarValue(interp, node, JIM_ERRMSG);
                 if (objPtr) {
                     Jim_SetResult(interp, objPtr);
                     return JIM_OK;
@@ -10750,7 +12515,7 @@ CHKRET static Jim_ObjPtr JimInterpolateTokens(Jim_InterpPtr interp, const Script
     }
 
 
-    s = objPtr->setBytes( new_CharArray(totlen + 1)); // #AllocF 
+    s = objPtr->allocBytes(totlen); // #AllocF 
     objPtr->setLength(totlen);
     for (i = 0; i < tokens; i++) {
         if (intv[i]) {
@@ -10759,42 +12524,883 @@ CHKRET static Jim_ObjPtr JimInterpolateTokens(Jim_InterpPtr interp, const Script
             Jim_DecrRefCount(interp, intv[i]);
         }
     }
-    objPtr->setBytes(totlen, '\0');
-    /* Free the intv vector if not static. */
-    if (intv != sintv) {
-        free_Jim_ObjArray(intv); // #FreeF 
+    objPtr->setBytes(totlen, '\0');
+    /* Free the intv vector if not static. */
+    if (intv != sintv) {
+        free_Jim_ObjArray(intv); // #FreeF 
+    }
+
+    return objPtr;
+}
+
+
+/* listPtr *must* be a list.
+ * The contents of the list is evaluated with the first element as the command_ and
+ * the remaining elements as the arguments.
+ */
+CHKRET static Retval JimEvalObjList(Jim_InterpPtr interp, Jim_ObjPtr listPtr)
+{
+    PRJ_TRACE;
+    Retval retcode = JIM_OK;
+
+    JimPanic((Jim_IsList(listPtr) == 0, "JimEvalObjList() invoked on non-list."));
+
+    if (listPtr->get_listValue_len()) {
+        Jim_IncrRefCount(listPtr);
+        retcode = JimInvokeCommand(interp,
+            listPtr->get_listValue_len(),
+            listPtr->get_listValue_ele()); 
+        Jim_DecrRefCount(interp, listPtr);
+    }
+    return retcode;
+}
+
+JIM_EXPORT Retval Jim_EvalObjList(Jim_InterpPtr interp, Jim_ObjPtr listObj) // #2Refs
+{
+    PRJ_TRACE;
+    IGNORERET SetListFromAny(interp, listObj);
+    return JimEvalObjList(interp, listObj);
+}
+
+/* Evaluates the single command_ whose JIM_TT_LINE startOfToken_ is at
+ * script->tokenArray_[*idx], advancing *idx past the command_ words.
+ * This is the token walker used by Jim_EvalObj() and, for commands it can't
+ * compile, by JimExecByteCode(). */
+CHKRET static Retval JimEvalScriptCommand(Jim_InterpPtr interp, ScriptObj *script, int *idx)
+{
+    PRJ_TRACE;
+    ScriptTokenPtr token = script->tokenArray_;
+    Jim_Obj *sargv[JIM_EVAL_SARGV_LEN], **argv = sargv;
+    Retval retcode = JIM_OK;
+    int i = *idx;
+    int argc;
+    int j;
+
+    /* First startOfToken_ of the lineNum_ is always JIM_TT_LINE */
+    argc = token[i].objPtr_->get_scriptLineValue_argc();
+    script->setErrorLineNum(token[i].objPtr_->get_scriptLineValue_line());
+
+    /* Allocate the arguments vector if required */
+    if (argc > JIM_EVAL_SARGV_LEN)
+        argv = new_Jim_ObjArray(argc); // #AllocF 
+
+    /* Skip the JIM_TT_LINE startOfToken_ */
+    i++;
+
+    /* Populate the arguments objects.
+     * If an errorText_ occurs, retcode will be set and
+     * 'j' will be set to the number of args_ expanded
+     */
+    for (j = 0; j < argc; j++) {
+        long wordtokens = 1;
+        int expand = 0;
+        Jim_ObjPtr wordObjPtr = NULL;
+
+        if (token[i].tokenType_ == JIM_TT_WORD) {
+            wordtokens = CAST(long)JimWideValue(token[i++].objPtr_);
+            if (wordtokens < 0) {
+                expand = 1;
+                wordtokens = -wordtokens;
+            }
+        }
+
+        if (wordtokens == 1) {
+            /* Fast path if the startOfToken_ does not
+             * need interpolation */
+
+            switch (token[i].tokenType_) {
+                case JIM_TT_ESC:
+                case JIM_TT_STR:
+                    wordObjPtr = token[i].objPtr_;
+                    break;
+                case JIM_TT_VAR:
+                    wordObjPtr = Jim_GetVariable(interp, token[i].objPtr_, JIM_ERRMSG);
+                    break;
+                case JIM_TT_EXPRSUGAR:
+                    wordObjPtr = JimExpandExprSugar(interp, token[i].objPtr_);
+                    break;
+                case JIM_TT_DICTSUGAR:
+                    wordObjPtr = JimExpandDictSugar(interp, token[i].objPtr_);
+                    break;
+                case JIM_TT_CMD:
+                    retcode = Jim_EvalObj(interp, token[i].objPtr_);
+                    if (retcode == JIM_OK) {
+                        wordObjPtr = Jim_GetResult(interp);
+                    }
+                    break;
+                default:
+                    JimPanic((1, "default token type reached " "in Jim_EvalObj()."));
+            }
+        }
+        else {
+            /* For interpolation we call a helper
+             * function_ to do the work for us. */
+            wordObjPtr = JimInterpolateTokens(interp, token + i, wordtokens, JIM_NONE);
+        }
+
+        if (!wordObjPtr) {
+            if (retcode == JIM_OK) {
+                retcode = JIM_ERR;
+            }
+            break;
+        }
+
+        Jim_IncrRefCount(wordObjPtr);
+        i += wordtokens;
+
+        if (!expand) {
+            argv[j] = wordObjPtr;
+        }
+        else {
+            /* Need to expand wordObjPtr into multiple args_ from argv[j] ... */
+            int len = Jim_ListLength(interp, wordObjPtr);
+            int newargc = argc + len - 1;
+            int k;
+
+            if (len > 1) {
+                if (argv == sargv) {
+                    if (newargc > JIM_EVAL_SARGV_LEN) {
+                        argv = new_Jim_ObjArray(newargc); // #AllocF 
+                        IGNORERET memcpy(argv, sargv, sizeof(*argv) * j);
+                    }
+                }
+                else {
+                    /* Need to realloc to make room for (len_ - 1) more entries */
+                    argv = realloc_Jim_ObjArray(argv, newargc); // #AllocF 
+                }
+            }
+
+            /* Now copy in the expanded version */
+            for (k = 0; k < len; k++) {
+                argv[j++] = wordObjPtr->get_listValue_objArray(k);
+                Jim_IncrRefCount(wordObjPtr->get_listValue_objArray(k));
+            }
+
+            /* The original object reference is no longer needed,
+             * after the expansion it is no longer present on
+             * the argument vector, but the single elements are
+             * in its place. */
+            Jim_DecrRefCount(interp, wordObjPtr);
+
+            /* And update the indexes */
+            j--;
+            argc += len - 1;
+        }
+    }
+
+    if (retcode == JIM_OK && argc) {
+        /* Invoke the command_ */
+        retcode = JimInvokeCommand(interp, argc, argv);
+        /* Check for a signal after each command_ */
+        if (Jim_CheckSignal(interp)) {
+            retcode = JIM_SIGNAL; // #MissInCoverage
+        }
+    }
+
+    /* Finished with the command_, so decrement ref counts of each argument */
+    while (j-- > 0) {
+        Jim_DecrRefCount(interp, argv[j]);
+    }
+
+    if (argv != sargv) {
+        free_Jim_ObjArray(argv); // #FreeF
+    }
+
+    *idx = i;
+    return retcode;
+}
+
+/* -----------------------------------------------------------------------------
+ * Compiled scripts
+ *
+ * Once a script has been evaluated JIM_BC_COMPILE_AFTER times its token array
+ * is translated into a flat array of JimBcInstr, one per command_, which is
+ * then executed by the dispatch loop in JimExecByteCode(). Each instruction
+ * records how to produce its words without re-walking the tokens and, when the
+ * command_ resolved to a native command_ at compile time, the Jim_CmdProc to
+ * call directly. [set], [incr], [expr], [if] and [while] with simple arguments
+ * are executed inline.
+ *
+ * Everything is guarded: before a direct or inline instruction runs, the
+ * command_ name is resolved again (cheap thanks to the procEpoch cache in
+ * Jim_GetCommand()) and if it no longer refers to the same native command_ the
+ * instruction is executed the generic way with JimInvokeCommand(). Commands
+ * using {*} expansion, or with too many words, are left to the token walker.
+ *
+ * Words naming a variable ($var, and the varName of [set] and [incr]) are bound
+ * to the compiled local slots of the procedure the script runs in (see
+ * JimProcAddSlot()), so that the dispatch loop reads and writes them by index.
+ * The binding is redone when the script runs in a frame of another procedure,
+ * and a variable that isn't in its slot (unset, static, or linked by [upvar])
+ * is still looked up by name_.
+ * ---------------------------------------------------------------------------*/
+CHKRET static Retval Jim_SetCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
+CHKRET static Retval Jim_WhileCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
+CHKRET static Retval Jim_IfCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
+CHKRET static Retval Jim_ExprCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv);
+
+enum {
+    JIM_BC_COMPILE_AFTER = 2    /* Evaluations of a script before it is compiled #MagicNum */
+};
+
+enum JIM_BC_OPS {
+    JIM_BC_WALK,        /* Use the token walker, JimEvalScriptCommand() */
+    JIM_BC_INVOKE,      /* Build the words and call JimInvokeCommand() */
+    JIM_BC_NATIVE,      /* Build the words and call cmdProc_ directly */
+    JIM_BC_SET,         /* [set varName ?value?] */
+    JIM_BC_INCR,        /* [incr varName ?constant?] */
+    JIM_BC_EXPR,        /* [expr {...}] */
+    JIM_BC_IF,          /* [if {...} ?then? {...} ?elseif {...} {...}? ?else {...}?] */
+    JIM_BC_WHILE        /* [while {...} {...}] */
+};
+
+enum JIM_BC_WORDS {
+    JIM_BC_WORD_CONST,      /* JIM_TT_ESC / JIM_TT_STR, used as is */
+    JIM_BC_WORD_VAR,        /* $var */
+    JIM_BC_WORD_CMD,        /* [script] */
+    JIM_BC_WORD_EXPRSUGAR,  /* $(expr_) */
+    JIM_BC_WORD_DICTSUGAR,  /* $dict(key) */
+    JIM_BC_WORD_INTERP      /* Several tokens, see JimInterpolateTokens() */
+};
+
+struct JimBcWord {
+    int kind_ = JIM_BC_WORD_CONST;
+    int numTokens_ = 0;
+    ScriptTokenPtr token_ = NULL;       /* First startOfToken_ of the word, owned by the ScriptObj */
+    int local_ = 0;                     /* The word names a variable, see JimBcBindSlots() */
+    int slot_ = -1;                     /* Compiled local slot of the variable, or -1 */
+};
+
+struct JimBcInstr {
+    int op_ = JIM_BC_WALK;
+    int tokenIdx_ = 0;                  /* Index of the JIM_TT_LINE startOfToken_ of the command_ */
+    int line_ = 0;
+    int argc_ = 0;
+    int firstWord_ = 0;                 /* Index of the first word in JimByteCode::words_ */
+    int evalWords_ = 0;                 /* Some word substitution may run a script */
+    Jim_CmdProc* cmdProc_ = NULL;       /* Native command_ seen at compile time */
+    jim_wide increment_ = 0;            /* JIM_BC_INCR */
+    int numClauses_ = 0;                /* JIM_BC_IF: number of condition/body pairs */
+    int elseWord_ = 0;                  /* JIM_BC_IF: word index of the else body, or -1 */
+    int* clauseWords_ = NULL;           /* JIM_BC_IF: condition/body word index pairs */
+};
+
+struct JimByteCode {
+    JimBcInstr* code_ = NULL;
+    int len_ = 0;
+    JimBcWord* words_ = NULL;
+    int numWords_ = 0;
+    int numLocals_ = 0;                 /* Words with local_ set */
+    Jim_HashTablePtr slotNames_ = NULL; /* Slot names the words are bound to */
+    unsigned_long procEpoch_ = 0;       /* Proc epoch of the binding, as slot tables are freed */
+};
+
+/* You might want to instrument or cache heap use so we wrap it access here. */
+#define new_JimByteCode         Jim_TAllocZ<JimByteCode>(1,"JimByteCode")
+#define free_JimByteCode(ptr)   Jim_TFree<JimByteCode>(ptr,"JimByteCode")
+#define new_JimBcInstr(sz)      Jim_TAllocZ<JimBcInstr>(sz,"JimBcInstr")
+#define free_JimBcInstr(ptr)    Jim_TFree<JimBcInstr>(ptr,"JimBcInstr")
+#define new_JimBcWord(sz)       Jim_TAllocZ<JimBcWord>(sz,"JimBcWord")
+#define free_JimBcWord(ptr)     Jim_TFree<JimBcWord>(ptr,"JimBcWord")
+#define new_JimBcClauses(sz)    Jim_TAlloc<int>(sz,"int")
+#define free_JimBcClauses(ptr)  Jim_TFree<int>(ptr,"int")
+
+static void JimFreeByteCode(JimByteCode *bc) // #JimScript #dtor_like
+{
+    PRJ_TRACE;
+    int i;
+
+    for (i = 0; i < bc->len_; i++) {
+        if (bc->code_[i].clauseWords_) {
+            free_JimBcClauses(bc->code_[i].clauseWords_); // #FreeF
+        }
+    }
+    free_JimBcInstr(bc->code_); // #FreeF
+    free_JimBcWord(bc->words_); // #FreeF
+    free_JimByteCode(bc); // #FreeF
+}
+
+CHKRET static inline Jim_ObjPtr JimBcWordObj(JimByteCode *bc, JimBcInstr *ip, int word)
+{
+    return bc->words_[ip->firstWord_ + word].token_->objPtr_;
+}
+
+CHKRET static inline int JimBcWordIsConst(JimByteCode *bc, JimBcInstr *ip, int word)
+{
+    return bc->words_[ip->firstWord_ + word].kind_ == JIM_BC_WORD_CONST;
+}
+
+/* Precomputes the clauses of a braced [if]. Returns 0 if the arguments are
+ * malformed, so that the command_ itself reports the error at runtime. */
+CHKRET static int JimCompileIf(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    int argc = ip->argc_, current = 1, falsebody;
+    int *clauses;
+
+    if (argc < 3) {
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (!JimBcWordIsConst(bc, ip, i)) {
+            return 0;
+        }
+    }
+    clauses = new_JimBcClauses(argc); // #AllocF
+    while (1) {
+        int cond = current++;
+
+        if (current >= argc)
+            break;
+        if (Jim_CompareStringImmediate(interp, JimBcWordObj(bc, ip, current), "then"))
+            current++;
+        if (current >= argc)
+            break;
+        clauses[ip->numClauses_ * 2] = cond;
+        clauses[ip->numClauses_ * 2 + 1] = current;
+        ip->numClauses_++;
+        if (++current >= argc) {
+            ip->clauseWords_ = clauses;
+            return 1;
+        }
+        falsebody = current++;
+        if (Jim_CompareStringImmediate(interp, JimBcWordObj(bc, ip, falsebody), "else")) {
+            if (current != argc - 1)
+                break;
+            ip->elseWord_ = current;
+            ip->clauseWords_ = clauses;
+            return 1;
+        }
+        else if (Jim_CompareStringImmediate(interp, JimBcWordObj(bc, ip, falsebody), "elseif")) {
+            continue;
+        }
+        else if (falsebody != argc - 1) {
+            break;
+        }
+        ip->elseWord_ = falsebody;
+        ip->clauseWords_ = clauses;
+        return 1;
+    }
+    free_JimBcClauses(clauses); // #FreeF
+    ip->numClauses_ = 0;
+    return 0;
+}
+
+/* Binds the words naming a variable to the compiled local slots of the
+ * current frame, looking each name_ up once. Words that aren't compiled
+ * locals of the frame's procedure get -1. */
+static void JimBcBindSlots(Jim_InterpPtr interp, JimByteCode *bc)
+{
+    PRJ_TRACE;
+    Jim_HashTablePtr slotNames = interp->framePtr()->slotNames();
+    int i;
+
+    for (i = 0; i < bc->numWords_; i++) {
+        JimBcWord *word = &bc->words_[i];
+
+        if (word->local_) {
+            Jim_HashEntryPtr he = NULL;
+
+            if (slotNames) {
+                he = Jim_FindHashEntry(slotNames, Jim_String(word->token_->objPtr_));
+            }
+            word->slot_ = he ? CAST(int)(CAST(intptr_t)Jim_GetHashEntryVal(he) - 1) : -1;
+        }
+    }
+    bc->slotNames_ = slotNames;
+    bc->procEpoch_ = interp->procEpoch();
+}
+
+/* Chooses the most specific instruction for a command_ whose words could all
+ * be described by JimBcWord. */
+static void JimCompileCommand(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    Jim_CmdPtr cmdPtr;
+    Jim_CmdProc* proc;
+    int argc = ip->argc_;
+
+    ip->op_ = JIM_BC_INVOKE;
+    if (!JimBcWordIsConst(bc, ip, 0)) {
+        return;
+    }
+    cmdPtr = Jim_GetCommand(interp, JimBcWordObj(bc, ip, 0), JIM_NONE);
+    if (cmdPtr == NULL || cmdPtr->isproc() || cmdPtr->getPrivData<void*>() != NULL) {
+        return;
+    }
+    proc = cmdPtr->cmdProc();
+    ip->cmdProc_ = proc;
+    ip->op_ = JIM_BC_NATIVE;
+    if (proc == Jim_SetCoreCommand && (argc == 2 || argc == 3) && JimBcWordIsConst(bc, ip, 1)) {
+        /* Even with a substituted value, see JimBcSetSlot() */
+        bc->words_[ip->firstWord_ + 1].local_ = 1;
+        bc->numLocals_++;
+    }
+    if (ip->evalWords_) {
+        return;
+    }
+
+    if (proc == Jim_SetCoreCommand && (argc == 2 || argc == 3) && JimBcWordIsConst(bc, ip, 1)) {
+        ip->op_ = JIM_BC_SET;
+    }
+    else if (proc == Jim_IncrCoreCommand && (argc == 2 || argc == 3) && JimBcWordIsConst(bc, ip, 1)) {
+        /* A variable increment is read by JimBcIncr() */
+        if (argc == 3 && bc->words_[ip->firstWord_ + 2].kind_ != JIM_BC_WORD_VAR) {
+            if (!JimBcWordIsConst(bc, ip, 2)
+                || JimGetWideNoErr(interp, JimBcWordObj(bc, ip, 2), &ip->increment_) != JIM_OK) {
+                return;
+            }
+        }
+        ip->op_ = JIM_BC_INCR;
+        bc->words_[ip->firstWord_ + 1].local_ = 1;
+        bc->numLocals_++;
+    }
+    else if (proc == Jim_ExprCoreCommand && argc == 2 && JimBcWordIsConst(bc, ip, 1)) {
+        ip->op_ = JIM_BC_EXPR;
+    }
+    else if (proc == Jim_WhileCoreCommand && argc == 3
+        && JimBcWordIsConst(bc, ip, 1) && JimBcWordIsConst(bc, ip, 2)) {
+        ip->op_ = JIM_BC_WHILE;
+    }
+    else if (proc == Jim_IfCoreCommand && JimCompileIf(interp, bc, ip)) {
+        ip->op_ = JIM_BC_IF;
+    }
+}
+
+/* Translates the tokens of a script into a JimByteCode. Never fails: commands
+ * that can't be compiled become JIM_BC_WALK instructions. */
+CHKRET static JimByteCode *JimCompileScript(Jim_InterpPtr interp, ScriptObj *script) // #JimScript
+{
+    PRJ_TRACE;
+    ScriptTokenPtr token = script->tokenArray_;
+    JimByteCode *bc = new_JimByteCode; // #AllocF
+    int numCmds = 0, numWords = 0;
+    int i;
+
+    /* First pass: count commands_ and words to size the arrays */
+    for (i = 0; i < script->Num_tokenArray(); i++) {
+        if (token[i].tokenType_ == JIM_TT_LINE) {
+            numCmds++;
+            numWords += token[i].objPtr_->get_scriptLineValue_argc();
+        }
+    }
+    bc->code_ = new_JimBcInstr(numCmds + 1); // #AllocF
+    bc->words_ = new_JimBcWord(numWords + 1); // #AllocF
+
+    for (i = 0; i < script->Num_tokenArray(); ) {
+        JimBcInstr *ip = &bc->code_[bc->len_++];
+        int argc = token[i].objPtr_->get_scriptLineValue_argc();
+        int simple = argc > 0 && argc <= JIM_EVAL_SARGV_LEN;
+        int j;
+
+        ip->tokenIdx_ = i;
+        ip->line_ = token[i].objPtr_->get_scriptLineValue_line();
+        ip->argc_ = argc;
+        ip->firstWord_ = bc->numWords_;
+        ip->increment_ = 1;
+        ip->elseWord_ = -1;
+        i++;
+
+        for (j = 0; j < argc; j++) {
+            JimBcWord *word = &bc->words_[bc->numWords_++];
+            long wordtokens = 1;
+
+            if (token[i].tokenType_ == JIM_TT_WORD) {
+                wordtokens = CAST(long)JimWideValue(token[i++].objPtr_);
+                if (wordtokens < 0) {
+                    /* {*} expansion changes the number of words at runtime */
+                    simple = 0;
+                    wordtokens = -wordtokens;
+                }
+            }
+            word->token_ = &token[i];
+            word->numTokens_ = CAST(int)wordtokens;
+            word->slot_ = -1;
+            if (wordtokens != 1) {
+                word->kind_ = JIM_BC_WORD_INTERP;
+                ip->evalWords_ = 1;
+            }
+            else {
+                switch (token[i].tokenType_) {
+                    case JIM_TT_ESC:
+                    case JIM_TT_STR:
+                        word->kind_ = JIM_BC_WORD_CONST;
+                        break;
+                    case JIM_TT_VAR:
+                        word->kind_ = JIM_BC_WORD_VAR;
+                        word->local_ = 1;
+                        bc->numLocals_++;
+                        break;
+                    case JIM_TT_EXPRSUGAR:
+                        word->kind_ = JIM_BC_WORD_EXPRSUGAR;
+                        ip->evalWords_ = 1;
+                        break;
+                    case JIM_TT_DICTSUGAR:
+                        /* The key is substituted, and may run a script */
+                        word->kind_ = JIM_BC_WORD_DICTSUGAR;
+                        ip->evalWords_ = 1;
+                        break;
+                    case JIM_TT_CMD:
+                        word->kind_ = JIM_BC_WORD_CMD;
+                        ip->evalWords_ = 1;
+                        break;
+                    default:
+                        simple = 0;
+                }
+            }
+            i += CAST(int)wordtokens;
+        }
+
+        if (simple) {
+            JimCompileCommand(interp, bc, ip);
+        }
+    }
+    if (bc->numLocals_) {
+        JimBcBindSlots(interp, bc);
+    }
+    return bc;
+}
+
+/* Returns the compiled local named by a word in the current frame, or NULL
+ * if the variable must be looked up by name_: the word isn't bound to this
+ * frame's slots, or the slot is unset or linked elsewhere. */
+CHKRET static inline Jim_VarPtr JimBcSlotVar(Jim_InterpPtr interp, JimByteCode *bc, JimBcWord *word)
+{
+    Jim_CallFramePtr framePtr = interp->framePtr();
+    Jim_VarPtr varPtr;
+
+    if (word->slot_ < 0 || framePtr->slotNames() != bc->slotNames_ || bc->procEpoch_ != interp->procEpoch()) {
+        return NULL;
+    }
+    varPtr = &framePtr->slots()[word->slot_];
+    return varPtr->objPtr() && varPtr->linkFramePtr() == NULL ? varPtr : NULL;
+}
+
+/* Produces the value of one word of a compiled command_, without an added
+ * reference. Returns NULL on failure, with *retcode set if a script failed. */
+CHKRET static Jim_ObjPtr JimBcWordValue(Jim_InterpPtr interp, JimByteCode *bc, JimBcWord *word, Retval *retcode)
+{
+    PRJ_TRACE;
+    Jim_ObjPtr wordObjPtr = NULL;
+
+    switch (word->kind_) {
+        case JIM_BC_WORD_CONST:
+            wordObjPtr = word->token_->objPtr_;
+            break;
+        case JIM_BC_WORD_VAR: {
+            Jim_VarPtr varPtr = JimBcSlotVar(interp, bc, word);
+
+            if (varPtr) {
+                wordObjPtr = varPtr->objPtr();
+            }
+            else {
+                wordObjPtr = Jim_GetVariable(interp, word->token_->objPtr_, JIM_ERRMSG);
+            }
+            break;
+        }
+        case JIM_BC_WORD_EXPRSUGAR:
+            wordObjPtr = JimExpandExprSugar(interp, word->token_->objPtr_);
+            break;
+        case JIM_BC_WORD_DICTSUGAR:
+            wordObjPtr = JimExpandDictSugar(interp, word->token_->objPtr_);
+            break;
+        case JIM_BC_WORD_CMD:
+            *retcode = Jim_EvalObj(interp, word->token_->objPtr_);
+            if (*retcode == JIM_OK) {
+                wordObjPtr = Jim_GetResult(interp);
+            }
+            break;
+        default:
+            wordObjPtr = JimInterpolateTokens(interp, word->token_, word->numTokens_, JIM_NONE);
+            break;
+    }
+    return wordObjPtr;
+}
+
+/* Produces the words of a compiled command_ into argv, each with an added
+ * reference. On failure the references taken so far are released. */
+CHKRET static Retval JimBcBuildWords(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip, Jim_ObjArray *argv)
+{
+    PRJ_TRACE;
+    JimBcWord *word = &bc->words_[ip->firstWord_];
+    Retval retcode = JIM_OK;
+    int j;
+
+    for (j = 0; j < ip->argc_; j++, word++) {
+        Jim_ObjPtr wordObjPtr = JimBcWordValue(interp, bc, word, &retcode);
+
+        if (!wordObjPtr) {
+            while (j-- > 0) {
+                Jim_DecrRefCount(interp, argv[j]);
+            }
+            return retcode == JIM_OK ? JIM_ERR : retcode;
+        }
+        Jim_IncrRefCount(wordObjPtr);
+        argv[j] = wordObjPtr;
+    }
+    return JIM_OK;
+}
+
+/* Returns the command_ if the name of a direct or inline instruction still
+ * resolves to the native command_ it was compiled against, else NULL. */
+CHKRET static inline Jim_CmdPtr JimBcGuard(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    Jim_CmdPtr cmdPtr;
+
+    if (interp->framePtr()->tailcallCmd() || interp->evalDepth() == interp->maxEvalDepth()) {
+        return NULL;
+    }
+    cmdPtr = Jim_GetCommand(interp, JimBcWordObj(bc, ip, 0), JIM_NONE);
+    if (cmdPtr && !cmdPtr->isproc() && cmdPtr->cmdProc() == ip->cmdProc_
+        && cmdPtr->getPrivData<void*>() == NULL) {
+        return cmdPtr;
+    }
+    return NULL;
+}
+
+CHKRET static int JimBcIncr(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    Jim_ObjPtr nameObjPtr = JimBcWordObj(bc, ip, 1);
+    Jim_VarPtr varPtr = JimBcSlotVar(interp, bc, &bc->words_[ip->firstWord_ + 1]);
+    Jim_ObjPtr intObjPtr;
+    jim_wide increment = ip->increment_;
+
+    if (ip->argc_ == 3 && bc->words_[ip->firstWord_ + 2].kind_ == JIM_BC_WORD_VAR) {
+        Retval retcode = JIM_OK;
+        Jim_ObjPtr incrObjPtr = JimBcWordValue(interp, bc, &bc->words_[ip->firstWord_ + 2], &retcode);
+
+        if (incrObjPtr == NULL || JimGetWideNoErr(interp, incrObjPtr, &increment) != JIM_OK) {
+            return 0;
+        }
+    }
+    if (varPtr) {
+        intObjPtr = varPtr->objPtr();
+    }
+    else {
+        intObjPtr = Jim_GetVariable(interp, nameObjPtr, JIM_NONE);
+        if (nameObjPtr->typePtr() != &g_variableObjType) {
+            return 0;
+        }
+    }
+    if (intObjPtr && !Jim_IsShared(intObjPtr) && intObjPtr->typePtr() == &g_intObjType) {
+        Jim_InvalidateStringRep(intObjPtr);
+        intObjPtr->setWideValue(JimWideValue(intObjPtr) + increment);
+        Jim_SetResult(interp, intObjPtr);
+        return 1;
+    }
+    return 0;
+}
+
+CHKRET static Retval JimBcIf(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    int k, boolean;
+    Retval retcode;
+
+    for (k = 0; k < ip->numClauses_; k++) {
+        retcode = Jim_GetBoolFromExpr(interp, JimBcWordObj(bc, ip, ip->clauseWords_[k * 2]), &boolean);
+        if (retcode != JIM_OK)
+            return retcode;
+        if (boolean)
+            return Jim_EvalObj(interp, JimBcWordObj(bc, ip, ip->clauseWords_[k * 2 + 1]));
+    }
+    if (ip->elseWord_ >= 0) {
+        return Jim_EvalObj(interp, JimBcWordObj(bc, ip, ip->elseWord_));
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+CHKRET static Retval JimBcWhile(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    Jim_ObjPtr condObjPtr = JimBcWordObj(bc, ip, 1);
+    Jim_ObjPtr bodyObjPtr = JimBcWordObj(bc, ip, 2);
+
+    while (1) {
+        int boolean; Retval retval;
+
+        if ((retval = Jim_GetBoolFromExpr(interp, condObjPtr, &boolean)) != JIM_OK)
+            return retval;
+        if (!boolean)
+            break;
+
+        if ((retval = Jim_EvalObj(interp, bodyObjPtr)) != JIM_OK) {
+            if (retval == JIM_BREAK)
+                break;
+            if (retval != JIM_CONTINUE)
+                return retval;
+        }
+    }
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+CHKRET static Retval JimBcSet(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip)
+{
+    PRJ_TRACE;
+    JimBcWord *nameWord = &bc->words_[ip->firstWord_ + 1];
+    Jim_ObjPtr objPtr;
+    Jim_VarPtr varPtr;
+    Retval retcode = JIM_OK;
+
+    if (ip->argc_ == 2) {
+        varPtr = JimBcSlotVar(interp, bc, nameWord);
+        objPtr = varPtr ? varPtr->objPtr() : Jim_GetVariable(interp, nameWord->token_->objPtr_, JIM_ERRMSG);
+        if (objPtr == NULL) {
+            return JIM_ERR;
+        }
+        Jim_SetResult(interp, objPtr);
+        return JIM_OK;
+    }
+    objPtr = JimBcWordValue(interp, bc, nameWord + 1, &retcode);
+    if (objPtr == NULL) {
+        return JIM_ERR;
+    }
+    varPtr = JimBcSlotVar(interp, bc, nameWord);
+    if (varPtr) {
+        Jim_IncrRefCount(objPtr);
+        Jim_DecrRefCount(interp, varPtr->objPtr());
+        varPtr->setObjPtr(objPtr);
+    }
+    else if (Jim_SetVariable(interp, nameWord->token_->objPtr_, objPtr) != JIM_OK) {
+        return JIM_ERR;
     }
-
-    return objPtr;
+    Jim_SetResult(interp, objPtr);
+    return JIM_OK;
 }
 
+/* [set varName value] with a substituted value runs as a native command_,
+ * but once its words are built the value is stored straight into the
+ * variable's slot. Returns 0 if the variable isn't in one. */
+CHKRET static int JimBcSetSlot(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip, Jim_ObjArray *argv)
+{
+    Jim_VarPtr varPtr;
 
-/* listPtr *must* be a list.
- * The contents of the list is evaluated with the first element as the command_ and
- * the remaining elements as the arguments.
- */
-CHKRET static Retval JimEvalObjList(Jim_InterpPtr interp, Jim_ObjPtr listPtr)
+    if (ip->argc_ != 3 || ip->cmdProc_ != Jim_SetCoreCommand || !JimBcWordIsConst(bc, ip, 1)
+        || (varPtr = JimBcSlotVar(interp, bc, &bc->words_[ip->firstWord_ + 1])) == NULL) {
+        return 0;
+    }
+    Jim_IncrRefCount(argv[2]);
+    Jim_DecrRefCount(interp, varPtr->objPtr());
+    varPtr->setObjPtr(argv[2]);
+    Jim_SetResult(interp, argv[2]);
+    return 1;
+}
+
+/* Executes one inline instruction. Sets *handled to 0 if the fast path
+ * doesn't apply and the native command_ must be called instead. */
+CHKRET static Retval JimBcInline(Jim_InterpPtr interp, JimByteCode *bc, JimBcInstr *ip, int *handled)
 {
     PRJ_TRACE;
     Retval retcode = JIM_OK;
 
-    JimPanic((Jim_IsList(listPtr) == 0, "JimEvalObjList() invoked on non-list."));
-
-    if (listPtr->get_listValue_len()) {
-        Jim_IncrRefCount(listPtr);
-        retcode = JimInvokeCommand(interp,
-            listPtr->get_listValue_len(),
-            listPtr->get_listValue_ele()); 
-        Jim_DecrRefCount(interp, listPtr);
+    interp->incrEvalDepth();
+    switch (ip->op_) {
+        case JIM_BC_SET:
+            retcode = JimBcSet(interp, bc, ip);
+            break;
+        case JIM_BC_INCR:
+            *handled = JimBcIncr(interp, bc, ip);
+            break;
+        case JIM_BC_EXPR:
+            retcode = Jim_EvalExpression(interp, JimBcWordObj(bc, ip, 1));
+            break;
+        case JIM_BC_IF:
+            retcode = JimBcIf(interp, bc, ip);
+            break;
+        case JIM_BC_WHILE:
+            retcode = JimBcWhile(interp, bc, ip);
+            break;
+        default:
+            break;
     }
+    interp->decrEvalDepth();
     return retcode;
 }
 
-JIM_EXPORT Retval Jim_EvalObjList(Jim_InterpPtr interp, Jim_ObjPtr listObj) // #2Refs
+/* The dispatch loop. Called by Jim_EvalObj() with the same bookkeeping
+ * (current script, inUse_) as the token walker. */
+CHKRET static Retval JimExecByteCode(Jim_InterpPtr interp, ScriptObj *script, JimByteCode *bc) // #JimScript
 {
     PRJ_TRACE;
-    IGNORERET SetListFromAny(interp, listObj);
-    return JimEvalObjList(interp, listObj);
+    Jim_Obj *argv[JIM_EVAL_SARGV_LEN];
+    Retval retcode = JIM_OK;
+    int pc;
+
+    if (bc->numLocals_ && (interp->framePtr()->slotNames() != bc->slotNames_
+        || bc->procEpoch_ != interp->procEpoch())) {
+        JimBcBindSlots(interp, bc);
+    }
+    for (pc = 0; pc < bc->len_ && retcode == JIM_OK; pc++) {
+        JimBcInstr *ip = &bc->code_[pc];
+        int op = ip->op_;
+        Jim_CmdPtr cmdPtr = NULL;
+        int j;
+
+        script->setErrorLineNum(ip->line_);
+
+        /* Inline instructions never have words that run scripts, so the
+         * guard can be checked up front for them. */
+        if (op >= JIM_BC_NATIVE && !ip->evalWords_ && (cmdPtr = JimBcGuard(interp, bc, ip)) == NULL) {
+            op = JIM_BC_INVOKE;
+        }
+        if (op > JIM_BC_NATIVE) {
+            int handled = 1;
+
+            retcode = JimBcInline(interp, bc, ip, &handled);
+            if (handled) {
+                if (Jim_CheckSignal(interp)) {
+                    retcode = JIM_SIGNAL; // #MissInCoverage
+                }
+                continue;
+            }
+            op = JIM_BC_NATIVE;
+        }
+
+        if (op == JIM_BC_WALK) {
+            int idx = ip->tokenIdx_;
+            retcode = JimEvalScriptCommand(interp, script, &idx);
+            continue;
+        }
+
+        retcode = JimBcBuildWords(interp, bc, ip, argv);
+        if (retcode != JIM_OK) {
+            continue;
+        }
+        /* Word substitution may have redefined the command_ */
+        if (op == JIM_BC_NATIVE && ip->evalWords_ && (cmdPtr = JimBcGuard(interp, bc, ip)) == NULL) {
+            op = JIM_BC_INVOKE;
+        }
+        if (op == JIM_BC_NATIVE && JimBcSetSlot(interp, bc, ip, argv)) {
+            retcode = JIM_OK;
+        }
+        else if (op == JIM_BC_NATIVE) {
+            void *prevPrivData = interp->cmdPrivData();
+
+            PRJ_TRACE_GEN(::prj_trace::ACTION_CMD_INVOKE, __FUNCTION__, argv, NULL);
+            /* Held like JimInvokeCommand() does, as the command_ may delete itself */
+            JimIncrCmdRefCount(cmdPtr);
+            interp->incrEvalDepth();
+            interp->setCmdPrivData(NULL);
+            Jim_SetEmptyResult(interp);
+            retcode = ip->cmdProc_(interp, ip->argc_, argv);
+            interp->setCmdPrivData(prevPrivData);
+            interp->decrEvalDepth();
+            JimDecrCmdRefCount(interp, cmdPtr);
+        }
+        else {
+            retcode = JimInvokeCommand(interp, ip->argc_, argv);
+        }
+        if (Jim_CheckSignal(interp)) {
+            retcode = JIM_SIGNAL; // #MissInCoverage
+        }
+        for (j = 0; j < ip->argc_; j++) {
+            Jim_DecrRefCount(interp, argv[j]);
+        }
+    }
+    return retcode;
 }
 
 JIM_EXPORT Retval Jim_EvalObj(Jim_InterpPtr interp, Jim_ObjPtr scriptObjPtr) // #ManyRefs
@@ -10804,7 +13410,6 @@ JIM_EXPORT Retval Jim_EvalObj(Jim_InterpPtr interp, Jim_ObjPtr scriptObjPtr) //
     ScriptObj *script;
     ScriptTokenPtr token;
     Retval retcode = JIM_OK;
-    Jim_Obj *sargv[JIM_EVAL_SARGV_LEN], **argv = NULL;
     Jim_ObjPtr prevScriptObj;
 
     /* If the object is of tokenType_ "list", with no string rep we can call
@@ -10870,144 +13475,19 @@ JIM_EXPORT Retval Jim_EvalObj(Jim_InterpPtr interp, Jim_ObjPtr scriptObjPtr) //
     interp->currentScriptObj(scriptObjPtr);
 
     interp->setErrorFlag(0);
-    argv = sargv;
 
     /* Execute every command_ sequentially until the end of the script
      * or an errorText_ occurs.
      */
-    for (i = 0; i < script->Num_tokenArray() && retcode == JIM_OK; ) {
-        int argc;
-        int j;
-
-        /* First startOfToken_ of the lineNum_ is always JIM_TT_LINE */
-        argc = token[i].objPtr_->get_scriptLineValue_argc();
-        script->setErrorLineNum(token[i].objPtr_->get_scriptLineValue_line());
-
-        /* Allocate the arguments vector if required */
-        if (argc > JIM_EVAL_SARGV_LEN)
-            argv = new_Jim_ObjArray(argc); // #AllocF 
-
-        /* Skip the JIM_TT_LINE startOfToken_ */
-        i++;
-
-        /* Populate the arguments objects.
-         * If an errorText_ occurs, retcode will be set and
-         * 'j' will be set to the number of args_ expanded
-         */
-        for (j = 0; j < argc; j++) {
-            long wordtokens = 1;
-            int expand = 0;
-            Jim_ObjPtr wordObjPtr = NULL;
-
-            if (token[i].tokenType_ == JIM_TT_WORD) {
-                wordtokens = CAST(long)JimWideValue(token[i++].objPtr_);
-                if (wordtokens < 0) {
-                    expand = 1;
-                    wordtokens = -wordtokens;
-                }
-            }
-
-            if (wordtokens == 1) {
-                /* Fast path if the startOfToken_ does not
-                 * need interpolation */
-
-                switch (token[i].tokenType_) {
-                    case JIM_TT_ESC:
-                    case JIM_TT_STR:
-                        wordObjPtr = token[i].objPtr_;
-                        break;
-                    case JIM_TT_VAR:
-                        wordObjPtr = Jim_GetVariable(interp, token[i].objPtr_, JIM_ERRMSG);
-                        break;
-                    case JIM_TT_EXPRSUGAR:
-                        wordObjPtr = JimExpandExprSugar(interp, token[i].objPtr_);
-                        break;
-                    case JIM_TT_DICTSUGAR:
-                        wordObjPtr = JimExpandDictSugar(interp, token[i].objPtr_);
-                        break;
-                    case JIM_TT_CMD:
-                        retcode = Jim_EvalObj(interp, token[i].objPtr_);
-                        if (retcode == JIM_OK) {
-                            wordObjPtr = Jim_GetResult(interp);
-                        }
-                        break;
-                    default:
-                        JimPanic((1, "default token type reached " "in Jim_EvalObj()."));
-                }
-            }
-            else {
-                /* For interpolation we call a helper
-                 * function_ to do the work for us. */
-                wordObjPtr = JimInterpolateTokens(interp, token + i, wordtokens, JIM_NONE);
-            }
-
-            if (!wordObjPtr) {
-                if (retcode == JIM_OK) {
-                    retcode = JIM_ERR;
-                }
-                break;
-            }
-
-            Jim_IncrRefCount(wordObjPtr);
-            i += wordtokens;
-
-            if (!expand) {
-                argv[j] = wordObjPtr;
-            }
-            else {
-                /* Need to expand wordObjPtr into multiple args_ from argv[j] ... */
-                int len = Jim_ListLength(interp, wordObjPtr);
-                int newargc = argc + len - 1;
-                int k;
-
-                if (len > 1) {
-                    if (argv == sargv) {
-                        if (newargc > JIM_EVAL_SARGV_LEN) {
-                            argv = new_Jim_ObjArray(newargc); // #AllocF 
-                            IGNORERET memcpy(argv, sargv, sizeof(*argv) * j);
-                        }
-                    }
-                    else {
-                        /* Need to realloc to make room for (len_ - 1) more entries */
-                        argv = realloc_Jim_ObjArray(argv, newargc); // #AllocF 
-                    }
-                }
-
-                /* Now copy in the expanded version */
-                for (k = 0; k < len; k++) {
-                    argv[j++] = wordObjPtr->get_listValue_objArray(k);
-                    Jim_IncrRefCount(wordObjPtr->get_listValue_objArray(k));
-                }
-
-                /* The original object reference is no longer needed,
-                 * after the expansion it is no longer present on
-                 * the argument vector, but the single elements are
-                 * in its place. */
-                Jim_DecrRefCount(interp, wordObjPtr);
-
-                /* And update the indexes */
-                j--;
-                argc += len - 1;
-            }
-        }
-
-        if (retcode == JIM_OK && argc) {
-            /* Invoke the command_ */
-            retcode = JimInvokeCommand(interp, argc, argv);
-            /* Check for a signal after each command_ */
-            if (Jim_CheckSignal(interp)) {
-                retcode = JIM_SIGNAL; // #MissInCoverage
-            }
-        }
-
-        /* Finished with the command_, so decrement ref counts of each argument */
-        while (j-- > 0) {
-            Jim_DecrRefCount(interp, argv[j]);
-        }
-
-        if (argv != sargv) {
-            free_Jim_ObjArray(argv); // #FreeF
-            argv = sargv;
+    if (g_JIM_BYTECODE_VAL && script->bc_ == NULL && ++script->bcRuns_ >= JIM_BC_COMPILE_AFTER) {
+        script->bc_ = JimCompileScript(interp, script);
+    }
+    if (script->bc_) {
+        retcode = JimExecByteCode(interp, script, script->bc_);
+    }
+    else {
+        for (i = 0; i < script->Num_tokenArray() && retcode == JIM_OK; ) {
+            retcode = JimEvalScriptCommand(interp, script, &i);
         }
     }
 
@@ -11189,6 +13669,7 @@ CHKRET static Retval JimCallProcedure(Jim_InterpPtr interp, Jim_CmdPtr cmd, int
     callFramePtr->setProcArgsObjPtr( cmd->proc_argListObjPtr());
     callFramePtr->setProcBodyObjPtr( cmd->proc_bodyObjPtr());
     callFramePtr->setStaticVars( cmd->proc_staticVars());
+    JimInitFrameSlots(callFramePtr, cmd);
 
     /* Remember where we were called from. */
     script = JimGetScript(interp, interp->currentScriptObj());
@@ -11219,6 +13700,13 @@ CHKRET static Retval JimCallProcedure(Jim_InterpPtr interp, Jim_CmdPtr cmd, int
             if (cmd->proc_arglist(d).defaultObjPtr()) {
                 nameObjPtr =cmd->proc_arglist(d).defaultObjPtr();
             }
+            if (cmd->proc_argSlots()) {
+                /* Argument d is always stored in slot d */
+                callFramePtr->slots()[d].setObjPtr(listObjPtr);
+                Jim_IncrRefCount(listObjPtr);
+                i += argsLen;
+                continue;
+            }
             retcode = Jim_SetVariable(interp, nameObjPtr, listObjPtr);
             if (retcode != JIM_OK) {
                 goto badargset; // #MissInCoverage
@@ -11229,6 +13717,14 @@ CHKRET static Retval JimCallProcedure(Jim_InterpPtr interp, Jim_CmdPtr cmd, int
         }
 
         /* Optional or required? */
+        if (cmd->proc_argSlots()) {
+            Jim_ObjPtr valObjPtr = (cmd->proc_arglist(d).defaultObjPtr() == NULL || optargs-- > 0) ?
+                argv[i++] : cmd->proc_arglist(d).defaultObjPtr();
+
+            callFramePtr->slots()[d].setObjPtr(valObjPtr);
+            Jim_IncrRefCount(valObjPtr);
+            continue;
+        }
         if (cmd->proc_arglist(d).defaultObjPtr() == NULL || optargs-- > 0) {
             retcode = JimSetProcArg(interp, nameObjPtr, argv[i++]);
         }
@@ -11685,6 +14181,36 @@ static void JimVariablesMatch(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr,
     }
 }
 
+/**
+ * Adds the matching compiled locals of framePtr to the list, in one pass
+ * over the slot names, as JimVariablesMatch() does for the hash table.
+ */
+static void JimFrameSlotsMatch(Jim_InterpPtr interp, Jim_ObjPtr listObjPtr, Jim_CallFramePtr framePtr,
+    Jim_ObjPtr patternObjPtr, int type)
+{
+    PRJ_TRACE;
+    Jim_HashTableIterator htiter;
+    Jim_HashEntryPtr he;
+
+    if (framePtr->slotNames() == NULL) {
+        return;
+    }
+    JimInitHashTableIterator(framePtr->slotNames(), &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+        Jim_VarPtr varPtr = &framePtr->slots()[CAST(intptr_t)Jim_GetHashEntryVal(he) - 1];
+
+        if (varPtr->objPtr() == NULL || (type == JIM_VARLIST_LOCALS && varPtr->linkFramePtr())) {
+            continue;
+        }
+        if (patternObjPtr == NULL || JimGlobMatch(Jim_String(patternObjPtr), he->keyAsStr(), 0)) {
+            Jim_ListAppendElement(interp, listObjPtr, Jim_NewStringObj(interp, he->keyAsStr(), -1));
+            if (type & JIM_VARLIST_VALUES) {
+                Jim_ListAppendElement(interp, listObjPtr, varPtr->objPtr());
+            }
+        }
+    }
+}
+
 /* mode is JIM_VARLIST_xxx */
 CHKRET static Jim_ObjPtr JimVariablesList(Jim_InterpPtr interp, Jim_ObjPtr patternObjPtr, int mode)
 {
@@ -11696,7 +14222,16 @@ CHKRET static Jim_ObjPtr JimVariablesList(Jim_InterpPtr interp, Jim_ObjPtr patte
     }
     else {
         Jim_CallFramePtr framePtr = (mode == JIM_VARLIST_GLOBALS) ? interp->topFramePtr() : interp->framePtr();
-        return JimHashtablePatternMatch(interp, &framePtr->vars(), patternObjPtr, JimVariablesMatch, mode);
+        Jim_ObjPtr listObjPtr;
+
+        if (framePtr->vars().used()) {
+            listObjPtr = JimHashtablePatternMatch(interp, &framePtr->vars(), patternObjPtr, JimVariablesMatch, mode);
+        }
+        else {
+            listObjPtr = Jim_NewListObj(interp, NULL, 0);
+        }
+        JimFrameSlotsMatch(interp, listObjPtr, framePtr, patternObjPtr, mode);
+        return listObjPtr;
     }
 }
 
@@ -12941,13 +15476,16 @@ CHKRET static Retval Jim_LreplaceCoreCommand(Jim_InterpPtr interp, int argc, Jim
     }
 
     /* Add the first set of elements */
-    newListObj = Jim_NewListObj(interp, listObj->get_listValue_ele(), first); 
+    newListObj = Jim_NewListObj(interp, NULL, 0);
+    if (first) {
+        JimListSetRange(interp, newListObj, listObj, 0, first);
+    }
 
     /* Add supplied elements */
-    ListInsertElements(newListObj, -1, argc - 4, argv + 4);
+    ListInsertElements(interp, newListObj, -1, argc - 4, argv + 4);
 
     /* Add the remaining elements */
-    ListInsertElements(newListObj, -1, len - first - rangeLen, listObj->get_listValue_ele() + first + rangeLen); 
+    ListInsertElements(interp, newListObj, -1, len - first - rangeLen, listObj->get_listValue_ele() + first + rangeLen); 
 
     Jim_SetResult(interp, newListObj);
     return JIM_OK;
@@ -13088,7 +15626,17 @@ CHKRET static Retval Jim_AppendCoreCommand(Jim_InterpPtr interp, int argc, Jim_O
         }
         else if (Jim_IsShared(stringObjPtr)) {
             new_obj = 1;
-            stringObjPtr = Jim_DuplicateObj(interp, stringObjPtr);
+            if (!JimIsRope(stringObjPtr) && Jim_Length(stringObjPtr) >= JIM_ROPE_MIN_CHUNK) {
+                /* Start a rope on the shared value rather than copy it */
+                Jim_ObjPtr ropeObjPtr = Jim_NewEmptyStringObj(interp);
+
+                JimRopeFromString(interp, ropeObjPtr);
+                JimRopeAppendObj(interp, ropeObjPtr, stringObjPtr);
+                stringObjPtr = ropeObjPtr;
+            }
+            else {
+                stringObjPtr = Jim_DuplicateObj(interp, stringObjPtr);
+            }
         }
         for (i = 2; i < argc; i++) {
             Jim_AppendObj(interp, stringObjPtr, argv[i]);
@@ -14439,23 +16987,143 @@ CHKRET static Retval Jim_SetrefCoreCommand(Jim_InterpPtr interp, int argc, Jim_O
     return JIM_OK;
 }
 
-/* [collect] */
-CHKRET static Retval Jim_CollectCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd #JimCoreCmd 
+/* [collect configure ?-option ?value ...??] */
+CHKRET static Retval JimCollectConfigure(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd
 {
     PRJ_TRACE;
-    if (argc != 1) {
-        Jim_WrongNumArgs(interp, 1, argv, "");// #MissInCoverage
+    Jim_Collector *gc = interp->collector();
+    static const char * const options[] = {
+        "-mode", "-idperiod", "-timeperiod", "-fullevery", "-step", NULL
+    };
+    enum { OPT_MODE, OPT_IDPERIOD, OPT_TIMEPERIOD, OPT_FULLEVERY, OPT_STEP };
+    static const char * const modes[] = { "full", "generational", NULL };
+    int *values[] = { &gc->mode_, &gc->idPeriod_, &gc->timePeriod_, &gc->fullEvery_, &gc->stepUsecs_ };
+    int option, i;
+
+    if (argc == 2) {
+        Jim_ObjPtr listObj = Jim_NewListObj(interp, NULL, 0);
+
+        for (i = 0; options[i]; i++) {
+            Jim_ListAppendElement(interp, listObj, Jim_NewStringObj(interp, options[i], -1));
+            Jim_ListAppendElement(interp, listObj, i == OPT_MODE ?
+                Jim_NewStringObj(interp, modes[gc->mode_], -1) : Jim_NewIntObj(interp, *values[i]));
+        }
+        Jim_SetResult(interp, listObj);
+        return JIM_OK;
+    }
+    if (argc == 3) {
+        if (Jim_GetEnum(interp, argv[2], options, &option, NULL, JIM_ERRMSG) != JIM_OK)
+            return JIM_ERR;
+        if (option == OPT_MODE)
+            Jim_SetResultString(interp, modes[gc->mode_], -1);
+        else
+            Jim_SetResultInt(interp, *values[option]);
+        return JIM_OK;
+    }
+    if (argc % 2) {
+        Jim_WrongNumArgs(interp, 2, argv, "?-option ?value ...??");
         return JIM_ERR;
     }
-    Jim_SetResultInt(interp, Jim_Collect(interp));
+    for (i = 2; i < argc; i += 2) {
+        int value;
 
-    /* Free all the freed objects. */
-    while (interp->freeList()) {
-        Jim_ObjPtr nextObjPtr = interp->freeList()->nextObjPtr(); 
-        interp->freeFreeList(); // #FreeF
-        interp->setFreeList(nextObjPtr);
+        if (Jim_GetEnum(interp, argv[i], options, &option, NULL, JIM_ERRMSG) != JIM_OK)
+            return JIM_ERR;
+        if (option == OPT_MODE) {
+            if (Jim_GetEnum(interp, argv[i + 1], modes, &value, "mode", JIM_ERRMSG | JIM_ENUM_ABBREV) != JIM_OK)
+                return JIM_ERR;
+            if (value == JIM_COLLECT_MODE_FULL && gc->mode_ != value && !gc->running_) {
+                /* Nothing is remembered between full cycles */
+                IGNORERET Jim_FreeHashTable(&gc->marks_);
+                gc->oldGen_ = NULL;
+                gc->minorCycles_ = 0;
+            }
+        }
+        else {
+            jim_wide wideValue;
+
+            if (Jim_GetWide(interp, argv[i + 1], &wideValue) != JIM_OK)
+                return JIM_ERR;
+            if (wideValue < 0 || wideValue > INT_MAX) {
+                Jim_SetResultFormatted(interp, "bad value for %#s: \"%#s\"", argv[i], argv[i + 1]);
+                return JIM_ERR;
+            }
+            value = CAST(int)wideValue;
+        }
+        *values[option] = value;
+    }
+    return JIM_OK;
+}
+
+/* [collect ?full|minor|step ?usecs?|stats|configure ?-option ?value ...???] */
+CHKRET static Retval Jim_CollectCoreCommand(Jim_InterpPtr interp, int argc, Jim_ObjConstArray argv) // #JimCmd #JimCoreCmd
+{
+    PRJ_TRACE;
+    Jim_Collector *gc = interp->collector();
+    static const char * const options[] = {
+        "full", "minor", "step", "stats", "configure", NULL
+    };
+    enum { OPT_FULL, OPT_MINOR, OPT_STEP, OPT_STATS, OPT_CONFIGURE };
+    int option = OPT_FULL;
+
+    if (argc > 1 && Jim_GetEnum(interp, argv[1], options, &option, "subcommand", JIM_ERRMSG) != JIM_OK) {
+        return Jim_CheckShowCommands(interp, argv[1], options);
     }
+    switch (option) {
+        case OPT_FULL:
+            if (argc > 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            Jim_SetResultInt(interp, Jim_Collect(interp));
+
+            /* Free all the freed objects. */
+            while (interp->freeList()) {
+                Jim_ObjPtr nextObjPtr = interp->freeList()->nextObjPtr();
+                interp->freeFreeList(); // #FreeF
+                interp->setFreeList(nextObjPtr);
+            }
+            return JIM_OK;
+
+        case OPT_MINOR:
+            if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            /* Finishes the running cycle, if any, else runs a young one */
+            if (interp->lastCollectId() == CAST(unsigned_long)~0) {
+                Jim_SetResultInt(interp, 0); // #MissInCoverage
+                return JIM_OK;
+            }
+            if (!gc->running_)
+                JimCollectBegin(interp, 0);
+            Jim_SetResultInt(interp, JimCollectSlice(interp, 0));
+            return JIM_OK;
+
+        case OPT_STEP: {
+            jim_wide usecs = gc->stepUsecs_;
+
+            if (argc > 3) {
+                Jim_WrongNumArgs(interp, 2, argv, "?usecs?");
+                return JIM_ERR;
+            }
+            if (argc == 3 && Jim_GetWide(interp, argv[2], &usecs) != JIM_OK)
+                return JIM_ERR;
+            Jim_SetResultInt(interp, Jim_CollectStep(interp, CAST(long)usecs));
+            return JIM_OK;
+        }
+
+        case OPT_STATS:
+            if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            Jim_SetResult(interp, JimCollectStats(interp));
+            return JIM_OK;
 
+        case OPT_CONFIGURE:
+            return JimCollectConfigure(interp, argc, argv);
+    }
     return JIM_OK;
 }
 
@@ -14530,9 +17198,10 @@ CHKRET static Retval Jim_RenameCoreCommand(Jim_InterpPtr interp, int argc, Jim_O
 JIM_EXPORT Retval Jim_DictMatchTypes(Jim_InterpPtr interp, Jim_ObjPtr objPtr, Jim_ObjPtr patternObj, int match_type, int return_types) // #4Refs
 {
     PRJ_TRACE;
-    Jim_HashEntryPtr he;
     Jim_ObjPtr listObjPtr;
-    Jim_HashTableIterator htiter;
+    Jim_ObjArray *table;
+    int len;
+    int i;
 
     if (SetDictFromAny(interp, objPtr) != JIM_OK) {
         return JIM_ERR;
@@ -14540,20 +17209,21 @@ JIM_EXPORT Retval Jim_DictMatchTypes(Jim_InterpPtr interp, Jim_ObjPtr objPtr, Ji
 
     listObjPtr = Jim_NewListObj(interp, NULL, 0);
 
-    JimInitHashTableIterator(CAST(Jim_HashTablePtr )objPtr->getVoidPtr(), &htiter);
-    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+    /* Nothing below can modify the dict, so the table can be used directly */
+    table = JimDictTable(objPtr, &len);
+    for (i = 0; i < len; i += 2) {
         if (patternObj) {
-            Jim_ObjPtr matchObj = (match_type == JIM_DICTMATCH_KEYS) ? CAST(Jim_ObjPtr )he->keyAsVoid() : (Jim_ObjPtr )Jim_GetHashEntryVal(he);
+            Jim_ObjPtr matchObj = (match_type == JIM_DICTMATCH_KEYS) ? table[i] : table[i + 1];
             if (!JimGlobMatch(Jim_String(patternObj), Jim_String(matchObj), 0)) {
                 /* no match */
                 continue;
             }
         }
         if (return_types & JIM_DICTMATCH_KEYS) {
-            Jim_ListAppendElement(interp, listObjPtr, he->keyAsObj());
+            Jim_ListAppendElement(interp, listObjPtr, table[i]);
         }
         if (return_types & JIM_DICTMATCH_VALUES) {
-            Jim_ListAppendElement(interp, listObjPtr, CAST(Jim_ObjPtr )Jim_GetHashEntryVal(he));
+            Jim_ListAppendElement(interp, listObjPtr, table[i + 1]);
         }
     }
 
@@ -14567,7 +17237,7 @@ JIM_EXPORT int Jim_DictSize(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #ManyRef
     if (SetDictFromAny(interp, objPtr) != JIM_OK) {
         return -1;
     }
-    return (CAST(Jim_HashTablePtr )objPtr->getVoidPtr())->used();
+    return JimDictRep(objPtr)->entries();
 }
 
 /**
@@ -14585,18 +17255,17 @@ JIM_EXPORT Jim_ObjPtr Jim_DictMerge(Jim_InterpPtr interp, int objc, Jim_ObjConst
     /* Note that we don't optimise the trivial case of a single argument */
 
     for (i = 0; i < objc; i++) {
-        Jim_HashTablePtr ht;
-        Jim_HashTableIterator htiter;
-        Jim_HashEntryPtr he;
+        Jim_ObjArray *table;
+        int len;
+        int j;
 
         if (SetDictFromAny(interp, objv[i]) != JIM_OK) {
             Jim_FreeObj(interp, objPtr);
             return NULL;
         }
-        ht = CAST(Jim_HashTablePtr )objv[i]->getVoidPtr();
-        JimInitHashTableIterator(ht, &htiter);
-        while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
-            IGNORERET Jim_ReplaceHashEntry(CAST(Jim_HashTablePtr )objPtr->getVoidPtr(), Jim_GetHashEntryKey(he), Jim_GetHashEntryVal(he));
+        table = JimDictTable(objv[i], &len);
+        for (j = 0; j < len; j += 2) {
+            JimDictReplace(interp, JimDictRep(objPtr), table[j], table[j + 1]);
         }
     }
     return objPtr;
@@ -14605,31 +17274,41 @@ JIM_EXPORT Jim_ObjPtr Jim_DictMerge(Jim_InterpPtr interp, int objc, Jim_ObjConst
 JIM_EXPORT Retval Jim_DictInfo(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #2Refs
 {
     PRJ_TRACE;
-    Jim_HashTablePtr ht;
+    Jim_Dict *dict;
     unsigned_int i;
+    unsigned_int buckets;
     char buffer[100]; // #MagicNum
     int sum = 0;
     int nonzero_count = 0;
     Jim_ObjPtr output;
     int bucket_counts[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }; // #MagicNum
+    int *counts = NULL;
 
     if (SetDictFromAny(interp, objPtr) != JIM_OK) {
         return JIM_ERR; // #MissInCoverage
     }
 
-    ht = CAST(Jim_HashTablePtr )objPtr->getVoidPtr();
+    dict = JimDictRep(objPtr);
 
-    /* Note that this uses internal knowledge of the hash table */
-    snprintf(buffer, sizeof(buffer), "%d entries in table, %d buckets\n", ht->used(), ht->size());
+    /* Note that this uses internal knowledge of the dict.
+     * A small dict without an index is reported as a single bucket,
+     * otherwise a bucket counts the keys whose home is that index slot. */
+    buckets = dict->ht_ ? dict->size_ : 1;
+    snprintf(buffer, sizeof(buffer), "%d entries in table, %d buckets\n", dict->entries(), buckets);
     output = Jim_NewStringObj(interp, buffer, -1);
 
-    for (i = 0; i < ht->size(); i++) {
-        Jim_HashEntryPtr he = ht->getEntry(i);
-        int entries = 0;
-        while (he) {
-            entries++;
-            he = he->next();
+    if (dict->ht_) {
+        /* One pass over the index, counting keys by home slot */
+        counts = Jim_TAllocZ<int>(buckets, "int"); // #AllocF
+        for (i = 0; i < dict->size_; i++) {
+            if (dict->ht_[i].offset_ > 0) {
+                counts[dict->ht_[i].hash_ & (dict->size_ - 1)]++;
+            }
         }
+    }
+    for (i = 0; i < buckets; i++) {
+        int entries = counts ? counts[i] : dict->entries();
+
         if (entries > 9) {
             bucket_counts[10]++; // #MissInCoverage
         }
@@ -14641,6 +17320,9 @@ JIM_EXPORT Retval Jim_DictInfo(Jim_InterpPtr interp, Jim_ObjPtr objPtr) // #2Ref
             nonzero_count++;
         }
     }
+    if (counts) {
+        Jim_TFree<int>(counts, "int"); // #FreeF
+    }
     for (i = 0; i < 10; i++) {
         IGNORERET snprintf(buffer, sizeof(buffer), "number of buckets with %d entries: %d\n", i, bucket_counts[i]);
         Jim_AppendString(interp, output, buffer, -1);
@@ -14913,13 +17595,13 @@ CHKRET static Retval Jim_InfoCoreCommand(Jim_InterpPtr interp, int argc, Jim_Obj
         "body", "statics", "commands", "procs", "channels", "exists", "globals", "level", "frame", "locals",
         "vars", "version", "patchlevel", "complete", "args", "hostname",
         "script", "source", "stacktrace", "nameofexecutable", "returncodes",
-        "references", "alias", NULL
+        "references", "alias", "alloc", NULL
     };
     enum
     { INFO_BODY, INFO_STATICS, INFO_COMMANDS, INFO_PROCS, INFO_CHANNELS, INFO_EXISTS, INFO_GLOBALS, INFO_LEVEL,
         INFO_FRAME, INFO_LOCALS, INFO_VARS, INFO_VERSION, INFO_PATCHLEVEL, INFO_COMPLETE, INFO_ARGS,
         INFO_HOSTNAME, INFO_SCRIPT, INFO_SOURCE, INFO_STACKTRACE, INFO_NAMEOFEXECUTABLE,
-        INFO_RETURNCODES, INFO_REFERENCES, INFO_ALIAS,
+        INFO_RETURNCODES, INFO_REFERENCES, INFO_ALIAS, INFO_ALLOC,
     };
 
 #ifdef jim_ext_namespace // #optionalCode
@@ -15185,6 +17867,14 @@ CHKRET static Retval Jim_InfoCoreCommand(Jim_InterpPtr interp, int argc, Jim_Obj
                 return JIM_ERR;
             }
             break;
+        case INFO_ALLOC:
+            if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            Jim_SetResult(interp, Jim_SlabStats(interp));
+            break;
+
         case INFO_REFERENCES:
 #ifdef JIM_REFERENCES // #optionalCode
             return JimInfoReferences(interp, argc, argv); // #MissInCoverage
@@ -15516,7 +18206,7 @@ CHKRET static Retval Jim_LrepeatCoreCommand(Jim_InterpPtr interp, int argc, Jim_
 
     objPtr = Jim_NewListObj(interp, argv, argc);
     while (--count) {
-        ListInsertElements(objPtr, -1, argc, argv);
+        ListInsertElements(interp, objPtr, -1, argc, argv);
     }
 
     Jim_SetResult(interp, objPtr);
@@ -15623,7 +18313,7 @@ CHKRET static Retval Jim_LreverseCoreCommand(Jim_InterpPtr interp, int argc, Jim
     len--;
     revObjPtr = Jim_NewListObj(interp, NULL, 0);
     while (len >= 0)
-        ListAppendElement(revObjPtr, ele[len--]);
+        ListAppendElement(interp, revObjPtr, ele[len--]);
     Jim_SetResult(interp, revObjPtr);
     return JIM_OK;
 }
@@ -15684,7 +18374,7 @@ CHKRET static Retval Jim_RangeCoreCommand(Jim_InterpPtr interp, int argc, Jim_Ob
     }
     objPtr = Jim_NewListObj(interp, NULL, 0);
     for (i = 0; i < len; i++)
-        ListAppendElement(objPtr, Jim_NewIntObj(interp, start + i * step));
+        ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, start + i * step));
     Jim_SetResult(interp, objPtr);
     return JIM_OK;
 }
@@ -4,8 +4,8 @@
 #include <jim-base.h>
 #include <prj_trace.h>
 
-static int64_t g_numCalls = 0;
-static int g_maxStackDepth = 0;
+static thread_local int64_t g_numCalls = 0;
+static thread_local int g_maxStackDepth = 0;
 
 #ifdef __GNUC__
 #  pragma GCC diagnostic ignored  "-Wunused-function"
@@ -86,13 +86,18 @@ static void prj_traceActCbShowAll(int action, const char* str, void* ptr, void*
             break;
         case prj_trace::ACTION_COLLECT_PRE:
         case prj_trace::ACTION_COLLECT_POST:
+        {
+            prj_trace::Collect_Stats* collect_stats = (prj_trace::Collect_Stats*) ptr2;
             if (traceCollect) 
-                ::printf("COLLECT: %d %s %p %p\n", action, str, ptr, ptr2);
-            break;
+                ::printf("COLLECT: %d %s %p steps %lld scanned %lld pause %lldus max %lldus\n", action, str, ptr,
+                         (long long) collect_stats->steps_, (long long) collect_stats->scanned_,
+                         (long long) collect_stats->lastPause_, (long long) collect_stats->maxPause_);
+        }
+        break;
     };
 }
 
-int prj_trace::stackDepth_ = 0;
+thread_local int prj_trace::stackDepth_ = 0;
 prj_trace::prj_traceCb prj_trace::logFunc_ = (prj_trace::prj_traceCb)NULL;
 prj_trace::prj_traceMemCb prj_trace::memFunc_ = (prj_trace::prj_traceMemCb)NULL;
 prj_trace::prj_traceActCb prj_trace::actionFunc_ = (prj_trace::prj_traceActCb)prj_traceActCbShowAll;
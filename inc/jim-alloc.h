@@ -54,31 +54,70 @@ T* Jim_TRealloc(T* ptr, int N, const char* typeName = NULL) {
     return ret;
 }
 
+/* Slab allocation of small fixed size structures.
+ * A typeName is registered once by Jim_SlabType() and gets its own statistics.
+ * Memory from Jim_TSlabAlloc<T>() must be released by Jim_TSlabFree<T>(). */
+CHKRET JIM_EXPORT int Jim_SlabType(const char* typeName, int size);
+JIM_EXPORT void* Jim_SlabAlloc(int type, int size);
+JIM_EXPORT void Jim_SlabFree(int type, void* ptr);
+
+template<typename T>
+T* Jim_TSlabAlloc(const char* typeName) {
+    static const int type = Jim_SlabType(typeName, sizeof(T));
+    auto v = (T*) Jim_SlabAlloc(type, sizeof(T));
+    PRJ_TRACEMEM_ALLOC(typeName, sizeof(T), (void*) v);
+    return v;
+}
+
+template<typename T>
+T* Jim_TSlabAllocZ(const char* typeName) {
+    auto v = Jim_TSlabAlloc<T>(typeName); memset(v, 0, sizeof(T));
+    return v;
+}
+
+template<typename T>
+void Jim_TSlabFree(T*& p, const char* typeName) {
+    static const int type = Jim_SlabType(typeName, sizeof(T));
+    PRJ_TRACEMEM_FREE(typeName, (void*) p);
+    Jim_SlabFree(type, p); p = NULL;
+}
+
 /* You might want to instrument or cache heap use so we wrap it access here. */
 #define new_Jim_Interp          Jim_TAllocZ<Jim_Interp>(1,"Jim_Interp")
 #define free_Jim_Interp(ptr)    Jim_TFree<Jim_Interp>(ptr,"Jim_Interp")
 #define new_Jim_Stack           Jim_TAlloc<Jim_Stack>(1,"Jim_Interp")
 #define free_Jim_Stack(ptr)     Jim_TFree<Jim_Stack>(ptr,"Jim_Stack")
-#define new_Jim_CallFrame       Jim_TAllocZ<Jim_CallFrame>(1,"Jim_Stack")
-#define free_Jim_CallFrame(ptr) Jim_TFree<Jim_CallFrame>(ptr,"Jim_CallFrame")
+#define new_Jim_CallFrame       Jim_TSlabAllocZ<Jim_CallFrame>("Jim_CallFrame")
+#define free_Jim_CallFrame(ptr) Jim_TSlabFree<Jim_CallFrame>(ptr,"Jim_CallFrame")
 #define new_Jim_HashTable       Jim_TAlloc<Jim_HashTable>(1,"Jim_HashTable")
 #define free_Jim_HashTable(ptr) Jim_TFree<Jim_HashTable>(ptr,"Jim_HashTable")
 #define new_Jim_HashTableIterator Jim_TAlloc<Jim_HashTableIterator>(1,"Jim_HashTableIterator")
 #define free_Jim_HashTableIterator(ptr) Jim_TFree<Jim_HashTableIterator>(ptr,"Jim_HashTableIterator") // #Review never called
-#define new_Jim_Var             Jim_TAlloc<Jim_Var>(1,"Jim_Var")
-#define free_Jim_Var(ptr)       Jim_TFree<Jim_Var>(ptr,"Jim_Var")
-#define new_Jim_HashEntry       Jim_TAlloc<Jim_HashEntry>(1,"Jim_HashEntry")
-#define free_Jim_HashEntry(ptr) Jim_TFree<Jim_HashEntry>(ptr, "Jim_HashEntry")
+#define new_Jim_Var             Jim_TSlabAlloc<Jim_Var>("Jim_Var")
+#define free_Jim_Var(ptr)       Jim_TSlabFree<Jim_Var>(ptr,"Jim_Var")
+#define realloc_Jim_VarArray(orgPtr, newSz) Jim_TRealloc<Jim_Var>(orgPtr, newSz, "Jim_Var")
+#define free_Jim_VarArray(ptr)  Jim_TFreeNR<Jim_Var>(ptr,"Jim_Var")
+#define new_Jim_HashEntry       Jim_TSlabAlloc<Jim_HashEntry>("Jim_HashEntry")
+#define free_Jim_HashEntry(ptr) Jim_TSlabFree<Jim_HashEntry>(ptr, "Jim_HashEntry")
 #define new_Jim_ObjArray(sz)    Jim_TAlloc<Jim_ObjArray>(sz,"Jim_ObjArray")
 #define new_Jim_ObjArrayZ(sz)   Jim_TAllocZ<Jim_ObjArray>(sz,"Jim_ObjArray")
 #define free_Jim_ObjArray(ptr)  Jim_TFree<Jim_ObjArray>(ptr,"Jim_ObjArray")
 #define realloc_Jim_ObjArray(orgPtr, newSz) Jim_TRealloc<Jim_ObjArray>(orgPtr, newSz, "Jim_ObjArray")
-#define new_Jim_Obj             Jim_TAllocZ<Jim_Obj>(1,"Jim_Obj")
-#define free_Jim_Obj(ptr)       Jim_TFree<Jim_Obj>(ptr, "Jim_Obj")
+#define new_Jim_ListStore(sz)   CAST(Jim_ListStore*) Jim_TAlloc<char>(sz,"Jim_ListStore")
+#define realloc_Jim_ListStore(orgPtr, sz) CAST(Jim_ListStore*) Jim_TRealloc<char>(CAST(char*) orgPtr, sz,"Jim_ListStore")
+#define free_Jim_ListStore(ptr) Jim_TFreeNR<char>(CAST(char*) ptr,"Jim_ListStore")
+#define new_Jim_Dict            Jim_TSlabAllocZ<Jim_Dict>("Jim_Dict")
+#define free_Jim_Dict(ptr)      Jim_TSlabFree<Jim_Dict>(ptr,"Jim_Dict")
+#define new_Jim_DictIndex(sz)   Jim_TAllocZ<Jim_DictIndexEntry>(sz,"Jim_DictIndexEntry")
+#define free_Jim_DictIndex(ptr) Jim_TFree<Jim_DictIndexEntry>(ptr,"Jim_DictIndexEntry")
+#define new_Jim_Obj             Jim_TSlabAllocZ<Jim_Obj>("Jim_Obj")
+#define free_Jim_Obj(ptr)       Jim_TSlabFree<Jim_Obj>(ptr, "Jim_Obj")
 #define new_CharArray(sz)       Jim_TAlloc<char>(sz, "CharArray")
 #define new_CharArrayZ(sz)      Jim_TAllocZ<char>(sz, "CharArray")
 #define free_CharArray(ptr)     Jim_TFree<char>(ptr, "CharArray")
 #define realloc_CharArray(orgPtr, newSz) Jim_TRealloc<char>(orgPtr, newSz, "CharArray")
+#define new_Jim_Collector       Jim_TAllocZ<Jim_Collector>(1,"Jim_Collector")
+#define free_Jim_Collector(ptr) Jim_TFree<Jim_Collector>(ptr,"Jim_Collector")
 #define new_Jim_Cmd             Jim_TAllocZ<Jim_Cmd>(1,"Jim_Cmd")
 #define free_Jim_Cmd(ptr)       Jim_TFree<Jim_Cmd>(ptr,"Jim_Cmd")
 
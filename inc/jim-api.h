@@ -159,6 +159,8 @@ CHKRET JIM_EXPORT Retval Jim_DeleteHashEntry(Jim_HashTablePtr ht, // #dtor_like
 CHKRET JIM_EXPORT Retval Jim_FreeHashTable(Jim_HashTablePtr ht); // #dtor_like
 CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_FindHashEntry(Jim_HashTablePtr ht,
                                              const void *key);
+CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_FindHashEntryHashed(Jim_HashTablePtr ht,
+                                             const void *key, unsigned_int keyHash);
 JIM_EXPORT void Jim_ResizeHashTable(Jim_HashTablePtr ht);
 CHKRET JIM_EXPORT Jim_HashTableIterator *Jim_GetHashTableIterator(Jim_HashTablePtr ht);
 CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_NextHashEntry(Jim_HashTableIterator *iter);
@@ -171,6 +173,8 @@ JIM_EXPORT void Jim_FreeObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr); // #dtor_l
 JIM_EXPORT void Jim_InvalidateStringRep(Jim_ObjPtr objPtr);
 CHKRET JIM_EXPORT Jim_ObjPtr  Jim_DuplicateObj(Jim_InterpPtr interp, // #copy_ctor_like
                                       Jim_ObjPtr objPtr);
+CHKRET JIM_EXPORT Jim_ObjPtr  Jim_CopyObjToInterp(Jim_InterpPtr target, // #copy_ctor_like
+                                      Jim_ObjPtr objPtr);
 CHKRET JIM_EXPORT const char * Jim_GetString(Jim_ObjPtr objPtr,
                                       int *lenPtr);
 CHKRET JIM_EXPORT const char *Jim_String(Jim_ObjPtr objPtr);
@@ -183,12 +187,17 @@ CHKRET JIM_EXPORT Jim_ObjPtr Jim_NewStringObjUtf8(Jim_InterpPtr interp, // #ctor
                                          const char *s, int charlen /* num chars */);
 CHKRET JIM_EXPORT Jim_ObjPtr  Jim_NewStringObjNoAlloc(Jim_InterpPtr interp, // #ctor_like
                                              char *s, int len /* -1 means strlen(s) */);
+typedef void Jim_ExternalBytesProc(char *bytes, int len, void *clientData);
+CHKRET JIM_EXPORT Jim_ObjPtr  Jim_NewStringObjExternal(Jim_InterpPtr interp, // #ctor_like
+                                             char *s, int len, Jim_ExternalBytesProc *releaseProc, void *clientData);
 JIM_EXPORT void Jim_AppendString(Jim_InterpPtr interp, Jim_ObjPtr objPtr,
                                  const char *str, int len /* -1 means strlen(s) */);
 JIM_EXPORT void Jim_AppendObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr,
                               Jim_ObjPtr appendObjPtr);
 JIM_EXPORT void Jim_AppendStrings(Jim_InterpPtr interp,
                                   Jim_ObjPtr objPtr, ...);
+CHKRET JIM_EXPORT int Jim_StringChunks(Jim_InterpPtr interp, Jim_ObjPtr objPtr,
+                                  Jim_ObjArray **chunkVec);
 CHKRET JIM_EXPORT int Jim_StringEqObj(Jim_ObjPtr aObjPtr, Jim_ObjPtr bObjPtr);
 CHKRET JIM_EXPORT int Jim_StringMatchObj(Jim_InterpPtr interp, Jim_ObjPtr patternObjPtr,
                                   Jim_ObjPtr objPtr, int nocase /*bool*/);
@@ -218,6 +227,7 @@ CHKRET JIM_EXPORT Retval Jim_GetFinalizer(Jim_InterpPtr interp, Jim_ObjPtr objPt
 /* interpreter */
 CHKRET JIM_EXPORT Jim_InterpPtr  Jim_CreateInterp(void); // #ctor_like
 JIM_EXPORT void Jim_FreeInterp(Jim_InterpPtr i); // #dtor_like
+CHKRET JIM_EXPORT Jim_ObjPtr Jim_SlabStats(Jim_InterpPtr interp);
 CHKRET JIM_EXPORT int Jim_GetExitCode(Jim_InterpPtr interp);
 CHKRET JIM_EXPORT const char *Jim_ReturnCode(int code);
 JIM_EXPORT void Jim_SetResultFormatted(Jim_InterpPtr interp, const char *format, ...);
@@ -269,7 +279,9 @@ CHKRET JIM_EXPORT Jim_CallFramePtr Jim_GetCallFrameByLevel(Jim_InterpPtr interp,
 
 /* garbage collection */
 CHKRET JIM_EXPORT int Jim_Collect(Jim_InterpPtr interp);
+CHKRET JIM_EXPORT int Jim_CollectStep(Jim_InterpPtr interp, long usecs);
 JIM_EXPORT void Jim_CollectIfNeeded(Jim_InterpPtr interp);
+JIM_EXPORT void Jim_CollectRememberObj(Jim_InterpPtr interp, Jim_ObjPtr objPtr);
 
 /* index object */
 CHKRET JIM_EXPORT Retval Jim_GetIndex(Jim_InterpPtr interp, Jim_ObjPtr objPtr,
@@ -29,7 +29,12 @@ private:
         void* val_;
         int intval_; // #UNUSED
     } u;
+    // Full hash of key_, kept by open addressing tables.
+    unsigned_int hash_;
 public:
+    // hash_
+    inline unsigned_int hash() const { return hash_; }
+    inline void setHash(unsigned_int v) { hash_ = v; }
     // val_
     inline void* getVal() const { return u.val_; }
     inline void setVal(void* v) { u.val_ = v; }
@@ -50,6 +55,7 @@ struct Jim_HashTableType {
     int (*keyCompare)(void* privdata, const void* key1, const void* key2) = NULL;
     void (*keyDestructor)(void* privdata, void* key) = NULL;
     void (*valDestructor)(void* privdata, void* obj) = NULL;
+    unsigned_int flags = 0; /* JIM_HT_xxx */
 };
 
 struct Jim_HashTable {
@@ -66,6 +72,16 @@ private:
     unsigned_int used_ = 0;
     Jim_HashEntryArray* table_ = NULL;
 
+    // Open addressing tables (type_->flags & JIM_HT_OPEN_ADDRESSING) use these instead of table_.
+    unsigned_char* ctrl_ = NULL; /* A control byte per slot: empty, deleted or 7 bits of the hash */
+    Jim_HashEntry* entries_ = NULL; /* size_ entries, stored inline */
+    unsigned_int tombstones_ = 0; /* Deleted slots in ctrl_ */
+    unsigned_char* oldCtrl_ = NULL; /* Table being moved into ctrl_/entries_ by a resize, or NULL */
+    Jim_HashEntry* oldEntries_ = NULL;
+    unsigned_int oldSize_ = 0;
+    unsigned_int oldUsed_ = 0; /* Entries still in the old table (included in used_) */
+    unsigned_int migrated_ = 0; /* Old slots already moved */
+
 public:
     // uniq_
     inline unsigned_int uniq() const { return uniq_; }
@@ -98,8 +114,28 @@ public:
     inline void setEntry(unsigned_int i, Jim_HashEntryPtr o) { table_[i] = o; }
     inline void setTable(Jim_HashEntryArray* tableD) { table_ = tableD; }
     inline Jim_HashEntryArray* table() { return table_; }
-    inline bool tableAllocated() const { return table_ != NULL; }
+    inline bool tableAllocated() const { return table_ != NULL || ctrl_ != NULL; }
     void freeTable(); // #FreeF 
+    // ctrl_, entries_, tombstones_
+    inline unsigned_char* ctrl() { return ctrl_; }
+    inline void setCtrl(unsigned_char* o) { ctrl_ = o; }
+    inline Jim_HashEntry* entries() { return entries_; }
+    inline void setEntries(Jim_HashEntry* o) { entries_ = o; }
+    inline unsigned_int tombstones() const { return tombstones_; }
+    inline void setTombstones(unsigned_int v) { tombstones_ = v; }
+    // oldCtrl_, oldEntries_, oldSize_, oldUsed_, migrated_
+    inline unsigned_char* oldCtrl() { return oldCtrl_; }
+    inline void setOldCtrl(unsigned_char* o) { oldCtrl_ = o; }
+    inline Jim_HashEntry* oldEntries() { return oldEntries_; }
+    inline void setOldEntries(Jim_HashEntry* o) { oldEntries_ = o; }
+    inline unsigned_int oldSize() const { return oldSize_; }
+    inline void setOldSize(unsigned_int v) { oldSize_ = v; }
+    inline unsigned_int oldUsed() const { return oldUsed_; }
+    inline void setOldUsed(unsigned_int v) { oldUsed_ = v; }
+    inline unsigned_int migrated() const { return migrated_; }
+    inline void setMigrated(unsigned_int v) { migrated_ = v; }
+    void freeEntries(); // #FreeF 
+    void freeOldEntries(); // #FreeF 
 };
 
 struct Jim_HashTableIterator {
@@ -126,6 +162,14 @@ enum {
     JIM_HT_INITIAL_SIZE = 16 // #MagicNum
 };
 
+/* Jim_HashTableType flags */
+enum {
+    /* Store entries inline and probe them a group of control bytes at a time,
+     * instead of chaining separately allocated entries. Entries may move when
+     * the table is added to, so don't keep a Jim_HashEntryPtr across an insert. */
+    JIM_HT_OPEN_ADDRESSING = 1
+};
+
 CHKRET JIM_EXPORT Retval Jim_InitHashTable(Jim_HashTablePtr ht, const Jim_HashTableType* type, void* privdata); // #ctor_like
 JIM_EXPORT void Jim_ExpandHashTable(Jim_HashTablePtr ht, unsigned_int size);
 CHKRET JIM_EXPORT Retval Jim_AddHashEntry(Jim_HashTablePtr ht, const void* key, void* val);
@@ -133,7 +177,11 @@ CHKRET JIM_EXPORT int Jim_ReplaceHashEntry(Jim_HashTablePtr ht, const void* key,
 CHKRET JIM_EXPORT Retval Jim_DeleteHashEntry(Jim_HashTablePtr ht, const void* key); // #dtor_like
 CHKRET JIM_EXPORT Retval Jim_FreeHashTable(Jim_HashTablePtr ht); // #dtor_like
 CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_FindHashEntry(Jim_HashTablePtr ht, const void* key);
+CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_FindHashEntryHashed(Jim_HashTablePtr ht, const void* key, unsigned_int keyHash);
 JIM_EXPORT void Jim_ResizeHashTable(Jim_HashTablePtr ht);
+JIM_EXPORT void Jim_ClearHashTable(Jim_HashTablePtr ht);
+JIM_EXPORT unsigned_int Jim_HashTableBuckets(Jim_HashTablePtr ht);
+JIM_EXPORT int Jim_HashTableBucketUsed(Jim_HashTablePtr ht, unsigned_int i);
 CHKRET JIM_EXPORT Jim_HashTableIterator* Jim_GetHashTableIterator(Jim_HashTablePtr ht);
 CHKRET JIM_EXPORT Jim_HashEntryPtr  Jim_NextHashEntry(Jim_HashTableIterator* iter);
 CHKRET JIM_EXPORT const char* Jim_KeyAsStr(Jim_HashEntryPtr  he);
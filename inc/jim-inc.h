@@ -17,8 +17,12 @@ JIM_API_INLINE int Jim_IsShared(Jim_ObjPtr  objPtr) { return ((objPtr)->refCount
 JIM_API_INLINE void* Jim_GetIntRepPtr(Jim_ObjPtr  o) { return (o)->getVoidPtr(); }
 
 JIM_API_INLINE void Jim_FreeIntRep(Jim_InterpPtr  i, Jim_ObjPtr  o) {
-    if ((o)->typePtr() && (o)->typePtr()->freeIntRepProc)
+    if ((o)->typePtr() && (o)->typePtr()->freeIntRepProc) {
+        /* A kept string may be the last copy of references the intrep held */
+        if ((o)->bytes() && (o)->refCount() > 0)
+            Jim_CollectRememberObj(i, o);
         (o)->typePtr()->freeIntRepProc(i, o);
+    }
 }
 
 JIM_API_INLINE long Jim_GetId(Jim_InterpPtr  i) { return i->incrId(); }
@@ -79,7 +79,8 @@ typedef int64_t jim_wide;
 
 enum {
     JIM_MAX_CALLFRAME_DEPTH = 1000, /* default max nesting depth for procs #MagicNum */
-    JIM_MAX_EVAL_DEPTH = 2000 /* default max nesting depth for eval #MagicNum */
+    JIM_MAX_EVAL_DEPTH = 2000, /* default max nesting depth for eval #MagicNum */
+    JIM_OBJ_INLINE_BYTES = 16 /* string reps shorter than this live inside the Jim_Obj #MagicNum */
 };
 
 /* Some function_ get an integer argument with flags_ to change
@@ -199,6 +200,7 @@ JIM_API_INLINE unsigned_int Jim_GetHashTableUsed(Jim_HashTablePtr  ht);
 const Jim_ObjType& dictSubstType();
 const Jim_ObjType& interpolatedType();
 const Jim_ObjType& stringType();
+const Jim_ObjType& ropeType();
 const Jim_ObjType& comparedStringType();
 const Jim_ObjType& sourceType();
 const Jim_ObjType& scriptLineType();
@@ -223,6 +225,20 @@ const Jim_ObjType& regexpType();
 const Jim_ObjType& subcmdLookupType();
 
 
+/* -----------------------------------------------------------------------------
+ * List element storage. A store can be shared by several list objects, each
+ * one seeing a span of its slots (see listValue_). The store holds a
+ * reference to each of the first len_ slots. Slots past the end of every
+ * span are free for an append, so appending to a shared list does not
+ * copy it when the list ends where the store does.
+ * ---------------------------------------------------------------------------*/
+struct Jim_ListStore {
+    int refCount_;          /* List objects using the store */
+    int len_;               /* Slots holding an element */
+    int maxLen_;            /* Allocated slots */
+    Jim_ObjPtr ele_[1];     /* The slots, maxLen_ of them */
+};
+
 /* -----------------------------------------------------------------------------
  * Jim object. This is mostly the same as Tcl_Obj itself,
  * with the addition of the 'prev' and 'next_' pointers.
@@ -232,6 +248,9 @@ const Jim_ObjType& subcmdLookupType();
  * linked list, used as object pool.
  *
  * The refcount of a freed object is always -1.
+ *
+ * Short string representations are kept in the object itself, in which
+ * case 'bytes_' points at 'inlineBytes_'.
  * ---------------------------------------------------------------------------*/ 
 typedef struct Jim_Obj {
 private:
@@ -263,7 +282,16 @@ public:
     inline void bytes_NULLterminate() { bytes_[length()] = '\0'; }
     inline char* setBytes(char* str) { bytes_ = str; return bytes_; }
     inline char* setBytes(int index, char ch) { bytes_[index] = ch; ; return bytes_; }
-    inline void freeBytes() { free_CharArray(bytes_);  } // #FreeF
+    inline bool bytesInline() const { return bytes_ == inlineBytes_; }
+    /* Sets bytes_ to a buffer for len bytes plus the null term. */
+    inline char* allocBytes(int len) { 
+        bytes_ = (len < JIM_OBJ_INLINE_BYTES) ? inlineBytes_ : new_CharArray(len + 1); // #AllocF
+        return bytes_;
+    }
+    inline void freeBytes() { 
+        if (bytesInline()) bytes_ = NULL; 
+        else free_CharArray(bytes_);  // #FreeF
+    }
     inline void copyBytes(Jim_ObjPtr srcObj) { memcpy(bytes_, srcObj->bytes_, srcObj->length() + 1); }
     inline void copyBytesAt(int pos, const char* str, int len) { memcpy(bytes_ + pos, str, len);  }
 
@@ -340,28 +368,26 @@ public:
     inline unsigned_long get_procEpoch_cmd() const { return internalRep.cmdValue_.procEpoch_; }
 
     // internalRep.listValue_.  See listType().
-    inline void setListValue(int lenD, int maxLenD, Jim_ObjArray* listObjPtrPtr) {
+    inline void setListValue(Jim_ListStore* storeD, int firstD, int lenD) {
+        internalRep.listValue_.store_ = storeD;
+        internalRep.listValue_.first_ = firstD;
         internalRep.listValue_.len_ = lenD;
-        internalRep.listValue_.maxLen_ = maxLenD;
-        internalRep.listValue_.ele_ = listObjPtrPtr;
     }
     inline int get_listValue_len() const { return internalRep.listValue_.len_; }
-    inline Jim_ObjPtr get_listValue_objArray(int i) { return internalRep.listValue_.ele_[i]; }
-    inline void set_listValue_objArray(int i, Jim_ObjPtr o) { internalRep.listValue_.ele_[i] = o; }
-    inline int get_listValue_maxLen() const { return internalRep.listValue_.maxLen_; }
+    inline int get_listValue_first() const { return internalRep.listValue_.first_; }
+    inline Jim_ListStore* get_listValue_store() { return internalRep.listValue_.store_; }
+    inline Jim_ObjPtr get_listValue_objArray(int i) { 
+        return internalRep.listValue_.store_->ele_[internalRep.listValue_.first_ + i]; 
+    }
+    inline void set_listValue_objArray(int i, Jim_ObjPtr o) { 
+        internalRep.listValue_.store_->ele_[internalRep.listValue_.first_ + i] = o; 
+    }
     inline void setListValueLen(int val) { internalRep.listValue_.len_ = val;  }
-    inline void setListValueMaxLen(int val) { internalRep.listValue_.maxLen_ = val; }
     inline void incrListValueLen(int val) { internalRep.listValue_.len_ += val; }
-    inline void free_listValue_ele() { free_Jim_ObjArray(internalRep.listValue_.ele_);  }  // #FreeF
-    inline void copy_listValue_ele(Jim_ObjPtr srcObj) {
-        memcpy(internalRep.listValue_.ele_, srcObj->internalRep.listValue_.ele_,
-               sizeof(Jim_ObjPtr) * srcObj->get_listValue_len());
-    }
-    inline void resize_listValue_ele(int len) {
-        internalRep.listValue_.ele_ =
-            realloc_Jim_ObjArray(get_listValue_ele(), len);
+    inline Jim_ObjArray* get_listValue_ele() { 
+        return internalRep.listValue_.store_ ? 
+            internalRep.listValue_.store_->ele_ + internalRep.listValue_.first_ : NULL; 
     }
-    inline Jim_ObjArray* get_listValue_ele() { return internalRep.listValue_.ele_; }
 
     // internalRep.strValue_.  See stringType().
     inline void setStrValue(int maxLenD, int charLenD) {
@@ -374,6 +400,15 @@ public:
     inline int get_strValue_maxLen() const { return internalRep.strValue_.maxLength_; }
     inline void setStrValue_maxLen(int len) { internalRep.strValue_.maxLength_ = len; }
 
+    // internalRep.ropeValue_.  See ropeType().
+    inline void setRopeValue(Jim_ObjPtr chunksD, int lengthD) {
+        internalRep.ropeValue_.chunksObj_ = chunksD;
+        internalRep.ropeValue_.length_ = lengthD;
+    }
+    inline Jim_ObjPtr get_ropeValue_chunks() { return internalRep.ropeValue_.chunksObj_; }
+    inline int get_ropeValue_length() const { return internalRep.ropeValue_.length_; }
+    inline void incrRopeValueLength(int len) { internalRep.ropeValue_.length_ += len; }
+
     // internalRep.refValue_.  See referenceType()
     inline void setRefValue(unsigned_long idD, Jim_ReferencePtr  refD) {
         internalRep.refValue_.id_ = idD;
@@ -456,9 +491,9 @@ public:
         /* List object */
         struct {
             // Used by list code.  See listType().
-            Jim_ObjArray* ele_;    /* Elements vector */
+            Jim_ListStore* store_;  /* Elements, maybe shared. NULL if none */
+            int first_;      /* Index in store_ of the first element */
             int len_;        /* Length */
-            int maxLen_;        /* Allocated 'ele' length */
         } listValue_;
         /* String tokenType_ */
         struct {
@@ -466,6 +501,12 @@ public:
             int maxLength_;
             int charLength_;     /* utf-8 char length. -1 if unknown */
          } strValue_;
+        /* Rope tokenType_ */
+        struct {
+            // Used by rope code. See ropeType().
+            Jim_ObjPtr chunksObj_; /* List of the string pieces */
+            int length_;           /* Length in bytes of all the pieces */
+        } ropeValue_;
         /* Reference tokenType_ */
         struct {
             // Use by reference code.  See referenceType().
@@ -498,6 +539,8 @@ public:
      */
     Jim_ObjPtr prevObjPtr_ = NULL; /* pointer to the prev object. */
     Jim_ObjPtr nextObjPtr_ = NULL; /* pointer to the next_ object. */
+
+    char inlineBytes_[JIM_OBJ_INLINE_BYTES]; /* See allocBytes() */
   public:
 
     inline Jim_ObjPtr  nextObjPtr() const { return nextObjPtr_; }
@@ -579,7 +622,11 @@ typedef struct Jim_CallFrame {
 private:
     unsigned_long id_ = 0; /* Call Frame ID. Used for caching. */
     int level_ = 0; /* Level of this call frame. 0 = global */
-    Jim_HashTable vars_; /* Where local vars are stored */
+    Jim_HashTable vars_; /* Where local vars are stored. Has no type until the first is added */
+    Jim_HashTablePtr slotNames_ = NULL; /* Procedure local names -> index into slots_, or NULL */
+    Jim_VarPtr slots_ = NULL; /* Compiled local vars. A var exists if its objPtr_ is set */
+    int numSlots_ = 0; /* Number of slots_ in use for the current procedure call */
+    int slotsCapacity_ = 0; /* Allocated length of slots_, kept when the frame is reused */
     Jim_HashTablePtr staticVars_ = NULL; /* pointer to procedure static vars */
     Jim_CallFramePtr parent_ = NULL; /* The parent callframe */
     Jim_ObjConstArray argv_ = NULL; /* object vector of the current procedure call. */
@@ -607,6 +654,15 @@ public:
     inline void setLevel(int v) { level_ = v; }
     // vars_
     inline Jim_HashTable& vars() { return vars_; }
+    // slotNames_, slots_, numSlots_, slotsCapacity_
+    inline Jim_HashTablePtr slotNames() { return slotNames_; }
+    inline void setSlotNames(Jim_HashTablePtr o) { slotNames_ = o; }
+    inline Jim_VarPtr slots() { return slots_; }
+    inline void setSlots(Jim_VarPtr o) { slots_ = o; }
+    inline int numSlots() const { return numSlots_; }
+    inline void setNumSlots(int v) { numSlots_ = v; }
+    inline int slotsCapacity() const { return slotsCapacity_; }
+    inline void setSlotsCapacity(int v) { slotsCapacity_ = v; }
     // staticVars_
     inline Jim_HashTablePtr  staticVars() { return staticVars_; }
     inline void setStaticVars(Jim_HashTablePtr o) { staticVars_ = o; }
@@ -708,6 +764,9 @@ private:
             int optArity_ = 0;               /* Number of optional parameters */
             int argsPos_ = 0;                /* Position of 'args_', if specified, or -1 */
             int upcall_ = 0;                 /* True if proc is currently in upcall_ */
+            int numSlots_ = 0;               /* Number of compiled local variables */
+            int argSlots_ = 0;               /* True if argument d is always stored in slot d */
+            Jim_HashTablePtr slotNames_ = NULL;  /* Local var name -> slot index + 1. NULL if no slots. */
 	        Jim_ProcArg *arglist_ = NULL;
             Jim_ObjPtr nsObj_ = NULL;             /* Namespace for this proc */
         } proc_;
@@ -766,6 +825,14 @@ public:
     inline Jim_HashTablePtr proc_staticVars() { return u.proc_.staticVars_; }
     inline void proc_setStaticVars(Jim_HashTablePtr o) { u.proc_.staticVars_ = o; }
     inline void proc_freeStaticVars() { free_Jim_HashTable(u.proc_.staticVars_); }
+    // u.proc_.slotNames_, numSlots_, argSlots_
+    inline Jim_HashTablePtr proc_slotNames() { return u.proc_.slotNames_; }
+    inline void proc_setSlotNames(Jim_HashTablePtr o) { u.proc_.slotNames_ = o; }
+    inline void proc_freeSlotNames() { free_Jim_HashTable(u.proc_.slotNames_); }
+    inline int proc_numSlots() const { return u.proc_.numSlots_; }
+    inline void proc_setNumSlots(int val) { u.proc_.numSlots_ = val; }
+    inline int proc_argSlots() const { return u.proc_.argSlots_; }
+    inline void proc_setArgSlots(int val) { u.proc_.argSlots_ = val; }
     // u.proc_arglist
     inline Jim_ProcArg* proc_arglist() { return u.proc_.arglist_; }
     inline void proc_setArglist(Jim_ProcArg* o) { u.proc_.arglist_ = o; }
@@ -780,6 +847,9 @@ struct Jim_PrngState {
 
 #define free_Jim_PrngState(ptr)             Jim_TFree<Jim_PrngState>(ptr,"Jim_PrngState")
 
+/* Reference collector state, see Jim_Collect() */
+struct Jim_Collector;
+
 /* -----------------------------------------------------------------------------
  * Jim interpreter structure.
  * Fields similar to the real Tcl interpreter structure have the same names.
@@ -827,6 +897,7 @@ private:
     unsigned_long referenceNextId_ = 0; /* Next id for reference. */
     Jim_HashTable references_; /* References hash table. */
     time_t lastCollectTime_ = 0; /* Unix time of the last GC execution */
+    Jim_Collector* collector_ = NULL; /* Reference collector state and statistics. */
     Jim_ObjPtr stackTrace_ = NULL; /* Stack trace object. */
     Jim_ObjPtr errorProc_ = NULL; /* Name of last procedure which returned an errorText_ */
     Jim_ObjPtr unknown_ = NULL; /* Unknown command_ cache */
@@ -975,6 +1046,9 @@ public:
     // lastCollectTime_
     inline time_t lastCollectTime() const { return lastCollectTime_; }
     inline void lastCollectTime(time_t val) { lastCollectTime_ = val; }
+    // collector_
+    inline Jim_Collector* collector() { return collector_; }
+    inline void setCollector(Jim_Collector* o) { collector_ = o; }
 };
 
 /* Free the internal representation of the object. */
@@ -24,4 +24,5 @@
 #define jim_ext_posix 1
 #define jim_ext_signal 1
 #define jim_ext_syslog 1
+#define jim_ext_thread 1
 #define jim_ext_zlib 1
\ No newline at end of file
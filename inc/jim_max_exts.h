@@ -22,8 +22,10 @@
 #define jim_ext_tclprefix 1
 #define jim_ext_tree 1
 #ifndef _WIN32
+#define jim_ext_eventloop 1
 #define jim_ext_posix 1
 #define jim_ext_signal 1
 #define jim_ext_syslog 1
+#define jim_ext_thread 1
 #endif
 //#define jim_ext_zlib 1
\ No newline at end of file
@@ -8,4 +8,7 @@
 #define JIM_STATICLIB 1
 #define JIM_UTF8 1
 #define JIM_DOCS 1
+#define JIM_BYTECODE 1
+#define JIM_PROC_SLOTS 1
+#define JIM_SLAB_ALLOC 1
 //#define JIM_STATICLIB 1
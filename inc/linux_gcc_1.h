@@ -47,6 +47,7 @@
 #define HAVE_USLEEP 1
 #define HAVE_UTIMES 1
 #define HAVE_VFORK 1
+#define HAVE_POSIX_SPAWN 1
 #define HAVE_STRUCT_SYSINFO_UPTIME 1
 #define HAVE_SYS_SOCKET_H 1
 #define HAVE_NETINET_IN_H 1
@@ -76,6 +76,7 @@ struct prj_dirent;
  * getpid()
  * gettimeofday()
  * gmtime()
+ * gmtime_r()
  * ioctl()
  * isatty()
  * kill()
@@ -361,6 +362,10 @@ extern prj_mktimeFp prj_mktime;
 typedef struct prj_tm *(*prj_gmtimeFp)(const prj_time_t *timep);
 extern prj_gmtimeFp prj_gmtime;
 
+/* Linux_2020: struct tm *gmtime_r(const time_t *timep, struct tm *result); */
+typedef struct prj_tm *(*prj_gmtime_rFp)(const prj_time_t *timep, struct prj_tm *result);
+extern prj_gmtime_rFp prj_gmtime_r;
+
 /* Linux_2020: struct tm *localtime(const time_t *timep); */
 typedef struct prj_tm *(*prj_localtimeFp)(const prj_time_t *timep);
 extern prj_localtimeFp prj_localtime;
@@ -436,6 +441,11 @@ extern prj_sysinfoFp prj_sysinfo;
 /* Extension */
 long prj_sysinfo_uptime(struct prj_sysinfo* info);
 
+/* Extension: nanoseconds since an arbitrary fixed point. Never goes
+ * backwards when the wall clock is changed, so use it for timers and
+ * intervals, not for the time of day. */
+long long prj_monotonic_ns(void);
+
 
 static inline int prj_funcDef(void* fp) { return NULL != fp; }
 
@@ -583,4 +593,5 @@ template<typename F, typename T> T testConv(F& v) {
 #define prj_fread fread
 #define prj_fgets fgets
 #define prj_fwrite fwrite
-#define prj_write write
\ No newline at end of file
+#define prj_write write
+#define prj_read read
\ No newline at end of file
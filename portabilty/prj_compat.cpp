@@ -558,16 +558,27 @@ prj_raiseFp prj_raise = (prj_raiseFp)raise;
 prj_signalFp prj_signal = (prj_signalFp)signal;
 prj_mktimeFp prj_mktime = (prj_mktimeFp)mktime;
 prj_localtimeFp prj_localtime = (prj_localtimeFp)localtime;
-prj_localtime_rFp prj_localtime_r = (prj_localtime_rFp)localtime;
 
 #ifndef _WIN32
 prj_closeFp prj_close = close;
 prj_pipeFp prj_pipe = (prj_pipeFp)pipe;
 prj_gmtimeFp prj_gmtime = (prj_gmtimeFp) gmtime;
+prj_localtime_rFp prj_localtime_r = (prj_localtime_rFp)localtime_r;
+prj_gmtime_rFp prj_gmtime_r = (prj_gmtime_rFp)gmtime_r;
 #else
 prj_closeFp prj_close = _close;
 prj_pipeFp prj_pipe = (prj_pipeFp) _pipe;
 prj_gmtimeFp prj_gmtime = (prj_gmtimeFp) gmtime;
+static struct prj_tm *win_localtime_r(const prj_time_t *timep, struct prj_tm *result) {
+    time_t t = (time_t)*timep;
+    return localtime_s((struct tm *)result, &t) == 0 ? result : NULL;
+}
+static struct prj_tm *win_gmtime_r(const prj_time_t *timep, struct prj_tm *result) {
+    time_t t = (time_t)*timep;
+    return gmtime_s((struct tm *)result, &t) == 0 ? result : NULL;
+}
+prj_localtime_rFp prj_localtime_r = win_localtime_r;
+prj_gmtime_rFp prj_gmtime_r = win_gmtime_r;
 #endif
 
 #if defined(HAVE_STRUCT_SYSINFO_UPTIME) && !defined(_WIN32)
@@ -691,6 +702,35 @@ int gettimeofday(struct prj_timeval *tv, struct prj_timezone *tz) { // #WinSimLi
   prj_gettimeofdayFp prj_gettimeofday = (prj_gettimeofdayFp) NULL;
 #endif
 
+long long prj_monotonic_ns(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    /* CLOCK_MONOTONIC is answered from the vDSO on Linux, without a system call */
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+#elif defined(PRJ_OS_WIN)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    if (QueryPerformanceCounter(&count)) {
+        return (long long)(count.QuadPart / freq.QuadPart) * 1000000000LL
+            + (long long)(count.QuadPart % freq.QuadPart) * 1000000000LL / freq.QuadPart;
+    }
+#endif
+    {
+        /* #MissInCoverage Only when no monotonic clock is available */
+        struct prj_timeval tv;
+
+        prj_gettimeofday(&tv, NULL);
+        return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+    }
+}
+
 #ifdef PRJ_COMPAT_MAIN
 int main(int argc, char* argv[]) {
 	struct timeval  x;
@@ -980,6 +1020,9 @@ void prj_compat_status(void) {
 #ifdef jim_ext_interp 
         printf("jim_ext_interp %d\n", jim_ext_interp);
 #endif
+#ifdef jim_ext_thread 
+        printf("jim_ext_thread %d\n", jim_ext_thread);
+#endif
 #ifdef jim_ext_load 
         printf("jim_ext_load %d\n", jim_ext_load);
 #endif
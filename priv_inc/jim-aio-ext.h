@@ -5,6 +5,7 @@
 BEGIN_JIM_NAMESPACE
 
 struct AioFile;
+struct JimAioCopy;
 
 struct JimAioFopsType {
     int (*writer)(struct AioFile* af, const char* buf, int len);
@@ -16,7 +17,7 @@ struct JimAioFopsType {
 };
 
 struct AioFile {
-    FILE* fp;
+    FILE* fp;                   /* stdio channels only, or made on demand by Jim_AioFilehandle() */
     Jim_ObjPtr  filename;
     int type;
     int openFlags;              /* AIO_KEEPOPEN? keep FILE* */
@@ -27,6 +28,35 @@ struct AioFile {
     int addr_family;
     void* ssl;
     const JimAioFopsType* fops;
+    FILE* fdFp;                 /* stdio stream over fd made by Jim_AioFilehandle(), closed with the channel */
+    /* Channel buffers. Input not yet consumed is rbuf[rpos, rend).
+     * Output not yet written is wq[0] from wqOff, the rest of wq, then wbuf[0, wlen).
+     */
+    char* rbuf;
+    int rpos;
+    int rend;
+    int rcap;
+    char* wbuf;
+    int wlen;
+    int wcap;
+    Jim_ObjArray* wq;           /* big strings waiting to be written, held rather than copied */
+    int wqLen;
+    int wqCap;
+    int wqOff;
+    jim_wide wqBytes;           /* total length of the strings in wq */
+    int flushing;               /* the event loop is writing out the output a non-blocking write left behind */
+    Jim_InterpPtr interp;
+    int bufferSize;             /* configured size of both buffers */
+    int buffering;              /* AIO_BUFFER_NONE, AIO_BUFFER_LINE or AIO_BUFFER_FULL */
+    int eof;                    /* the last read hit end of file */
+    int err;                    /* errno of the last failed read or write */
+    int errWrite;               /* err is from a write, where even a reset connection is an error */
+    int* closedFlag;            /* set to 1 if the channel is closed while its readable script runs */
+    JimAioCopy* copy;           /* background copyto this channel is part of */
+    int asyncOps;               /* [read -async] and [puts -async] not yet reported */
+    jim_wide highWater;         /* pending output at which hEvent is run */
+    Jim_ObjPtr  hEvent;
+    int overHigh;               /* hEvent has been told of high water and not yet of the drain */
 };
 
 /* You might want to instrument or cache heap use so we wrap it access here. */
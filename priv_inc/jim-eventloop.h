@@ -69,6 +69,8 @@ JIM_EXPORT jim_wide Jim_CreateTimeHandler (Jim_InterpPtr interp,
         Jim_TimeProc *proc, void *clientData,
         Jim_EventFinalizerProc *finalizerProc);
 JIM_EXPORT jim_wide Jim_DeleteTimeHandler (Jim_InterpPtr interp, jim_wide id);
+/* Lets wakeups for time events be up to 'us' late, so nearby deadlines fire together */
+JIM_EXPORT void Jim_SetTimeSlack (Jim_InterpPtr interp, jim_wide us);
 
 enum {
    JIM_FILE_EVENTS = 1,
@@ -34,6 +34,16 @@ struct prj_trace {
         int evalDepth_ = 0;             /* Current eval depth */
         int returnLevel_ = 0;           /* Current level_ of 'return -level_' */
     };
+    struct Collect_Stats {
+        int64_t cycles_ = 0;            /* Completed collection cycles */
+        int64_t fullCycles_ = 0;        /* Completed cycles which rescanned every live object */
+        int64_t steps_ = 0;             /* Time slices run, each one a pause */
+        int64_t scanned_ = 0;           /* Objects scanned for references */
+        int64_t collected_ = 0;         /* References collected */
+        int64_t lastPause_ = 0;         /* Length of the last slice in microseconds */
+        int64_t maxPause_ = 0;
+        int64_t totalPause_ = 0;
+    };
     typedef void (*prj_traceMemCb)(int action, const char* type, int sz, void* ptr, void* ptr2);
     typedef void (*prj_traceCb)(int action, const char* funcName, int stackDepth,
                                 const char* obj1Name, void* obj1,
@@ -44,7 +54,7 @@ struct prj_trace {
     static prj_traceMemCb memFunc_;
     static prj_traceActCb actionFunc_;
 
-    static int stackDepth_;
+    static thread_local int stackDepth_; /* Per thread, each one runs its own interpreters */
 
     const char* funcName_;
 
@@ -44,6 +44,9 @@ if {[info commands stdout] ne ""} {
 				-bl* {
 					$f ndelay $(!$v)
 				}
+				-buffers* {
+					$f buffersize $v
+				}
 				-bu* {
 					$f buffering $v
 				}
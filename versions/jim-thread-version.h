@@ -0,0 +1 @@
+JIM_VERSION(0,1)